@@ -0,0 +1,1569 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "Intersection.h"
+#include "CompactIntersection.h"
+#include "ArrivalGenerator.h"
+#include "DemandReader.h"
+#include "Snapshot.h"
+#include "InputJournal.h"
+#include "Telemetry.h"
+#include "LightHistory.h"
+#include "DelayMetrics.h"
+#include "QuantileSketch.h"
+#include "VehiclePool.h"
+#include "RoadNetwork.h"
+#include "SignalController.h"
+#include "PredictiveController.h"
+#include "ScheduleOptimizer.h"
+#include "TrafficEnv.h"
+#include "CorridorCoordinator.h"
+#include "LockstepVariants.h"
+#include "Timer_Linux.h"
+#include "SmartTraffic.h"
+
+#define BENCH_NUM_INTERSECTIONS (100000)
+#define BENCH_REFRESH_RATE      (50)
+#define SECONDS_PER_DAY         (24 * 60 * 60)
+#define BENCH_DEMAND_DAYS       (3650)
+#define BENCH_JOURNAL_HOURS     (24)
+#define BENCH_TELEMETRY_INTERSECTIONS   (1000)
+#define BENCH_TELEMETRY_RATE    (1000)
+#define BENCH_TELEMETRY_SECONDS (5)
+#define BENCH_HISTORY_INTERSECTIONS     (100)
+#define BENCH_HISTORY_QUERIES   (1000000)
+#define BENCH_METRICS_QUERIES   (1000000)
+#define BENCH_SKETCH_RUNS       (1000)
+#define BENCH_SKETCH_VALUES     (10000)
+#define BENCH_AGENT_TICKS       (200)
+#define BENCH_ROUTING_LOOKUPS   (10000000)
+#define BENCH_ACTUATED_INTERSECTIONS    (1000)
+#define BENCH_ACTUATED_SECONDS  (120)
+#define BENCH_ACTUATED_RATE     (10)
+#define BENCH_DECISIONS         (10000000)
+#define BENCH_PRESSURE_SWEEPS   (20)
+#define BENCH_POLICY_INTERSECTIONS      (5000)
+#define BENCH_POLICY_TICKS      (1000)
+#define BENCH_ENV_BATCH         (4096)
+#define BENCH_ENV_STEPS         (500)
+#define BENCH_FORKS             (100000)
+#define BENCH_WHAT_IF_SECONDS   (60)
+#define BENCH_WHAT_IFS          (200)
+#define BENCH_MPC_SECONDS       (600)
+#define BENCH_MPC_HORIZON_PHASES        (2)
+#define BENCH_MPC_HORIZON_SECONDS       (15.0)
+#define BENCH_OPT_SECONDS       (900)
+#define BENCH_OPT_RATE          (10)
+#define BENCH_OPT_GENERATIONS   (10)
+#define BENCH_CORRIDOR_INTERSECTIONS    (200)
+#define BENCH_CORRIDOR_SECONDS  (300)
+#define BENCH_LOCKSTEP_VARIANTS (512)
+#define BENCH_LOCKSTEP_SECONDS  (600)
+#define BENCH_LIGHTS            (10000)
+#define BENCH_LIGHT_TICKS       (20000)
+
+/**
+ * @brief Gets the number of seconds elapsed since "startTime"
+ */
+static double secondsSince(std::chrono::_V2::steady_clock::time_point startTime){
+    std::chrono::duration<double> elapsedSeconds = currentTime() - startTime;
+    return elapsedSeconds.count();
+}
+
+/**
+ * @brief Adds the four roads used by main.cpp to "inter" and schedules its LightConfigs.
+ */
+static void buildIntersection(Intersection& inter){
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+
+    inter.schedule(LightConfig::doubleGreen, Road::north, 3.0, 3.0);
+    inter.schedule(LightConfig::doubleGreenLeft, Road::north, 3.0, DEFAULT_YELLOW_DURATION);
+    inter.schedule(LightConfig::doubleGreen, Road::east, 3.0, DEFAULT_YELLOW_DURATION);
+    inter.schedule(LightConfig::singleGreen, Road::west, 3.0, DEFAULT_YELLOW_DURATION);
+}
+
+/**
+ * @brief Memory per lane group and per Intersection of the object representation vs CompactIntersection.
+ */
+static void benchMemory(){
+    Intersection inter = Intersection();
+    CompactIntersection compact = CompactIntersection();
+    std::vector<CompactIntersection> network(BENCH_NUM_INTERSECTIONS);
+    size_t objectBytes, compactBytes;
+    double packSeconds;
+
+    buildIntersection(inter);
+    inter.addMaxVehicles();
+    inter.start();
+    compact.pack(inter);
+
+    objectBytes = CompactIntersection::footprint(inter);
+    compactBytes = sizeof(CompactIntersection);
+
+    std::cout << "  lane group:          " << CompactIntersection::laneGroupFootprint() << " B object, " << sizeof(CompactIntersection::LaneGroup) << " B compact\n";
+    std::cout << "  intersection (" << compact.getNumLaneGroups() << " lane groups): " << objectBytes << " B object, " << compactBytes << " B compact ("
+              << std::fixed << std::setprecision(2) << (double)objectBytes / compactBytes << "x smaller)\n";
+    std::cout << "  1M intersections:    " << (objectBytes * 1000000) / (1024 * 1024) << " MiB object, " << (compactBytes * 1000000) / (1024 * 1024) << " MiB compact\n";
+
+    auto startTime = currentTime();
+    for(CompactIntersection& slot : network){
+        slot.pack(inter);
+    }
+    packSeconds = secondsSince(startTime);
+
+    std::cout << "  pack:                " << std::setprecision(1) << (BENCH_NUM_INTERSECTIONS / packSeconds) / 1e6 << " M intersections/s\n";
+}
+
+/**
+ * @brief Adds exit roads to "inter" so vehicles can cross.
+ */
+static void addExitRoads(Intersection& inter){
+    inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+}
+
+/**
+ * @brief One simulated day stepped with tick() vs one simulated year with advance().
+ */
+static void benchAdvance(){
+    Intersection stepped = Intersection();
+    Intersection advanced = Intersection();
+    unsigned long dayTicks = (unsigned long)SECONDS_PER_DAY * BENCH_REFRESH_RATE;
+    double stepSeconds, advanceSeconds;
+
+    refreshRateHzGlobal = BENCH_REFRESH_RATE;
+
+    for(Intersection* inter : {&stepped, &advanced}){
+        buildIntersection(*inter);
+        addExitRoads(*inter);
+        inter->addMaxVehicles();
+        inter->setAutoSequence(true);
+        inter->start();
+    }
+
+    auto startTime = currentTime();
+    for(unsigned long i=0; i < dayTicks; i++){
+        stepped.tick();
+    }
+    stepSeconds = secondsSince(startTime);
+
+    startTime = currentTime();
+    advanced.advance(365 * dayTicks);
+    advanceSeconds = secondsSince(startTime);
+
+    std::cout << "  tick():    1 day in " << std::fixed << std::setprecision(3) << stepSeconds * 1e3 << " ms\n";
+    std::cout << "  advance(): 365 days in " << advanceSeconds * 1e3 << " ms\n";
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Poisson arrivals generated for every lane group, in batches and one tick at a time.
+ */
+static void benchArrivals(){
+    ArrivalGenerator gen = ArrivalGenerator(1);
+    std::vector<uint16_t> counts;
+    unsigned long numTicks = 1000000;
+    unsigned long total = 0;
+    double batchSeconds, singleSeconds;
+
+    refreshRateHzGlobal = BENCH_REFRESH_RATE;
+    gen.setAllArrivals(ArrivalProcess::poissonArrivals(600));
+
+    auto startTime = currentTime();
+    for(unsigned long tick=0; tick < numTicks; tick += ARRIVAL_BATCH_TICKS){
+        gen.generate(tick, ARRIVAL_BATCH_TICKS, counts);
+        total += counts[0];
+    }
+    batchSeconds = secondsSince(startTime);
+
+    startTime = currentTime();
+    for(unsigned long tick=0; tick < numTicks / 10; tick++){
+        for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+            total += gen.arrivalsAt(tick, lane);
+        }
+    }
+    singleSeconds = secondsSince(startTime) * 10;
+
+    std::cout << "  batched:        " << std::fixed << std::setprecision(1) << (numTicks * NUM_LANE_GROUPS / batchSeconds) / 1e6 << " M lane-ticks/s\n";
+    std::cout << "  per lane, tick: " << (numTicks * NUM_LANE_GROUPS / singleSeconds) / 1e6 << " M lane-ticks/s (checksum " << total << ")\n";
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Parse throughput of DemandReader on ten years of 15 minute counts for every lane group.
+ */
+static void benchDemand(){
+    std::string path = (std::filesystem::temp_directory_path() / "SmartTrafficBench_demand.csv").string();
+    DemandRecord record;
+    unsigned long total = 0;
+    double parseSeconds, fileMB;
+
+    {
+        std::ofstream out(path);
+        const char* directions[] = {"north", "east", "south", "west"};
+        const char* turns[] = {"left", "straight", "right"};
+
+        out << "startSeconds,direction,turn,count\n";
+        for(long bin=0; bin < BENCH_DEMAND_DAYS * (SECONDS_PER_DAY / (long)DEFAULT_DEMAND_BIN_SECONDS); bin++){
+            for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+                out << bin * (long)DEFAULT_DEMAND_BIN_SECONDS << ',' << directions[lane / TurnOption::numTurnOptions] << ','
+                    << turns[lane % TurnOption::numTurnOptions] << ',' << (bin * 7 + lane) % 97 << '\n';
+            }
+        }
+    }
+
+    DemandReader reader = DemandReader(path);
+
+    auto startTime = currentTime();
+    while(reader.nextRecord(record)){
+        total += record.count;
+    }
+    parseSeconds = secondsSince(startTime);
+    fileMB = reader.getBytesRead() / 1e6;
+
+    std::cout << "  " << std::fixed << std::setprecision(1) << fileMB << " MB, " << reader.getNumRecords() << " rows in " << parseSeconds * 1e3 << " ms\n";
+    std::cout << "  parse: " << fileMB / parseSeconds << " MB/s, " << (reader.getNumRecords() / parseSeconds) / 1e6 << " M rows/s (checksum " << total << ")\n";
+
+    std::filesystem::remove(path);
+}
+
+/**
+ * @brief Saving, mapping and restoring a snapshot of BENCH_NUM_INTERSECTIONS warmed up Intersections.
+ */
+static void benchSnapshot(){
+    std::string path = (std::filesystem::temp_directory_path() / "SmartTrafficBench.snapshot").string();
+    std::vector<Intersection> network(BENCH_NUM_INTERSECTIONS);
+    std::vector<Intersection> restored(BENCH_NUM_INTERSECTIONS);
+    std::vector<Intersection*> networkPtrs;
+    Intersection warm = Intersection();
+    CompactIntersection warmState;
+    double saveSeconds, mapSeconds, restoreSeconds;
+
+    refreshRateHzGlobal = BENCH_REFRESH_RATE;
+
+    /// Every Intersection shares the state of one warmed up for a minute
+    buildIntersection(warm);
+    addExitRoads(warm);
+    warm.addMaxVehicles();
+    warm.setAutoSequence(true);
+    warm.start();
+    warm.advance(60 * BENCH_REFRESH_RATE);
+    warmState.pack(warm);
+
+    for(Intersection& inter : network){
+        buildIntersection(inter);
+        inter.setAutoSequence(true);
+        inter.start();
+        warmState.unpack(inter);
+        networkPtrs.push_back(&inter);
+    }
+
+    auto startTime = currentTime();
+    Snapshot::save(path, networkPtrs);
+    saveSeconds = secondsSince(startTime);
+
+    startTime = currentTime();
+    Snapshot snapshot = Snapshot(path);
+    mapSeconds = secondsSince(startTime);
+
+    startTime = currentTime();
+    for(size_t i=0; i < snapshot.getNumIntersections(); i++){
+        snapshot.restore(i, restored[i]);
+    }
+    restoreSeconds = secondsSince(startTime);
+
+    std::cout << "  " << BENCH_NUM_INTERSECTIONS << " intersections, " << std::filesystem::file_size(path) / (1024 * 1024) << " MiB\n";
+    std::cout << "  save:    " << std::fixed << std::setprecision(1) << saveSeconds * 1e3 << " ms\n";
+    std::cout << "  map:     " << std::setprecision(3) << mapSeconds * 1e3 << " ms\n";
+    std::cout << "  restore: " << std::setprecision(1) << restoreSeconds * 1e3 << " ms\n";
+
+    std::filesystem::remove(path);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief A named benchmark. Run all of them with "make bench" or a subset by passing their names.
+ */
+struct Benchmark{
+    const char* name;
+    void (*run)();
+};
+
+/**
+ * @brief Runs "inter" for BENCH_JOURNAL_HOURS with a platoon of vehicles joining a lane group every 10 seconds.
+ */
+static void runJournaledDemand(Intersection& inter){
+    unsigned long numTicks = (unsigned long)BENCH_JOURNAL_HOURS * SECONDS_PER_HOUR * BENCH_REFRESH_RATE;
+    unsigned int lcg = 1;
+
+    for(unsigned long t=0; t < numTicks; t++){
+        if(t % (10 * BENCH_REFRESH_RATE) == 0){
+            lcg = lcg * 1103515245 + 12345;
+            int lane = (lcg >> 8) % NUM_LANE_GROUPS;
+            inter.addVehicles(Road::laneGroupDirection(lane), Road::laneGroupTurn(lane), 1 + (lcg >> 20) % 8);
+        }
+
+        inter.tick();
+    }
+}
+
+static void benchJournal(){
+    Intersection plain = Intersection();
+    Intersection recorded = Intersection();
+    Intersection replayed = Intersection();
+    InputJournal journal = InputJournal();
+    CompactIntersection recordedState, replayedState;
+    double plainSeconds, recordSeconds, replaySeconds;
+
+    refreshRateHzGlobal = BENCH_REFRESH_RATE;
+
+    for(Intersection* inter : {&plain, &recorded, &replayed}){
+        buildIntersection(*inter);
+        addExitRoads(*inter);
+    }
+
+    /// Exit queues fill up over the day, keep the traffic jam messages out of the timings
+    std::streambuf* coutBuffer = std::cout.rdbuf(NULL);
+
+    auto startTime = currentTime();
+    plain.setAutoSequence(true);
+    plain.start();
+    runJournaledDemand(plain);
+    plainSeconds = secondsSince(startTime);
+
+    startTime = currentTime();
+    recorded.setJournal(&journal);
+    recorded.setAutoSequence(true);
+    recorded.start();
+    runJournaledDemand(recorded);
+    recorded.setJournal(NULL);
+    recordSeconds = secondsSince(startTime);
+
+    startTime = currentTime();
+    journal.replay(replayed, recorded.time());
+    replaySeconds = secondsSince(startTime);
+
+    std::cout.rdbuf(coutBuffer);
+    std::cout.clear();
+
+    recordedState.pack(recorded);
+    replayedState.pack(replayed);
+
+    std::cout << "  " << BENCH_JOURNAL_HOURS << " hours, " << journal.getNumEvents() << " events, " << journal.getNumBytes() << " bytes ("
+              << std::fixed << std::setprecision(1) << (double)journal.getNumBytes() / BENCH_JOURNAL_HOURS << " bytes/hour)\n";
+    std::cout << "  run:    " << std::setprecision(1) << plainSeconds * 1e3 << " ms\n";
+    std::cout << "  record: " << recordSeconds * 1e3 << " ms\n";
+    std::cout << "  replay: " << replaySeconds * 1e3 << " ms, " << (replayedState == recordedState ? "identical" : "DIVERGED") << "\n";
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+static void benchTelemetry(){
+    std::string path = (std::filesystem::temp_directory_path() / "SmartTrafficBench.telemetry").string();
+    std::vector<Intersection> network(BENCH_TELEMETRY_INTERSECTIONS);
+    TelemetryBlock block;
+    double tickSeconds = 0, sampleSeconds = 0, closeSeconds, readSeconds;
+    unsigned long numRows, numStalls, numBytes, numRead = 0;
+
+    refreshRateHzGlobal = BENCH_TELEMETRY_RATE;
+
+    for(Intersection& inter : network){
+        buildIntersection(inter);
+        addExitRoads(inter);
+        inter.addMaxVehicles();
+        inter.setAutoSequence(true);
+        inter.start();
+    }
+
+    {
+        TelemetryWriter writer = TelemetryWriter(path);
+
+        for(int t=0; t < BENCH_TELEMETRY_SECONDS * BENCH_TELEMETRY_RATE; t++){
+            auto startTime = currentTime();
+            for(Intersection& inter : network){
+                inter.tick();
+            }
+            tickSeconds += secondsSince(startTime);
+
+            startTime = currentTime();
+            for(size_t id=0; id < network.size(); id++){
+                writer.sample(network[id], id);
+            }
+            sampleSeconds += secondsSince(startTime);
+        }
+
+        auto startTime = currentTime();
+        writer.close();
+        closeSeconds = secondsSince(startTime);
+
+        numRows = writer.getNumRows();
+        numStalls = writer.getNumStalls();
+        numBytes = writer.getBytesWritten();
+    }
+
+    auto startTime = currentTime();
+    TelemetryReader reader = TelemetryReader(path);
+    while(reader.nextBlock(block)){
+        numRead += block.numRows;
+    }
+    readSeconds = secondsSince(startTime);
+
+    std::cout << "  " << numRows / (BENCH_TELEMETRY_SECONDS * BENCH_TELEMETRY_RATE) << " lanes at " << BENCH_TELEMETRY_RATE << " Hz for "
+              << BENCH_TELEMETRY_SECONDS << " s, " << numRows << " rows, " << std::fixed << std::setprecision(2) << (double)numBytes / numRows << " bytes/row\n";
+    std::cout << "  tick:   " << std::setprecision(1) << tickSeconds * 1e3 << " ms\n";
+    std::cout << "  sample: " << sampleSeconds * 1e3 << " ms (" << numRows / sampleSeconds / 1e6 << " M rows/s), " << numStalls << " stalls\n";
+    std::cout << "  close:  " << closeSeconds * 1e3 << " ms\n";
+    std::cout << "  read:   " << readSeconds * 1e3 << " ms (" << numRead / readSeconds / 1e6 << " M rows/s)\n";
+
+    std::filesystem::remove(path);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+static void benchHistory(){
+    std::vector<Intersection> network(BENCH_HISTORY_INTERSECTIONS);
+    std::vector<LightHistory> histories(BENCH_HISTORY_INTERSECTIONS);
+    std::vector<LightLog::Run> runs;
+    unsigned long numTicks = SECONDS_PER_HOUR * BENCH_REFRESH_RATE;
+    size_t numLights = 0, numRuns = 0, numRangeRuns = 0;
+    unsigned int lcg = 1;
+    int colorSum = 0;
+    double recordSeconds, pointSeconds, rangeSeconds;
+
+    refreshRateHzGlobal = BENCH_REFRESH_RATE;
+
+    for(size_t i=0; i < network.size(); i++){
+        buildIntersection(network[i]);
+        network[i].setAutoSequence(true);
+        network[i].setLightHistory(&histories[i]);
+        network[i].start();
+        numLights += network[i].getLights().size();
+    }
+
+    auto startTime = currentTime();
+    for(Intersection& inter : network){
+        inter.advance(numTicks);
+    }
+    recordSeconds = secondsSince(startTime);
+
+    for(LightHistory& history : histories){
+        numRuns += history.getNumRuns();
+    }
+
+    startTime = currentTime();
+    for(int q=0; q < BENCH_HISTORY_QUERIES; q++){
+        lcg = lcg * 1103515245 + 12345;
+        LightLog* log = histories[(lcg >> 4) % BENCH_HISTORY_INTERSECTIONS].getLog(Road::north, TurnOption::straight);
+        colorSum += log->colorAt((lcg >> 8) % numTicks);
+    }
+    pointSeconds = secondsSince(startTime);
+
+    startTime = currentTime();
+    for(int q=0; q < BENCH_HISTORY_QUERIES; q++){
+        lcg = lcg * 1103515245 + 12345;
+        LightLog* log = histories[(lcg >> 4) % BENCH_HISTORY_INTERSECTIONS].getLog(Road::north, TurnOption::straight);
+        unsigned long fromTick = (lcg >> 8) % (numTicks - 60 * BENCH_REFRESH_RATE);
+
+        /// One minute of history
+        log->getRuns(fromTick, fromTick + 60 * BENCH_REFRESH_RATE, runs);
+        numRangeRuns += runs.size();
+    }
+    rangeSeconds = secondsSince(startTime);
+
+    std::cout << "  " << numLights << " lights for 1 hour at " << BENCH_REFRESH_RATE << " Hz, " << numRuns << " runs, "
+              << std::fixed << std::setprecision(0) << (double)numRuns * sizeof(uint64_t) / numLights << " bytes/light-hour\n";
+    std::cout << "  record: " << std::setprecision(1) << recordSeconds * 1e3 << " ms\n";
+    std::cout << "  colorAt: " << pointSeconds / BENCH_HISTORY_QUERIES * 1e9 << " ns/query (checksum " << colorSum << ")\n";
+    std::cout << "  getRuns: " << rangeSeconds / BENCH_HISTORY_QUERIES * 1e9 << " ns/query, " << (double)numRangeRuns / BENCH_HISTORY_QUERIES << " runs/minute\n";
+
+    for(Intersection& inter : network){
+        inter.setLightHistory(NULL);
+    }
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Per tick cost of DelayMetrics on one hour of Poisson arrivals, and the cost of a window query.
+ */
+static void benchMetrics(){
+    Intersection plain = Intersection();
+    Intersection measured = Intersection();
+    ArrivalGenerator plainGen = ArrivalGenerator(3);
+    ArrivalGenerator measuredGen = ArrivalGenerator(3);
+    DelayMetrics metrics = DelayMetrics();
+    unsigned long numTicks = SECONDS_PER_HOUR * BENCH_REFRESH_RATE;
+    double plainSeconds, measuredSeconds, querySeconds, delaySum = 0;
+
+    refreshRateHzGlobal = BENCH_REFRESH_RATE;
+
+    plainGen.setAllArrivals(ArrivalProcess::poissonArrivals(60));
+    measuredGen.setAllArrivals(ArrivalProcess::poissonArrivals(60));
+
+    for(Intersection* inter : {&plain, &measured}){
+        buildIntersection(*inter);
+        addExitRoads(*inter);
+        inter->setAutoSequence(true);
+    }
+    plain.setArrivals(&plainGen);
+    measured.setArrivals(&measuredGen);
+    measured.setDelayMetrics(&metrics);
+    plain.start();
+    measured.start();
+
+    /// Queues overflow now and then, keep the messages out of the timings
+    std::streambuf* coutBuf = std::cout.rdbuf(NULL);
+
+    auto startTime = currentTime();
+    plain.advance(numTicks);
+    plainSeconds = secondsSince(startTime);
+
+    startTime = currentTime();
+    measured.advance(numTicks);
+    measuredSeconds = secondsSince(startTime);
+
+    std::cout.rdbuf(coutBuf);
+    std::cout.clear();
+
+    startTime = currentTime();
+    for(int q=0; q < BENCH_METRICS_QUERIES; q++){
+        delaySum += metrics.getIntersectionWindow().totalDelay;
+    }
+    querySeconds = secondsSince(startTime);
+
+    DelayMetrics::Summary total = metrics.getIntersectionTotal();
+
+    std::cout << "  1 hour at " << BENCH_REFRESH_RATE << " Hz: " << total.arrivals << " arrivals, " << total.departures << " departures, "
+              << std::fixed << std::setprecision(1) << total.averageDelay << " s average delay\n";
+    std::cout << "  tick:    " << plainSeconds / numTicks * 1e9 << " ns without, " << measuredSeconds / numTicks * 1e9 << " ns with metrics\n";
+    std::cout << "  window:  " << querySeconds / BENCH_METRICS_QUERIES * 1e9 << " ns/query (checksum " << std::setprecision(0) << delaySum << ")\n";
+
+    measured.setDelayMetrics(NULL);
+    plain.setArrivals(NULL);
+    measured.setArrivals(NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief An ensemble of runs each sketching its delays, merged into one network-wide sketch vs sorting every value.
+ */
+static void benchSketch(){
+    std::vector<QuantileSketch> runs(BENCH_SKETCH_RUNS);
+    std::vector<double> values;
+    std::vector<uint8_t> bytes;
+    QuantileSketch ensemble = QuantileSketch();
+    unsigned int lcg = 1;
+    double addSeconds, mergeSeconds, sortSeconds;
+
+    values.reserve((size_t)BENCH_SKETCH_RUNS * BENCH_SKETCH_VALUES);
+
+    auto startTime = currentTime();
+    for(QuantileSketch& run : runs){
+        for(int i=0; i < BENCH_SKETCH_VALUES; i++){
+            lcg = lcg * 1103515245 + 12345;
+
+            /// Mostly short delays with a long tail, in tenths of a second
+            double u = (lcg >> 8) / 16777216.0;
+            double delay = 0.1 * (int)(10 * 600 * u * u * u);
+
+            run.add(delay);
+            values.push_back(delay);
+        }
+    }
+    addSeconds = secondsSince(startTime);
+
+    startTime = currentTime();
+    for(QuantileSketch& run : runs){
+        ensemble.merge(run);
+    }
+    mergeSeconds = secondsSince(startTime);
+
+    startTime = currentTime();
+    std::sort(values.begin(), values.end());
+    sortSeconds = secondsSince(startTime);
+
+    ensemble.serialize(bytes);
+
+    std::cout << "  " << BENCH_SKETCH_RUNS << " runs of " << BENCH_SKETCH_VALUES << " delays, " << ensemble.getNumBuckets() << " buckets, "
+              << bytes.size() << " bytes serialized\n";
+    std::cout << "  add:   " << std::fixed << std::setprecision(1) << addSeconds / values.size() * 1e9 << " ns/value\n";
+    std::cout << "  merge: " << mergeSeconds / BENCH_SKETCH_RUNS * 1e6 << " us/run (sort of every value " << sortSeconds * 1e3 << " ms)\n";
+
+    for(double q : {0.5, 0.95, 0.99}){
+        double exact = values[(size_t)(q * (values.size() - 1))];
+
+        std::cout << "  p" << std::setprecision(0) << q * 100 << ": " << std::setprecision(2) << ensemble.quantile(q) << " s sketch, "
+                  << exact << " s exact\n";
+    }
+}
+
+/**
+ * @brief Counts trips and adds up their ticks, standing in for a sink that writes them out.
+ */
+class CountingTripSink : public TripSink{
+public:
+    unsigned long numTrips = 0;
+    unsigned long totalTicks = 0;
+
+    void trip(const VehicleRecord& vehicle, unsigned long departureTick, bool completed) override{
+        numTrips++;
+        totalTicks += departureTick - vehicle.arrivalTick;
+    }
+};
+
+/**
+ * @brief Tick cost of agent mode vs the count-based mode on networks holding up to 1M live vehicles.
+ */
+static void benchAgents(){
+    refreshRateHzGlobal = BENCH_REFRESH_RATE;
+
+    for(size_t numIntersections : {80, 800, 8000}){
+        std::vector<Intersection> counted(numIntersections), agents(numIntersections);
+        std::vector<ArrivalGenerator> countedGens, agentGens;
+        CountingTripSink sink = CountingTripSink();
+        VehiclePool pool = VehiclePool(numIntersections * 125, &sink);
+        double countedSeconds, agentSeconds;
+
+        for(size_t i=0; i < numIntersections; i++){
+            countedGens.emplace_back(1, i);
+            agentGens.emplace_back(1, i);
+            countedGens.back().setAllArrivals(ArrivalProcess::poissonArrivals(600));
+            agentGens.back().setAllArrivals(ArrivalProcess::poissonArrivals(600));
+        }
+
+        /// Queues overflow, keep the messages out of the timings
+        std::streambuf* coutBuf = std::cout.rdbuf(NULL);
+
+        for(size_t i=0; i < numIntersections; i++){
+            for(Intersection* inter : {&counted[i], &agents[i]}){
+                buildIntersection(*inter);
+                addExitRoads(*inter);
+                inter->setAutoSequence(true);
+                inter->addMaxVehicles();
+            }
+            counted[i].setArrivals(&countedGens[i]);
+            agents[i].setArrivals(&agentGens[i]);
+            agents[i].setVehiclePool(&pool);
+            counted[i].start();
+            agents[i].start();
+        }
+        unsigned long numLive = pool.getNumLive();
+
+        auto startTime = currentTime();
+        for(int t=0; t < BENCH_AGENT_TICKS; t++){
+            for(Intersection& inter : counted){
+                inter.tick();
+            }
+        }
+        countedSeconds = secondsSince(startTime);
+
+        startTime = currentTime();
+        for(int t=0; t < BENCH_AGENT_TICKS; t++){
+            for(Intersection& inter : agents){
+                inter.tick();
+            }
+        }
+        agentSeconds = secondsSince(startTime);
+
+        std::cout.rdbuf(coutBuf);
+        std::cout.clear();
+
+        std::cout << "  " << std::setw(7) << numLive << " live vehicles (" << numIntersections << " intersections, "
+                  << pool.getCapacity() * sizeof(VehicleRecord) / 1024 << " KiB of records): " << std::fixed << std::setprecision(2)
+                  << countedSeconds / BENCH_AGENT_TICKS * 1e3 << " ms/tick counts, " << agentSeconds / BENCH_AGENT_TICKS * 1e3
+                  << " ms/tick agents, " << sink.numTrips << " trips\n";
+
+        for(size_t i=0; i < numIntersections; i++){
+            agents[i].setVehiclePool(NULL);
+            counted[i].setArrivals(NULL);
+            agents[i].setArrivals(NULL);
+        }
+    }
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Adds a "side" x "side" grid of Intersections to "net" with every neighbor connected both ways.
+ */
+static void buildGridNetwork(std::deque<Intersection>& grid, RoadNetwork& net, int side){
+    for(int node=0; node < side * side; node++){
+        buildIntersection(grid.emplace_back());
+        net.addIntersection(grid.back());
+    }
+
+    for(int node=0; node < side * side; node++){
+        int r = node / side, c = node % side;
+
+        if(c + 1 < side){ net.connect(node, Road::east, node + 1, Road::west); }
+        if(c > 0){ net.connect(node, Road::west, node - 1, Road::east); }
+        if(r + 1 < side){ net.connect(node, Road::south, node + side, Road::north); }
+        if(r > 0){ net.connect(node, Road::north, node - side, Road::south); }
+
+        for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+            if(grid[node].getExitRoad(dir) == NULL){
+                grid[node].setExitRoad(dir, new Road(dir, {1, 2, 1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+            }
+        }
+    }
+}
+
+/**
+ * @brief Building the next hop tables of grids on one thread and on every hardware thread, rebuilding them after a
+ *          road closes and looking up next hops.
+ */
+static void benchRouting(){
+    for(int side : {10, 20, 30}){
+        std::deque<Intersection> serialGrid, parallelGrid;
+        RoadNetwork serial = RoadNetwork(0, 1);
+        RoadNetwork parallel = RoadNetwork(0, 0);
+        double serialSeconds, parallelSeconds, closeSeconds, lookupSeconds;
+        int numRebuilt;
+        std::vector<uint32_t> exits;
+        uint32_t lcg = 1;
+        unsigned long numRouted = 0;
+
+        buildGridNetwork(serialGrid, serial, side);
+        buildGridNetwork(parallelGrid, parallel, side);
+
+        for(uint32_t dest=0; dest < parallel.getNumDestinations(); dest++){
+            if(parallel.getLink(dest / Road::numRoadDirections, (Road::RoadDirection)(dest % Road::numRoadDirections)).toNode < 0){
+                exits.push_back(dest);
+            }
+        }
+
+        auto startTime = currentTime();
+        serial.updateTables();
+        serialSeconds = secondsSince(startTime);
+
+        startTime = currentTime();
+        parallel.updateTables();
+        parallelSeconds = secondsSince(startTime);
+
+        /// A road in the middle of the grid closes
+        startTime = currentTime();
+        parallel.closeRoad(side * (side / 2) + side / 2, Road::east);
+        numRebuilt = parallel.updateTables();
+        closeSeconds = secondsSince(startTime);
+
+        startTime = currentTime();
+        for(int i=0; i < BENCH_ROUTING_LOOKUPS; i++){
+            lcg = lcg * 1664525 + 1013904223;
+            VehicleRecord vehicle = {0, 0, ROUTE_DESTINATION_FLAG | exits[(lcg >> 8) % exits.size()]};
+
+            numRouted += parallel.laneFor(vehicle, (lcg >> 4) % parallel.getNumDestinations()) != NULL;
+        }
+        lookupSeconds = secondsSince(startTime);
+
+        std::cout << "  " << std::setw(4) << side * side << " intersections, " << exits.size() << " destinations: "
+                  << std::fixed << std::setprecision(1) << serialSeconds * 1e3 << " ms on 1 thread, " << parallelSeconds * 1e3
+                  << " ms on " << parallel.getNumThreads() << ", road closure " << closeSeconds * 1e3 << " ms (" << numRebuilt
+                  << " destinations), " << std::setprecision(2) << lookupSeconds / BENCH_ROUTING_LOOKUPS * 1e9 << " ns/lookup ("
+                  << 100.0 * numRouted / BENCH_ROUTING_LOOKUPS << "% routed)\n";
+    }
+}
+
+/**
+ * @brief Replaces every exit Road of "inter" with an empty one with the same lanes, as if the vehicles had driven off.
+ */
+static void drainExitRoads(Intersection& inter){
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        Road* exitRoad = inter.getExitRoad(dir);
+        std::array<int, TurnOption::numTurnOptions> numLanes;
+
+        for(int turn=0; turn < TurnOption::numTurnOptions; turn++){
+            numLanes[turn] = exitRoad->getTurnOption((TurnOption::Type)turn)->getNumLanes();
+        }
+
+        inter.setExitRoad(dir, new Road(dir, numLanes, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        delete exitRoad;
+    }
+}
+
+/**
+ * @brief Sums the queued vehicles and the departures of every lane group of "inter".
+ */
+static void countVehicles(Intersection& inter, unsigned long& queued, unsigned long& departures){
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        TurnOption* turnOpt = inter.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane));
+
+        if(turnOpt->isValid()){
+            queued += turnOpt->getQueuedVehicles();
+            departures += turnOpt->getCumulativeDepartures();
+        }
+    }
+}
+
+/**
+ * @brief The fixed schedule vs ActuatedController under heavy north-south and light east-west demand, with the exit
+ *          Roads emptied every tick: departures, mean queued vehicles, tick time and the time of one decision.
+ */
+static void benchActuated(){
+    const int numTicks = BENCH_ACTUATED_SECONDS * BENCH_ACTUATED_RATE;
+    std::vector<Intersection> fixed(BENCH_ACTUATED_INTERSECTIONS), actuated(BENCH_ACTUATED_INTERSECTIONS);
+    std::vector<ArrivalGenerator> fixedGens, actuatedGens;
+    ActuatedController ctrl = ActuatedController();
+    unsigned long fixedQueued = 0, actuatedQueued = 0, fixedDepartures = 0, actuatedDepartures = 0, unused = 0;
+    double fixedSeconds = 0, actuatedSeconds = 0, decisionSeconds;
+    int phase = 0;
+
+    refreshRateHzGlobal = BENCH_ACTUATED_RATE;
+
+    for(size_t i=0; i < BENCH_ACTUATED_INTERSECTIONS; i++){
+        fixedGens.emplace_back(1, i);
+        actuatedGens.emplace_back(1, i);
+
+        for(ArrivalGenerator* gen : {&fixedGens.back(), &actuatedGens.back()}){
+            gen->setArrivals(Road::north, TurnOption::straight, ArrivalProcess::poissonArrivals(900));
+            gen->setArrivals(Road::south, TurnOption::straight, ArrivalProcess::poissonArrivals(600));
+            gen->setArrivals(Road::west, TurnOption::straight, ArrivalProcess::poissonArrivals(60));
+        }
+    }
+
+    /// Queues overflow, keep the messages out of the timings
+    std::streambuf* coutBuf = std::cout.rdbuf(NULL);
+
+    for(size_t i=0; i < BENCH_ACTUATED_INTERSECTIONS; i++){
+        for(Intersection* inter : {&fixed[i], &actuated[i]}){
+            buildIntersection(*inter);
+            addExitRoads(*inter);
+            inter->setAutoSequence(true);
+        }
+        fixed[i].setArrivals(&fixedGens[i]);
+        actuated[i].setArrivals(&actuatedGens[i]);
+        actuated[i].setSignalController(&ctrl);
+        fixed[i].start();
+        actuated[i].start();
+    }
+
+    for(int t=0; t < numTicks; t++){
+        auto startTime = currentTime();
+        for(Intersection& inter : fixed){
+            inter.tick();
+        }
+        fixedSeconds += secondsSince(startTime);
+
+        startTime = currentTime();
+        for(Intersection& inter : actuated){
+            inter.tick();
+        }
+        actuatedSeconds += secondsSince(startTime);
+
+        for(size_t i=0; i < BENCH_ACTUATED_INTERSECTIONS; i++){
+            countVehicles(fixed[i], fixedQueued, unused);
+            countVehicles(actuated[i], actuatedQueued, unused);
+            drainExitRoads(fixed[i]);
+            drainExitRoads(actuated[i]);
+        }
+    }
+
+    std::cout.rdbuf(coutBuf);
+    std::cout.clear();
+
+    for(size_t i=0; i < BENCH_ACTUATED_INTERSECTIONS; i++){
+        countVehicles(fixed[i], unused, fixedDepartures);
+        countVehicles(actuated[i], unused, actuatedDepartures);
+    }
+
+    auto startTime = currentTime();
+    for(int i=0; i < BENCH_DECISIONS; i++){
+        phase = ctrl.nextPhase(actuated[i % BENCH_ACTUATED_INTERSECTIONS], phase).phase;
+    }
+    decisionSeconds = secondsSince(startTime);
+
+    std::cout << "  fixed:    " << fixedDepartures << " departures, " << std::fixed << std::setprecision(2)
+              << (double)fixedQueued / numTicks / BENCH_ACTUATED_INTERSECTIONS << " queued per intersection, "
+              << fixedSeconds / numTicks * 1e3 << " ms/tick\n";
+    std::cout << "  actuated: " << actuatedDepartures << " departures, "
+              << (double)actuatedQueued / numTicks / BENCH_ACTUATED_INTERSECTIONS << " queued per intersection, "
+              << actuatedSeconds / numTicks * 1e3 << " ms/tick, " << decisionSeconds / BENCH_DECISIONS * 1e9
+              << " ns/decision (phase " << phase << ")\n";
+
+    for(size_t i=0; i < BENCH_ACTUATED_INTERSECTIONS; i++){
+        fixed[i].setArrivals(NULL);
+        actuated[i].setArrivals(NULL);
+        actuated[i].setSignalController(NULL);
+    }
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Max-pressure sweeps of grids with random queues on one thread and on every hardware thread.
+ */
+static void benchPressure(){
+    for(int side : {10, 100, 300}){
+        std::deque<Intersection> grid;
+        RoadNetwork net = RoadNetwork(0, 1);
+        MaxPressureController serial = MaxPressureController(net, 1);
+        MaxPressureController parallel = MaxPressureController(net, 0);
+        double serialSeconds, parallelSeconds;
+        uint32_t lcg = 1;
+        int numDifferent = 0;
+
+        buildGridNetwork(grid, net, side);
+
+        for(Intersection& inter : grid){
+            for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+                TurnOption* turnOpt = inter.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane));
+
+                lcg = lcg * 1664525 + 1013904223;
+                if(turnOpt->isValid()){
+                    turnOpt->addVehicles((lcg >> 8) % (turnOpt->getMaxNumVehicles() + 1));
+                }
+            }
+        }
+
+        auto startTime = currentTime();
+        for(int i=0; i < BENCH_PRESSURE_SWEEPS; i++){
+            serial.sweep();
+        }
+        serialSeconds = secondsSince(startTime);
+
+        startTime = currentTime();
+        for(int i=0; i < BENCH_PRESSURE_SWEEPS; i++){
+            parallel.sweep();
+        }
+        parallelSeconds = secondsSince(startTime);
+
+        for(int node=0; node < net.getNumIntersections(); node++){
+            numDifferent += serial.getDecision(node) != parallel.getDecision(node);
+        }
+
+        std::cout << "  " << std::setw(6) << side * side << " intersections: " << std::fixed << std::setprecision(3)
+                  << serialSeconds / BENCH_PRESSURE_SWEEPS * 1e3 << " ms/sweep on 1 thread, " << parallelSeconds / BENCH_PRESSURE_SWEEPS * 1e3
+                  << " ms/sweep on " << parallel.getNumThreads() << ", " << numDifferent << " decisions differ\n";
+    }
+}
+
+/**
+ * @brief Counts the Intersections of "a" and "b" running different LightConfigs.
+ */
+static int countDifferentPhases(std::vector<Intersection>& a, std::vector<Intersection>& b){
+    int numDifferent = 0;
+
+    for(size_t i=0; i < a.size(); i++){
+        numDifferent += a[i].getConfigScheduleIdx() != b[i].getConfigScheduleIdx();
+    }
+
+    return numDifferent;
+}
+
+/**
+ * @brief Ticks "fleet" BENCH_POLICY_TICKS times with "tickOne" and returns the nanoseconds per Intersection tick.
+ */
+template <typename TickFn>
+static double timePolicy(std::vector<Intersection>& fleet, TickFn tickOne){
+    auto startTime = currentTime();
+
+    for(int t=0; t < BENCH_POLICY_TICKS; t++){
+        for(Intersection& inter : fleet){
+            tickOne(inter);
+        }
+    }
+
+    return secondsSince(startTime) / BENCH_POLICY_TICKS / fleet.size() * 1e9;
+}
+
+/**
+ * @brief Fleets ticked with the fixed round-robin and with ActuatedController, each through a SignalController set
+ *          on the Intersections and as a policy passed to tick().
+ */
+static void benchPolicy(){
+    std::vector<Intersection> plain(BENCH_POLICY_INTERSECTIONS), fixedStatic(BENCH_POLICY_INTERSECTIONS), fixedWrapped(BENCH_POLICY_INTERSECTIONS);
+    std::vector<Intersection> actuatedVirtual(BENCH_POLICY_INTERSECTIONS), actuatedStatic(BENCH_POLICY_INTERSECTIONS);
+    FixedPolicy fixedPolicy = FixedPolicy();
+    PolicyController<FixedPolicy> wrapped = PolicyController<FixedPolicy>();
+    ActuatedController virtualCtrl = ActuatedController();
+    ActuatedController staticCtrl = ActuatedController();
+    double plainNs, fixedStaticNs, fixedWrappedNs, actuatedVirtualNs, actuatedStaticNs;
+
+    refreshRateHzGlobal = BENCH_REFRESH_RATE;
+
+    for(std::vector<Intersection>* fleet : {&plain, &fixedStatic, &fixedWrapped, &actuatedVirtual, &actuatedStatic}){
+        for(Intersection& inter : *fleet){
+            buildIntersection(inter);
+            addExitRoads(inter);
+            inter.setAutoSequence(true);
+
+            if(fleet == &fixedWrapped){
+                inter.setSignalController(&wrapped);
+            }
+            else if(fleet == &actuatedVirtual){
+                inter.setSignalController(&virtualCtrl);
+            }
+
+            inter.start();
+        }
+    }
+
+    /// The first fleet would otherwise also pay for warming the caches
+    timePolicy(plain, [](Intersection& inter){ inter.tick(); });
+    plainNs = timePolicy(plain, [](Intersection& inter){ inter.tick(); });
+    fixedStaticNs = timePolicy(fixedStatic, [&fixedPolicy](Intersection& inter){ inter.tick(fixedPolicy); });
+    fixedWrappedNs = timePolicy(fixedWrapped, [](Intersection& inter){ inter.tick(); });
+    actuatedVirtualNs = timePolicy(actuatedVirtual, [](Intersection& inter){ inter.tick(); });
+    actuatedStaticNs = timePolicy(actuatedStatic, [&staticCtrl](Intersection& inter){ inter.tick(staticCtrl); });
+
+    std::cout << std::fixed << std::setprecision(1) << "  no controller:         " << plainNs << " ns/tick\n"
+              << "  FixedPolicy static:    " << fixedStaticNs << " ns/tick\n"
+              << "  FixedPolicy wrapped:   " << fixedWrappedNs << " ns/tick\n"
+              << "  Actuated virtual:      " << actuatedVirtualNs << " ns/tick\n"
+              << "  Actuated static:       " << actuatedStaticNs << " ns/tick (" << fixedStatic[0].time() << " ticks, "
+              << countDifferentPhases(fixedStatic, fixedWrapped) << " fixed and " << countDifferentPhases(actuatedVirtual, actuatedStatic)
+              << " actuated phases differ)\n";
+
+    for(Intersection& inter : fixedWrapped){
+        inter.setSignalController(NULL);
+    }
+    for(Intersection& inter : actuatedVirtual){
+        inter.setSignalController(NULL);
+    }
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Env-steps per second of a TrafficEnv batch on one thread and on every hardware thread, with random actions.
+ */
+static void benchEnv(){
+    refreshRateHzGlobal = BENCH_REFRESH_RATE;
+
+    for(unsigned int threads : {1u, 0u}){
+        TrafficEnv env = TrafficEnv(BENCH_ENV_BATCH, [](Intersection& inter, ArrivalGenerator& gen){
+            buildIntersection(inter);
+            gen.setAllArrivals(ArrivalProcess::poissonArrivals(120));
+        }, 1, 10000, threads);
+        std::vector<float> queues(BENCH_ENV_BATCH * NUM_LANE_GROUPS), rewards(BENCH_ENV_BATCH);
+        std::vector<int32_t> colors(BENCH_ENV_BATCH * NUM_LANE_GROUPS), ticksRemaining(BENCH_ENV_BATCH * NUM_LANE_GROUPS);
+        std::vector<uint8_t> dones(BENCH_ENV_BATCH);
+        std::vector<uint64_t> seeds(BENCH_ENV_BATCH);
+        std::vector<int32_t> actions(BENCH_ENV_BATCH);
+        double seconds = 0, reward = 0;
+        uint32_t lcg = 1;
+
+        for(size_t i=0; i < BENCH_ENV_BATCH; i++){
+            seeds[i] = i;
+        }
+        env.setBuffers({queues.data(), colors.data(), ticksRemaining.data(), rewards.data(), dones.data()});
+        env.reset(seeds.data());
+
+        /// Queues overflow, keep the messages out of the timings
+        std::streambuf* coutBuf = std::cout.rdbuf(NULL);
+
+        for(int step=0; step < BENCH_ENV_STEPS; step++){
+            for(size_t i=0; i < BENCH_ENV_BATCH; i++){
+                lcg = lcg * 1664525 + 1013904223;
+                actions[i] = (lcg >> 8) % env.getNumActions(i);
+            }
+
+            auto startTime = currentTime();
+            env.step(actions.data());
+            seconds += secondsSince(startTime);
+
+            reward += rewards[0];
+        }
+
+        std::cout.rdbuf(coutBuf);
+        std::cout.clear();
+
+        std::cout << "  " << env.getNumThreads() << " thread(s): " << std::fixed << std::setprecision(2)
+                  << (double)BENCH_ENV_BATCH * BENCH_ENV_STEPS / seconds / 1e6 << " M env-steps/s, "
+                  << seconds / BENCH_ENV_STEPS * 1e3 << " ms/batch step (reward of env 0 " << std::setprecision(0) << reward << ")\n";
+    }
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief fork() building a new copy vs reusing a released one, and 60 second what-ifs run on copies.
+ */
+static void benchFork(){
+    Intersection live = Intersection();
+    ArrivalGenerator gen = ArrivalGenerator(1);
+    double buildSeconds, reuseSeconds, whatIfSeconds;
+    unsigned long numDepartures = 0;
+
+    refreshRateHzGlobal = BENCH_REFRESH_RATE;
+
+    buildIntersection(live);
+    addExitRoads(live);
+    live.setAutoSequence(true);
+    gen.setAllArrivals(ArrivalProcess::poissonArrivals(120));
+    live.setArrivals(&gen);
+    live.start();
+
+    /// Queues overflow, keep the messages out of the timings
+    std::streambuf* coutBuf = std::cout.rdbuf(NULL);
+
+    for(int t=0; t < 1000; t++){
+        live.tick();
+    }
+
+    auto startTime = currentTime();
+    Intersection* clone = live.fork();
+    buildSeconds = secondsSince(startTime);
+    live.releaseFork(clone);
+
+    startTime = currentTime();
+    for(int i=0; i < BENCH_FORKS; i++){
+        live.releaseFork(live.fork());
+    }
+    reuseSeconds = secondsSince(startTime);
+
+    /// What if the next LightConfig started now?
+    startTime = currentTime();
+    for(int i=0; i < BENCH_WHAT_IFS; i++){
+        clone = live.fork();
+        clone->nextLightConfig();
+
+        for(int t=0; t < BENCH_WHAT_IF_SECONDS * BENCH_REFRESH_RATE; t++){
+            clone->tick();
+        }
+
+        numDepartures += clone->getRoad(Road::north)->getTurnOption(TurnOption::straight)->getCumulativeDepartures();
+        live.releaseFork(clone);
+    }
+    whatIfSeconds = secondsSince(startTime);
+
+    std::cout.rdbuf(coutBuf);
+    std::cout.clear();
+
+    std::cout << "  first fork " << std::fixed << std::setprecision(0) << buildSeconds * 1e9 << " ns, reused fork "
+              << reuseSeconds / BENCH_FORKS * 1e9 << " ns (" << live.getNumForks() << " copy), "
+              << std::setprecision(1) << BENCH_WHAT_IFS / whatIfSeconds << " what-ifs of " << BENCH_WHAT_IF_SECONDS
+              << " s per second (" << numDepartures / BENCH_WHAT_IFS << " departures)\n";
+
+    live.setArrivals(NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief The fixed schedule vs PredictiveController on one Intersection at the bench refresh rate under heavy
+ *          north-south and light east-west demand, with the exit Roads emptied every tick: mean queued vehicles and
+ *          the latency of a decision against the length of a tick.
+ */
+static void benchMpc(){
+    const int numTicks = BENCH_MPC_SECONDS * BENCH_REFRESH_RATE;
+    Intersection fixed = Intersection();
+    Intersection mpc = Intersection();
+    ArrivalGenerator fixedGen = ArrivalGenerator(1);
+    ArrivalGenerator mpcGen = ArrivalGenerator(1);
+    PredictiveController ctrl = PredictiveController(BENCH_MPC_HORIZON_PHASES, BENCH_MPC_HORIZON_SECONDS);
+    unsigned long fixedQueued = 0, mpcQueued = 0, fixedDepartures = 0, mpcDepartures = 0;
+
+    refreshRateHzGlobal = BENCH_REFRESH_RATE;
+
+    for(ArrivalGenerator* gen : {&fixedGen, &mpcGen}){
+        gen->setArrivals(Road::north, TurnOption::straight, ArrivalProcess::poissonArrivals(900));
+        gen->setArrivals(Road::south, TurnOption::straight, ArrivalProcess::poissonArrivals(600));
+        gen->setArrivals(Road::west, TurnOption::straight, ArrivalProcess::poissonArrivals(60));
+    }
+
+    /// Queues overflow, keep the messages out of the timings
+    std::streambuf* coutBuf = std::cout.rdbuf(NULL);
+
+    for(Intersection* inter : {&fixed, &mpc}){
+        buildIntersection(*inter);
+        addExitRoads(*inter);
+        inter->setAutoSequence(true);
+    }
+    fixed.setArrivals(&fixedGen);
+    mpc.setArrivals(&mpcGen);
+    mpc.setSignalController(&ctrl);
+    fixed.start();
+    mpc.start();
+
+    for(int t=0; t < numTicks; t++){
+        unsigned long unused = 0;
+
+        fixed.tick();
+        mpc.tick();
+        countVehicles(fixed, fixedQueued, unused);
+        countVehicles(mpc, mpcQueued, unused);
+        drainExitRoads(fixed);
+        drainExitRoads(mpc);
+    }
+
+    std::cout.rdbuf(coutBuf);
+    std::cout.clear();
+
+    countVehicles(fixed, fixedQueued, fixedDepartures);
+    countVehicles(mpc, mpcQueued, mpcDepartures);
+
+    const QuantileSketch& latencies = ctrl.getLatencies();
+
+    std::cout << "  fixed: " << fixedDepartures << " departures, " << std::fixed << std::setprecision(2)
+              << (double)fixedQueued / numTicks << " queued\n";
+    std::cout << "  mpc:   " << mpcDepartures << " departures, " << (double)mpcQueued / numTicks << " queued, "
+              << ctrl.getNumDecisions() << " decisions on " << ctrl.getNumThreads() << " threads\n";
+    std::cout << "  decision latency p50 " << latencies.quantile(0.5) / 1e6 << " ms, p99 " << latencies.quantile(0.99) / 1e6
+              << " ms, max " << latencies.getMax() / 1e6 << " ms (fork p50 " << ctrl.getForkLatencies().quantile(0.5) / 1e6
+              << " ms), tick " << 1e3 / BENCH_REFRESH_RATE << " ms\n";
+
+    fixed.setArrivals(NULL);
+    mpc.setArrivals(NULL);
+    mpc.setSignalController(NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Builds the main.cpp Intersection with its 3 second greens under mixed demand, for ScheduleOptimizer.
+ */
+static void buildOptimizerIntersection(Intersection& inter, ArrivalGenerator& gen){
+    buildIntersection(inter);
+    gen.setArrivals(Road::north, TurnOption::straight, ArrivalProcess::poissonArrivals(900));
+    gen.setArrivals(Road::north, TurnOption::left, ArrivalProcess::poissonArrivals(300));
+    gen.setArrivals(Road::south, TurnOption::straight, ArrivalProcess::poissonArrivals(600));
+    gen.setArrivals(Road::east, TurnOption::straight, ArrivalProcess::poissonArrivals(120));
+    gen.setArrivals(Road::west, TurnOption::straight, ArrivalProcess::poissonArrivals(300));
+}
+
+/**
+ * @brief ScheduleOptimizer on the main.cpp Intersection on one thread and on every hardware thread: delay of the
+ *          built and optimized schedules, candidates simulated, dropped and found in the memo, and search time.
+ */
+static void benchOptimize(){
+    refreshRateHzGlobal = BENCH_OPT_RATE;
+
+    /// Queues overflow, keep the messages out of the timings
+    std::streambuf* coutBuf = std::cout.rdbuf(NULL);
+    std::ostringstream report;
+
+    for(unsigned int threads : {1u, std::max(1u, std::thread::hardware_concurrency())}){
+        ScheduleOptimizer opt = ScheduleOptimizer(buildOptimizerIntersection, BENCH_OPT_SECONDS, ScheduleOptimizer::minimizeDelay, 1, threads);
+        double builtDelay = opt.evaluate(opt.getBestSchedule()).delay;
+
+        auto startTime = currentTime();
+        std::vector<LightConfig> best = opt.optimize(BENCH_OPT_GENERATIONS);
+        double searchSeconds = secondsSince(startTime);
+
+        report << "  " << threads << " thread(s): delay " << std::fixed << std::setprecision(0) << builtDelay << " -> "
+               << opt.getBestEvaluation().delay << " vehicle-s, " << opt.getNumSimulated() << " simulated ("
+               << opt.getNumDropped() << " dropped, " << opt.getNumMemoHits() << " memo hits), " << std::setprecision(2)
+               << searchSeconds << " s\n   ";
+        for(LightConfig& config : best){
+            report << " " << config.getDirection() << "/" << config.getConfigOption() << " " << std::setprecision(1)
+                   << config.getDuration() << "+" << config.getYellowDuration() << " s";
+        }
+        report << "\n";
+    }
+
+    std::cout.rdbuf(coutBuf);
+    std::cout.clear();
+    std::cout << report.str();
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Adds the Roads and the two phase schedule of an Intersection of the corridor bench.
+ */
+static void buildCorridorIntersection(Intersection& inter, double northSouth, double eastWest){
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        inter.addRoad(dir, {1, 2, 1});
+        inter.setExitRoad(dir, new Road(dir, {1, 2, 1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    }
+
+    inter.schedule(LightConfig::doubleGreen, Road::east, eastWest, 1.0);
+    inter.schedule(LightConfig::doubleGreen, Road::north, northSouth, 1.0);
+    inter.setAllRedDuration(0.5);
+    inter.setAutoSequence(true);
+}
+
+/**
+ * @brief CorridorCoordinator on a two way corridor of Intersections with different splits and links: bandwidth and
+ *          time of optimize(), and delay of the optimized and zero offsets with the time of verify() on one thread
+ *          and on every hardware thread.
+ */
+static void benchCorridor(){
+    std::deque<Intersection> inters(BENCH_CORRIDOR_INTERSECTIONS);
+    std::deque<ArrivalGenerator> gens;
+    std::vector<Intersection*> corridor;
+    std::vector<double> links;
+    std::vector<unsigned long> zero(BENCH_CORRIDOR_INTERSECTIONS, 0), offsets;
+    std::ostringstream report;
+
+    refreshRateHzGlobal = BENCH_OPT_RATE;
+
+    /// Heavy through demand at both ends, light through demand joining everywhere
+    for(int k=0; k < BENCH_CORRIDOR_INTERSECTIONS; k++){
+        double throughRate = (k == 0 || k == BENCH_CORRIDOR_INTERSECTIONS - 1) ? 700 : 60;
+
+        buildCorridorIntersection(inters[k], 10.0 + (k % 3), 10.0 - (k % 3));
+        gens.emplace_back(1, k);
+        gens.back().setArrivals(Road::west, TurnOption::straight, ArrivalProcess::poissonArrivals(throughRate));
+        gens.back().setArrivals(Road::east, TurnOption::straight, ArrivalProcess::poissonArrivals(throughRate));
+        inters[k].setArrivals(&gens.back());
+        corridor.push_back(&inters[k]);
+        if(k < BENCH_CORRIDOR_INTERSECTIONS - 1){
+            links.push_back(2.0 + (k * 7) % 5);
+        }
+    }
+
+    for(unsigned int threads : {1u, std::max(1u, std::thread::hardware_concurrency())}){
+        CorridorCoordinator coord = CorridorCoordinator(corridor, Road::west, threads);
+        coord.setLinkSeconds(links);
+
+        auto startTime = currentTime();
+        offsets = coord.optimize();
+        double optimizeSeconds = secondsSince(startTime);
+
+        /// Queues overflow, keep the messages out of the timings
+        std::streambuf* coutBuf = std::cout.rdbuf(NULL);
+        startTime = currentTime();
+        CorridorCoordinator::Verification optimized = coord.verify(offsets, BENCH_CORRIDOR_SECONDS);
+        double verifySeconds = secondsSince(startTime);
+        CorridorCoordinator::Verification unoptimized = coord.verify(zero, BENCH_CORRIDOR_SECONDS);
+        std::cout.rdbuf(coutBuf);
+        std::cout.clear();
+
+        report << "  " << threads << " thread(s): bandwidth " << coord.getOutboundBandwidth() << "/"
+               << coord.getInboundBandwidth() << " ticks of " << coord.getCycleLength() << " (zero offsets "
+               << coord.bandwidth(zero, true) << "/" << coord.bandwidth(zero, false) << ") in " << coord.getNumPasses()
+               << " passes, " << std::fixed << std::setprecision(3) << optimizeSeconds << " s\n"
+               << "    delay " << std::setprecision(0) << unoptimized.delay << " -> " << optimized.delay
+               << " vehicle-s over " << BENCH_CORRIDOR_SECONDS << " s, verify " << std::setprecision(2) << verifySeconds
+               << " s on " << coord.getNumThreads() << " thread(s)\n";
+    }
+
+    for(Intersection& inter : inters){
+        inter.setArrivals(NULL);
+    }
+    std::cout << report.str();
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Builds variant "k" of the lockstep bench: the bench Intersection with exit Roads, its all-red clearance and
+ *          demand depending on "k".
+ */
+static void buildLockstepVariant(Intersection& inter, ArrivalGenerator& gen, int k){
+    buildIntersection(inter);
+    addExitRoads(inter);
+    inter.setAllRedDuration(0.5 * (k % 3));
+    inter.setAutoSequence(true);
+    gen.setAllArrivals(ArrivalProcess::poissonArrivals(100 + 5 * (k % 40)));
+    inter.setArrivals(&gen);
+    inter.start();
+}
+
+/**
+ * @brief Variants of one Intersection ticked in lockstep by LockstepVariants vs ticked one at a time: variant-ticks per
+ *          second of each, on one thread and on every hardware thread, and the variants that end up different.
+ */
+static void benchLockstep(){
+    std::deque<Intersection> lockstep(BENCH_LOCKSTEP_VARIANTS), scalar(BENCH_LOCKSTEP_VARIANTS);
+    std::deque<ArrivalGenerator> lockstepGens, scalarGens;
+    std::vector<Intersection*> ptrs;
+    CompactIntersection packedA, packedB;
+    unsigned long ticks, variantTicks;
+    double scalarSeconds;
+    bool isStored = false;
+    int numDifferent = 0;
+
+    refreshRateHzGlobal = BENCH_OPT_RATE;
+    ticks = BENCH_LOCKSTEP_SECONDS * BENCH_OPT_RATE;
+    variantTicks = ticks * BENCH_LOCKSTEP_VARIANTS;
+
+    for(int k=0; k < BENCH_LOCKSTEP_VARIANTS; k++){
+        lockstepGens.emplace_back(2, k);
+        scalarGens.emplace_back(2, k);
+        buildLockstepVariant(lockstep[k], lockstepGens[k], k);
+        buildLockstepVariant(scalar[k], scalarGens[k], k);
+        ptrs.push_back(&lockstep[k]);
+    }
+
+    /// Queues overflow, keep the messages out of the timings
+    std::streambuf* coutBuf = std::cout.rdbuf(NULL);
+    auto startTime = currentTime();
+    for(Intersection& inter : scalar){
+        for(unsigned long t=0; t < ticks; t++){
+            inter.tick();
+        }
+    }
+    scalarSeconds = secondsSince(startTime);
+    std::cout.rdbuf(coutBuf);
+    std::cout.clear();
+
+    std::cout << "  " << BENCH_LOCKSTEP_VARIANTS << " variants, " << BENCH_LOCKSTEP_SECONDS << " s, " << LOCKSTEP_WIDTH
+              << " lanes\n  scalar:     " << std::fixed << std::setprecision(2) << variantTicks / scalarSeconds / 1e6
+              << " M variant-ticks/s\n";
+
+    /// The first run is stored to check it against the scalar one
+    for(unsigned int threads : {1u, std::max(1u, std::thread::hardware_concurrency())}){
+        LockstepVariants lock = LockstepVariants(ptrs, false, threads);
+
+        startTime = currentTime();
+        lock.tick(ticks);
+        double lockstepSeconds = secondsSince(startTime);
+
+        std::cout << "  lockstep:   " << variantTicks / lockstepSeconds / 1e6 << " M variant-ticks/s ("
+                  << scalarSeconds / lockstepSeconds << "x) on " << lock.getNumThreads() << " thread(s)\n";
+
+        if( ! isStored){
+            lock.store();
+            isStored = true;
+        }
+    }
+
+    for(int k=0; k < BENCH_LOCKSTEP_VARIANTS; k++){
+        packedA.pack(lockstep[k]);
+        packedB.pack(scalar[k]);
+        numDifferent += !(packedA == packedB);
+        lockstep[k].setArrivals(NULL);
+        scalar[k].setArrivals(NULL);
+    }
+    std::cout << "  variants different from scalar: " << numDifferent << "\n";
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @class SwitchTrafficLight
+ * @brief A TrafficLight ticked by the switch on the color that nextState() used before the TransitionTables, kept as
+ *          the baseline the table lookup is timed against.
+ */
+class SwitchTrafficLight : public TrafficLight{
+public:
+    SwitchTrafficLight(AvailableColors aOnColor, double onColorDur, double redDur) : TrafficLight(aOnColor, onColorDur, redDur){}
+
+    int tick(){
+        if(ticksRemaining > 0){
+            ticksRemaining--;
+        }
+
+        if(ticksRemaining == 0){
+            switch(color){
+                case green:
+                case greenLeft:
+                case greenRight:
+                    color = yellow;
+                    setTicksRemainingColor(yellow);
+                    break;
+
+                case yellow:
+                    color = red;
+                    setTicksRemainingColor(red);
+                    break;
+
+                case red:
+                    color = onColor;
+                    setTicksRemainingColor(onColor);
+                    break;
+
+                default:
+                    throw std::out_of_range("SwitchTrafficLight reached unexpected color in tick()");
+                    break;
+            }
+        }
+
+        return ticksRemaining;
+    }
+};
+
+/**
+ * @brief Ticks BENCH_LIGHTS lights of mixed types and durations BENCH_LIGHT_TICKS times and returns the nanoseconds per
+ *          light tick. "table" is set on every light unless NULL, Light::tick() is called directly.
+ */
+template<typename Light>
+static double timeLightTicks(const TrafficLight::TransitionTable* table, unsigned long& numGreen){
+    std::vector<Light> lights;
+
+    for(int k=0; k < BENCH_LIGHTS; k++){
+        lights.push_back(Light((TrafficLight::AvailableColors)(k % 3), 1.0 + (k % 7), 2.0 + (k % 5)));
+        lights.back().setDuration(TrafficLight::green, 1.5);
+        lights.back().setTransitions(table);
+        lights.back().start();
+    }
+
+    auto startTime = currentTime();
+    for(int t=0; t < BENCH_LIGHT_TICKS; t++){
+        for(Light& light : lights){
+            light.tick();
+        }
+    }
+    double seconds = secondsSince(startTime);
+
+    for(Light& light : lights){
+        numGreen += light.isGreen();
+    }
+
+    return seconds * 1e9 / ((double)BENCH_LIGHTS * BENCH_LIGHT_TICKS);
+}
+
+/**
+ * @brief TrafficLight::tick() following the default TransitionTables vs the old switch on the color and a protected
+ *          then permissive sequence. Both green counts match when the default tables cycle as the switch did.
+ */
+static void benchLights(){
+    static constexpr TrafficLight::TransitionTable protectedPermissive = TrafficLight::makeSequenceTransitions<4>({TrafficLight::greenLeft, TrafficLight::green, TrafficLight::yellow, TrafficLight::red});
+    unsigned long numSwitchGreen = 0, numTableGreen = 0, numGreen = 0;
+
+    refreshRateHzGlobal = BENCH_REFRESH_RATE;
+
+    std::cout << "  " << BENCH_LIGHTS << " lights, " << BENCH_LIGHT_TICKS << " ticks\n";
+    std::cout << "  switch (baseline):    " << std::fixed << std::setprecision(2) << timeLightTicks<SwitchTrafficLight>(NULL, numSwitchGreen) << " ns per light tick\n";
+    std::cout << "  default tables:       " << timeLightTicks<TrafficLight>(NULL, numTableGreen) << " ns per light tick\n";
+    std::cout << "  protected-permissive: " << timeLightTicks<TrafficLight>(&protectedPermissive, numGreen) << " ns per light tick\n";
+    std::cout << "  (" << numSwitchGreen << " switch, " << numTableGreen << " table, " << numGreen << " protected-permissive green at the end)\n";
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+static const Benchmark benchmarks[] = {
+    {"memory", benchMemory},
+    {"advance", benchAdvance},
+    {"arrivals", benchArrivals},
+    {"demand", benchDemand},
+    {"snapshot", benchSnapshot},
+    {"journal", benchJournal},
+    {"telemetry", benchTelemetry},
+    {"history", benchHistory},
+    {"metrics", benchMetrics},
+    {"sketch", benchSketch},
+    {"agents", benchAgents},
+    {"routing", benchRouting},
+    {"actuated", benchActuated},
+    {"pressure", benchPressure},
+    {"policy", benchPolicy},
+    {"env", benchEnv},
+    {"fork", benchFork},
+    {"mpc", benchMpc},
+    {"optimize", benchOptimize},
+    {"corridor", benchCorridor},
+    {"lockstep", benchLockstep},
+    {"lights", benchLights},
+};
+
+int main(int argc, char *argv[]){
+    for(const Benchmark& bench : benchmarks){
+        bool selected = (argc <= 1);
+
+        for(int i=1; i < argc; i++){
+            selected = selected || (strcmp(argv[i], bench.name) == 0);
+        }
+
+        if(selected){
+            std::cout << bench.name << ":\n";
+            bench.run();
+        }
+    }
+
+    return 0;
+}
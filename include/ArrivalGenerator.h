@@ -0,0 +1,196 @@
+#ifndef ARRIVAL_GENERATOR_H
+#define ARRIVAL_GENERATOR_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "Intersection.h"
+#include "Philox.h"
+
+#define ARRIVAL_BATCH_TICKS             (64)    ///< Ticks of arrivals generated at once for every lane group
+#define ARRIVAL_TICKS_PER_DRAW          (4)     ///< Consecutive ticks of a lane group sharing one Philox4x32 draw, a word each
+#define ARRIVAL_MAX_MEAN_PER_TICK       (64.0)  ///< Largest mean number of Poisson arrivals per tick of a lane group
+#define SECONDS_PER_HOUR                (3600.0)
+
+/**
+ * @class ArrivalProcess
+ * @brief Describes how vehicles arrive at one lane group (a TurnOption of a Road).
+ */
+class ArrivalProcess{
+public:
+    /**
+     * @brief The available arrival processes.
+     *
+     * none         no arrivals
+     * poisson      vehicles arrive independently at a constant rate
+     * platoon      a fixed sized group of vehicles arrives every period, e.g. released by an upstream signal
+     * timeVarying  Poisson arrivals whose rate changes every bin, the bins repeat e.g. a daily profile
+     */
+    enum Type {none, poisson, platoon, timeVarying, numArrivalTypes};
+
+protected:
+    Type type;                              ///< The arrival process
+    std::vector<double> vehiclesPerHour;    ///< The Poisson rate, one per bin for timeVarying
+    double binDuration;                     ///< The duration of each timeVarying bin in seconds
+    int platoonSize;                        ///< The number of vehicles in each platoon
+    double platoonPeriod;                   ///< The seconds between two platoons
+    double platoonOffset;                   ///< The seconds from the start of the simulation to the first platoon
+
+public:
+    ArrivalProcess() : type(none), binDuration(0), platoonSize(0), platoonPeriod(0), platoonOffset(0) {}
+
+    /**
+     * @brief Poisson arrivals at a constant rate.
+     *
+     * @param rate  the mean number of vehicles per hour
+     *
+     * @throws std::domain_error if "rate" is negative
+     */
+    static ArrivalProcess poissonArrivals(double rate);
+
+    /**
+     * @brief "size" vehicles arrive together every "periodSeconds" seconds, starting at "offsetSeconds".
+     *
+     * @throws std::domain_error if "size" or "offsetSeconds" is negative or "periodSeconds" is not positive
+     */
+    static ArrivalProcess platoonArrivals(int size, double periodSeconds, double offsetSeconds=0);
+
+    /**
+     * @brief Poisson arrivals whose rate is rates[i] during bin i. Bins are "binSeconds" long and repeat once the
+     *          last one ends.
+     *
+     * @param rates         the mean number of vehicles per hour in every bin
+     * @param binSeconds    the duration of a bin in seconds
+     *
+     * @throws std::domain_error if "rates" is empty, a rate is negative or "binSeconds" is not positive
+     */
+    static ArrivalProcess timeVaryingArrivals(const std::vector<double>& rates, double binSeconds);
+
+    Type getType(){ return type; }
+    const std::vector<double>& getRates(){ return vehiclesPerHour; }
+    double getBinDuration(){ return binDuration; }
+    int getPlatoonSize(){ return platoonSize; }
+    double getPlatoonPeriod(){ return platoonPeriod; }
+    double getPlatoonOffset(){ return platoonOffset; }
+};
+
+/**
+ * @class ArrivalGenerator
+ * @brief Injects vehicles into the TurnOption queues of an Intersection every tick according to an ArrivalProcess
+ *          per lane group.
+ *
+ * Every random draw comes from Philox4x32 with the counter (tick / ARRIVAL_TICKS_PER_DRAW, lane group, intersectionId)
+ * and the seed as the key, word tick % ARRIVAL_TICKS_PER_DRAW going to the tick. The arrivals of a tick are the same
+ * regardless of thread count, the order Intersections are ticked in or which ticks were skipped. Arrivals are generated for all lane groups ARRIVAL_BATCH_TICKS ticks at a time.
+ *
+ * Vehicles that do not fit in a full queue are turned away and counted by getNumBlockedArrivals().
+ */
+class ArrivalGenerator{
+protected:
+    /**
+     * @brief An ArrivalProcess with its durations converted to ticks.
+     */
+    struct CompiledProcess{
+        ArrivalProcess::Type type;
+        std::vector<double> meanPerTick;    ///< Mean arrivals per tick in each bin
+        std::vector<double> expNegMean;     ///< exp(-meanPerTick) in each bin
+        long binTicks;                      ///< The duration of a bin in ticks
+        long platoonPeriodTicks;            ///< The ticks between two platoons
+        long platoonOffsetTicks;            ///< The tick of the first platoon
+    };
+
+    uint64_t seed;                                                      ///< The RNG key
+    uint32_t intersectionId;                                            ///< Distinguishes the streams of Intersections sharing a seed
+    std::array<ArrivalProcess, NUM_LANE_GROUPS> processes;              ///< The arrival process of every lane group
+    std::array<CompiledProcess, NUM_LANE_GROUPS> compiled;              ///< processes converted at compiledRefreshRate
+    int compiledRefreshRate;                                            ///< refreshRateHzGlobal processes were converted at, 0 if stale
+    std::vector<uint16_t> batch;                                        ///< Arrivals of ARRIVAL_BATCH_TICKS ticks, [tick][lane group]
+    unsigned long batchStartTick;                                       ///< The first tick in batch
+    bool batchIsValid;                                                  ///< False when batch does not hold arrivals for the current processes
+    unsigned long numArrivals;                                          ///< Vehicles added to queues
+    unsigned long numBlockedArrivals;                                   ///< Vehicles turned away by full queues
+
+    /**
+     * @brief Converts every ArrivalProcess to ticks at refreshRateHzGlobal.
+     *
+     * @throws std::domain_error if a bin or platoon period is shorter than a tick or a rate exceeds
+     *          ARRIVAL_MAX_MEAN_PER_TICK vehicles per tick
+     */
+    void compile();
+
+    /**
+     * @brief Draws the number of arrivals from a Poisson distribution by inversion of the uniform "u"
+     */
+    static int samplePoisson(double u, double mean, double expNegMean);
+
+public:
+    friend class RoadNetwork; ///< Friend class RoadNetwork.
+    friend class LockstepVariants; ///< Friend class LockstepVariants.
+
+    ArrivalGenerator(uint64_t rngSeed, uint32_t id=0);
+
+    /**
+     * @brief Sets the ArrivalProcess of the "turn" TurnOption of the Road facing "dir".
+     */
+    void setArrivals(Road::RoadDirection dir, TurnOption::Type turn, const ArrivalProcess& process);
+
+    /**
+     * @brief Sets the same ArrivalProcess for every lane group.
+     */
+    void setAllArrivals(const ArrivalProcess& process);
+
+    /**
+     * @brief Replaces the RNG key, e.g. to start another episode, and clears the counters. Arrivals only depend on
+     *          the key, the tick and the lane group, so the new stream starts at once.
+     */
+    void reseed(uint64_t rngSeed);
+
+    ArrivalProcess& getArrivals(Road::RoadDirection dir, TurnOption::Type turn){ return processes.at(Road::laneGroupIdx(dir, turn)); }
+
+    /**
+     * @brief Generates the arrivals of every lane group for ticks ["startTick", "startTick" + "numTicks").
+     *
+     * @param startTick the first tick
+     * @param numTicks  the number of ticks
+     * @param counts    filled with numTicks * #NUM_LANE_GROUPS counts, counts[tick * #NUM_LANE_GROUPS + laneGroupIdx]
+     */
+    void generate(unsigned long startTick, int numTicks, std::vector<uint16_t>& counts);
+
+    /**
+     * @brief Gets the number of vehicles arriving at lane group "laneGroup" on tick "tick".
+     */
+    int arrivalsAt(unsigned long tick, int laneGroup);
+
+    /**
+     * @brief Adds the arrivals of the current tick, inter.time(), to the queues of "inter". Lane groups whose
+     *          TurnOption does not exist are skipped.
+     *
+     * @note Called by Intersection::tick() for the ArrivalGenerator set with Intersection::setArrivals()
+     *
+     * @return the number of vehicles added
+     */
+    int inject(Intersection& inter);
+
+    /**
+     * @brief Gets the first tick from which the arrivals repeat every "period" ticks, the last first platoon. Only
+     *          arrivals where every lane group has none or platoons whose period divides "period" ever repeat.
+     *
+     * @throws std::domain_error see compile()
+     *
+     * @return the tick, -1 if the arrivals never repeat every "period" ticks
+     */
+    long repeatStart(long period);
+
+    /**
+     * @brief Adds vehicles that arrived or were turned away on ticks skipped by Intersection::advance() to the
+     *          counters.
+     */
+    void addSkipped(unsigned long arrived, unsigned long blocked){ numArrivals += arrived; numBlockedArrivals += blocked; }
+
+    uint64_t getSeed(){ return seed; }
+    uint32_t getIntersectionId(){ return intersectionId; }
+    unsigned long getNumArrivals(){ return numArrivals; }
+    unsigned long getNumBlockedArrivals(){ return numBlockedArrivals; }
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef COMPACT_INTERSECTION_H
+#define COMPACT_INTERSECTION_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "Intersection.h"
+
+#define ALLOC_OVERHEAD_BYTES    (16)    ///< Bookkeeping bytes the heap adds to every new, used by the memory report
+
+/**
+ * @class CompactIntersection
+ * @brief A bit-packed, pointer-free encoding of the simulation state of an Intersection.
+ *
+ * Each TurnOption and the TrafficLight that directs it (a "lane group") is stored in a fixed 56 byte
+ * record: colors are bit-packed, queue counters are narrowed to 16 bits, the running totals are kept
+ * at 64 bits and every duration is precomputed in ticks. An Intersection's roads, lights and vehicles fit in a single flat object
+ * with no heap allocations, so millions of them can be held for city-scale runs.
+ *
+ * @note Exit roads are not encoded, they belong to the neighboring Intersections.
+ */
+class CompactIntersection{
+public:
+    /**
+     * @brief The durations kept for every lane group, in ticks.
+     */
+    enum DurationSlot {onSlot, yellowSlot, redSlot, numDurationSlots};
+
+    /**
+     * @brief Packed state of one TurnOption and its TrafficLight.
+     */
+    struct LaneGroup{
+        uint8_t  color : 3;                                     ///< The current TrafficLight::AvailableColors of the light
+        uint8_t  onColor : 3;                                   ///< The onColor of the light
+        uint8_t  valid : 1;                                     ///< 1 when the TurnOption exists (TurnOption::isValid())
+        uint8_t  numLanes;                                      ///< The number of lanes
+        uint8_t  maxVehiclesPerLane;                            ///< The max number of vehicles allowed per lane
+        uint8_t  reserved;                                      ///< Padding, always 0
+        uint16_t timeToCross;                                   ///< The number of ticks it takes a vehicle to cross
+        uint16_t queuedVehicles;                                ///< The number of vehicles currently waiting
+        uint16_t currentVehicleProgress;                        ///< Ticks remaining for the vehicles currently crossing
+        uint16_t numVehiclesCurrentlyCrossing;                  ///< The number of vehicles currently crossing
+        int32_t  ticksRemaining;                                ///< Ticks remaining in the current color
+        std::array<int32_t, numDurationSlots> durationTicks;    ///< onColor, yellow and red durations in ticks. -1 is infinite.
+        uint32_t reservedWord;                                  ///< Padding before the 64 bit totals, always 0
+        uint64_t numVehiclesDirected;                           ///< Total vehicles that have crossed under this light
+        uint64_t cumulativeArrivals;                            ///< TurnOption::getCumulativeArrivals()
+        uint64_t cumulativeDepartures;                          ///< TurnOption::getCumulativeDepartures()
+
+        bool operator==(const LaneGroup& other) const = default;
+    };
+
+protected:
+    uint64_t ticksSinceStart;                                   ///< Intersection::ticksSinceStart
+    uint16_t configScheduleIdx;                                 ///< Intersection::configScheduleIdx
+    uint8_t  numUnfinishedLights;                               ///< Intersection::numUnfinishedLights
+    uint8_t  roadMask;                                          ///< Bit "dir" is set when the Road facing "dir" exists
+    int32_t  clearanceTicksRemaining;                           ///< Intersection::clearanceTicksRemaining
+    uint32_t phaseGreenTicks;                                   ///< Intersection::phaseGreenTicks
+    uint32_t phaseIdleTicks;                                    ///< Intersection::phaseIdleTicks
+    uint8_t  hasController;                                     ///< 1 when a SignalController is set, its own state is not encoded
+    std::array<uint8_t, 7> reserved;                            ///< Padding, always 0
+    std::array<LaneGroup, NUM_LANE_GROUPS> laneGroups;          ///< One record per (Road::RoadDirection, TurnOption::Type)
+
+public:
+    CompactIntersection();
+
+    /**
+     * @brief Gets the index into the lane group array for the "turn" TurnOption of the Road facing "dir"
+     */
+    static int laneGroupIdx(Road::RoadDirection dir, TurnOption::Type turn){ return Road::laneGroupIdx(dir, turn); }
+
+    /**
+     * @brief Encodes the current state of "inter".
+     *
+     * @param inter the Intersection to be encoded
+     *
+     * @throws std::overflow_error if a value does not fit its narrowed field, e.g. a queue longer
+     *          than 65535 vehicles or a duration longer than INT32_MAX ticks.
+     */
+    void pack(Intersection& inter);
+
+    /**
+     * @brief Writes the encoded state back into "inter": light colors, ticksRemaining, vehicle counters and
+     *          cumulative curves, configScheduleIdx, numUnfinishedLights, the all-red clearance countdown, the
+     *          green and idle ticks of the current LightConfig and ticksSinceStart.
+     *
+     * @note Durations are configuration and are left untouched, and so is the SignalController: set it before
+     *          unpacking, Intersection::setSignalController() restarts the green and idle counts. "inter" is
+     *          expected to be built the same way as the Intersection that was packed.
+     *
+     * @param inter the Intersection to be overwritten
+     *
+     * @throws std::logic_error if the roads or TurnOptions of "inter" do not match the packed ones.
+     */
+    void unpack(Intersection& inter);
+
+    /**
+     * @brief Checks "other" encodes the same simulation state, ignoring the clock, the numVehiclesDirected
+     *          counters and the cumulative curves. Two such states evolve identically tick for tick.
+     *
+     * @param other the packed state to compare with
+     */
+    bool sameState(const CompactIntersection& other) const;
+
+    bool operator==(const CompactIntersection& other) const = default;
+
+    /**
+     * @brief Gets a 64 bit FNV-1a digest of the whole packed state, clock and counters included. Two runs that
+     *          produce the same digest at the same tick are, barring a collision, in the same state.
+     */
+    uint64_t hash() const;
+
+    const LaneGroup& getLaneGroup(Road::RoadDirection dir, TurnOption::Type turn) const{ return laneGroups.at(laneGroupIdx(dir, turn)); }
+    int getNumLaneGroups();
+    uint64_t time() const{ return ticksSinceStart; }
+    unsigned int getConfigScheduleIdx() const{ return configScheduleIdx; }
+    int getNumUnfinishedLights() const{ return numUnfinishedLights; }
+    unsigned long getPhaseGreenTicks() const{ return phaseGreenTicks; }
+    unsigned long getPhaseIdleTicks() const{ return phaseIdleTicks; }
+    bool isControlled() const{ return hasController; }
+    bool roadExists(Road::RoadDirection dir) const{ return (roadMask >> dir) & 1; }
+
+    /**
+     * @brief Gets the number of bytes one lane group takes in the object representation: a heap
+     *          allocated TurnOption and TrafficLight.
+     */
+    static size_t laneGroupFootprint();
+
+    /**
+     * @brief Gets the number of heap and object bytes "inter" takes in the object representation.
+     *          Roads, TurnOptions, TrafficLights and scheduled LightConfigs are included, exit roads are not.
+     */
+    static size_t footprint(Intersection& inter);
+};
+
+static_assert(sizeof(CompactIntersection::LaneGroup) == 56, "CompactIntersection::LaneGroup is expected to pack into 56 bytes");
+static_assert(sizeof(CompactIntersection) == 32 + NUM_LANE_GROUPS * sizeof(CompactIntersection::LaneGroup), "CompactIntersection::hash() reads the header as raw bytes, it must have no padding");
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef CORRIDOR_COORDINATOR_H
+#define CORRIDOR_COORDINATOR_H
+
+#include <vector>
+#include "Intersection.h"
+
+#define CORRIDOR_MAX_PASSES                 (10)    ///< Most coordinate descent passes over the corridor
+#define CORRIDOR_MIN_NODES_PER_THREAD       (32)    ///< Fewer Intersections than this per thread are simulated on fewer threads
+
+/**
+ * @class CorridorCoordinator
+ * @brief Green-wave coordination of a chain of Intersections: the offset of every fixed schedule that maximizes the
+ *          progression bandwidth along the corridor.
+ *
+ * Intersection k + 1 follows Intersection k: through vehicles on the Road facing "approach" cross straight and arrive
+ * on the Road facing "approach" of the next Intersection. When every Intersection also has the opposite Road, vehicles
+ * on it travel the other way, inbound. A vehicle takes the crossing time of its TurnOption plus the link time, plus the
+ * tick it is handed over on, to reach the next Intersection.
+ *
+ * The offset of an Intersection is the tick of its cycle it is at when the corridor starts, see
+ * Intersection::startAt(). All schedules must share one cycle length. The bandwidth of a direction is the number of
+ * ticks of the cycle a vehicle can pass the first Intersection on and then find the straight light green at every
+ * Intersection on arrival. It is computed from the compiled SignalPlans only: for every Intersection the cross
+ * correlation of its green intervals with the band of the others gives its best offset at once, and passes over the
+ * corridor repeat that until no offset changes. The score is the weighted sum of both directions; the descent starts
+ * from each direction on its own and from both, and the best result is kept.
+ *
+ * verify() simulates the corridor on copies of the Intersections, handing through vehicles down the links. Links
+ * delay vehicles at least one tick, so every Intersection of a tick only depends on the last one and the Intersections
+ * are split across threads in contiguous blocks, meeting at a barrier every tick.
+ *
+ * @note Offsets assume the fixed schedule, any SignalController is ignored by verify().
+ */
+class CorridorCoordinator{
+public:
+    /**
+     * @brief The outcome of simulating the corridor.
+     */
+    struct Verification{
+        double delay;                       ///< Vehicle-seconds queued on the through Roads
+        unsigned long outboundDepartures;   ///< Through vehicles leaving the last Intersection
+        unsigned long inboundDepartures;    ///< Through vehicles leaving the first Intersection the other way
+    };
+
+protected:
+    /**
+     * @brief A run of ticks of the cycle, [start, start + length).
+     */
+    struct Interval{
+        long start;
+        long length;
+    };
+
+    std::vector<Intersection*> nodes;           ///< The corridor in order. Not owned.
+    Road::RoadDirection outboundRoad;           ///< The Road outbound vehicles arrive on
+    Road::RoadDirection inboundRoad;            ///< The Road inbound vehicles arrive on
+    bool twoWay;                                ///< True when every Intersection has the inbound Road
+    std::vector<double> linkSeconds;            ///< Travel time of every link, seconds
+    double outboundWeight;
+    double inboundWeight;
+    unsigned int numThreads;                    ///< Most threads simulating
+
+    long cycleLength;                           ///< The common cycle, ticks
+    std::vector<std::vector<Interval>> outboundGreens;  ///< Green intervals of the outbound straight light of every node
+    std::vector<std::vector<Interval>> inboundGreens;   ///< Green intervals of the inbound straight light of every node
+    std::vector<long> outboundArrival;          ///< Ticks from the first node to every node, outbound
+    std::vector<long> inboundArrival;           ///< Ticks from the last node to every node, inbound
+    std::vector<unsigned long> offsets;         ///< The best offsets found
+    long outboundBandwidth;                     ///< Of offsets, ticks
+    long inboundBandwidth;                      ///< Of offsets, ticks
+    int numPasses;                              ///< Coordinate descent passes of the last optimize()
+
+    /**
+     * @brief Gets the travel time of link "link" in ticks, crossing and hand over included.
+     */
+    long linkTicks(int link, bool outbound);
+
+    /**
+     * @brief Compiles the green intervals and arrival times of every node.
+     *
+     * @throws std::invalid_argument if the cycle lengths differ, a cycle never ends or a TrafficLight does not follow
+     *          its default TransitionTable
+     */
+    void compile();
+
+    /**
+     * @brief Gets the intervals of the ticks set in "band".
+     */
+    static std::vector<Interval> toIntervals(const std::vector<char>& band);
+
+    /**
+     * @brief Sets "band" to the ticks a vehicle passing the first node of its direction on finds "node" green,
+     *          given its offset.
+     */
+    void nodeBand(int node, unsigned long offset, bool outbound, std::vector<char>& band);
+
+    /**
+     * @brief Gets, for every shift d, the number of ticks s in "band" with "node" green at s + d.
+     */
+    void correlate(const std::vector<Interval>& band, const std::vector<Interval>& greens, std::vector<long>& counts);
+
+    /**
+     * @brief Coordinate descent from offset 0 everywhere: the first pass places every node in order against the ones
+     *          before it with the given weights, the following ones against all others with the set weights.
+     *
+     * @param result    set to the offsets found
+     * @param outBand   set to their outbound bandwidth
+     * @param inBand    set to their inbound bandwidth
+     * @return the weighted bandwidth of "result"
+     */
+    double descend(double firstOutWeight, double firstInWeight, std::vector<unsigned long>& result, long& outBand, long& inBand);
+
+public:
+    /**
+     * @param corridor  the Intersections in the order outbound vehicles cross them
+     * @param approach  the Road outbound vehicles arrive on at every Intersection
+     * @param threads   the most threads simulating, 0 for one per hardware thread
+     *
+     * @throws std::invalid_argument if there are fewer than 2 Intersections or one has no straight TurnOption on
+     *          "approach"
+     */
+    CorridorCoordinator(const std::vector<Intersection*>& corridor, Road::RoadDirection approach, unsigned int threads=0);
+
+    /**
+     * @brief Sets the travel time of every link, from Intersection k to k + 1, in seconds. 0 for all by default.
+     *
+     * @throws std::invalid_argument if there is not one time per link or one is negative
+     */
+    void setLinkSeconds(const std::vector<double>& seconds);
+
+    /**
+     * @brief Sets how much the bandwidth of each direction counts. Both 1 by default.
+     *
+     * @throws std::domain_error if a weight is negative
+     */
+    void setWeights(double outbound, double inbound);
+
+    /**
+     * @brief Computes the offsets maximizing the weighted bandwidth, the first Intersection at offset 0.
+     *
+     * @throws std::invalid_argument if the cycle lengths differ, a cycle never ends or a TrafficLight does not follow
+     *          its default TransitionTable
+     *
+     * @return the offset of every Intersection in ticks
+     */
+    const std::vector<unsigned long>& optimize();
+
+    /**
+     * @brief Computes the bandwidth of "corridorOffsets" in ticks.
+     *
+     * @return the bandwidth, 0 inbound for a one way corridor
+     *
+     * @throws std::invalid_argument if there is not one offset per Intersection
+     */
+    long bandwidth(const std::vector<unsigned long>& corridorOffsets, bool outbound);
+
+    /**
+     * @brief Starts every Intersection at its offset with Intersection::startAt().
+     */
+    void apply();
+
+    /**
+     * @brief Simulates the corridor started at "corridorOffsets" for "seconds" on copies of the Intersections, with
+     *          their arrivals. The Intersections themselves do not move. An exception thrown while simulating an
+     *          Intersection stops every thread and is rethrown here once they have all finished.
+     *
+     * @throws std::invalid_argument if there is not one offset per Intersection
+     */
+    Verification verify(const std::vector<unsigned long>& corridorOffsets, double seconds);
+
+    const std::vector<unsigned long>& getOffsets(){ return offsets; }
+    long getOutboundBandwidth(){ return outboundBandwidth; }
+    long getInboundBandwidth(){ return inboundBandwidth; }
+    long getCycleLength(){ return cycleLength; }
+    bool isTwoWay(){ return twoWay; }
+    int getNumPasses(){ return numPasses; }
+    unsigned int getNumThreads(){ return numThreads; }
+    int getNumIntersections(){ return (int)nodes.size(); }
+};
+
+#endif
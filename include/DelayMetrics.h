@@ -0,0 +1,189 @@
+#ifndef DELAY_METRICS_H
+#define DELAY_METRICS_H
+
+#include <array>
+#include <iostream>
+#include <vector>
+#include "Intersection.h"
+#include "QuantileSketch.h"
+
+#define DEFAULT_METRICS_WINDOW_SECONDS  (900.0)     ///< Sliding window of 15 minutes
+#define DEFAULT_METRICS_BUCKET_SECONDS  (1.0)       ///< The window slides one second at a time
+
+/**
+ * @class DelayMetrics
+ * @brief Delay, queue and throughput statistics of every TurnOption of an Intersection, derived from the cumulative
+ *          arrival and departure curves without tracking individual vehicles.
+ *
+ * The queue of a TurnOption is the gap between its arrival curve A(t) and departure curve D(t), and the area between
+ * the curves is the total time vehicles spent waiting and crossing. update() adds the current queue to that area
+ * once per tick, so total delay, average delay per departed vehicle, max queue and throughput are kept both since
+ * attach() and over a sliding window, with constant work per lane group per tick.
+ *
+ * The window is made of whole buckets: the last windowSeconds / bucketSeconds finished buckets plus the one in
+ * progress. The curves are sampled at every bucket boundary and the max queue of each bucket kept in a monotonic
+ * queue, so window values are differences of two samples and the front of that queue.
+ *
+ * The distributions behind the averages are kept in QuantileSketches since attach(): the queue of every approach
+ * and the total queue of the Intersection each tick, and the delay of every departing vehicle. Departures are
+ * matched to arrivals first in, first out, so a vehicle's delay is the ticks from the one it joined the queue on to
+ * the one it finished crossing on. Vehicles already queued at attach() count from attach(). The sketches of
+ * DelayMetrics on other Intersections, threads or runs merge exactly, e.g. for network-wide p99 queues.
+ */
+class DelayMetrics{
+public:
+    /**
+     * @brief Statistics of one lane group, or an Intersection, over some span of ticks.
+     */
+    struct Summary{
+        unsigned long arrivals;         ///< Vehicles that joined the queue
+        unsigned long departures;       ///< Vehicles that finished crossing
+        double totalDelay;              ///< Vehicle seconds spent in the queue
+        double averageDelay;            ///< totalDelay / departures in seconds, 0 without departures
+        unsigned int maxQueue;          ///< The longest queue seen
+        double throughput;              ///< Departures per hour
+        double duration;                ///< The span in seconds
+    };
+
+protected:
+    /**
+     * @brief The curves of a lane group since attach().
+     */
+    struct Sample{
+        unsigned long arrivals;         ///< A(t) - A(attach)
+        unsigned long departures;       ///< D(t) - D(attach)
+        unsigned long delayTicks;       ///< Area between the curves in vehicle ticks
+    };
+
+    /**
+     * @brief The running state of one lane group.
+     */
+    struct Lane{
+        bool valid;                                             ///< False where the Intersection has no TurnOption
+        unsigned long baseArrivals;                             ///< TurnOption::getCumulativeArrivals() when attached
+        unsigned long baseDepartures;                           ///< TurnOption::getCumulativeDepartures() when attached
+        Sample current;                                         ///< The curves now
+        Sample windowStart;                                     ///< The curves at the start of the window
+        unsigned int maxQueue;                                  ///< The longest queue since attach()
+        unsigned int bucketMaxQueue;                            ///< The longest queue in the bucket in progress
+        std::vector<Sample> bucketSamples;                      ///< Ring of the curves at the last numBuckets bucket boundaries
+        std::vector<std::pair<unsigned long, unsigned int>> maxQueues;  ///< Ring of (bucket, max queue), decreasing max queue
+        size_t maxQueuesHead;                                   ///< Index of the oldest entry in maxQueues
+        size_t maxQueuesSize;                                   ///< Number of entries in maxQueues
+        std::vector<unsigned long> arrivalTicks;                ///< Ring of the tick each queued vehicle arrived on, oldest first
+        size_t arrivalTicksHead;                                ///< Index of the oldest entry in arrivalTicks
+        size_t arrivalTicksSize;                                ///< Number of queued vehicles in arrivalTicks
+    };
+
+    std::array<Lane, NUM_LANE_GROUPS> lanes;    ///< One per lane group, indexed by Road::laneGroupIdx()
+    double windowSeconds;                       ///< Length of the window in seconds
+    double bucketSeconds;                       ///< Length of a bucket in seconds
+    long bucketTicks;                           ///< bucketSeconds converted to ticks when attached
+    size_t numBuckets;                          ///< Finished buckets in the window
+    int refreshRate;                            ///< refreshRateHzGlobal when attached, converts ticks to seconds
+    unsigned long numTicks;                     ///< Ticks since attach()
+    unsigned long numBucketsFinished;           ///< Bucket boundaries passed since attach()
+    std::array<QuantileSketch, Road::numRoadDirections> queueSketches;  ///< Vehicles queued on each approach every tick
+    std::array<QuantileSketch, Road::numRoadDirections> delaySketches;  ///< Seconds from arrival to departure of every vehicle of each approach
+    QuantileSketch intersectionQueueSketch;     ///< Vehicles queued at the Intersection every tick
+    QuantileSketch intersectionDelaySketch;     ///< Seconds from arrival to departure of every vehicle
+
+    /**
+     * @brief Matches "numArrived" new arrivals and "numDeparted" departures of "lane" first in, first out and adds
+     *          the delay of each departed vehicle to the sketches of approach "dir".
+     */
+    void updateDelays(Lane& lane, Road::RoadDirection dir, unsigned long numArrived, unsigned long numDeparted);
+
+    /**
+     * @brief Builds a Summary from curve differences, a max queue and a span of ticks.
+     */
+    Summary summarize(const Sample& from, const Sample& to, unsigned int maxQueue, unsigned long spanTicks);
+
+    /**
+     * @brief Gets the first tick of the window, counted from attach()
+     */
+    unsigned long windowStartTick();
+
+    /**
+     * @brief Gets lane group "lane" of an attached Intersection.
+     *
+     * @throws std::invalid_argument if the Intersection has no such TurnOption
+     */
+    Lane& getLane(Road::RoadDirection dir, TurnOption::Type turn);
+
+public:
+    /**
+     * @brief Creates metrics with a sliding window of "window" seconds that slides "bucket" seconds at a time, and
+     *          quantile sketches of relative accuracy "sketchAccuracy".
+     *
+     * @throws std::domain_error if "bucket" is not positive or longer than "window", or "sketchAccuracy" is not in (0, 1)
+     */
+    DelayMetrics(double window=DEFAULT_METRICS_WINDOW_SECONDS, double bucket=DEFAULT_METRICS_BUCKET_SECONDS, double sketchAccuracy=DEFAULT_SKETCH_ACCURACY);
+
+    /**
+     * @brief Starts measuring "inter" from its current curves, dropping earlier statistics.
+     *
+     * @note Called by Intersection::setDelayMetrics()
+     *
+     * @throws std::domain_error if a bucket is shorter than a tick at the current refresh rate
+     */
+    void attach(Intersection& inter);
+
+    /**
+     * @brief Adds one tick to the statistics of every lane group of "inter". Called at the end of Intersection::tick().
+     */
+    void update(Intersection& inter);
+
+    /**
+     * @brief Gets the statistics of the "turn" TurnOption of the Road facing "dir" since attach().
+     *
+     * @throws std::invalid_argument if the Intersection has no such TurnOption
+     */
+    Summary getTotal(Road::RoadDirection dir, TurnOption::Type turn);
+
+    /**
+     * @brief Gets the statistics of the "turn" TurnOption of the Road facing "dir" over the sliding window.
+     *
+     * @throws std::invalid_argument if the Intersection has no such TurnOption
+     */
+    Summary getWindow(Road::RoadDirection dir, TurnOption::Type turn);
+
+    /**
+     * @brief Gets the statistics of every TurnOption added together since attach(). maxQueue is the longest queue
+     *          of any one TurnOption.
+     */
+    Summary getIntersectionTotal();
+
+    /**
+     * @brief Gets the statistics of every TurnOption added together over the sliding window.
+     */
+    Summary getIntersectionWindow();
+
+    /**
+     * @brief Gets the sketch of the number of vehicles queued on the Road facing "dir", one value per tick.
+     *
+     * @throws std::out_of_range if "dir" is not a RoadDirection
+     */
+    const QuantileSketch& getQueueSketch(Road::RoadDirection dir);
+
+    /**
+     * @brief Gets the sketch of the delay in seconds of every vehicle that departed from the Road facing "dir".
+     *
+     * @throws std::out_of_range if "dir" is not a RoadDirection
+     */
+    const QuantileSketch& getDelaySketch(Road::RoadDirection dir);
+
+    const QuantileSketch& getIntersectionQueueSketch(){ return intersectionQueueSketch; }
+    const QuantileSketch& getIntersectionDelaySketch(){ return intersectionDelaySketch; }
+
+    unsigned long getNumTicks(){ return numTicks; }
+    double getWindowSeconds(){ return windowSeconds; }
+
+    /**
+     * @brief Prints the statistics since attach() of every TurnOption and the Intersection, and the queue and delay
+     *          percentiles of every approach, to "out".
+     */
+    void printSummary(std::ostream& out=std::cout);
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef DEMAND_READER_H
+#define DEMAND_READER_H
+
+#include <array>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Intersection.h"
+
+#define DEFAULT_DEMAND_BIN_SECONDS  (900.0)         ///< Loop detector counts are binned every 15 minutes
+#define DEFAULT_DEMAND_CHUNK_BYTES  (1 << 20)       ///< Bytes read from the file at a time
+
+/**
+ * @brief One row of a demand file: "count" vehicles arrive at a lane group during the bin starting at "startSeconds".
+ */
+struct DemandRecord{
+    double startSeconds;            ///< Start of the bin in seconds since the start of the simulation
+    Road::RoadDirection direction;  ///< The Road the vehicles arrive on
+    TurnOption::Type turn;          ///< The TurnOption the vehicles queue in
+    unsigned long count;            ///< The number of vehicles arriving during the bin
+};
+
+/**
+ * @class DemandReader
+ * @brief Streams time of day demand from a CSV file of binned counts and feeds it to an Intersection as the simulation runs.
+ *
+ * Each row is "startSeconds,direction,turn,count". Directions are north, east, south, west or 0-3 and turns are left,
+ * straight, right or 0-2. Rows must be ordered by startSeconds. Blank lines, lines starting with '#' and a header row
+ * are skipped.
+ *
+ * The file is read DEFAULT_DEMAND_CHUNK_BYTES at a time into one buffer and rows are tokenized in place without copying,
+ * so memory use does not depend on the size of the file. The count of a bin is spread evenly over its ticks.
+ */
+class DemandReader{
+protected:
+    /**
+     * @brief The bin currently feeding a lane group.
+     */
+    struct ActiveBin{
+        unsigned long startTick;    ///< The first tick of the bin
+        unsigned long count;        ///< Vehicles to add over the bin
+        bool active;                ///< False before the first bin of the lane group
+    };
+
+    std::FILE* file;                                    ///< The demand file
+    std::string path;                                   ///< Path to the demand file, used in error messages
+    double binDuration;                                 ///< The duration of every bin in seconds
+    std::vector<char> buffer;                           ///< The chunk of the file being tokenized
+    size_t bufferPos;                                   ///< Start of the next unread line in buffer
+    size_t bufferEnd;                                   ///< End of the valid bytes in buffer
+    bool endOfFile;                                     ///< True once the last chunk has been read
+    unsigned long lineNumber;                           ///< The line number of the last line read
+    unsigned long bytesRead;                            ///< Total bytes read from the file
+    unsigned long numRecords;                           ///< Rows parsed so far
+    double lastStartSeconds;                            ///< startSeconds of the last row, rows must not go back in time
+    DemandRecord pending;                               ///< The next row to be fed
+    bool hasPending;                                    ///< True while pending holds a row that has not been fed
+    std::array<ActiveBin, NUM_LANE_GROUPS> bins;        ///< The bin feeding each lane group
+    unsigned long numFed;                               ///< Vehicles added to queues
+    unsigned long numBlocked;                           ///< Vehicles that did not fit in a full queue or whose TurnOption does not exist
+
+    /**
+     * @brief Gets the next line of the file, reading another chunk when the buffer runs out.
+     *
+     * @param line  set to the line without its newline, valid until the next call
+     * @return false at the end of the file
+     */
+    bool nextLine(std::string_view& line);
+
+    /**
+     * @brief Parses one row into "record".
+     *
+     * @return false if "line" is blank, a comment or the header
+     *
+     * @throws std::runtime_error if the row is malformed
+     */
+    bool parseLine(std::string_view line, DemandRecord& record);
+
+    /**
+     * @brief Throws a std::runtime_error naming the file and the current line
+     */
+    [[noreturn]] void parseError(const std::string& reason);
+
+public:
+    /**
+     * @brief Opens the demand file at "filePath".
+     *
+     * @param filePath      the CSV file
+     * @param binSeconds    (optional) the duration of every bin in seconds
+     * @param chunkBytes    (optional) bytes read at a time, rows longer than this grow the buffer
+     *
+     * @throws std::runtime_error if the file can not be opened
+     * @throws std::domain_error if "binSeconds" or "chunkBytes" is not positive
+     */
+    DemandReader(const std::string& filePath, double binSeconds=DEFAULT_DEMAND_BIN_SECONDS, size_t chunkBytes=DEFAULT_DEMAND_CHUNK_BYTES);
+
+    ~DemandReader();
+
+    DemandReader(const DemandReader&) = delete;
+    DemandReader& operator=(const DemandReader&) = delete;
+
+    /**
+     * @brief Parses the next row of the file.
+     *
+     * @param record filled with the row
+     * @return false at the end of the file
+     *
+     * @throws std::runtime_error if a row is malformed or goes back in time
+     */
+    bool nextRecord(DemandRecord& record);
+
+    /**
+     * @brief Adds this tick's share of every active bin to the queues of "inter" with Intersection::addVehicles().
+     *          Rows are read up to the current tick, inter.time(). Call once per tick before Intersection::tick().
+     *
+     * @return the number of vehicles added
+     */
+    int feed(Intersection& inter);
+
+    unsigned long getBytesRead(){ return bytesRead; }
+    unsigned long getNumRecords(){ return numRecords; }
+    unsigned long getNumFed(){ return numFed; }
+    unsigned long getNumBlocked(){ return numBlocked; }
+    double getBinDuration(){ return binDuration; }
+};
+
+#endif
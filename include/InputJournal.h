@@ -0,0 +1,137 @@
+#ifndef INPUT_JOURNAL_H
+#define INPUT_JOURNAL_H
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "Intersection.h"
+
+#define JOURNAL_MAGIC                       "STJRNL\r\n"    ///< First 8 bytes of every journal file
+#define JOURNAL_VERSION                     (1)             ///< Bumped whenever the encoding of an event changes
+#define DEFAULT_JOURNAL_CHECKPOINT_TICKS    (3000)          ///< Ticks between state digests, 1 minute at 50 Hz
+
+/**
+ * @class InputJournal
+ * @brief A compact binary log of every external input to one Intersection, with the tick it arrived on, that can be
+ *          replayed to reproduce the run exactly.
+ *
+ * Attached with Intersection::setJournal(), the Intersection records each call to addVehicles(), addMaxVehicles(),
+ * schedule(), clearSchedule(), setAllLightDurations(), start(), nextLightConfig(), setAllRedDuration() and
+ * setAutoSequence(). Everything else the simulation does follows from these and the state the journal started from.
+ *
+ * An event is a varint tick delta from the previous event, an opcode byte and varint arguments. Durations are stored
+ * as raw doubles so they replay bit for bit. A typical addVehicles() event takes 4 bytes. Every checkpointInterval
+ * ticks tick() also records a CompactIntersection::hash() of the state, which replay() checks against.
+ *
+ * @note An ArrivalGenerator is deterministic in its seed and is not journaled, attach the same one when replaying.
+ */
+class InputJournal{
+public:
+    enum Opcode {addVehiclesOp, addMaxVehiclesOp, scheduleOp, clearScheduleOp, setAllLightDurationsOp, startOp,
+                 nextLightConfigOp, setAllRedDurationOp, setAutoSequenceOp, checkpointOp, numOpcodes};
+
+    /**
+     * @brief The first bytes of a journal file, followed by the encoded events.
+     */
+    struct Header{
+        char     magic[8];              ///< JOURNAL_MAGIC
+        uint32_t version;               ///< JOURNAL_VERSION
+        uint32_t reserved;              ///< Padding, always 0
+        uint64_t startTick;             ///< Intersection::time() when recording began
+        uint64_t lastTick;              ///< Tick of the last event
+        uint64_t numEvents;             ///< The number of events
+        uint64_t numBytes;              ///< Size of the encoded events
+        uint64_t checkpointInterval;    ///< Ticks between checkpoints, 0 for none
+    };
+
+protected:
+    std::vector<uint8_t> events;        ///< The encoded events
+    unsigned long startTick;            ///< Intersection::time() when recording began
+    unsigned long lastTick;             ///< Tick of the last event, the next event stores its tick relative to it
+    unsigned long numEvents;            ///< The number of events
+    unsigned long checkpointInterval;   ///< Ticks between checkpoints, 0 for none
+
+    /**
+     * @brief Appends the tick delta and opcode that start every event.
+     *
+     * @throws std::logic_error if "tick" is before the last event
+     */
+    void beginEvent(unsigned long tick, Opcode op);
+
+    /**
+     * @brief Decodes the arguments of one event at "pos" and makes the call it records on "inter".
+     *
+     * @throws std::runtime_error if the event is malformed or a checkpoint does not match the state of "inter"
+     */
+    void applyEvent(Opcode op, const uint8_t*& pos, const uint8_t* end, Intersection& inter);
+
+public:
+    /**
+     * @brief Creates an empty journal.
+     *
+     * @param firstTick         (optional) Intersection::time() of the Intersection it will be attached to
+     * @param checkpointTicks   (optional) ticks between state digests, 0 for none
+     */
+    InputJournal(unsigned long firstTick=0, unsigned long checkpointTicks=DEFAULT_JOURNAL_CHECKPOINT_TICKS);
+
+    void recordAddVehicles(unsigned long tick, Road::RoadDirection dir, TurnOption::Type turn, int numVehiclesToAdd);
+    void recordAddMaxVehicles(unsigned long tick);
+    void recordSchedule(unsigned long tick, LightConfig::Option configOpt, Road::RoadDirection direction, double duration, double yellowDuration);
+    void recordClearSchedule(unsigned long tick);
+    void recordSetAllLightDurations(unsigned long tick, int onDur, int yellowDur);
+    void recordStart(unsigned long tick);
+    void recordNextLightConfig(unsigned long tick);
+    void recordSetAllRedDuration(unsigned long tick, double seconds);
+    void recordSetAutoSequence(unsigned long tick, bool enable);
+
+    /**
+     * @brief Checks if tick() should record a checkpoint now that the Intersection has reached "tick"
+     */
+    bool checkpointDue(unsigned long tick){ return checkpointInterval != 0 && tick % checkpointInterval == 0; }
+
+    /**
+     * @brief Records a digest of the current state of "inter".
+     */
+    void recordCheckpoint(Intersection& inter);
+
+    /**
+     * @brief Feeds the journal back into "inter" as fast as possible: the Intersection is moved with
+     *          Intersection::advance() to the tick of each event and the recorded call is made. Checkpoints are
+     *          compared with the replayed state. Finally "inter" is moved on to "endTick".
+     *
+     * @param inter     An Intersection in the state the journal started from, e.g. restored from a Snapshot taken
+     *                  when recording began, with the same exit roads and ArrivalGenerator
+     * @param endTick   The tick to stop at, events after it are not replayed
+     *
+     * @return the number of events replayed
+     *
+     * @throws std::logic_error if inter.time() is not the tick the journal started at
+     * @throws std::runtime_error if the journal is malformed or the replay diverges from a checkpoint
+     */
+    unsigned long replay(Intersection& inter, unsigned long endTick);
+
+    /**
+     * @brief Writes the journal to a new file at "path".
+     *
+     * @throws std::runtime_error if the file can not be written
+     */
+    void save(const std::string& path);
+
+    /**
+     * @brief Reads a journal written by save().
+     *
+     * @throws std::runtime_error if the file can not be read, is not a journal, has another version or is truncated
+     */
+    static InputJournal load(const std::string& path);
+
+    unsigned long getStartTick(){ return startTick; }
+    unsigned long getLastTick(){ return lastTick; }
+    unsigned long getNumEvents(){ return numEvents; }
+    size_t getNumBytes(){ return events.size(); }
+    unsigned long getCheckpointInterval(){ return checkpointInterval; }
+};
+
+static_assert(std::is_trivially_copyable<InputJournal::Header>::value, "InputJournal::Header is written to disk as raw bytes");
+
+#endif
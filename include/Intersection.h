@@ -2,13 +2,24 @@
 #define INTERSECTION_H
 
 #include <array>
+#include <stdexcept>
 #include <vector>
 #include "TrafficLight.h"
 #include "Road.h"
 #include "LightConfig.h"
+#include "SignalPlan.h"
+#include "SignalPolicy.h"
 
 #define MIN_NUM_ROADS    (3)
 
+class ArrivalGenerator;
+class InputJournal;
+class LightHistory;
+class DelayMetrics;
+class VehiclePool;
+class RoadNetwork;
+class SignalController;
+
 /// #defines used for the print() function
 #define MAX_LEN_RIGHT    (10)
 #define MAX_LEN_LEFT     (9)
@@ -38,6 +49,51 @@ protected:
     unsigned long configScheduleIdx;                            ///< The index in configSchedule indicating the LightConfig the Intersecion is currently on.
     int numUnfinishedLights;                                    ///< The number of lights for the current config that have not yet turned red     
     unsigned long ticksSinceStart;                              ///< Total number of times tick() has been called on this Intersection
+    SignalPlan plan;                                            ///< configSchedule compiled into a table of phases
+    bool planIsStale;                                           ///< True when configSchedule or the Roads changed since plan was compiled
+    bool autoSequence;                                          ///< When true tick() moves to the next LightConfig as soon as the current one finishes
+    double allRedDuration;                                      ///< Seconds every light stays red between two LightConfigs
+    int clearanceTicksRemaining;                                ///< Ticks of all-red left before the next LightConfig, -1 while lights are unfinished
+    ArrivalGenerator* arrivals;                                 ///< Adds vehicles to the queues at the start of every tick, NULL for none. Not owned.
+    InputJournal* journal;                                      ///< Records every external input, NULL for none. Not owned.
+    LightHistory* lightHistory;                                 ///< Records every light color change, NULL for none. Not owned.
+    DelayMetrics* metrics;                                      ///< Updated from the cumulative curves at the end of every tick, NULL for none. Not owned.
+    VehiclePool* vehiclePool;                                   ///< Holds a record of every queued vehicle in agent mode, NULL in the count-based mode. Not owned.
+    RoadNetwork* network;                                       ///< Routes vehicles with a destination and adds the origin-destination demand, NULL outside a network. Not owned.
+    int networkNode;                                            ///< The node of the Intersection in network, -1 outside a network
+    SignalController* controller;                               ///< Picks the next LightConfig and may end greens early, NULL for the fixed round-robin. Not owned.
+    unsigned long phaseGreenTicks;                              ///< Ticks a light of the current LightConfig has been green, counted while a controller is set
+    unsigned long phaseIdleTicks;                               ///< Ticks in a row the lanes of the current LightConfig have been empty while green
+    unsigned long layoutVersion;                                ///< Bumped whenever the Roads, exit Roads or the schedule change
+
+    /**
+     * @brief A clone handed out by fork(), kept to be handed out again.
+     */
+    struct Fork{
+        Intersection* clone;                                    ///< The clone. Owned.
+        std::array<Road*, Road::numRoadDirections> exitRoads;   ///< The exit Roads of the clone. Owned.
+        ArrivalGenerator* arrivals;                             ///< The copy of arrivals the clone draws from, NULL for none. Owned.
+        unsigned long layoutVersion;                            ///< layoutVersion the clone was built at
+        bool inUse;                                             ///< True from fork() until releaseFork()
+    };
+
+    std::vector<Fork> forks;                                    ///< Every clone built by fork()
+
+    /**
+     * @brief Builds the clone of "fork": Roads, exit Roads and schedule laid out as in this Intersection.
+     */
+    void buildFork(Fork& fork);
+
+    /**
+     * @brief Deletes the clone of "fork" with its exit Roads and ArrivalGenerator.
+     */
+    static void deleteFork(Fork& fork);
+
+    /**
+     * @brief Copies the state of this Intersection into the clone of "fork", which has the same layout: lights,
+     *          queues, crossing vehicles, exit queues, sequencing and the arrivals.
+     */
+    void copyToFork(Fork& fork);
 
     /**
      * @brief Checks to see if "light" should be ticked and updates the Intersections
@@ -46,6 +102,55 @@ protected:
      * @param light the TrafficLight object to be checked
      */
     void handleLightTick(TrafficLight* light);
+
+    /**
+     * @brief Counts down the all-red clearance once every light of the current LightConfig is red and
+     *          moves to the next LightConfig when it runs out. LightConfigs that finish immediately are skipped.
+     * 
+     * @note Called by tick() when autoSequence is set
+     *
+     * @param policy    picks the next LightConfig, NULL for the round-robin
+     */
+    template <typename Policy>
+    void sequenceLightConfigs(Policy* policy);
+
+    /**
+     * @brief The start of tick(): adds the arrivals, moves vehicles and ticks the lights.
+     */
+    void beginTick();
+
+    /**
+     * @brief The end of tick(): counts the tick, updates the metrics and records a due checkpoint.
+     *
+     * @return the number of unfinished lights in the Intersection.
+     */
+    int endTick();
+
+    /**
+     * @brief Gets the length in ticks after which the light state of the Intersection repeats: the SignalPlan
+     *          cycle when sequencing, otherwise 1 as the lights stay red once the LightConfig finishes.
+     */
+    long repeatPeriod();
+
+    /**
+     * @brief Counts the green and idle ticks of the current LightConfig and turns its green lights yellow when the
+     *          SignalController ends the green.
+     *
+     * @note Called by tick() while a SignalController is set
+     */
+    template <typename Policy>
+    void actuate(Policy& policy);
+
+    /**
+     * @brief Fills "queues" with the number of vehicles queued in every exit TurnOption, indexed by Road::laneGroupIdx().
+     */
+    void getExitQueues(std::array<unsigned int, NUM_LANE_GROUPS>& queues);
+
+    /**
+     * @brief Fills the arrays with TurnOption::getCumulativeArrivals() and getCumulativeDepartures() of every lane
+     *          group, indexed by Road::laneGroupIdx(). 0 where there is no TurnOption.
+     */
+    void getCumulativeCurves(std::array<unsigned long, NUM_LANE_GROUPS>& cumulativeArrivals, std::array<unsigned long, NUM_LANE_GROUPS>& cumulativeDepartures);
     
     /**
      * @brief Advances vehicles currenly crossing intersection and adds new vehicles to cross
@@ -97,15 +202,45 @@ protected:
     void printHelper(Road::RoadDirection dir, std::string& outStr);
 
     /**
-     * @brief Sets the Intersection to the "idx" LightConfig in the schedule vector.
+     * @brief Sets the Intersection to the "idx" LightConfig in the schedule vector by starting the lights
+     *          of the "idx" phase of the compiled SignalPlan.
      *
-     * @param idx       The idx of the desired LightConfig in configSchedule vector
+     * @param idx         The idx of the desired LightConfig in configSchedule vector
+     * @param greenTicks  (optional) Ticks the lights stay on before turning yellow, -1 for the scheduled duration
      *
-     * @return false if any of the specified Roads are NULL of if an unhandled LightConfig::Option is requested.
+     * @return false if any of the specified Roads are NULL.
+     * 
+     * @throws std::out_of_range if an unhandled LightConfig::Option is requested.
     */
-    bool setLightConfig(int idx);
+    bool setLightConfig(int idx, int greenTicks=-1);
+
+    /**
+     * @brief Moves to the next LightConfig in configSchedule, looping back to the first after the last, or to the
+     *          one the SignalController picks.
+     *
+     * @note nextLightConfig() for the sequencer, the move is not journaled as it follows from the schedule.
+     *
+     * @throws std::out_of_range if the SignalController picks a LightConfig that is not in the schedule
+     *
+     * @return false if the scheduled LightConfig fails
+     */
+    bool stepLightConfig();
+
+    /**
+     * @brief stepLightConfig() with "policy" picking the next LightConfig, NULL for the round-robin.
+     */
+    template <typename Policy>
+    bool stepLightConfig(Policy* policy);
 
 public:
+    friend class CompactIntersection; ///< Friend class CompactIntersection.
+    friend class Snapshot; ///< Friend class Snapshot.
+    friend class RoadNetwork; ///< Friend class RoadNetwork.
+    friend class PredictiveController; ///< Friend class PredictiveController.
+    friend class ScheduleOptimizer; ///< Friend class ScheduleOptimizer.
+    friend class CorridorCoordinator; ///< Friend class CorridorCoordinator.
+    friend class LockstepVariants; ///< Friend class LockstepVariants.
+
     Intersection();
 
     ~Intersection();
@@ -123,12 +258,73 @@ public:
 
     /**
      * @brief Call tick() for all TrafficLights in this Intersection and advance
-     *  vehicles waiting at each light accordingly.
+     *  vehicles waiting at each light accordingly. With setAutoSequence(true) the next LightConfig
+     *  is also started on the tick the current one finishes.
      *
      * @return the number of unfinished lights in the Intersection.
     */
     int tick();
 
+    /**
+     * @brief tick() with "policy" in place of the SignalController. The calls to the policy are resolved at compile
+     *          time and can be inlined into the tick, giving a fleet of one strategy the speed of the fixed schedule.
+     *          Mixed fleets set a SignalController on each Intersection, or wrap a policy in PolicyController.
+     *
+     * @note Ticks made this way are only reproduced by InputJournal::replay() with the same policy set as the
+     *          SignalController.
+     *
+     * @return the number of unfinished lights in the Intersection.
+     */
+    template <SignalPolicy Policy>
+    int tick(Policy& policy);
+
+    /**
+     * @brief Gets an independent copy of the Intersection to simulate what-ifs on, e.g. ticking it 60 seconds after
+     *          starting another LightConfig, without touching this one. The copy has its own Roads, lights, queues,
+     *          schedule, exit Roads and a copy of the ArrivalGenerator, so it sees the same arrivals, and shares the
+     *          SignalController.
+     *
+     * Copies are kept for reuse: once released, the next fork() copies only the state into one, about a memcpy of
+     * every lane group, as long as the Roads, exit Roads and schedule have not changed since it was built.
+     *
+     * @note Copies run count-based, outside any journal, LightHistory, DelayMetrics, VehiclePool and RoadNetwork.
+     *
+     * @return the copy, owned by this Intersection and valid until releaseFork() or its destruction
+     */
+    Intersection* fork();
+
+    /**
+     * @brief Hands a copy made by fork() back for reuse.
+     *
+     * @throws std::invalid_argument if "clone" is not a copy of this Intersection in use
+     */
+    void releaseFork(Intersection* clone);
+
+    int getNumForks(){ return (int)forks.size(); }
+
+    /**
+     * @brief Moves the Intersection "ticks" ticks forward, leaving it in exactly the state "ticks" calls to tick()
+     *          would.
+     *
+     * One period of the signal cycle is stepped and the state at both ends compared. Once the lights, queues and
+     * crossing vehicles of the Intersection and its exit queues repeat, i.e. queues have drained or saturated,
+     * every following period is identical and all remaining whole periods are applied at once by moving the clock
+     * and adding the vehicles each period directs. Otherwise the next period is stepped and compared again.
+     *
+     * @note Console messages, e.g. traffic jams, are only printed for the periods that are stepped.
+     * @note With an ArrivalGenerator set every tick is stepped unless its arrivals repeat every period, see
+     *          ArrivalGenerator::repeatStart(), random arrivals never do. So is every tick while a
+     *          LightHistory, DelayMetrics or VehiclePool is attached, to record each color change, queue length and
+     *          vehicle, and while the Intersection is part of a RoadNetwork, whose demand never repeats either, or
+     *          a SignalController is set, whose phases need not repeat. An InputJournal also gets every tick, so
+     *          each checkpoint is recorded, and so does a state CompactIntersection::pack() can not hold.
+     *
+     * @param ticks the number of ticks to move forward
+     *
+     * @return the number of unfinished lights in the Intersection.
+     */
+    int advance(unsigned long ticks);
+
     /**
      * @brief Add a LightConfig to the end of the Intersections current configSchedule vector
      *
@@ -156,6 +352,21 @@ public:
     */
     bool start();
 
+    /**
+     * @brief Begins light operation as start() would have "cycleTick" ticks ago, i.e. "cycleTick" ticks into the
+     *          cycle of the fixed schedule. The offset of the Intersection in a coordinated corridor.
+     *
+     * Every light is turned red first. The lights and sequencer are stepped on a copy from fork() and their state
+     * copied back, so neither the clock nor any vehicle moves.
+     *
+     * @param cycleTick ticks into the cycle, wrapping around whole cycles
+     *
+     * @throws std::logic_error if a journal is attached, the offset could not be replayed
+     *
+     * @return false if there is an error
+     */
+    bool startAt(unsigned long cycleTick);
+
     /**
      * @brief Sets the Intersection to the next scheduled LightConfig in configSchedule. If the last
      *          LightConfig is reached, loop back to the first LightConfig.
@@ -171,6 +382,112 @@ public:
      */
     LightConfig* currentLightConfig(){ return configSchedule.at(configScheduleIdx); }
 
+    unsigned long getConfigScheduleIdx(){ return configScheduleIdx; }
+
+    /**
+     * @brief Lets tick() sequence the schedule: the next LightConfig starts on the exact tick the last light
+     *          of the current one turns red, after the all-red clearance. Off by default, nextLightConfig()
+     *          must then be called by the driver.
+     * 
+     * @param enable true to sequence LightConfigs in tick()
+     */
+    void setAutoSequence(bool enable);
+    bool getAutoSequence(){ return autoSequence; }
+
+    /**
+     * @brief Sets how long every light stays red between the end of one LightConfig and the start of the next.
+     * 
+     * @param seconds the all-red clearance interval in seconds, 0 to start the next LightConfig immediately
+     * 
+     * @throws std::domain_error if "seconds" is negative
+     */
+    void setAllRedDuration(double seconds);
+    double getAllRedDuration(){ return allRedDuration; }
+
+    /**
+     * @brief Sets the ArrivalGenerator that adds vehicles to the queues at the start of every tick.
+     * 
+     * @param generator the ArrivalGenerator, NULL to stop arrivals. The Intersection does not take ownership.
+     */
+    void setArrivals(ArrivalGenerator* generator){ arrivals = generator; }
+    ArrivalGenerator* getArrivals(){ return arrivals; }
+
+    /**
+     * @brief Sets the InputJournal that records every external input to the Intersection from now on, so the run
+     *          can be reproduced with InputJournal::replay().
+     * 
+     * @param inputJournal the InputJournal, NULL to stop recording. The Intersection does not take ownership.
+     */
+    void setJournal(InputJournal* inputJournal){ journal = inputJournal; }
+    InputJournal* getJournal(){ return journal; }
+
+    /**
+     * @brief Sets the LightHistory that records the color changes of every light from now on. Add the Roads first,
+     *          lights added later are not recorded.
+     * 
+     * @param history the LightHistory, NULL to stop recording. The Intersection does not take ownership, the history
+     *          must be detached before it is destroyed.
+     *
+     * @throws std::logic_error if "history" is already attached to another Intersection
+     */
+    void setLightHistory(LightHistory* history);
+    LightHistory* getLightHistory(){ return lightHistory; }
+
+    /**
+     * @brief Sets the DelayMetrics that derive delay, queue and throughput statistics from the cumulative arrival
+     *          and departure curves of every TurnOption, starting now.
+     * 
+     * @param delayMetrics the DelayMetrics, NULL to stop updating them. The Intersection does not take ownership.
+     */
+    void setDelayMetrics(DelayMetrics* delayMetrics);
+    DelayMetrics* getDelayMetrics(){ return metrics; }
+
+    /**
+     * @brief Switches every TurnOption to agent mode, holding a VehicleRecord from "pool" for each queued vehicle.
+     *          Add the Roads first.
+     * 
+     * @param pool the VehiclePool, NULL to return to the count-based mode. The Intersection does not take ownership.
+     *
+     * @throws std::logic_error if a TurnOption is already in agent mode with another pool
+     * @throws std::length_error if "pool" has no room for the TurnOptions
+     */
+    void setVehiclePool(VehiclePool* pool);
+    VehiclePool* getVehiclePool(){ return vehiclePool; }
+
+    /**
+     * @brief Gets the RoadNetwork the Intersection was added to with RoadNetwork::addIntersection(), NULL for none.
+     */
+    RoadNetwork* getRoadNetwork(){ return network; }
+    int getNetworkNode(){ return networkNode; }
+
+    /**
+     * @brief Sets the SignalController that picks the next LightConfig from the schedule and how long it stays green,
+     *          instead of the fixed round-robin. Takes effect at the next change of LightConfig.
+     * 
+     * @param signalController the SignalController, NULL for the fixed round-robin. The Intersection does not take
+     *          ownership.
+     */
+    void setSignalController(SignalController* signalController);
+    SignalController* getSignalController(){ return controller; }
+
+    /**
+     * @brief Compiles configSchedule into the SignalPlan used to start each LightConfig.
+     * 
+     * @note Called automatically when the schedule, the Roads or the refresh rate change. Call it again if
+     *          light yellow durations are changed by hand after start().
+     *
+     * @return SignalPlan& the compiled plan
+     */
+    SignalPlan& compileSchedule();
+
+    /**
+     * @brief Gets the compiled SignalPlan, compiling it first if it is out of date. Cycle length and
+     *          phase timing can be read from it without simulating.
+     * 
+     * @return SignalPlan& the compiled plan
+     */
+    SignalPlan& getSignalPlan();
+
     /**
      * @brief Sets two opposite roads green. Allowing both straight and right Road::turnOptions for both Roads.
      *
@@ -228,6 +545,15 @@ public:
      */
     Road* getExitRoad(Road::RoadDirection startDir, TurnOption::Type turnOpt);
 
+    /**
+     * @brief Gets the TurnOption vehicles making turn "turnOpt" from Road "startDir" queue in, the one of the same
+     *          type on the exit Road or its straight TurnOption if that one is not valid. Routed vehicles may join
+     *          another, see RoadNetwork.
+     * 
+     * @return TurnOption* the exit TurnOption, NULL if there is no exit Road
+     */
+    TurnOption* getExitTurnOption(Road::RoadDirection startDir, TurnOption::Type turnOpt);
+
     /**
      * @brief Creates new Road while checking to make sure it conforms with other Roads already present.
      * 
@@ -314,4 +640,100 @@ public:
     void print();
 };
 
+template <typename Policy>
+void Intersection::sequenceLightConfigs(Policy* policy){
+    if(numUnfinishedLights > 0 || configSchedule.empty()){
+        return;
+    }
+
+    if(clearanceTicksRemaining < 0){
+        /// The last light turned red on this tick
+        clearanceTicksRemaining = getSignalPlan().getClearanceTicks();
+    }
+    else if(clearanceTicksRemaining > 0){
+        clearanceTicksRemaining--;
+    }
+
+    /// A cycle of zero length would never end, nor would a policy picking only LightConfigs that finish at once
+    for(int i=0; clearanceTicksRemaining == 0 && getSignalPlan().getCycleLength() != 0 && (policy == NULL || i < getSignalPlan().getNumPhases()); i++){
+        stepLightConfig(policy);
+    }
+}
+
+template <typename Policy>
+void Intersection::actuate(Policy& policy){
+    const SignalPlan::Phase& phase = getSignalPlan().getPhase(configScheduleIdx);
+    bool isGreen = false;
+    bool isIdle = true;
+
+    for(const SignalPlan::LightStart& lightStart : phase.lightStarts){
+        isGreen = isGreen || lightStart.light->isGreen();
+        isIdle = isIdle && roads[Road::laneGroupDirection(lightStart.laneGroup)]->getTurnOption(Road::laneGroupTurn(lightStart.laneGroup))->queueIsEmpty();
+    }
+
+    if( ! isGreen){
+        return;
+    }
+
+    phaseGreenTicks++;
+    phaseIdleTicks = isIdle ? phaseIdleTicks + 1 : 0;
+
+    if(policy.endGreen(*this, configScheduleIdx, phaseGreenTicks, phaseIdleTicks)){
+        for(const SignalPlan::LightStart& lightStart : phase.lightStarts){
+            if(lightStart.light->isGreen()){
+                /// Goes yellow now rather than on the next tick
+                lightStart.light->ticksRemaining = 0;
+                lightStart.light->nextState();
+            }
+        }
+    }
+}
+
+template <typename Policy>
+bool Intersection::stepLightConfig(Policy* policy){
+    bool configSuccess;
+    int greenTicks = -1;
+
+    if(policy != NULL){
+        PhaseDecision decision = policy->nextPhase(*this, configScheduleIdx);
+
+        if(decision.phase < 0 || decision.phase >= (int)configSchedule.size()){
+            throw std::out_of_range("Intersection::nextLightConfig() the SignalController picked a LightConfig that is not scheduled");
+        }
+
+        configScheduleIdx = decision.phase;
+        greenTicks = decision.greenTicks;
+    }
+    else{
+        configScheduleIdx++;
+
+        if(configScheduleIdx >= configSchedule.size()){
+            /// Loop the LightConfigs in configSchedule
+            configScheduleIdx = 0;
+        }
+    }
+
+    configSuccess = setLightConfig(configScheduleIdx, greenTicks);
+    if( ! configSuccess){
+        throw std::runtime_error("Intersection::nextLightConfig() error, invalid LightConfig\n");
+    }
+
+    return configSuccess;
+}
+
+template <SignalPolicy Policy>
+int Intersection::tick(Policy& policy){
+    beginTick();
+
+    if(numUnfinishedLights > 0){
+        actuate(policy);
+    }
+
+    if(autoSequence){
+        sequenceLightConfigs(&policy);
+    }
+
+    return endTick();
+}
+
 #endif
\ No newline at end of file
@@ -15,7 +15,7 @@ public:
     /**
      * @brief The possible configurations for a Road or Roads in an Intersection.
      *
-     * @warning if a new option is added, a new switch case must be added to Intersection::setLightConfig()
+     * @warning if a new option is added, a new switch case must be added to SignalPlan::compile()
     */
     enum Option {doubleGreen, singleGreen, doubleGreenLeft, numConfigOptions};
 
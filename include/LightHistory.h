@@ -0,0 +1,135 @@
+#ifndef LIGHT_HISTORY_H
+#define LIGHT_HISTORY_H
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "Intersection.h"
+
+class LightHistory;
+
+/**
+ * @class LightLog
+ * @brief The color history of one TrafficLight as a run-length encoded log: one entry per color change.
+ *
+ * Each run is packed into 8 bytes, its start tick shifted past the 3 bits of its color, so runs sorted by start
+ * tick are also sorted as integers and a binary search over them finds the run covering any tick.
+ */
+class LightLog{
+public:
+    /**
+     * @brief A span of ticks the light stayed one color, from startTick until the start of the next run.
+     */
+    struct Run{
+        unsigned long startTick;            ///< The first tick shown in "color"
+        TrafficLight::AvailableColors color; ///< The color of the light
+    };
+
+protected:
+    std::deque<uint64_t> runs;  ///< Packed runs, oldest first
+    LightHistory* history;      ///< Supplies the current tick and the retention window
+
+    static uint64_t packRun(unsigned long startTick, int color){ return ((uint64_t)startTick << 3) | color; }
+    static Run unpackRun(uint64_t packed){ return {(unsigned long)(packed >> 3), (TrafficLight::AvailableColors)(packed & 7)}; }
+
+    /**
+     * @brief Gets the index of the run covering "tick".
+     *
+     * @throws std::out_of_range if "tick" is before the oldest run or after the current tick
+     */
+    size_t findRun(unsigned long tick) const;
+
+public:
+    LightLog(LightHistory* owner, TrafficLight::AvailableColors initialColor);
+
+    /**
+     * @brief Starts a new run of "color" at the current tick and drops runs that ended before the retention window.
+     *          Called by the TrafficLight whenever its color is set.
+     */
+    void record(TrafficLight::AvailableColors color);
+
+    /**
+     * @brief Gets the color the light showed at "tick".
+     *
+     * @throws std::out_of_range if "tick" is no longer retained or has not happened yet
+     */
+    TrafficLight::AvailableColors colorAt(unsigned long tick) const;
+
+    /**
+     * @brief Fills "out" with every run overlapping the ticks [fromTick, toTick). The first run may start before
+     *          "fromTick".
+     *
+     * @throws std::out_of_range if "fromTick" is no longer retained or "toTick" - 1 has not happened yet
+     */
+    void getRuns(unsigned long fromTick, unsigned long toTick, std::vector<Run>& out) const;
+
+    size_t getNumRuns() const{ return runs.size(); }
+    unsigned long getOldestTick() const{ return unpackRun(runs.front()).startTick; }
+};
+
+/**
+ * @class LightHistory
+ * @brief Records every color change of the lights of an Intersection so that the color of any light at any past tick
+ *          can be looked up in O(log n).
+ *
+ * Attach with Intersection::setLightHistory() once the Roads have been added. Each TrafficLight then reports its
+ * color changes from setColor() and nextState() to its LightLog. Runs that ended more than retentionTicks ago are
+ * dropped, so memory is bounded by the color changes within the window.
+ *
+ * A light changing color during tick T shows the new color from tick T + 1, the state Intersection::time() reports
+ * once tick() returns. Changes made between ticks, e.g. by Intersection::start(), show from the current tick.
+ *
+ * @note Intersection::advance() steps every tick while a LightHistory is attached.
+ */
+class LightHistory{
+protected:
+    std::array<LightLog*, NUM_LANE_GROUPS> logs;    ///< One log per lane group, NULL where there is no light
+    unsigned long now;                              ///< The tick color changes are recorded at
+    unsigned long retentionTicks;                   ///< Runs that ended longer ago than this are dropped, 0 keeps every run
+
+public:
+    friend class LightLog; ///< Friend class LightLog.
+    friend class Intersection; ///< Friend class Intersection.
+
+    /**
+     * @brief Creates a history that keeps the last "retention" ticks, 0 to keep everything.
+     */
+    LightHistory(unsigned long retention=0);
+
+    ~LightHistory();
+
+    LightHistory(const LightHistory&) = delete;
+    LightHistory& operator=(const LightHistory&) = delete;
+
+    /**
+     * @brief Creates a LightLog for every light of "inter" starting at its current color and inter.time().
+     *
+     * @note Called by Intersection::setLightHistory()
+     *
+     * @throws std::logic_error if the history is already attached to lights
+     */
+    void attach(Intersection& inter);
+
+    /**
+     * @brief Gets the log of the "turn" light on the Road facing "dir", NULL if the light did not exist when attached.
+     */
+    LightLog* getLog(Road::RoadDirection dir, TurnOption::Type turn){ return logs.at(Road::laneGroupIdx(dir, turn)); }
+
+    /**
+     * @brief Gets the color of the "turn" light on the Road facing "dir" at "tick".
+     *
+     * @throws std::invalid_argument if there is no such light
+     * @throws std::out_of_range if "tick" is no longer retained or has not happened yet
+     */
+    TrafficLight::AvailableColors colorAt(Road::RoadDirection dir, TurnOption::Type turn, unsigned long tick);
+
+    unsigned long getRetentionTicks(){ return retentionTicks; }
+
+    /**
+     * @brief Gets the total number of runs held by every log.
+     */
+    size_t getNumRuns();
+};
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef LOCKSTEP_VARIANTS_H
+#define LOCKSTEP_VARIANTS_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "Intersection.h"
+#include "ArrivalGenerator.h"
+
+#ifndef LOCKSTEP_WIDTH
+#define LOCKSTEP_WIDTH                  (8)     ///< Variants one pass of the tick kernel advances, 16 fills an AVX-512 register
+#endif
+static_assert(LOCKSTEP_WIDTH >= 4 && (LOCKSTEP_WIDTH & (LOCKSTEP_WIDTH - 1)) == 0, "LOCKSTEP_WIDTH must be a power of two of at least 4, drawWords() fills 4 lanes per SSE2 chunk");
+#define LOCKSTEP_MIN_BLOCKS_PER_THREAD  (4)     ///< Fewer blocks than this per thread are ticked on fewer threads
+
+/**
+ * @class LockstepVariants
+ * @brief Ticks many variants of one Intersection in lockstep, e.g. for sensitivity analysis: lane k of every vector
+ *          holds the state of variant k of a block, so one pass of the tick kernel advances #LOCKSTEP_WIDTH variants.
+ *
+ * The variants are Intersections built the same way: the same Roads, TurnOptions, exit Roads and LightConfig options and
+ * directions. Durations, all-red clearances, queue limits, crossing times, queues, lights and arrivals may all differ.
+ * load() copies their state into the blocks, tick() advances every variant and store() writes the state back, after
+ * which every variant is in the state tick() would have left it in, its ArrivalGenerator counters included.
+ *
+ * The state is kept as one vector per quantity and lane group, a structure of arrays, and every branch of
+ * Intersection::tick() becomes a mask, so variants in different colors or phases still share the pass. The vectors use
+ * GCC vector extensions and compile to whatever SIMD the target has. Blocks are independent and split across threads in
+ * contiguous runs. Arrivals are drawn from the ArrivalGenerator of every variant, the Philox4x32 rounds of all the
+ * variants of a block in one pass.
+ *
+ * @note Variants must run the fixed schedule, without a SignalController, journal, LightHistory, DelayMetrics,
+ *          VehiclePool or RoadNetwork, and with the default TrafficLight TransitionTables. Counters are kept in 32 bits
+ *          between load() and store().
+ */
+class LockstepVariants{
+public:
+    /**
+     * @brief One value per variant of a block. Comparisons give -1 in the lanes where they hold, 0 elsewhere.
+     */
+    typedef int32_t Lanes __attribute__((vector_size(LOCKSTEP_WIDTH * sizeof(int32_t))));
+
+protected:
+    typedef std::array<Lanes, NUM_LANE_GROUPS> GroupLanes;
+
+    /**
+     * @brief The state of #LOCKSTEP_WIDTH variants. Lanes past the last variant repeat it without arrivals.
+     */
+    struct Block{
+        GroupLanes color;               ///< TrafficLight::AvailableColors of every light
+        GroupLanes ticksRemaining;
+        GroupLanes onTicks;             ///< The onColor duration of every light
+        GroupLanes yellowTicks;
+        GroupLanes redTicks;
+        GroupLanes lastPhase;           ///< The phase that last started every light, -1 if none since load()
+        GroupLanes lastYellowPhase;     ///< The phase that last set the yellow duration of every light, -1 if none
+        GroupLanes queued;
+        GroupLanes progress;            ///< TurnOption::currentVehicleProgress
+        GroupLanes crossing;            ///< TurnOption::numVehiclesCurrentlyCrossing
+        GroupLanes timeToCross;         ///< Ticks
+        GroupLanes maxQueued;           ///< TurnOption::getMaxNumVehicles()
+        GroupLanes arrivals;            ///< Vehicles admitted to every queue since load()
+        GroupLanes departures;          ///< Vehicles that finished crossing since load()
+        GroupLanes exitQueued;          ///< Vehicles queued in every exit TurnOption
+        GroupLanes exitMaxQueued;
+        GroupLanes exitArrivals;        ///< Vehicles admitted to every exit TurnOption since load()
+        Lanes configScheduleIdx;
+        Lanes numUnfinishedLights;
+        Lanes clearanceTicksRemaining;
+        Lanes clearanceTicks;           ///< The all-red clearance of every variant
+        Lanes cycles;                   ///< -1 where the cycle has a length, as Intersection::sequenceLightConfigs()
+        Lanes injected;                 ///< Arrivals added since load()
+        Lanes blocked;                  ///< Arrivals turned away since load()
+        Lanes queuedTicks;              ///< Vehicle-ticks queued since the last flush into vehicleTicks
+        std::vector<Lanes> startOnTicks;        ///< [light start] onColor duration set by its phase
+        std::vector<Lanes> startYellowTicks;    ///< [light start] yellow duration set by its phase
+        std::vector<Lanes> startSetsYellow;     ///< [light start] -1 where the phase sets the yellow duration
+        Lanes keyLow;                   ///< Low word of the ArrivalGenerator seed of every variant
+        Lanes keyHigh;                  ///< High word of the ArrivalGenerator seed of every variant
+        Lanes streamId;                 ///< ArrivalGenerator intersectionId of every variant
+        std::vector<Lanes> arrivalBatch;        ///< [tick][lane group] arrivals of #ARRIVAL_BATCH_TICKS ticks
+        unsigned long batchStartTick;           ///< The first tick of arrivalBatch
+        bool batchIsValid;
+        std::array<unsigned long, LOCKSTEP_WIDTH> vehicleTicks; ///< Vehicle-ticks queued since load()
+    };
+
+    std::vector<Intersection*> variants;        ///< Not owned
+    std::vector<Block> blocks;
+    unsigned int numThreads;                    ///< Most threads ticking
+    bool drainExits;                            ///< True to empty the exit TurnOptions at the end of every tick
+
+    /// The layout shared by every variant, read from the first one
+    std::vector<int> validGroups;               ///< Lane groups with a TurnOption, in the order tick() visits them
+    std::array<int, NUM_LANE_GROUPS> numLanes;
+    std::array<int, NUM_LANE_GROUPS> onColor;
+    std::array<int, NUM_LANE_GROUPS> exitGroup; ///< The lane group of the exit TurnOption of every lane group
+    std::vector<int> exitGroups;                ///< Every lane group of an exit TurnOption
+    std::vector<int> startGroups;               ///< [light start] the lane group of every light started by a phase
+    std::vector<int> phaseFirstStart;           ///< The first light start of every phase, one past the last at the end
+    bool autoSequence;
+    unsigned long ticksSinceStart;
+    int loadedRefreshRate;                      ///< refreshRateHzGlobal the durations were read at
+
+    /**
+     * @brief Reads the layout of "inter" into the shared layout, or checks "inter" has it.
+     *
+     * @throws std::invalid_argument if "inter" does not match or uses something the kernel does not model
+     */
+    void readLayout(Intersection& inter, bool isFirst);
+
+    /**
+     * @brief Copies the state of "inter" into lane "lane" of "blk".
+     */
+    void loadLane(Block& blk, int lane, Intersection& inter);
+
+    /**
+     * @brief Fills the arrival batch of "blk" starting at "tick", the same counts as ArrivalGenerator::generate().
+     */
+    void generateArrivals(size_t block, unsigned long tick);
+
+    /**
+     * @brief Sets "words" to the words Philox4x32::generate() gives every variant of "blk" for lane group "group" at
+     *          draw "draw", the ticks from draw * ARRIVAL_TICKS_PER_DRAW on. All variants in one pass.
+     */
+    static void drawWords(const Block& blk, unsigned long draw, int group, std::array<Lanes, ARRIVAL_TICKS_PER_DRAW>& words);
+
+    /**
+     * @brief Adds the vehicle-ticks queued so far to the counters of every variant of "blk".
+     */
+    static void flushQueuedTicks(Block& blk);
+
+    /**
+     * @brief Advances the variants of "blk" one tick, the same steps as Intersection::tick().
+     */
+    void tickBlock(Block& blk, unsigned long tick);
+
+    /**
+     * @brief Calls "fn" for every block, split across threads.
+     */
+    template <typename Fn>
+    void forEachBlock(Fn fn);
+
+    static bool anyLane(const Lanes& mask);
+
+public:
+    /**
+     * @param scenarioVariants  the Intersections ticked in lockstep, started and at the same time()
+     * @param drainExitRoads    true to empty the exit TurnOptions at the end of every tick, as TrafficEnv does
+     * @param threads           the most threads ticking, 0 for one per hardware thread
+     *
+     * @throws std::invalid_argument if there are no variants or they do not share a layout, see load()
+     */
+    LockstepVariants(const std::vector<Intersection*>& scenarioVariants, bool drainExitRoads=false, unsigned int threads=0);
+
+    /**
+     * @brief Copies the state of every variant into the blocks and clears the counters.
+     *
+     * @throws std::invalid_argument if the variants are at different times, differ in their Roads, TurnOption lanes,
+     *          exit Roads, LightConfig options and directions or automatic sequencing, miss an exit TurnOption, or
+     *          have a SignalController, journal, LightHistory, DelayMetrics, VehiclePool or RoadNetwork set or a
+     *          TrafficLight with its own TransitionTable
+     */
+    void load();
+
+    /**
+     * @brief Advances every variant "ticks" ticks. The Intersections themselves do not move until store().
+     *
+     * @throws std::logic_error if refreshRateHzGlobal changed since load()
+     */
+    void tick(unsigned long ticks=1);
+
+    /**
+     * @brief Writes the state of every variant back into its Intersection and ArrivalGenerator.
+     */
+    void store();
+
+    /**
+     * @brief Gets the vehicle-seconds variant "variant" has spent queued since load(), counted at the end of every tick.
+     */
+    double getDelay(size_t variant);
+
+    unsigned int getQueuedVehicles(size_t variant, Road::RoadDirection dir, TurnOption::Type turn);
+    TrafficLight::AvailableColors getColor(size_t variant, Road::RoadDirection dir, TurnOption::Type turn);
+    int getTicksRemaining(size_t variant, Road::RoadDirection dir, TurnOption::Type turn);
+    size_t getNumVariants(){ return variants.size(); }
+    size_t getNumBlocks(){ return blocks.size(); }
+    unsigned int getNumThreads(){ return numThreads; }
+    unsigned long time(){ return ticksSinceStart; }
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <array>
+#include <cstdint>
+
+#define PHILOX_M0       (0xD2511F53u)
+#define PHILOX_M1       (0xCD9E8D57u)
+#define PHILOX_W0       (0x9E3779B9u)
+#define PHILOX_W1       (0xBB67AE85u)
+#define PHILOX_ROUNDS   (10)
+
+/**
+ * @class Philox4x32
+ * @brief The Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel Random Numbers:
+ *          As Easy as 1, 2, 3").
+ *
+ * Instead of advancing a hidden state, every output is a pure function of a 128 bit counter and a 64 bit key.
+ * Any (counter, key) can be drawn in any order from any thread, so a value keyed by e.g. (tick, lane) is the same
+ * no matter how the simulation is split up or which ticks are skipped.
+ */
+class Philox4x32{
+public:
+    typedef std::array<uint32_t, 4> Counter;
+    typedef std::array<uint32_t, 2> Key;
+
+    /**
+     * @brief Generates the four random words for "counter" under "key".
+     */
+    static Counter generate(Counter counter, Key key);
+
+    /**
+     * @brief Maps a random word to a double uniformly distributed in (0, 1). Never returns 0 or 1.
+     */
+    static double toUniform(uint32_t word){ return (word + 0.5) * (1.0 / 4294967296.0); }
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef PREDICTIVE_CONTROLLER_H
+#define PREDICTIVE_CONTROLLER_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SignalController.h"
+#include "QuantileSketch.h"
+
+#define MPC_MAX_HORIZON_PHASES      (4)     ///< The longest LightConfig sequence a rollout plays
+#define MPC_MAX_CANDIDATES          (256)   ///< The most sequences scored per decision
+#define DEFAULT_MPC_HORIZON_PHASES  (2)     ///< LightConfigs in every candidate sequence
+#define DEFAULT_MPC_HORIZON_SECONDS (30.0)  ///< Seconds every rollout is simulated
+
+/**
+ * @class PredictiveController
+ * @brief Model-predictive control: at every phase boundary each sequence of the next LightConfigs is simulated on a
+ *          copy of the Intersection from Intersection::fork() and the first LightConfig of the sequence with the
+ *          least delay starts.
+ *
+ * The candidates are every sequence of horizonPhases valid LightConfigs, scored in order starting with the one after
+ * the current LightConfig so ties follow the schedule. A rollout starts its sequence on the copy, follows the schedule
+ * once the sequence is played, and runs horizonSeconds. Its cost is the vehicle-ticks spent queued, the delay.
+ *
+ * Rollouts run on a pool of threads kept between decisions, the calling thread included. Copies are forked on the
+ * calling thread and reused across decisions, so a decision allocates nothing once the first one has built them.
+ * The latency of every decision and of its fork and rollout stages is kept in QuantileSketches, in nanoseconds.
+ *
+ * @note Greens always last their scheduled duration.
+ */
+class PredictiveController final : public SignalController{
+protected:
+    /**
+     * @brief A candidate sequence of LightConfigs simulated on a copy of the Intersection.
+     */
+    struct Rollout{
+        Intersection* clone;                                ///< The copy, from Intersection::fork()
+        std::array<int, MPC_MAX_HORIZON_PHASES> phases;     ///< The sequence
+        unsigned long cost;                                 ///< Vehicle-ticks queued over the horizon
+    };
+
+    /**
+     * @brief Plays a sequence of LightConfigs, then the schedule in order.
+     */
+    struct SequencePolicy{
+        const int* phases;      ///< The sequence
+        int numPhases;          ///< Its length
+        int next;               ///< The next one to start
+
+        PhaseDecision nextPhase(Intersection& inter, int current){
+            if(next < numPhases){
+                return {phases[next++], -1};
+            }
+            return {(current + 1) % inter.getSignalPlan().getNumPhases(), -1};
+        }
+        bool endGreen(Intersection& inter, int phase, unsigned long greenTicks, unsigned long idleTicks){ return false; }
+    };
+
+    int horizonPhases;                      ///< LightConfigs in every candidate sequence
+    double horizonSeconds;                  ///< Seconds every rollout is simulated
+    unsigned int numThreads;                ///< Threads running rollouts, the calling thread included
+    std::vector<int> validPhases;           ///< The valid LightConfigs of the Intersection deciding
+    std::vector<Rollout> rollouts;          ///< The candidates of the current decision
+    int rolloutTicks;                       ///< horizonSeconds in ticks for the current decision
+
+    std::vector<std::thread> workers;       ///< The pool, numThreads - 1 threads
+    std::mutex poolMutex;                   ///< Guards the fields below
+    std::condition_variable workReady;      ///< Signalled when a decision has rollouts to run
+    std::condition_variable workDone;       ///< Signalled when the last rollout of a decision finishes or the last worker leaves it
+    unsigned long generation;               ///< Decisions handed to the pool
+    size_t numFinished;                     ///< Rollouts of the current decision finished
+    unsigned int numActive;                 ///< Workers woken for the current decision still taking rollouts
+    bool stopping;                          ///< Set to end the workers
+    std::atomic<size_t> nextRollout;        ///< The next rollout to take
+
+    QuantileSketch latencies;               ///< Nanoseconds per decision
+    QuantileSketch forkLatencies;           ///< Nanoseconds forking the copies of a decision
+    QuantileSketch rolloutLatencies;        ///< Nanoseconds running the rollouts of a decision
+    unsigned long numDecisions;             ///< nextPhase() calls since creation
+
+    /**
+     * @brief Simulates "rollout" on its copy and sets its cost.
+     */
+    void runRollout(Rollout& rollout);
+
+    /**
+     * @brief Takes rollouts of the current decision until none are left.
+     */
+    void takeRollouts();
+
+    /**
+     * @brief The loop of every thread of the pool.
+     */
+    void workerLoop();
+
+public:
+    /**
+     * @param phases    LightConfigs in every candidate sequence
+     * @param seconds   seconds every rollout is simulated
+     * @param threads   threads running rollouts, the calling thread included, 0 for one per hardware thread
+     *
+     * @throws std::domain_error if "phases" is not in [1, #MPC_MAX_HORIZON_PHASES] or "seconds" is not positive
+     */
+    PredictiveController(int phases=DEFAULT_MPC_HORIZON_PHASES, double seconds=DEFAULT_MPC_HORIZON_SECONDS, unsigned int threads=0);
+
+    ~PredictiveController();
+
+    PredictiveController(const PredictiveController&) = delete;
+    PredictiveController& operator=(const PredictiveController&) = delete;
+
+    /**
+     * @brief Scores every candidate sequence and picks the first LightConfig of the best.
+     *
+     * @throws std::invalid_argument if the Intersection has more candidate sequences than #MPC_MAX_CANDIDATES
+     */
+    Decision nextPhase(Intersection& inter, int current) override;
+
+    bool endGreen(Intersection& inter, int phase, unsigned long greenTicks, unsigned long idleTicks) override { return false; }
+
+    int getHorizonPhases(){ return horizonPhases; }
+    double getHorizonSeconds(){ return horizonSeconds; }
+    unsigned int getNumThreads(){ return numThreads; }
+    unsigned long getNumDecisions(){ return numDecisions; }
+    const QuantileSketch& getLatencies(){ return latencies; }
+    const QuantileSketch& getForkLatencies(){ return forkLatencies; }
+    const QuantileSketch& getRolloutLatencies(){ return rolloutLatencies; }
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include <cstdint>
+#include <vector>
+
+#define DEFAULT_SKETCH_ACCURACY     (0.01)      ///< Quantiles within 1% of the true value
+#define DEFAULT_SKETCH_MAX_BUCKETS  (2048)      ///< Covers values from 1 to about 10^17 at 1% before collapsing
+
+/**
+ * @class QuantileSketch
+ * @brief A streaming quantile sketch of non-negative values with a relative accuracy guarantee, in the style of
+ *          DDSketch.
+ *
+ * A value x > 0 is counted in bucket ceil(log(x) / log(gamma)) where gamma = (1 + a) / (1 - a) for an accuracy a,
+ * so every value in a bucket is within a of the bucket's representative value. Zeros, e.g. empty queues, have their
+ * own count. The buckets are plain counts, so merging two sketches adds them: a merge is exact and gives the same
+ * sketch as adding every value to one sketch, in any order, across threads or runs.
+ *
+ * At most maxBuckets buckets are kept. Past that the lowest buckets are folded into the lowest one kept, a rule that
+ * depends only on the highest bucket and so keeps merges exact. Only quantiles that land in the folded bucket lose
+ * the accuracy guarantee.
+ */
+class QuantileSketch{
+protected:
+    double relativeAccuracy;            ///< Every quantile is within this fraction of the true value
+    double logGamma;                    ///< log((1 + relativeAccuracy) / (1 - relativeAccuracy))
+    size_t maxBuckets;                  ///< The most buckets kept before the lowest are folded
+    std::vector<uint64_t> buckets;      ///< Counts of buckets minIndex, minIndex + 1, ...
+    int minIndex;                       ///< The bucket counted in buckets[0]
+    uint64_t zeroCount;                 ///< Number of values equal to 0
+    uint64_t count;                     ///< Number of values added
+    double minValue;                    ///< The smallest value added
+    double maxValue;                    ///< The largest value added
+
+    int bucketIndex(double value) const;
+    double bucketValue(int index) const;
+
+    /**
+     * @brief Adds "n" to bucket "index", growing the buckets and folding the lowest past maxBuckets.
+     */
+    void addToBucket(int index, uint64_t n);
+
+public:
+    /**
+     * @brief Creates an empty sketch.
+     *
+     * @param accuracy      the relative accuracy of quantiles, in (0, 1)
+     * @param numBuckets    the most buckets kept, at least 2
+     *
+     * @throws std::domain_error if "accuracy" or "numBuckets" is out of range
+     */
+    QuantileSketch(double accuracy=DEFAULT_SKETCH_ACCURACY, size_t numBuckets=DEFAULT_SKETCH_MAX_BUCKETS);
+
+    /**
+     * @brief Adds "n" copies of "value".
+     *
+     * @throws std::domain_error if "value" is negative, infinite or NaN
+     */
+    void add(double value, uint64_t n=1);
+
+    /**
+     * @brief Adds every value of "other" to this sketch.
+     *
+     * @throws std::invalid_argument if "other" has a different accuracy or bucket limit
+     */
+    void merge(const QuantileSketch& other);
+
+    /**
+     * @brief Gets the value at quantile "q", e.g. 0.99 for the 99th percentile.
+     *
+     * @throws std::domain_error if "q" is not in [0, 1]
+     * @throws std::logic_error if the sketch is empty
+     */
+    double quantile(double q) const;
+
+    /**
+     * @brief Removes every value.
+     */
+    void clear();
+
+    uint64_t getCount() const{ return count; }
+    double getMin() const{ return minValue; }
+    double getMax() const{ return maxValue; }
+    size_t getNumBuckets() const{ return buckets.size(); }
+    double getRelativeAccuracy() const{ return relativeAccuracy; }
+
+    /**
+     * @brief True if both sketches hold the same counts in the same buckets.
+     */
+    bool operator==(const QuantileSketch& other) const;
+
+    /**
+     * @brief Appends the sketch to "out" as varints, to merge the results of runs in other processes.
+     */
+    void serialize(std::vector<uint8_t>& out) const;
+
+    /**
+     * @brief Reads a sketch written by serialize() from the "size" bytes at "data".
+     *
+     * @throws std::runtime_error if the bytes are not a valid sketch
+     */
+    static QuantileSketch deserialize(const uint8_t* data, size_t size);
+};
+
+#endif
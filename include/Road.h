@@ -99,6 +99,22 @@ public:
      */
     static RoadDirection roadOppositeOf(RoadDirection dir);
 
+    /**
+     * @brief Gets the lane group index of the "turn" TurnOption of the Road facing "dir". Every
+     *          (RoadDirection, TurnOption::Type) pair of an Intersection has its own index.
+     * 
+     * @param dir   The direction of the Road
+     * @param turn  The TurnOption of the Road
+     * @return int between 0 and (#NUM_LANE_GROUPS - 1)
+     */
+    static int laneGroupIdx(RoadDirection dir, TurnOption::Type turn){ return ((int)dir * TurnOption::numTurnOptions) + turn; }
+
+    /**
+     * @brief Gets the Road direction and TurnOption of lane group "idx", the inverse of laneGroupIdx()
+     */
+    static RoadDirection laneGroupDirection(int idx){ return (RoadDirection)(idx / TurnOption::numTurnOptions); }
+    static TurnOption::Type laneGroupTurn(int idx){ return (TurnOption::Type)(idx % TurnOption::numTurnOptions); }
+
     /**
      * @brief Sets this Road's green light. Allows straight travel and right turns if available.
      *
@@ -156,4 +172,6 @@ public:
     std::vector<TrafficLight*> getLights();
 };
 
+#define NUM_LANE_GROUPS ((int)Road::numRoadDirections * (int)TurnOption::numTurnOptions)
+
 #endif
\ No newline at end of file
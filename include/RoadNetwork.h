@@ -0,0 +1,277 @@
+#ifndef ROAD_NETWORK_H
+#define ROAD_NETWORK_H
+
+#include <cstdint>
+#include <vector>
+#include "Intersection.h"
+#include "VehiclePool.h"
+
+#define ROUTE_DESTINATION_FLAG      (0x80000000u)   ///< Set in VehicleRecord::routeIndex of vehicles with a destination
+#define NO_NEXT_HOP                 (0xff)          ///< Next hop table entry of a destination that cannot be reached
+#define UNREACHABLE_HOPS            (0xffff)        ///< Hop count table entry of a destination that cannot be reached
+#define ROUTING_MIN_DESTINATIONS_PER_THREAD (16)    ///< Fewer destinations than this per thread are built on fewer threads
+
+/**
+ * @class RoadNetwork
+ * @brief Connects Intersections into a road graph and routes vehicles with a destination through it.
+ *
+ * Every exit Road of every Intersection is a link. A link either continues into a Road of another Intersection of
+ * the network, set with connect(), or leaves the network. Each link leaving the network is a destination, numbered
+ * destination(node, exitDir). A state is a Road of an Intersection, where vehicles queue before choosing a turn.
+ *
+ * For every destination the next hop table holds the turn to take from every state on a path with the fewest
+ * Intersections to the destination, found by a breadth first search backwards from it. Destinations are independent
+ * so the tables are built in parallel. Routing a vehicle is then one lookup, nextHops[destination row][state], where
+ * only links leaving the network when the tables were sized have a row. Connecting, closing or opening a link only
+ * rebuilds the destinations whose paths it can change.
+ *
+ * Routing applies in agent mode: a vehicle with a destination joins the TurnOption the table gives for the Road it
+ * crosses into, instead of the TurnOption matching the turn it made. Vehicles without one, or whose destination
+ * cannot be reached, keep the default behavior. Origin-destination demand added with addDemand() creates such
+ * vehicles at the start of every tick.
+ *
+ * @note Closing a link only stops routing onto it, vehicles already queued for it still cross.
+ * @note Call invalidate() after adding Roads or TurnOptions to an Intersection of the network.
+ */
+class RoadNetwork{
+public:
+    /**
+     * @brief An exit Road of an Intersection of the network.
+     */
+    struct Link{
+        int toNode;                     ///< The Intersection the link continues into, -1 if it leaves the network
+        Road::RoadDirection toRoad;     ///< The Road of toNode the link is
+        bool open;                      ///< False when closed, no vehicle is routed onto it
+    };
+
+protected:
+    /**
+     * @brief Vehicles per hour from a Road of an Intersection to a destination.
+     */
+    struct Demand{
+        Road::RoadDirection road;       ///< The Road the vehicles arrive on
+        uint32_t destination;           ///< Where they are headed
+        double vehiclesPerHour;         ///< The Poisson rate
+        double meanPerTick;             ///< vehiclesPerHour per tick at compiledRefreshRate
+        double expNegMean;              ///< exp(-meanPerTick)
+    };
+
+    std::vector<Intersection*> nodes;               ///< The Intersections, indexed by node. Not owned.
+    std::vector<Link> links;                        ///< Every exit Road, indexed by node * numRoadDirections + exit direction
+    std::vector<int> upstreamLinks;                 ///< The link feeding every state, -1 for none
+    std::vector<uint8_t> validTurns;                ///< Bit mask of the valid TurnOptions of every state
+    Road::RoadDirection approaches[Road::numRoadDirections][TurnOption::numTurnOptions];   ///< The Road a turn onto each exit is made from
+    std::vector<int> destinationRows;               ///< The table row of every destination, -1 for links inside the network when the tables were last sized
+    std::vector<uint8_t> nextHops;                  ///< The turn to take, [destination row][state]
+    std::vector<uint16_t> hopCounts;                ///< Intersections left to cross, [destination row][state]
+    size_t numStates;                               ///< States covered by the tables
+    size_t numRows;                                 ///< Destination rows in the tables
+    bool tablesAreStale;                            ///< True when every destination must be rebuilt
+    std::vector<bool> staleDestinations;            ///< Destinations to rebuild
+    unsigned int numThreads;                        ///< Most threads building the tables
+    unsigned long numRebuilt;                       ///< Destinations built since creation
+
+    std::vector<std::vector<Demand>> demands;       ///< The demand arriving at every node
+    uint64_t seed;                                  ///< The RNG key of the demand
+    int compiledRefreshRate;                        ///< refreshRateHzGlobal the demand was converted at, 0 if stale
+    unsigned long numODArrivals;                    ///< Vehicles with a destination added to queues
+    unsigned long numBlockedArrivals;               ///< Vehicles turned away by full queues
+    unsigned long numUnroutable;                    ///< Vehicles not added as their destination cannot be reached
+
+    /**
+     * @brief Gets the link index of exit "exitDir" of "node".
+     *
+     * @throws std::out_of_range if "node" is not in the network
+     */
+    size_t linkIdx(int node, Road::RoadDirection exitDir);
+
+    /**
+     * @brief Gets the index of "dest" and "state" in the tables.
+     *
+     * @return the index, -1 if the tables have no entry for them
+     */
+    long tableIdx(uint32_t dest, size_t state);
+
+    /**
+     * @brief Rebuilds the next hop and hop count tables of "destination" with a breadth first search backwards.
+     *
+     * @param queue a buffer for the search, so threads reuse their own
+     */
+    void buildDestination(uint32_t destination, std::vector<uint32_t>& queue);
+
+    /**
+     * @brief Marks stale every destination with a path through link "link".
+     */
+    void linkRemoved(size_t link);
+
+    /**
+     * @brief Marks stale every destination whose paths link "link" may shorten or tie.
+     */
+    void linkAdded(size_t link);
+
+    /**
+     * @brief Converts every Demand to mean arrivals per tick at refreshRateHzGlobal.
+     *
+     * @throws std::domain_error if a rate exceeds ARRIVAL_MAX_MEAN_PER_TICK vehicles per tick
+     */
+    void compileDemand();
+
+public:
+    /**
+     * @brief Creates an empty network.
+     *
+     * @param rngSeed   the key of the random draws of the demand
+     * @param threads   the most threads building the tables, 0 for one per hardware thread
+     */
+    RoadNetwork(uint64_t rngSeed=0, unsigned int threads=0);
+
+    ~RoadNetwork();
+
+    RoadNetwork(const RoadNetwork&) = delete;
+    RoadNetwork& operator=(const RoadNetwork&) = delete;
+
+    /**
+     * @brief Adds "inter" to the network. Add its Roads first. Every exit Road of it leaves the network until
+     *          connected.
+     *
+     * @return the node of "inter"
+     *
+     * @throws std::logic_error if "inter" is already part of a network
+     */
+    int addIntersection(Intersection& inter);
+
+    /**
+     * @brief Connects exit "exitDir" of "fromNode" to the Road facing "roadDir" of "toNode", setting it as the
+     *          exit Road. The link no longer leaves the network and stops being a destination.
+     *
+     * @throws std::out_of_range if a node is not in the network
+     * @throws std::invalid_argument if "toNode" has no Road facing "roadDir"
+     * @throws std::logic_error if the link is already connected or the Road is already fed by another link
+     */
+    void connect(int fromNode, Road::RoadDirection exitDir, int toNode, Road::RoadDirection roadDir);
+
+    /**
+     * @brief Closes exit "exitDir" of "node". Vehicles are no longer routed onto it.
+     *
+     * @throws std::out_of_range if "node" is not in the network
+     */
+    void closeRoad(int node, Road::RoadDirection exitDir);
+
+    /**
+     * @brief Opens exit "exitDir" of "node" again after closeRoad().
+     *
+     * @throws std::out_of_range if "node" is not in the network
+     */
+    void openRoad(int node, Road::RoadDirection exitDir);
+
+    /**
+     * @brief Marks every destination stale, e.g. after Roads were added to an Intersection of the network.
+     */
+    void invalidate(){ tablesAreStale = true; }
+
+    /**
+     * @brief Rebuilds the tables of the stale destinations, in parallel. Does nothing when none are stale.
+     *
+     * @note Called by tick(). Call it before ticking the Intersections directly.
+     *
+     * @return the number of destinations rebuilt
+     */
+    int updateTables();
+
+    /**
+     * @brief Gets the destination of vehicles leaving the network by exit "exitDir" of "node".
+     *
+     * @throws std::out_of_range if "node" is not in the network
+     */
+    uint32_t destination(int node, Road::RoadDirection exitDir){ return (uint32_t)linkIdx(node, exitDir); }
+
+    /**
+     * @brief Gets the turn a vehicle on the Road facing "road" of "node" takes towards "dest", as of the last
+     *          updateTables().
+     *
+     * @return the turn, TurnOption::numTurnOptions if "dest" cannot be reached from there
+     *
+     * @throws std::out_of_range if "node" or "dest" is not in the network
+     */
+    TurnOption::Type nextTurn(int node, Road::RoadDirection road, uint32_t dest);
+
+    /**
+     * @brief Gets the number of Intersections a vehicle on the Road facing "road" of "node" crosses to reach
+     *          "dest", as of the last updateTables().
+     *
+     * @return the number of Intersections, -1 if "dest" cannot be reached from there
+     *
+     * @throws std::out_of_range if "node" or "dest" is not in the network
+     */
+    int hopCount(int node, Road::RoadDirection road, uint32_t dest);
+
+    /**
+     * @brief Gets the state vehicles leaving "node" by exit "exitDir" queue in next.
+     *
+     * @return the state, -1 if the link leaves the network
+     */
+    long downstreamState(int node, Road::RoadDirection exitDir);
+
+    /**
+     * @brief Gets the TurnOption "vehicle" joins on state "state". One table lookup.
+     *
+     * @return the TurnOption, NULL if the vehicle has no destination or it cannot be reached
+     */
+    TurnOption* laneFor(const VehicleRecord& vehicle, long state);
+
+    /**
+     * @brief Moves the "numFinished" oldest vehicles of "from" that finished crossing into state "state", each to
+     *          the TurnOption laneFor() gives it or "fallback" without one. Vehicles joining a TurnOption without a
+     *          ring leave the network, those turned away by a full queue end their trip lost.
+     *
+     * @note Called by TurnOption::nextVehiclesBeginCrossing()
+     *
+     * @return the number of vehicles admitted to a queue
+     */
+    unsigned int routeVehicles(VehicleRing* from, unsigned int numFinished, long state, TurnOption* fallback);
+
+    /**
+     * @brief Vehicles arrive on the Road facing "road" of "node" headed for "dest" at "vehiclesPerHour", as a
+     *          Poisson process. Each joins the TurnOption of its next hop.
+     *
+     * @throws std::out_of_range if "node" or "dest" is not in the network
+     * @throws std::invalid_argument if "node" has no Road facing "road"
+     * @throws std::domain_error if "vehiclesPerHour" is negative
+     */
+    void addDemand(int node, Road::RoadDirection road, uint32_t dest, double vehiclesPerHour);
+
+    /**
+     * @brief Removes all demand.
+     */
+    void clearDemand();
+
+    /**
+     * @brief Adds the demand arriving at "inter" on its current tick, inter.time(). Random draws come from Philox4x32
+     *          with the counter (tick, demand, node) as in ArrivalGenerator.
+     *
+     * @note Called by Intersection::tick() for Intersections of the network
+     *
+     * @return the number of vehicles added
+     */
+    int inject(Intersection& inter);
+
+    /**
+     * @brief Updates the tables and ticks every Intersection once, in node order.
+     *
+     * @return the number of unfinished lights in the network
+     */
+    int tick();
+
+    int getNumIntersections(){ return (int)nodes.size(); }
+    Intersection* getIntersection(int node){ return nodes.at(node); }
+    uint32_t getNumDestinations(){ return (uint32_t)links.size(); }
+    bool roadIsOpen(int node, Road::RoadDirection exitDir){ return links[linkIdx(node, exitDir)].open; }
+    const Link& getLink(int node, Road::RoadDirection exitDir){ return links[linkIdx(node, exitDir)]; }
+    unsigned int getNumThreads(){ return numThreads; }
+    unsigned long getNumRebuilt(){ return numRebuilt; }
+    unsigned long getNumODArrivals(){ return numODArrivals; }
+    unsigned long getNumBlockedArrivals(){ return numBlockedArrivals; }
+    unsigned long getNumUnroutable(){ return numUnroutable; }
+};
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef SCHEDULE_OPTIMIZER_H
+#define SCHEDULE_OPTIMIZER_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+#include "Intersection.h"
+#include "LightConfig.h"
+#include "CompactIntersection.h"
+#include "ArrivalGenerator.h"
+
+#define OPT_CHECKPOINTS                 (4)     ///< Points of an evaluation where a candidate may be dropped, the last one its end
+#define DEFAULT_OPT_POPULATION          (32)    ///< Candidates sampled per generation
+#define DEFAULT_OPT_ELITE_FRACTION      (0.25)  ///< Fraction of a generation the distribution is refitted to
+#define DEFAULT_OPT_SMOOTHING           (0.7)   ///< Weight of the elites when refitting, the rest keeps the old distribution
+#define DEFAULT_OPT_RESOLUTION          (0.5)   ///< Seconds durations are rounded to
+#define DEFAULT_OPT_PRUNE_MARGIN        (0.5)   ///< How much worse than the worst elite a candidate may be before it is dropped
+#define DEFAULT_OPT_MIN_GREEN           (1.0)   ///< Seconds
+#define DEFAULT_OPT_MAX_GREEN           (60.0)  ///< Seconds
+
+/**
+ * @class ScheduleOptimizer
+ * @brief Searches the order and durations of an Intersection's LightConfig schedule for the least delay or the most
+ *          throughput under a given demand, with the cross-entropy method.
+ *
+ * The Intersection, its schedule and its arrival processes come from a builder, as for TrafficEnv. Its LightConfigs are
+ * what is searched: each one keeps its option and direction, the search picks their order and their green and yellow
+ * durations, and the built durations and order are where it starts. Every generation samples candidates from a normal
+ * distribution per LightConfig over its green, its yellow and a priority, the schedule running in order of priority,
+ * simulates them and refits the distribution to the best of them. Yellow durations are only searched once
+ * setYellowBounds() is called.
+ *
+ * A candidate is simulated for the evaluation length from the built state with the same arrivals every time, the exit
+ * Roads emptied every tick. Its score is the vehicle-seconds spent queued, or minus the vehicles that crossed, lower
+ * being better. Candidates are spread over threads, each simulating on its own Intersection. Durations are rounded to
+ * the resolution, and a candidate already scored is never simulated again. From the second generation on a candidate
+ * is dropped at a checkpoint once its score so far is worse than the worst elite of the previous generation at the
+ * same point by more than the prune margin, and stays dropped.
+ *
+ * Sampling only depends on the seed, so results do not depend on the number of threads.
+ */
+class ScheduleOptimizer{
+public:
+    /**
+     * @brief Adds the Roads, schedule and arrival processes of the Intersection. The exit Roads missing afterwards
+     *          are added with the lanes of the Road facing the same way.
+     */
+    typedef std::function<void(Intersection& inter, ArrivalGenerator& arrivals)> Builder;
+
+    enum Objective {minimizeDelay, maximizeThroughput};
+
+    /**
+     * @brief The outcome of simulating one schedule.
+     */
+    struct Evaluation{
+        double delay;                                       ///< Vehicle-seconds spent queued
+        unsigned long departures;                           ///< Vehicles that crossed
+        double score;                                       ///< Lower is better, infinity if dropped
+        bool dropped;                                       ///< True if it was dropped before the end
+        std::array<double, OPT_CHECKPOINTS> partialScores;  ///< The score so far at every checkpoint reached
+    };
+
+protected:
+    /**
+     * @brief An Intersection a thread simulates candidates on.
+     */
+    struct Workspace{
+        Intersection inter;                 ///< Rebuilt from initial before every candidate
+        ArrivalGenerator arrivals;          ///< Reseeded before every candidate
+        CompactIntersection initial;        ///< The state before the first tick
+        std::vector<Road*> ownedExitRoads;  ///< Exit Roads added for the builder. Owned.
+
+        Workspace() : arrivals(0, 0) {}
+    };
+
+    /**
+     * @brief The normal distribution of one quantity.
+     */
+    struct Normal{
+        double mean;
+        double stddev;
+    };
+
+    std::vector<Workspace*> workspaces;                 ///< One per thread. Owned.
+    std::vector<LightConfig> configs;                   ///< The LightConfigs searched, as built
+    std::vector<Normal> greens;                         ///< Green of every LightConfig, seconds
+    std::vector<Normal> yellows;                        ///< Yellow of every LightConfig, seconds
+    std::vector<Normal> priorities;                     ///< Priority of every LightConfig, the schedule runs lowest first
+    std::map<std::vector<int>, Evaluation> memo;        ///< Every candidate scored, by key
+    std::array<double, OPT_CHECKPOINTS> cutoffs;        ///< Partial scores of the worst elite of the last generation
+    bool hasCutoffs;                                    ///< False until a generation has elites
+
+    Objective objective;
+    uint64_t seed;                                      ///< Seeds sampling and the arrivals
+    int evalTicks;                                      ///< Ticks every candidate is simulated
+    int population;
+    double eliteFraction;
+    double smoothing;
+    double resolution;
+    double pruneMargin;
+    double minGreen, maxGreen;
+    double minYellow, maxYellow;
+    bool searchYellows;                                 ///< True once setYellowBounds() was called
+
+    std::vector<int> bestKey;                           ///< The best candidate so far
+    Evaluation bestEvaluation;
+    unsigned long numGenerations;
+    unsigned long numSimulated;                         ///< Candidates simulated, dropped ones included
+    unsigned long numDropped;
+    unsigned long numMemoHits;                          ///< Candidates sampled that had already been scored
+
+    /**
+     * @brief Rounds seconds to the resolution, in steps of the resolution.
+     */
+    int toSteps(double seconds, double low, double high);
+
+    /**
+     * @brief Gets the key of the candidate made of the priorities, greens and yellows of every LightConfig: the order
+     *          of the LightConfigs, then the green and yellow of each in steps of the resolution.
+     */
+    std::vector<int> makeKey(const std::vector<double>& priority, const std::vector<double>& green, const std::vector<double>& yellow);
+
+    /**
+     * @brief Simulates the candidate "key" on "space" and scores it.
+     *
+     * @param prune true to drop it at a checkpoint, see ScheduleOptimizer
+     */
+    Evaluation simulate(Workspace& space, const std::vector<int>& key, bool prune);
+
+    /**
+     * @brief Scores every key missing from the memo, split across threads. An exception thrown on any thread is
+     *          rethrown here once every thread has finished.
+     */
+    void simulateAll(const std::vector<std::vector<int>>& keys, bool prune);
+
+    /**
+     * @brief Draws a standard normal value for sample "sample", quantity "dim" of generation "gen".
+     */
+    double gaussian(unsigned long gen, int sample, int dim);
+
+public:
+    /**
+     * @param build         builds the Intersection, called once per thread in order
+     * @param evalSeconds   seconds every candidate is simulated
+     * @param goal          what the score measures
+     * @param rngSeed       seeds sampling and the arrivals
+     * @param threads       the most threads simulating, 0 for one per hardware thread
+     *
+     * @throws std::domain_error if "evalSeconds" is shorter than a tick
+     * @throws std::invalid_argument if the Intersection is built without LightConfigs
+     */
+    ScheduleOptimizer(const Builder& build, double evalSeconds, Objective goal=minimizeDelay, uint64_t rngSeed=0, unsigned int threads=0);
+
+    ScheduleOptimizer(const ScheduleOptimizer&) = delete;
+    ScheduleOptimizer& operator=(const ScheduleOptimizer&) = delete;
+
+    ~ScheduleOptimizer();
+
+    /**
+     * @brief Sets the candidates per generation and the fraction of them the distribution is refitted to.
+     *
+     * @throws std::domain_error if "size" is less than 2 or "fraction" is not in (0, 1]
+     */
+    void setPopulation(int size, double fraction=DEFAULT_OPT_ELITE_FRACTION);
+
+    /**
+     * @brief Sets the range searched for greens.
+     *
+     * @throws std::domain_error unless 0 < "low" <= "high"
+     */
+    void setGreenBounds(double low, double high);
+
+    /**
+     * @brief Searches yellows within the range, instead of keeping the built ones.
+     *
+     * @throws std::domain_error unless 0 <= "low" <= "high"
+     */
+    void setYellowBounds(double low, double high);
+
+    /**
+     * @brief Sets the seconds durations are rounded to.
+     *
+     * @throws std::domain_error if "seconds" is not positive
+     */
+    void setResolution(double seconds);
+
+    /**
+     * @brief Sets how much worse than the worst elite a candidate may score before it is dropped, as a fraction of
+     *          the elite's score. Negative never drops.
+     */
+    void setPruneMargin(double margin){ pruneMargin = margin; }
+
+    /**
+     * @brief Samples, scores and refits one generation. The first also scores the built schedule.
+     */
+    void step();
+
+    /**
+     * @brief Runs "generations" generations.
+     *
+     * @return the best schedule found
+     */
+    std::vector<LightConfig> optimize(int generations);
+
+    /**
+     * @brief Simulates "schedule" to the end of an evaluation, without dropping it.
+     *
+     * @throws std::invalid_argument if "schedule" is not an order of the built LightConfigs
+     */
+    Evaluation evaluate(const std::vector<LightConfig>& schedule);
+
+    /**
+     * @brief Gets the best schedule found, the built one before the first generation.
+     */
+    std::vector<LightConfig> getBestSchedule();
+
+    /**
+     * @brief Replaces the schedule of "inter" with the best one found.
+     */
+    void apply(Intersection& inter);
+
+    const Evaluation& getBestEvaluation(){ return bestEvaluation; }
+    unsigned long getNumGenerations(){ return numGenerations; }
+    unsigned long getNumSimulated(){ return numSimulated; }
+    unsigned long getNumDropped(){ return numDropped; }
+    unsigned long getNumMemoHits(){ return numMemoHits; }
+    unsigned int getNumThreads(){ return workspaces.size(); }
+    int getEvalTicks(){ return evalTicks; }
+};
+
+#endif
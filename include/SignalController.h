@@ -0,0 +1,238 @@
+#ifndef SIGNAL_CONTROLLER_H
+#define SIGNAL_CONTROLLER_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "Intersection.h"
+#include "RoadNetwork.h"
+#include "SignalPolicy.h"
+
+#define DEFAULT_MIN_GREEN   (2.0)   ///< Seconds a green lasts before it may gap out
+#define DEFAULT_MAX_GREEN   (30.0)  ///< Seconds after which a green maxes out
+#define DEFAULT_GAP         (1.0)   ///< Seconds the lanes of a green must stay empty for it to gap out
+#define PRESSURE_MIN_NODES_PER_THREAD   (64)    ///< Fewer Intersections than this per thread are swept on fewer threads
+#define NO_PRESSURE_DECISION            (-1)    ///< Decision of an Intersection not swept yet
+
+/**
+ * @class SignalController
+ * @brief Replaces the fixed round-robin of an Intersection's LightConfig schedule with decisions made from the
+ *          live state of the Intersection.
+ *
+ * The schedule still lists the LightConfigs, i.e. the option and direction of every phase, and the SignalPlan
+ * compiled from it. The controller picks which of them runs next and how long its lights stay on, and may end
+ * a green early. One controller can drive any number of Intersections, everything it needs about an
+ * Intersection is passed in.
+ *
+ * @note Decisions must only depend on the Intersection so InputJournal::replay() reproduces them with the same
+ *          controller set.
+ * @note Calls go through a virtual table so Intersections of one fleet can run different strategies. A fleet running
+ *          one can pass it to Intersection::tick(Policy&) instead, see SignalPolicy.
+ */
+class SignalController{
+public:
+    typedef PhaseDecision Decision;     ///< The LightConfig to start next
+
+    virtual ~SignalController(){}
+
+    /**
+     * @brief Picks the LightConfig to start once LightConfig "current" has finished.
+     *
+     * @note Called by Intersection::nextLightConfig() and the sequencer in Intersection::tick()
+     */
+    virtual Decision nextPhase(Intersection& inter, int current) = 0;
+
+    /**
+     * @brief Called once per tick while a light of LightConfig "phase" is green.
+     *
+     * @param greenTicks    ticks the phase has been green, counting this one
+     * @param idleTicks     ticks in a row its lanes have had no queued vehicles, counting this one
+     *
+     * @return true to turn the green lights of the phase yellow now
+     */
+    virtual bool endGreen(Intersection& inter, int phase, unsigned long greenTicks, unsigned long idleTicks) = 0;
+};
+
+/**
+ * @class FixedPolicy
+ * @brief The round-robin of the schedule as a SignalPolicy: every LightConfig in order for its scheduled duration,
+ *          the same as an Intersection without a SignalController.
+ */
+class FixedPolicy{
+public:
+    PhaseDecision nextPhase(Intersection& inter, int current){ return {(current + 1) % inter.getSignalPlan().getNumPhases(), -1}; }
+    bool endGreen(Intersection& inter, int phase, unsigned long greenTicks, unsigned long idleTicks){ return false; }
+};
+
+/**
+ * @class PolicyController
+ * @brief Wraps a SignalPolicy in a SignalController so it can be set on an Intersection next to other strategies,
+ *          at the cost of a virtual call per decision.
+ */
+template <SignalPolicy Policy>
+class PolicyController final : public SignalController{
+protected:
+    Policy policy;      ///< The wrapped policy
+
+public:
+    /**
+     * @param args  passed to the constructor of the policy
+     */
+    template <typename... Args>
+    PolicyController(Args&&... args) : policy(std::forward<Args>(args)...) {}
+
+    Decision nextPhase(Intersection& inter, int current) override { return policy.nextPhase(inter, current); }
+    bool endGreen(Intersection& inter, int phase, unsigned long greenTicks, unsigned long idleTicks) override { return policy.endGreen(inter, phase, greenTicks, idleTicks); }
+
+    Policy& getPolicy(){ return policy; }
+};
+
+/**
+ * @class ActuatedController
+ * @brief Queue-actuated control: the next phase in schedule order with a queued vehicle starts, phases without
+ *          one are skipped. Its green lasts at least the minimum green, ends once its lanes have been empty for the
+ *          gap (gap-out) and never lasts past the maximum green (max-out). When no lane has a vehicle the next
+ *          phase runs for the minimum green.
+ *
+ * A decision reads the queues of the lanes each phase serves through the compiled SignalPlan, so it takes a bounded
+ * number of steps set by the size of the schedule and never allocates.
+ */
+class ActuatedController final : public SignalController{
+protected:
+    double minGreen;            ///< Seconds
+    double maxGreen;            ///< Seconds
+    double gap;                 ///< Seconds
+    int minGreenTicks;          ///< minGreen at compiledRefreshRate
+    int maxGreenTicks;          ///< maxGreen at compiledRefreshRate
+    int gapTicks;               ///< gap at compiledRefreshRate
+    int compiledRefreshRate;    ///< refreshRateHzGlobal the durations were converted at, 0 if never
+
+    /**
+     * @brief Converts the durations to ticks at refreshRateHzGlobal.
+     */
+    void compileTicks();
+
+    /**
+     * @brief Converts the durations to ticks when refreshRateHzGlobal has changed.
+     */
+    void refreshTicks(){
+        if(compiledRefreshRate != refreshRateHzGlobal){
+            compileTicks();
+        }
+    }
+
+    /**
+     * @brief Counts the vehicles queued in the lanes the lights of "phase" serve.
+     */
+    static unsigned long phaseDemand(Intersection& inter, const SignalPlan::Phase& phase);
+
+public:
+    /**
+     * @param minGreenSeconds   the least a green lasts
+     * @param maxGreenSeconds   the most a green lasts
+     * @param gapSeconds        the time the lanes of a green must stay empty for it to end early
+     *
+     * @throws std::domain_error unless 0 <= "minGreenSeconds" <= "maxGreenSeconds", "maxGreenSeconds" > 0 and
+     *          "gapSeconds" >= 0
+     */
+    ActuatedController(double minGreenSeconds=DEFAULT_MIN_GREEN, double maxGreenSeconds=DEFAULT_MAX_GREEN, double gapSeconds=DEFAULT_GAP);
+
+    Decision nextPhase(Intersection& inter, int current) override;
+    bool endGreen(Intersection& inter, int phase, unsigned long greenTicks, unsigned long idleTicks) override{
+        refreshTicks();
+
+        /// A gap of 0 still needs one tick with the lanes empty
+        return (greenTicks >= (unsigned long)minGreenTicks && idleTicks >= (unsigned long)std::max(1, gapTicks)) || greenTicks >= (unsigned long)maxGreenTicks;
+    }
+
+    double getMinGreen(){ return minGreen; }
+    double getMaxGreen(){ return maxGreen; }
+    double getGap(){ return gap; }
+};
+
+/**
+ * @class MaxPressureController
+ * @brief Max-pressure control of every Intersection of a RoadNetwork.
+ *
+ * The pressure of a lane group is the number of vehicles queued in it minus the number queued in the exit TurnOption
+ * its vehicles join, see Intersection::getExitTurnOption(), times its lanes as that many vehicles cross at once. The
+ * pressure of a phase is the sum over the lane groups its lights serve. sweep() scores every phase of every
+ * Intersection and keeps the one with the most pressure, ties going to the earliest in the schedule. Each
+ * Intersection starts its kept phase at its next phase boundary, for the scheduled duration.
+ *
+ * A sweep first copies the queue counts of every Intersection into a snapshot, then scores from the snapshot only, so
+ * every decision sees the same state whatever the order the Intersections are scored in. Both passes split the
+ * Intersections across threads, each Intersection written by one thread only.
+ *
+ * @note Call sweep() between ticks, or tick() which does both. Intersections outside the network, or not swept
+ *          yet, run their schedule in order.
+ */
+class MaxPressureController final : public SignalController{
+protected:
+    RoadNetwork* network;                       ///< The Intersections controlled. Not owned.
+    unsigned int numThreads;                    ///< Most threads sweeping
+    std::vector<int> upstreamQueues;            ///< Vehicles queued in every lane group, [node][laneGroup]
+    std::vector<int> downstreamQueues;          ///< Vehicles queued in the exit TurnOption of every lane group, [node][laneGroup]
+    std::vector<int> decisions;                 ///< The phase every node starts next, NO_PRESSURE_DECISION if none
+    std::vector<long> pressures;                ///< The pressure of the decision of every node
+    unsigned long numSweeps;                    ///< sweep() calls since creation
+
+    /**
+     * @brief Copies the queue counts of "node" into the snapshot.
+     */
+    void snapshotNode(int node);
+
+    /**
+     * @brief Scores every phase of "node" from the snapshot and keeps the one with the most pressure.
+     */
+    void decideNode(int node);
+
+    /**
+     * @brief Calls "fn" for every node, split across threads. An exception thrown by "fn" on any thread is rethrown
+     *          here once every thread has finished.
+     */
+    template <typename Fn>
+    void forEachNode(Fn fn);
+
+public:
+    /**
+     * @param net       the network whose Intersections are controlled. Set this controller on each of them.
+     * @param threads   the most threads sweeping, 0 for one per hardware thread
+     */
+    MaxPressureController(RoadNetwork& net, unsigned int threads=0);
+
+    /**
+     * @brief Takes a snapshot of every queue of the network and picks the next phase of every Intersection from it.
+     */
+    void sweep();
+
+    /**
+     * @brief Sweeps then ticks the network once.
+     *
+     * @return the number of unfinished lights in the network
+     */
+    int tick(){ sweep(); return network->tick(); }
+
+    /**
+     * @brief Gets the phase the sweep picked for "inter", or the next valid phase after "current" in schedule order
+     *          if there is none.
+     */
+    Decision nextPhase(Intersection& inter, int current) override;
+
+    /**
+     * @brief Greens always last their scheduled duration.
+     */
+    bool endGreen(Intersection& inter, int phase, unsigned long greenTicks, unsigned long idleTicks) override { return false; }
+
+    /**
+     * @brief Computes the pressure of phase "phase" of "inter" from its live queues.
+     */
+    static long phasePressure(Intersection& inter, const SignalPlan::Phase& phase);
+
+    int getDecision(int node){ return decisions.at(node); }
+    long getPressure(int node){ return pressures.at(node); }
+    unsigned int getNumThreads(){ return numThreads; }
+    unsigned long getNumSweeps(){ return numSweeps; }
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef SIGNAL_PLAN_H
+#define SIGNAL_PLAN_H
+
+#include <array>
+#include <vector>
+#include "TrafficLight.h"
+#include "Road.h"
+
+class Intersection;
+class LightConfig;
+
+/**
+ * @class SignalPlan
+ * @brief An Intersection's LightConfig schedule compiled into a cyclic table of phases.
+ *
+ * Every LightConfig becomes a Phase holding the lights it turns on with their durations already
+ * converted to ticks, the tick within the cycle it starts on, and the target color of every lane
+ * group at that boundary. Starting a phase is then a walk over a short array and the cycle length,
+ * phase boundaries and the color of any light at any tick can be answered without simulating.
+ *
+ * @note A phase lasts until the last light it turned on is red again, followed by the all-red clearance
+ *          interval. The plan assumes lights return to red and stay there, i.e. red durations are infinite
+ *          as set by Road.
+ */
+class SignalPlan{
+public:
+    /**
+     * @brief A light turned on by a phase with its precomputed durations.
+     */
+    struct LightStart{
+        TrafficLight* light;        ///< The light to be started
+        int laneGroup;              ///< Road::laneGroupIdx() of the light
+        double onDuration;          ///< The onColor duration in seconds
+        int onTicks;                ///< onDuration in ticks
+        double yellowDuration;      ///< The yellow duration in seconds, DONT_SET keeps the light's own
+        int yellowTicks;            ///< The yellow duration the light will use, in ticks
+    };
+
+    /**
+     * @brief One compiled LightConfig.
+     */
+    struct Phase{
+        bool valid;                                                         ///< False if a Road the LightConfig needs is missing
+        unsigned long startTick;                                            ///< The tick within the cycle the phase starts on
+        long lengthTicks;                                                   ///< Ticks until every light of the phase is red plus the clearance, -1 if never
+        std::vector<LightStart> lightStarts;                                ///< The lights turned on at the start of the phase
+        std::array<TrafficLight::AvailableColors, NUM_LANE_GROUPS> targetColor;  ///< The color of every lane group at the start of the phase
+    };
+
+protected:
+    std::vector<Phase> phases;      ///< The compiled phases in schedule order
+    long cycleLength;               ///< Sum of all phase lengths in ticks, -1 if a phase never ends
+    int clearanceTicks;             ///< All-red ticks between the end of a phase and the start of the next
+    int compiledRefreshRate;        ///< refreshRateHzGlobal the durations were converted at, 0 if never compiled
+    TickRounding compiledRounding;  ///< tickRoundingGlobal the durations were converted with
+
+    /**
+     * @brief Adds the lights of Road "rd" for "turn" to "phase"
+     */
+    void addLight(Phase& phase, Road* rd, TurnOption::Type turn, LightConfig* config);
+
+public:
+    SignalPlan() : cycleLength(0), clearanceTicks(0), compiledRefreshRate(0), compiledRounding(roundDown) {}
+
+    /**
+     * @brief Compiles "schedule" for the Roads of "inter" at the current refresh rate.
+     *
+     * @param inter           The Intersection the schedule belongs to
+     * @param schedule        The LightConfigs in order
+     * @param allRedDuration  (optional) Seconds every light stays red after a phase before the next one starts
+     *
+     * @throws std::out_of_range if a LightConfig has an unhandled LightConfig::Option
+     * @throws std::domain_error if "allRedDuration" is negative
+     */
+    void compile(Intersection& inter, const std::vector<LightConfig*>& schedule, double allRedDuration=0);
+
+    /**
+     * @brief Checks the plan was compiled at the current refresh rate and rounding policy
+     */
+    bool isCurrent(){ return compiledRefreshRate == refreshRateHzGlobal && compiledRounding == tickRoundingGlobal; }
+
+    /**
+     * @brief Gets the index of the phase running at "tick" ticks after the start of the first phase.
+     *          Ticks beyond one cycle wrap around.
+     *
+     * @param tick  Ticks since the first phase started
+     * @return The phase index
+     *
+     * @throws std::out_of_range if the plan has no phases
+     */
+    int phaseAt(unsigned long tick);
+
+    /**
+     * @brief Gets the color of a light "tick" ticks after the start of the first phase, computed from the table.
+     *
+     * @param tick  Ticks since the first phase started
+     * @param dir   The direction of the Road
+     * @param turn  The TurnOption of the light
+     * @return The color of the light, red for lights not in the current phase
+     */
+    TrafficLight::AvailableColors colorAt(unsigned long tick, Road::RoadDirection dir, TurnOption::Type turn);
+
+    int getNumPhases(){ return phases.size(); }
+    const Phase& getPhase(int idx){ return phases.at(idx); }
+    long getPhaseLength(int idx){ return phases.at(idx).lengthTicks; }
+    unsigned long getPhaseStart(int idx){ return phases.at(idx).startTick; }
+    long getCycleLength(){ return cycleLength; }
+    int getClearanceTicks(){ return clearanceTicks; }
+};
+
+#endif
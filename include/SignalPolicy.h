@@ -0,0 +1,31 @@
+#ifndef SIGNAL_POLICY_H
+#define SIGNAL_POLICY_H
+
+#include <concepts>
+
+class Intersection;
+
+/**
+ * @brief The LightConfig a signal policy starts next.
+ */
+struct PhaseDecision{
+    int phase;          ///< The index of the LightConfig in the schedule
+    int greenTicks;     ///< Ticks its lights stay on before turning yellow, -1 for the scheduled duration
+};
+
+/**
+ * @brief A signal strategy Intersection::tick(Policy&) can call directly, without virtual dispatch.
+ *
+ * nextPhase(inter, current) picks the LightConfig to start once LightConfig "current" has finished.
+ * endGreen(inter, phase, greenTicks, idleTicks) is called once per tick while a light of "phase" is green and returns
+ * true to turn its green lights yellow now, see SignalController.
+ *
+ * Every SignalController satisfies it, a final one has its calls resolved at compile time.
+ */
+template <typename Policy>
+concept SignalPolicy = requires(Policy& policy, Intersection& inter, int phase, unsigned long ticks){
+    { policy.nextPhase(inter, phase) } -> std::same_as<PhaseDecision>;
+    { policy.endGreen(inter, phase, ticks, ticks) } -> std::same_as<bool>;
+};
+
+#endif
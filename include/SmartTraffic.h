@@ -18,6 +18,9 @@ extern int refreshRateHzGlobal;
  * @param refreshRateHz     The number of ticks per second
  * @param runTime           The number of seconds this function will run for. A value of FOREVER runs until an interrupt is received.
  * @param printToConsole    Prints Intersection status to console when true
+ *
+ * @note "inter" runs with auto sequencing on. Its DelayMetrics and auto sequencing are restored on return, the
+ *          simulation state is left where the run ended.
  * 
  * @return true     The function exited normally
  * @return false    "inter" is invalid or there was a clock overrun
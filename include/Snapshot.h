@@ -0,0 +1,140 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "Intersection.h"
+#include "CompactIntersection.h"
+
+#define SNAPSHOT_MAGIC          "STSNAP\r\n"    ///< First 8 bytes of every snapshot file
+#define SNAPSHOT_VERSION        (3)             ///< Bumped whenever the layout of a record changes
+#define SNAPSHOT_ENDIAN_MARKER  (0x01020304u)   ///< Reads back differently on a machine of the other endianness
+
+/**
+ * @class Snapshot
+ * @brief A versioned, flat binary checkpoint of a set of Intersections that is loaded with mmap.
+ *
+ * The file is a Header followed by one fixed size Record per Intersection and a table of every scheduled LightConfig.
+ * Records hold no pointers: the CompactIntersection state, the configuration needed to rebuild the roads and lights,
+ * and the position of the Intersection's LightConfigs in the schedule table. Opening a snapshot maps the file and
+ * checks the header, the records are read in place. restore() rebuilds an Intersection from its record.
+ *
+ * @note Exit roads and ArrivalGenerators are not part of an Intersection's state and are not saved.
+ */
+class Snapshot{
+public:
+    /**
+     * @brief The first bytes of a snapshot file.
+     */
+    struct Header{
+        char     magic[8];              ///< SNAPSHOT_MAGIC
+        uint32_t version;               ///< SNAPSHOT_VERSION
+        uint32_t endianMarker;          ///< SNAPSHOT_ENDIAN_MARKER
+        uint32_t recordBytes;           ///< sizeof(Record)
+        uint32_t lightConfigBytes;      ///< sizeof(LightConfigEntry)
+        uint64_t numRecords;            ///< The number of Intersections
+        uint64_t recordsOffset;         ///< Byte offset of the first Record
+        uint64_t numLightConfigs;       ///< The number of entries in the schedule table
+        uint64_t lightConfigsOffset;    ///< Byte offset of the schedule table
+        int32_t  refreshRateHz;         ///< refreshRateHzGlobal when saved, tick counts are only valid at this rate
+        int32_t  tickRounding;          ///< tickRoundingGlobal when saved
+    };
+
+    /**
+     * @brief Configuration of one lane group that CompactIntersection keeps only in ticks.
+     */
+    struct LaneGroupConfig{
+        std::array<double, TrafficLight::numColors> colorDuration;  ///< TrafficLight durations in seconds
+        uint32_t timeToCross;                                       ///< TurnOption time to cross in seconds
+        uint32_t reserved;                                          ///< Padding, always 0
+    };
+
+    /**
+     * @brief One scheduled LightConfig.
+     */
+    struct LightConfigEntry{
+        uint8_t configOpt;              ///< LightConfig::Option
+        uint8_t direction;              ///< Road::RoadDirection
+        uint8_t reserved[6];            ///< Padding, always 0
+        double  duration;               ///< LightConfig duration in seconds
+        double  yellowDuration;         ///< LightConfig yellow duration in seconds
+    };
+
+    /**
+     * @brief Everything needed to rebuild one Intersection.
+     */
+    struct Record{
+        CompactIntersection state;                                  ///< Light, vehicle and sequencing state
+        std::array<LaneGroupConfig, NUM_LANE_GROUPS> laneGroups;    ///< Durations in seconds
+        uint64_t firstLightConfig;                                  ///< Index of the Intersection's first LightConfig in the schedule table
+        uint32_t numLightConfigs;                                   ///< The number of LightConfigs scheduled
+        uint8_t  autoSequence;                                      ///< Intersection::getAutoSequence()
+        uint8_t  expectedRoadMask;                                  ///< Bit "dir" is set when Intersection::roadIsExpected(dir)
+        uint16_t reserved;                                          ///< Padding, always 0
+        double   allRedDuration;                                    ///< Intersection::getAllRedDuration()
+    };
+
+protected:
+    const unsigned char* mapping;   ///< The mapped file
+    size_t mappingBytes;            ///< Size of the mapped file
+    const Header* header;           ///< The header at the start of mapping
+    const Record* records;          ///< The records in mapping
+    const LightConfigEntry* lightConfigs;  ///< The schedule table in mapping
+
+public:
+    /**
+     * @brief Writes the state of every Intersection in "inters" to a new snapshot file at "path".
+     *
+     * @throws std::runtime_error if the file can not be written
+     * @throws std::overflow_error if a value does not fit, see CompactIntersection::pack()
+     * @throws std::logic_error if a TrafficLight does not follow its default TransitionTable, nothing is written
+     */
+    static void save(const std::string& path, const std::vector<Intersection*>& inters);
+
+    /**
+     * @brief Maps the snapshot file at "path" and checks its header.
+     *
+     * @throws std::runtime_error if the file can not be mapped, is not a snapshot, has another version or layout
+     *          or is truncated
+     */
+    Snapshot(const std::string& path);
+
+    ~Snapshot();
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    size_t getNumIntersections(){ return header->numRecords; }
+    int getRefreshRate(){ return header->refreshRateHz; }
+    TickRounding getTickRounding(){ return (TickRounding)header->tickRounding; }
+
+    /**
+     * @brief Gets record "idx" in place.
+     *
+     * @throws std::out_of_range if "idx" is not below getNumIntersections()
+     */
+    const Record& getRecord(size_t idx);
+
+    /**
+     * @brief Rebuilds Intersection "idx" into "inter": its roads, light and TurnOption configuration, schedule and
+     *          the whole simulation state.
+     *
+     * @param idx        The index of the Intersection in the snapshot
+     * @param inter      A newly constructed Intersection with no roads and an empty schedule
+     * @param controller (optional) The SignalController "inter" had when saved, set on it before its green and idle
+     *                      ticks are restored. Only whether one was set is saved, not its own state.
+     *
+     * @throws std::logic_error if "inter" already has roads or LightConfigs, refreshRateHzGlobal or tickRoundingGlobal
+     *          differ from when the snapshot was saved, or "controller" is NULL exactly when one was set
+     * @throws std::out_of_range if "idx" is not below getNumIntersections()
+     */
+    void restore(size_t idx, Intersection& inter, SignalController* controller=NULL);
+};
+
+static_assert(std::is_trivially_copyable<Snapshot::Record>::value, "Snapshot::Record is written to and mapped from disk as raw bytes");
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Intersection.h"
+
+#define TELEMETRY_MAGIC                 "STTELEM\n"     ///< First 8 bytes of every telemetry file
+#define TELEMETRY_VERSION               (1)             ///< Bumped whenever the encoding of a block changes
+#define DEFAULT_TELEMETRY_BLOCK_ROWS    (1 << 16)       ///< Rows buffered before a block is handed to the writer thread
+#define DEFAULT_TELEMETRY_PENDING       (8)             ///< Full blocks that may wait for the writer thread before sample() waits
+
+/**
+ * @brief One block of telemetry rows stored column by column. Row "i" is the state of lane group laneGroups[i]
+ *          at tick ticks[i].
+ */
+struct TelemetryBlock{
+    /**
+     * @brief The columns in the order they are written.
+     */
+    enum Column {tickColumn, laneGroupColumn, colorColumn, queuedColumn, crossingColumn, directedColumn, numColumns};
+
+    std::vector<uint64_t> ticks;                ///< Intersection::time() when sampled
+    std::vector<uint32_t> laneGroups;           ///< TelemetryWriter::laneGroupId() of the row
+    std::vector<uint8_t>  colors;               ///< TrafficLight::AvailableColors
+    std::vector<uint32_t> queuedVehicles;       ///< TurnOption::getQueuedVehicles()
+    std::vector<uint32_t> numVehiclesCrossing;  ///< TurnOption::getNumVehiclesCurrentlyCrossing()
+    std::vector<uint64_t> numVehiclesDirected;  ///< TrafficLight::getNumVehiclesDirected()
+    size_t numRows;                             ///< Rows in use, the columns may be longer
+
+    TelemetryBlock(){ numRows = 0; }
+
+    /**
+     * @brief Sizes every column for "rows" rows.
+     */
+    void resize(size_t rows);
+};
+
+/**
+ * @class TelemetryWriter
+ * @brief Records the light color and vehicle counts of every lane group at every sampled tick to a columnar binary file.
+ *
+ * sample() only copies values into the columns of the current block. Full blocks are handed to a background thread
+ * that delta encodes every column against the previous row, zigzag varint encodes the deltas and writes the whole
+ * block with a single write. Consecutive rows differ by little, most values take one byte.
+ *
+ * The file is a header followed by blocks, each a BlockHeader giving the encoded size of every column followed by
+ * the columns. Read it back with TelemetryReader.
+ */
+class TelemetryWriter{
+public:
+    /**
+     * @brief The first bytes of a telemetry file.
+     */
+    struct FileHeader{
+        char     magic[8];      ///< TELEMETRY_MAGIC
+        uint32_t version;       ///< TELEMETRY_VERSION
+        uint32_t numColumns;    ///< TelemetryBlock::numColumns
+    };
+
+    /**
+     * @brief The first bytes of every block.
+     */
+    struct BlockHeader{
+        uint32_t numRows;                                           ///< Rows in the block
+        uint32_t reserved;                                          ///< Padding, always 0
+        uint64_t columnBytes[TelemetryBlock::numColumns];           ///< Encoded size of each column
+    };
+
+protected:
+    std::FILE* file;                            ///< The telemetry file
+    std::string path;                           ///< Path to the file, used in error messages
+    size_t blockRows;                           ///< Rows per block
+    std::vector<TelemetryBlock> blockPool;      ///< Every block, never resized once the thread runs
+    TelemetryBlock* current;                    ///< The block sample() fills
+    std::vector<TelemetryBlock*> freeBlocks;    ///< Empty blocks
+    std::vector<TelemetryBlock*> fullBlocks;    ///< Blocks waiting for the writer thread, oldest first
+    size_t numWriting;                          ///< Blocks taken by the writer thread and not yet written
+    bool stopping;                              ///< Set by close() to end the writer thread
+    std::string writeError;                     ///< Set by the writer thread when a write fails
+    std::mutex mutex;                           ///< Guards the block lists, numWriting, stopping and writeError
+    std::condition_variable blockIsFull;        ///< Signals the writer thread
+    std::condition_variable blockIsFree;        ///< Signals sample() and flush()
+    std::thread writerThread;                   ///< Encodes and writes full blocks
+    unsigned long numRows;                      ///< Rows sampled
+    unsigned long numStalls;                    ///< Times sample() had to wait for a free block
+    unsigned long bytesWritten;                 ///< Bytes written to the file, written by the writer thread only
+
+    /**
+     * @brief Hands the current block to the writer thread and takes a free one, waiting if there is none.
+     */
+    void submitBlock();
+
+    /**
+     * @brief Body of writerThread.
+     */
+    void writeBlocks();
+
+    /**
+     * @brief Delta and varint encodes "block" into "encoded", BlockHeader first.
+     */
+    static void encodeBlock(const TelemetryBlock& block, std::vector<uint8_t>& encoded);
+
+    /**
+     * @brief Throws a std::runtime_error if the writer thread failed. Called with mutex held.
+     */
+    void checkWriteError();
+
+public:
+    /**
+     * @brief Creates the telemetry file at "filePath" and starts the writer thread.
+     *
+     * @param filePath      the file to write
+     * @param rowsPerBlock  (optional) rows buffered before a block is written
+     * @param maxPending    (optional) full blocks that may wait for the writer thread
+     *
+     * @throws std::runtime_error if the file can not be created
+     * @throws std::domain_error if "rowsPerBlock" or "maxPending" is 0
+     */
+    TelemetryWriter(const std::string& filePath, size_t rowsPerBlock=DEFAULT_TELEMETRY_BLOCK_ROWS, size_t maxPending=DEFAULT_TELEMETRY_PENDING);
+
+    ~TelemetryWriter();
+
+    TelemetryWriter(const TelemetryWriter&) = delete;
+    TelemetryWriter& operator=(const TelemetryWriter&) = delete;
+
+    /**
+     * @brief Gets the lane group id stored for the "laneGroup" lane group, see Road::laneGroupIdx(), of Intersection "intersectionId"
+     */
+    static uint32_t laneGroupId(uint32_t intersectionId, int laneGroup){ return intersectionId * NUM_LANE_GROUPS + laneGroup; }
+
+    /**
+     * @brief Appends one row per existing lane group of "inter" at inter.time(). Call after Intersection::tick().
+     *
+     * @param inter             the Intersection to sample
+     * @param intersectionId    (optional) tells Intersections apart in laneGroupId()
+     *
+     * @throws std::runtime_error if the writer thread failed to write an earlier block
+     */
+    void sample(Intersection& inter, uint32_t intersectionId=0);
+
+    /**
+     * @brief Writes every row sampled so far and waits until it is in the file.
+     *
+     * @throws std::runtime_error if a block could not be written
+     */
+    void flush();
+
+    /**
+     * @brief Flushes, stops the writer thread and closes the file. Called by the destructor, which does not throw.
+     *
+     * @throws std::runtime_error if a block could not be written
+     */
+    void close();
+
+    unsigned long getNumRows(){ return numRows; }
+    unsigned long getNumStalls(){ return numStalls; }
+
+    /**
+     * @brief Gets the size of the file so far. Exact after flush().
+     */
+    unsigned long getBytesWritten();
+};
+
+/**
+ * @class TelemetryReader
+ * @brief Reads a file written by TelemetryWriter back one block at a time.
+ */
+class TelemetryReader{
+protected:
+    std::FILE* file;                    ///< The telemetry file
+    std::string path;                   ///< Path to the file, used in error messages
+    std::vector<uint8_t> encoded;       ///< The encoded columns of the block being read
+    unsigned long numRows;              ///< Rows read so far
+
+public:
+    /**
+     * @brief Opens the telemetry file at "filePath" and checks its header.
+     *
+     * @throws std::runtime_error if the file can not be opened, is not telemetry or has another version
+     */
+    TelemetryReader(const std::string& filePath);
+
+    ~TelemetryReader();
+
+    TelemetryReader(const TelemetryReader&) = delete;
+    TelemetryReader& operator=(const TelemetryReader&) = delete;
+
+    /**
+     * @brief Decodes the next block of the file into "block".
+     *
+     * @return false at the end of the file
+     *
+     * @throws std::runtime_error if the block is truncated or malformed
+     */
+    bool nextBlock(TelemetryBlock& block);
+
+    unsigned long getNumRows(){ return numRows; }
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#define MICROS_PER_SECOND (1000000LL)
+
+/**
+ * @brief How a duration that is not a whole number of ticks is converted to ticks.
+ */
+enum TickRounding {roundDown, roundNearest, roundUp};
+
+/**
+ * @brief The rounding policy used for every seconds to ticks conversion. Defaults to roundDown.
+ */
+extern TickRounding tickRoundingGlobal;
+
+/**
+ * @brief Converts a duration in seconds to a whole number of microseconds.
+ *
+ * @note Durations are snapped to the microsecond before being scaled to ticks, so decimal durations
+ *          such as 0.29s are exact rationals and do not pick up floating point error.
+ *
+ * @param seconds the duration to convert
+ * @return the nearest whole number of microseconds
+ */
+long long secondsToMicros(double seconds);
+
+/**
+ * @brief Converts a duration in seconds to ticks at "refreshRateHz" using only integer arithmetic
+ *          on the microsecond value of "seconds".
+ *
+ * @param seconds       the duration to convert. A negative duration is infinite.
+ * @param refreshRateHz the number of ticks per second
+ * @param rounding      (optional) how a fractional number of ticks is rounded
+ *
+ * @return the duration in ticks, or -1 if "seconds" is negative
+ *
+ * @throws std::overflow_error if the result does not fit in an int
+ * @throws std::domain_error if "seconds" is NaN or "refreshRateHz" is not positive
+ */
+int secondsToTicks(double seconds, int refreshRateHz, TickRounding rounding=tickRoundingGlobal);
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef TRAFFIC_ENV_H
+#define TRAFFIC_ENV_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "Intersection.h"
+#include "CompactIntersection.h"
+#include "ArrivalGenerator.h"
+
+#define ENV_KEEP_SCHEDULE           (-1)    ///< Action continuing the schedule in order
+#define ENV_MIN_ENVS_PER_THREAD     (256)   ///< Fewer environments than this per thread are stepped on fewer threads
+
+/**
+ * @class TrafficEnv
+ * @brief A batch of independent single Intersection environments for training signal controllers: reset() and
+ *          step() in the style of a vectorized gym environment.
+ *
+ * Every environment is an Intersection built by the same function with its own ArrivalGenerator. An action is the
+ * index of the LightConfig in the schedule to start at the next phase boundary, or #ENV_KEEP_SCHEDULE. It holds
+ * until the next step() changes it, so lights always pass through yellow and the all-red clearance.
+ *
+ * After reset() and every step() the observations are written straight into the buffers given to setBuffers(),
+ * contiguous and indexed [environment][Road::laneGroupIdx()]:
+ *  - queues            vehicles queued in the lane group
+ *  - colors            the TrafficLight::AvailableColors of its light
+ *  - ticksRemaining    ticks left in the current color
+ * Lane groups without a TurnOption read 0 vehicles, red and 0 ticks. Each step also writes the reward, minus the
+ * vehicles queued at the end of the step, and whether the episode ended.
+ *
+ * An episode only depends on its seed: environments given the same seed run the same arrivals.
+ * An environment whose episode ends is reset at once with the next seed, its seed + 1, and its observation is the
+ * first one of the new episode. Vehicles leave the exit Roads on the tick they arrive, so exits never fill.
+ *
+ * The environments are split across threads in contiguous blocks, each written by one thread only.
+ */
+class TrafficEnv{
+public:
+    /**
+     * @brief Adds the Roads, schedule and arrival processes of one environment. The exit Roads missing afterwards
+     *          are added with the lanes of the Road facing the same way.
+     */
+    typedef std::function<void(Intersection& inter, ArrivalGenerator& arrivals)> Builder;
+
+    /**
+     * @brief The observation, reward and episode buffers, owned by the caller. Any may be NULL to skip it.
+     */
+    struct Buffers{
+        float* queues;              ///< [environment][lane group]
+        int32_t* colors;            ///< [environment][lane group]
+        int32_t* ticksRemaining;    ///< [environment][lane group]
+        float* rewards;             ///< [environment]
+        uint8_t* dones;             ///< [environment], 1 if the episode ended on this step
+    };
+
+protected:
+    /**
+     * @brief The SignalPolicy of an environment: its last action picks the next phase. Passed to tick() so the call
+     *          is resolved at compile time.
+     */
+    struct ActionPolicy{
+        int32_t action;     ///< The last action, #ENV_KEEP_SCHEDULE to follow the schedule
+
+        PhaseDecision nextPhase(Intersection& inter, int current){
+            SignalPlan& plan = inter.getSignalPlan();
+            int numPhases = plan.getNumPhases();
+
+            if(action != ENV_KEEP_SCHEDULE){
+                return {action, -1};
+            }
+
+            /// The next valid LightConfig in schedule order, skipping those aimed at missing Roads
+            for(int i=1; i <= numPhases; i++){
+                int idx = (current + i) % numPhases;
+
+                if(plan.getPhase(idx).valid){
+                    return {idx, -1};
+                }
+            }
+
+            return {(current + 1) % numPhases, -1};
+        }
+        bool endGreen(Intersection& inter, int phase, unsigned long greenTicks, unsigned long idleTicks){ return false; }
+    };
+
+    std::vector<Intersection> inters;           ///< The environments
+    std::vector<ArrivalGenerator> arrivals;     ///< The arrivals of every environment
+    std::vector<CompactIntersection> initial;   ///< The state of every environment when its episode starts
+    std::vector<ActionPolicy> policies;         ///< The action of every environment
+    std::vector<uint64_t> seeds;                ///< The seed of the current episode of every environment
+    std::vector<int> numPhases;                 ///< LightConfigs scheduled in every environment
+    std::vector<Road*> ownedExitRoads;          ///< The exit Roads added by the constructor. Owned.
+    int ticksPerStep;                           ///< Ticks every step() moves forward
+    unsigned long episodeTicks;                 ///< Ticks in an episode, 0 for episodes that never end
+    unsigned int numThreads;                    ///< Most threads stepping
+    Buffers buffers;                            ///< Where observations are written
+    unsigned long numSteps;                     ///< step() calls since creation
+
+    /**
+     * @brief Starts a new episode of environment "env" with seed "seed".
+     */
+    void resetEnv(size_t env, uint64_t seed);
+
+    /**
+     * @brief Empties every exit TurnOption of environment "env".
+     */
+    void drainExits(size_t env);
+
+    /**
+     * @brief Writes the observation of environment "env" to the buffers and returns the vehicles queued.
+     */
+    unsigned long observe(size_t env);
+
+    /**
+     * @brief Calls "fn" for every environment, split across threads. An exception thrown by "fn" on any thread is
+     *          rethrown here once every thread has finished.
+     */
+    void forEachEnv(const std::function<void(size_t first, size_t last)>& fn);
+
+public:
+    /**
+     * @param batchSize     the number of environments
+     * @param build         builds every environment, called "batchSize" times in order
+     * @param stepTicks     ticks every step() moves forward
+     * @param episodeLength ticks in an episode, 0 for episodes that never end
+     * @param threads       the most threads stepping, 0 for one per hardware thread
+     *
+     * @throws std::domain_error if "batchSize" or "stepTicks" is not positive
+     * @throws std::invalid_argument if an environment is built without LightConfigs
+     */
+    TrafficEnv(size_t batchSize, const Builder& build, int stepTicks=1, unsigned long episodeLength=0, unsigned int threads=0);
+
+    TrafficEnv(const TrafficEnv&) = delete;
+    TrafficEnv& operator=(const TrafficEnv&) = delete;
+
+    ~TrafficEnv();
+
+    /**
+     * @brief Sets the buffers observations are written to. Each holds getBatchSize() * #NUM_LANE_GROUPS or
+     *          getBatchSize() values.
+     */
+    void setBuffers(const Buffers& newBuffers){ buffers = newBuffers; }
+
+    /**
+     * @brief Starts a new episode of every environment and writes the first observations.
+     *
+     * @param episodeSeeds  getBatchSize() seeds, one per environment
+     */
+    void reset(const uint64_t* episodeSeeds);
+
+    /**
+     * @brief Sets the action of every environment, moves all of them getTicksPerStep() ticks forward and writes the
+     *          observations, rewards and ends of episodes.
+     *
+     * @param actions   getBatchSize() actions, one per environment
+     *
+     * @throws std::out_of_range if an action is neither #ENV_KEEP_SCHEDULE nor a valid LightConfig of its
+     *          environment, i.e. one aimed at a missing Road. No environment is stepped.
+     */
+    void step(const int32_t* actions);
+
+    size_t getBatchSize(){ return inters.size(); }
+    int getNumActions(size_t env){ return numPhases.at(env); }
+    int getTicksPerStep(){ return ticksPerStep; }
+    unsigned long getEpisodeTicks(){ return episodeTicks; }
+    unsigned int getNumThreads(){ return numThreads; }
+    unsigned long getNumSteps(){ return numSteps; }
+    uint64_t getSeed(size_t env){ return seeds.at(env); }
+    Intersection& getIntersection(size_t env){ return inters.at(env); }
+};
+
+#endif
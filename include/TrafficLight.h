@@ -3,9 +3,13 @@
 
 #include <array>
 #include <iostream>
+#include <stdexcept>
+#include "Timebase.h"
 
 extern int refreshRateHzGlobal;
 
+class LightLog;
+
 #define DEFAULT_ON_DURATION (1)
 #define DEFAULT_YELLOW_DURATION (1)
 #define DONT_SET (-1)
@@ -24,6 +28,25 @@ public:
      */
     enum AvailableColors {green, greenLeft, greenRight, yellow, red, numColors};
 
+    /**
+     * @brief What a light does once the duration of its current color runs out.
+     */
+    struct Transition{
+        AvailableColors next;           ///< The color it switches to
+        AvailableColors durationOf;     ///< The color whose duration it then stays on "next" for
+    };
+
+    /**
+     * @brief The Transition out of every color, indexed by the current color.
+     */
+    typedef std::array<Transition, numColors> TransitionTable;
+
+    /**
+     * @brief The default TransitionTable of every onColor: any green goes yellow, yellow goes red and red goes back to
+     *          the onColor, each for its own duration. Built at compile time, see makeDefaultTransitions().
+     */
+    static const std::array<TransitionTable, numColors> defaultTransitions;
+
     double yellowDuration = DEFAULT_YELLOW_DURATION; ///< The duration of the yellow light in seconds.
 
 protected:
@@ -31,18 +54,30 @@ protected:
     AvailableColors color; ///< The current color of the traffic light.
     int ticksRemaining; ///< The remaining duration for the current color in ticks.
     std::array<double, numColors> colorDuration; ///< Array of durations for each color in seconds.
+    std::array<int, numColors> colorDurationTicks; ///< colorDuration converted to ticks at ticksRefreshRate.
+    int ticksRefreshRate; ///< The refresh rate colorDurationTicks was converted at. 0 if never converted.
+    TickRounding ticksRounding; ///< The rounding policy colorDurationTicks was converted with.
     
     /// Variables associated with the lanes directed by this light.
     unsigned long numVehiclesDirected;   ///< The total number of vehicles directed by this light that have crossed through the intersection.
 
+    LightLog* history;  ///< Records every color change, NULL for none. Owned by a LightHistory.
+    const TransitionTable* transitions;  ///< The table nextState() follows, the default table of onColor unless set. Never NULL, not owned.
+
 public:
     /**
      * @brief Default constructor for TrafficLight.
      */
-    TrafficLight(): color(red), 
+    TrafficLight(): onColor(green),
+                    color(red), 
                     ticksRemaining(-1), 
                     colorDuration{0.0, 0.0, 0.0, yellowDuration, -1.0}, 
-                    numVehiclesDirected(0)
+                    colorDurationTicks{0, 0, 0, 0, -1},
+                    ticksRefreshRate(0),
+                    ticksRounding(roundDown),
+                    numVehiclesDirected(0),
+                    history(NULL),
+                    transitions(&defaultTransitions[green])
                     {};
 
     /**
@@ -56,6 +91,9 @@ public:
     TrafficLight(AvailableColors aOnColor, double onColorDur, double redDur);
 
     friend class Intersection; ///< Friend class Intersection.
+    friend class CompactIntersection; ///< Friend class CompactIntersection.
+    friend class Snapshot; ///< Friend class Snapshot.
+    friend class LockstepVariants; ///< Friend class LockstepVariants.
 
     /**
     * @brief Starts the TrafficLight by setting its color to the onColor.
@@ -76,15 +114,90 @@ public:
     /**
      * @brief Determines and sets the next state of the TrafficLight based on the current color and duration.
      * 
-     * If the ticksRemaining is 0, procede to the next state. 
+     * If the ticksRemaining is 0, procede to the next state: the Transition of the current color in the
+     * TransitionTable gives the new color and the color whose duration it stays on for.
      *
      * @return The new color of the TrafficLight.
      * 
-     * @throws std::out_of_range if TrafficLight reaches an unexpected color state.
      * @warning if ticksRemaining is negative, it will remain in the same state
      */
     AvailableColors nextState();
 
+    /**
+     * @brief Builds the default TransitionTable of a light whose onColor is "aOnColor".
+     */
+    static constexpr TransitionTable makeDefaultTransitions(AvailableColors aOnColor){
+        return {{{yellow, yellow}, {yellow, yellow}, {yellow, yellow}, {red, red}, {aOnColor, aOnColor}}};
+    }
+
+    /**
+     * @brief Builds the default TransitionTable of every onColor, indexed by the onColor.
+     */
+    static constexpr std::array<TransitionTable, numColors> makeDefaultTransitions(){
+        std::array<TransitionTable, numColors> tables{};
+
+        for(int tableOnColor=0; tableOnColor < numColors; tableOnColor++){
+            tables[tableOnColor] = makeDefaultTransitions((AvailableColors)tableOnColor);
+        }
+
+        return tables;
+    }
+
+    /**
+     * @brief Builds the TransitionTable of a light cycling through "sequence" in order, staying on each color for
+     *          that color's duration. Colors missing from "sequence" go to its first color.
+     *
+     * e.g. {yellow} flashes yellow, {greenLeft, green, yellow, red} is a protected then permissive left.
+     *
+     * @throws std::invalid_argument if a color appears twice in "sequence", at compile time in a constant expression
+     */
+    template <size_t N>
+    static constexpr TransitionTable makeSequenceTransitions(const std::array<AvailableColors, N>& sequence){
+        static_assert(N > 0 && N <= numColors, "A sequence holds every color at most once");
+        TransitionTable table{};
+        std::array<bool, numColors> isInSequence{};
+
+        for(int fromColor=0; fromColor < numColors; fromColor++){
+            table[fromColor] = {sequence[0], sequence[0]};
+        }
+
+        for(size_t i=0; i < N; i++){
+            AvailableColors next = sequence[(i + 1) % N];
+
+            if(isInSequence[sequence[i]]){
+                throw std::invalid_argument("TrafficLight::makeSequenceTransitions() a color appears twice in the sequence");
+            }
+
+            isInSequence[sequence[i]] = true;
+            table[sequence[i]] = {next, next};
+        }
+
+        return table;
+    }
+
+    /**
+     * @brief Sets the TransitionTable nextState() follows, e.g. one from makeSequenceTransitions().
+     *
+     * @param table the table, NULL for the default table of the onColor. The TrafficLight does not take ownership.
+     *
+     * @note Intersection::fork() copies the table, so Intersection::startAt() and the PredictiveController follow
+     *          it too. SignalPlan, CompactIntersection, Snapshot, CorridorCoordinator and LockstepVariants model the
+     *          default table only; Snapshot::save(), CorridorCoordinator::optimize() and LockstepVariants throw on
+     *          any other. An Intersection waits for its lights to turn red before the next LightConfig, so a table
+     *          that never reaches red keeps its LightConfig on.
+     */
+    void setTransitions(const TransitionTable* table){ transitions = (table != NULL) ? table : &defaultTransitions[onColor]; }
+
+    /**
+     * @brief Gets the TransitionTable nextState() follows.
+     */
+    const TransitionTable& getTransitions(){ return *transitions; }
+
+    /**
+     * @brief Checks if nextState() follows the default TransitionTable of the onColor.
+     */
+    bool hasDefaultTransitions(){ return transitions == &defaultTransitions[onColor]; }
+
     /**
      * @brief Get the time remaining until next state in ticks
      * 
@@ -100,6 +213,33 @@ public:
      */
     double getColorDuration(AvailableColors durColor){ return colorDuration[durColor]; };
 
+    /**
+     * @brief Gets the duration for a specific color in ticks. The durations are only converted again
+     *          when refreshRateHzGlobal or tickRoundingGlobal has changed since the last conversion.
+     *
+     * @param durColor The color for which to get the duration.
+     * @return The duration for the specified color in ticks, -1 is infinite.
+     */
+    int getColorDurationTicks(AvailableColors durColor){
+        if( ! durationTicksAreCurrent()){
+            refreshDurationTicks();
+        }
+
+        return colorDurationTicks[durColor];
+    }
+
+    /**
+     * @brief Checks if colorDurationTicks was converted at the current refresh rate and rounding policy
+     */
+    bool durationTicksAreCurrent(){ return ticksRefreshRate == refreshRateHzGlobal && ticksRounding == tickRoundingGlobal; }
+
+    /**
+     * @brief Converts every colorDuration to ticks at the current refresh rate and rounding policy.
+     *
+     * @throws std::overflow_error if a duration does not fit in ticks, colorDurationTicks is left unchanged.
+     */
+    void refreshDurationTicks();
+
     /**
      * @brief Gets the current color of the traffic light.
      *
@@ -144,9 +284,9 @@ public:
      * @brief Adds "numVehicles" to the total number of vehicles directed by this light
      * 
      * @param numVehicles the amount to be added
-     * @return int the new total directed
+     * @return the new total directed
      */
-    int addVehiclesDirected(int numVehicles);
+    unsigned long addVehiclesDirected(long numVehicles);
 
     /**
      * @brief Sets the ticks remaining to the duration for the current color.
@@ -158,22 +298,41 @@ public:
      *
      * @param newDuration The new duration value in seconds.
      */
-    void setTicksRemaining(double newDuration){ ticksRemaining = static_cast<int>(newDuration * refreshRateHzGlobal); }
+    void setTicksRemaining(double newDuration){ ticksRemaining = secondsToTicks(newDuration, refreshRateHzGlobal); }
 
     /**
-     * @brief Sets the ticksRemaining to the duration of a specific color.
+     * @brief Sets the ticksRemaining to the duration of a specific color. Integer only unless the
+     *          refresh rate has changed since the durations were last converted.
      *
      * @param durColor The color of the duration to be set to ticksRemaining.
      */
-    void setTicksRemainingColor(AvailableColors durColor){ ticksRemaining = static_cast<int>(colorDuration[durColor] * refreshRateHzGlobal); }
+    void setTicksRemainingColor(AvailableColors durColor){ ticksRemaining = getColorDurationTicks(durColor); }
 
     /**
-     * @brief Sets the duration for a specific color.
+     * @brief Sets the duration for a specific color and converts it to ticks.
      *
      * @param durColor The color for which to set the duration.
      * @param duration The duration value. The number of seconds to stay on "durColor" color.
+     *
+     * @throws std::overflow_error if "duration" does not fit in ticks, the duration is left unchanged.
+     */
+    void setDuration(AvailableColors durColor, double duration);
+
+    /**
+     * @brief Sets the duration for a specific color with its ticks already converted, e.g. by SignalPlan::compile().
+     *
+     * @param durColor  The color for which to set the duration.
+     * @param duration  The duration value in seconds.
+     * @param ticks     "duration" converted to ticks at the current refresh rate and rounding policy.
      */
-    void setDuration(AvailableColors durColor, double duration){ colorDuration[durColor] = duration; }
+    void setDurationTicks(AvailableColors durColor, double duration, int ticks){
+        if( ! durationTicksAreCurrent()){
+            refreshDurationTicks();
+        }
+
+        colorDuration[durColor] = duration;
+        colorDurationTicks[durColor] = ticks;
+    }
 
     /**
      * @brief Sets the duration for the onColor.
@@ -187,12 +346,15 @@ public:
      *
      * @param newColor The new color.
      */
-    void setColor(AvailableColors newColor){ 
-        isValidColor(newColor);
+    void setColor(AvailableColors newColor);
 
-        color = newColor;
-        setTicksRemainingColor(newColor);
-    }
+    /**
+     * @brief Sets the LightLog every color change is recorded to.
+     *
+     * @param log the LightLog, NULL to stop recording
+     */
+    void setHistory(LightLog* log){ history = log; }
+    LightLog* getHistory(){ return history; }
 
     static bool isValidColor(const AvailableColors& aColor){
         if(aColor < 0 || aColor >= numColors){
@@ -264,4 +426,6 @@ public:
 
 };
 
+inline constexpr std::array<TrafficLight::TransitionTable, TrafficLight::numColors> TrafficLight::defaultTransitions = TrafficLight::makeDefaultTransitions();
+
 #endif
\ No newline at end of file
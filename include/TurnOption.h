@@ -7,6 +7,9 @@
 #define DEFAULT_NUM_LANES (1)
 #define DEFAULT_TIME_TO_CROSS (2)   
 
+class VehicleRing;
+class RoadNetwork;
+
 /**
  * @class TurnOption
  * @brief Represents a set of lanes that is directed by a single TrafficLight.
@@ -42,13 +45,34 @@ protected:
     TrafficLight* light;                            ///< Pointer to the TrafficLight that directs these lanes.
     unsigned int numLanes;                          ///< The number of lanes
     unsigned int maxVehiclesPerLane;                ///< The max number of vehicles allowed per lane
-    unsigned int timeToCross;                       ///< The number of ticks it takes for a vehicle to cross through the intersection
+    unsigned int timeToCross;                       ///< The number of seconds it takes for a vehicle to cross through the intersection
+    unsigned int timeToCrossTicks;                  ///< timeToCross converted to ticks at ticksRefreshRate
+    int ticksRefreshRate;                           ///< The refresh rate timeToCrossTicks was converted at. 0 if never converted.
 
     unsigned int queuedVehicles;                    ///< The number of vehicles currently waiting
     unsigned int currentVehicleProgress;            ///< The number of ticks remaining for the vehicle(s) currently in the intersection to cross.
     unsigned int numVehiclesCurrentlyCrossing;      ///< The number of vehicles currently crossing the intersection.
+    unsigned long cumulativeArrivals;               ///< Total vehicles that have joined the queue
+    unsigned long cumulativeDepartures;             ///< Total vehicles that have left the queue by crossing
+    VehicleRing* vehicles;                          ///< The queued vehicles in agent mode, NULL in the count-based mode. Owned by a VehiclePool.
+
+    /**
+     * @brief Adds up to "numVehiclesToAdd" vehicles to the count of queued vehicles, as many as fit.
+     *
+     * @return the number of vehicles added
+     */
+    unsigned int admitVehicles(int numVehiclesToAdd);
 
 public:
+    friend class Intersection; ///< Friend class Intersection.
+    friend class CompactIntersection; ///< Friend class CompactIntersection.
+    friend class Snapshot; ///< Friend class Snapshot.
+    friend class RoadNetwork; ///< Friend class RoadNetwork.
+    friend class TrafficEnv; ///< Friend class TrafficEnv.
+    friend class ScheduleOptimizer; ///< Friend class ScheduleOptimizer.
+    friend class CorridorCoordinator; ///< Friend class CorridorCoordinator.
+    friend class LockstepVariants; ///< Friend class LockstepVariants.
+
     /**
      * @brief Default constructor for TurnOption. Sets all values to 0, type is set to an invalid value.
      */
@@ -57,9 +81,14 @@ public:
                     numLanes(0), 
                     maxVehiclesPerLane(0),
                     timeToCross(0),
+                    timeToCrossTicks(0),
+                    ticksRefreshRate(0),
                     queuedVehicles(0), 
                     currentVehicleProgress(0), 
-                    numVehiclesCurrentlyCrossing(0)
+                    numVehiclesCurrentlyCrossing(0),
+                    cumulativeArrivals(0),
+                    cumulativeDepartures(0),
+                    vehicles(NULL)
                     {}
     
     TurnOption(Type aType, unsigned int lanes, unsigned int maxNumVehiclesPerLane, unsigned int crossTime, double lightDuration, double lightRedDuration=-1.0);   
@@ -106,8 +135,11 @@ public:
      * Adds vehicles into Intersection crossing only if light is green, not yellow/red.
      * 
      * @param exitTurnOpt   The TurnOption being exited onto, the exiting vehicles will be added to this queue.
+     * @param network       (Optional) In agent mode routes each exiting vehicle with a destination to its next hop
+     *                      instead, with "exitTurnOpt" for the rest.
+     * @param routeState    (Optional) The RoadNetwork state of the Road being exited onto
      */
-    void nextVehiclesBeginCrossing(TurnOption *exitTurnOpt);
+    void nextVehiclesBeginCrossing(TurnOption *exitTurnOpt, RoadNetwork* network=NULL, long routeState=-1);
 
     /**
      * @brief Operations to be taken when vehicles are still in the Intersection when the TrafficLight has turned red.
@@ -120,7 +152,7 @@ public:
 
     /**
      * @brief Add "numVehiclesToAdd" vehicles to the queue. The queue is limited to 
-     *  the size returned by getMaxNumVehicles().
+     *  the size returned by getMaxNumVehicles(). In agent mode a new vehicle is created for each one added.
      * 
      * @param numVehicles 
      * @return true all "numVehiclesToAdd" vehicles were added without exceeding the max queue size
@@ -133,11 +165,56 @@ public:
     unsigned int getNumLanes(){ return numLanes; }
     unsigned int getMaxVehiclesPerLane(){ return maxVehiclesPerLane; }
     unsigned int getMaxNumVehicles(){ return getMaxVehiclesPerLane() * getNumLanes(); }
-    unsigned int getTimeToCross(){ return timeToCross * refreshRateHzGlobal; }
+
+    /**
+     * @brief Sets the max number of vehicles allowed per lane. Set it before a VehiclePool is attached, whose
+     *          rings are sized from it.
+     */
+    void setMaxVehiclesPerLane(unsigned int maxVehicles){ maxVehiclesPerLane = maxVehicles; }
+
+    /**
+     * @brief Gets the number of ticks it takes for a vehicle to cross. Only converted again when
+     *          refreshRateHzGlobal has changed since the last call.
+     */
+    unsigned int getTimeToCross(){
+        if(ticksRefreshRate != refreshRateHzGlobal){
+            timeToCrossTicks = timeToCross * refreshRateHzGlobal;
+            ticksRefreshRate = refreshRateHzGlobal;
+        }
+
+        return timeToCrossTicks;
+    }
+
     unsigned int getQueuedVehicles(){ return queuedVehicles; }
     unsigned int getCurrentVehicleProgress(){ return currentVehicleProgress; }
     unsigned int getNumVehiclesCurrentlyCrossing(){ return numVehiclesCurrentlyCrossing; }
 
+    /**
+     * @brief Gets the cumulative arrival curve A(t): every vehicle ever added to the queue. The queue length is
+     *          A(t) - D(t) and the area between the two curves is the total time vehicles spent queued.
+     */
+    unsigned long getCumulativeArrivals(){ return cumulativeArrivals; }
+
+    /**
+     * @brief Gets the cumulative departure curve D(t): every vehicle that has finished crossing.
+     */
+    unsigned long getCumulativeDepartures(){ return cumulativeDepartures; }
+
+    /**
+     * @brief Adds to both cumulative curves, e.g. for the signal periods Intersection::advance() skips.
+     */
+    void addCumulative(unsigned long arrivals, unsigned long departures){ cumulativeArrivals += arrivals; cumulativeDepartures += departures; }
+
+    /**
+     * @brief Gets the ring of queued vehicles in agent mode, NULL in the count-based mode.
+     */
+    VehicleRing* getVehicles(){ return vehicles; }
+
+    /**
+     * @brief Sets the ring of queued vehicles. Called by VehiclePool.
+     */
+    void setVehicles(VehicleRing* ring){ vehicles = ring; }
+
 };
 
 #endif
\ No newline at end of file
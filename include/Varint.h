@@ -0,0 +1,102 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#define VARINT_MAX_BYTES    (10)    ///< A 64 bit value takes at most 10 bytes
+
+/**
+ * @brief Appends "value" to "out" as an unsigned LEB128 varint: 7 bits per byte, low bits first, the high bit of
+ *          every byte but the last is set. Values below 128 take a single byte.
+ */
+inline void putVarint(std::vector<uint8_t>& out, uint64_t value){
+    while(value >= 0x80){
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+
+    out.push_back((uint8_t)value);
+}
+
+/**
+ * @brief Reads a varint written by putVarint() at "pos" and moves "pos" past it.
+ *
+ * @throws std::runtime_error if the varint runs past "end" or is longer than VARINT_MAX_BYTES
+ */
+inline uint64_t getVarint(const uint8_t*& pos, const uint8_t* end){
+    uint64_t value = 0;
+
+    for(int shift=0; shift < 7 * VARINT_MAX_BYTES; shift += 7){
+        if(pos == end){
+            throw std::runtime_error("getVarint() varint is truncated");
+        }
+
+        uint8_t byte = *pos++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+
+        if((byte & 0x80) == 0){
+            return value;
+        }
+    }
+
+    throw std::runtime_error("getVarint() varint is too long");
+}
+
+/**
+ * @brief Maps signed values to unsigned ones so that small magnitudes of either sign encode into few varint bytes:
+ *          0, -1, 1, -2, ... become 0, 1, 2, 3, ...
+ */
+inline uint64_t zigzagEncode(int64_t value){ return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+inline int64_t zigzagDecode(uint64_t value){ return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+/**
+ * @brief Appends the 8 bytes of "value" to "out" unchanged, for values such as digests that fill all 64 bits.
+ */
+inline void putFixed64(std::vector<uint8_t>& out, uint64_t value){
+    uint8_t bytes[sizeof(uint64_t)];
+
+    std::memcpy(bytes, &value, sizeof(uint64_t));
+    out.insert(out.end(), bytes, bytes + sizeof(uint64_t));
+}
+
+/**
+ * @brief Reads a value written by putFixed64() at "pos" and moves "pos" past it.
+ *
+ * @throws std::runtime_error if fewer than 8 bytes are left before "end"
+ */
+inline uint64_t getFixed64(const uint8_t*& pos, const uint8_t* end){
+    uint64_t value;
+
+    if(end - pos < (long)sizeof(uint64_t)){
+        throw std::runtime_error("getFixed64() value is truncated");
+    }
+
+    std::memcpy(&value, pos, sizeof(uint64_t));
+    pos += sizeof(uint64_t);
+
+    return value;
+}
+
+/**
+ * @brief Appends the bits of "value" with putFixed64() so that it reads back exactly.
+ */
+inline void putDouble(std::vector<uint8_t>& out, double value){
+    uint64_t bits;
+
+    std::memcpy(&bits, &value, sizeof(double));
+    putFixed64(out, bits);
+}
+
+inline double getDouble(const uint8_t*& pos, const uint8_t* end){
+    uint64_t bits = getFixed64(pos, end);
+    double value;
+
+    std::memcpy(&value, &bits, sizeof(double));
+
+    return value;
+}
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef VEHICLE_POOL_H
+#define VEHICLE_POOL_H
+
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <vector>
+#include "Intersection.h"
+
+class VehiclePool;
+
+/**
+ * @brief One vehicle in agent mode.
+ */
+struct VehicleRecord{
+    uint32_t id;            ///< Unique within its VehiclePool until 2^32 vehicles have been created
+    uint32_t arrivalTick;   ///< The tick the vehicle entered the network
+    uint32_t routeIndex;    ///< The route of the vehicle, the lane id of the queue it entered by or its RoadNetwork destination
+};
+
+/**
+ * @class TripSink
+ * @brief Receives every vehicle that leaves the network.
+ */
+class TripSink{
+public:
+    virtual ~TripSink(){}
+
+    /**
+     * @brief Called once per vehicle as it leaves the network.
+     *
+     * @param vehicle       the vehicle
+     * @param departureTick the tick it finished crossing
+     * @param completed     false if it was lost because the queue it crossed into was full
+     */
+    virtual void trip(const VehicleRecord& vehicle, unsigned long departureTick, bool completed) = 0;
+};
+
+/**
+ * @class TripStream
+ * @brief A TripSink that writes one CSV line per trip: id,route,arrivalTick,departureTick,tripSeconds,completed
+ */
+class TripStream : public TripSink{
+protected:
+    std::ostream& out;  ///< Receives the lines
+    int refreshRate;    ///< refreshRateHzGlobal when created, converts ticks to seconds
+
+public:
+    /**
+     * @brief Creates a stream writing to "output", starting with the header line.
+     */
+    TripStream(std::ostream& output);
+
+    void trip(const VehicleRecord& vehicle, unsigned long departureTick, bool completed) override;
+};
+
+/**
+ * @class VehicleRing
+ * @brief The vehicles queued in one TurnOption, oldest first, in a fixed-capacity ring of records owned by a
+ *          VehiclePool.
+ *
+ * The ring holds the same number of vehicles as TurnOption::getQueuedVehicles(). The vehicles crossing are the
+ * oldest getNumVehiclesCurrentlyCrossing() of them, as in the count-based mode.
+ */
+class VehicleRing{
+protected:
+    VehiclePool* pool;      ///< Owns the records and receives finished trips
+    VehicleRecord* slots;   ///< "capacity" records inside the pool
+    uint32_t capacity;      ///< TurnOption::getMaxNumVehicles() when allocated
+    uint32_t head;          ///< Index of the oldest vehicle in slots
+    uint32_t size;          ///< Number of vehicles in the ring
+    uint32_t laneId;        ///< Index of the ring in its pool, the route of vehicles created in it
+
+public:
+    friend class VehiclePool; ///< Friend class VehiclePool.
+
+    VehicleRing(VehiclePool* owner, VehicleRecord* records, uint32_t numSlots, uint32_t id)
+        : pool(owner), slots(records), capacity(numSlots), head(0), size(0), laneId(id){}
+
+    /**
+     * @brief Appends "vehicle" as the newest.
+     *
+     * @throws std::length_error if the ring is full
+     */
+    void push(const VehicleRecord& vehicle);
+
+    /**
+     * @brief Removes and returns the oldest vehicle.
+     *
+     * @throws std::logic_error if the ring is empty
+     */
+    VehicleRecord pop();
+
+    /**
+     * @brief Creates "numVehicles" new vehicles arriving now.
+     */
+    void spawn(unsigned int numVehicles){ spawn(numVehicles, laneId); }
+
+    /**
+     * @brief Creates "numVehicles" new vehicles arriving now on route "routeIndex".
+     */
+    void spawn(unsigned int numVehicles, uint32_t routeIndex);
+
+    /**
+     * @brief Gets the "i"th oldest vehicle.
+     *
+     * @throws std::out_of_range if there are not more than "i" vehicles
+     */
+    const VehicleRecord& at(uint32_t i) const;
+
+    uint32_t getSize() const{ return size; }
+    uint32_t getCapacity() const{ return capacity; }
+    uint32_t getLaneId() const{ return laneId; }
+    VehiclePool* getPool() const{ return pool; }
+
+    /**
+     * @brief Moves the "numFinished" vehicles that finished crossing out of "from" into "to". The first
+     *          "numAdmitted" join "to", the rest were turned away by a full queue and end their trip lost. Vehicles
+     *          crossing into a TurnOption without a ring leave the network.
+     *
+     * @param from          the ring of the TurnOption crossed from, NULL in count mode to create the vehicles
+     * @param to            the ring of the exit TurnOption, NULL if it is not in agent mode
+     * @param numFinished   vehicles that finished crossing
+     * @param numAdmitted   of those, the number the exit TurnOption had room for
+     */
+    static void transfer(VehicleRing* from, VehicleRing* to, unsigned int numFinished, unsigned int numAdmitted);
+};
+
+/**
+ * @class VehiclePool
+ * @brief Agent mode: every queued vehicle is a 12 byte VehicleRecord, so trip times can be measured per vehicle.
+ *
+ * Attaching an Intersection gives each of its TurnOptions a VehicleRing cut from one block of records reserved up
+ * front, so vehicles arrive, cross and move between the rings of connected Intersections without allocating. The
+ * counts kept by TurnOption are unchanged and match the count-based mode. A vehicle leaves the network when it
+ * crosses into a TurnOption without a ring, and its trip goes to the TripSink.
+ *
+ * Rings are not returned to the pool when an Intersection is detached.
+ *
+ * @note Intersection::advance() steps every tick while a VehiclePool is attached.
+ * @note CompactIntersection::unpack() and Snapshot::restore() set the counts without the rings, attach afterwards.
+ */
+class VehiclePool{
+protected:
+    std::vector<VehicleRecord> records;     ///< The storage of every ring, never reallocated
+    size_t numAllocated;                    ///< Records handed out to rings
+    std::deque<VehicleRing> rings;          ///< Every ring allocated, addresses stay valid as it grows
+    TripSink* sink;                         ///< Receives finished trips, NULL to drop them. Not owned.
+    uint32_t nextId;                        ///< The id of the next vehicle created
+    unsigned long now;                      ///< The tick vehicles arrive and depart at
+    unsigned long numLive;                  ///< Vehicles in a ring
+    unsigned long numTrips;                 ///< Vehicles that left the network
+    unsigned long numLost;                  ///< Of those, vehicles turned away by a full queue
+
+    /**
+     * @brief Ends the trip of "vehicle" now and passes it to the sink.
+     */
+    void finishTrip(const VehicleRecord& vehicle, bool completed);
+
+public:
+    friend class VehicleRing; ///< Friend class VehicleRing.
+    friend class Intersection; ///< Friend class Intersection.
+    friend class RoadNetwork; ///< Friend class RoadNetwork.
+
+    /**
+     * @brief Creates a pool with room for "capacity" queued vehicles.
+     *
+     * @param tripSink  receives every finished trip, NULL for none. The pool does not take ownership.
+     */
+    VehiclePool(size_t capacity, TripSink* tripSink=NULL);
+
+    VehiclePool(const VehiclePool&) = delete;
+    VehiclePool& operator=(const VehiclePool&) = delete;
+
+    /**
+     * @brief Gives every TurnOption of "inter" a ring holding a new vehicle for each queued one.
+     *
+     * @note Called by Intersection::setVehiclePool()
+     *
+     * @throws std::logic_error if a TurnOption already has a ring
+     * @throws std::length_error if the pool does not have room for the rings
+     */
+    void attach(Intersection& inter);
+
+    /**
+     * @brief Returns the TurnOptions of "inter" to the count-based mode. Their vehicles are dropped without a trip.
+     */
+    void detach(Intersection& inter);
+
+    void setTripSink(TripSink* tripSink){ sink = tripSink; }
+
+    unsigned long getNumLive(){ return numLive; }
+    unsigned long getNumTrips(){ return numTrips; }
+    unsigned long getNumLost(){ return numLost; }
+    size_t getCapacity(){ return records.size(); }
+    size_t getNumAllocated(){ return numAllocated; }
+};
+
+#endif
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+
+#include "ArrivalGenerator.h"
+
+static_assert(ARRIVAL_TICKS_PER_DRAW == std::tuple_size<Philox4x32::Counter>::value, "Every word of a Philox4x32 draw goes to one tick");
+
+ArrivalProcess ArrivalProcess::poissonArrivals(double rate){
+    ArrivalProcess process;
+
+    if( ! (rate >= 0)){
+        throw std::domain_error("ArrivalProcess::poissonArrivals() rate must be >= 0");
+    }
+
+    process.type = poisson;
+    process.vehiclesPerHour = {rate};
+
+    return process;
+}
+
+ArrivalProcess ArrivalProcess::platoonArrivals(int size, double periodSeconds, double offsetSeconds){
+    ArrivalProcess process;
+
+    if(size < 0 || size > UINT16_MAX || ! (periodSeconds > 0) || ! (offsetSeconds >= 0)){
+        throw std::domain_error("ArrivalProcess::platoonArrivals() needs 0 <= size <= 65535, period > 0 and offset >= 0");
+    }
+
+    process.type = platoon;
+    process.platoonSize = size;
+    process.platoonPeriod = periodSeconds;
+    process.platoonOffset = offsetSeconds;
+
+    return process;
+}
+
+ArrivalProcess ArrivalProcess::timeVaryingArrivals(const std::vector<double>& rates, double binSeconds){
+    ArrivalProcess process;
+
+    if(rates.empty() || ! (binSeconds > 0)){
+        throw std::domain_error("ArrivalProcess::timeVaryingArrivals() needs at least one bin and a bin duration > 0");
+    }
+
+    for(double rate : rates){
+        if( ! (rate >= 0)){
+            throw std::domain_error("ArrivalProcess::timeVaryingArrivals() rates must be >= 0");
+        }
+    }
+
+    process.type = timeVarying;
+    process.vehiclesPerHour = rates;
+    process.binDuration = binSeconds;
+
+    return process;
+}
+
+ArrivalGenerator::ArrivalGenerator(uint64_t rngSeed, uint32_t id){
+    seed = rngSeed;
+    intersectionId = id;
+    compiledRefreshRate = 0;
+    batch.resize(ARRIVAL_BATCH_TICKS * NUM_LANE_GROUPS);
+    batchStartTick = 0;
+    batchIsValid = false;
+    numArrivals = 0;
+    numBlockedArrivals = 0;
+}
+
+void ArrivalGenerator::reseed(uint64_t rngSeed){
+    seed = rngSeed;
+    batchIsValid = false;
+    numArrivals = 0;
+    numBlockedArrivals = 0;
+}
+
+void ArrivalGenerator::setArrivals(Road::RoadDirection dir, TurnOption::Type turn, const ArrivalProcess& process){
+    processes.at(Road::laneGroupIdx(dir, turn)) = process;
+    compiledRefreshRate = 0;
+    batchIsValid = false;
+}
+
+void ArrivalGenerator::setAllArrivals(const ArrivalProcess& process){
+    processes.fill(process);
+    compiledRefreshRate = 0;
+    batchIsValid = false;
+}
+
+void ArrivalGenerator::compile(){
+    std::array<CompiledProcess, NUM_LANE_GROUPS> newCompiled;
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        ArrivalProcess& process = processes[lane];
+        CompiledProcess& out = newCompiled[lane];
+
+        out.type = process.getType();
+        out.binTicks = 1;
+        out.platoonPeriodTicks = 1;
+        out.platoonOffsetTicks = 0;
+
+        switch(process.getType()){
+            case ArrivalProcess::none:
+                break;
+
+            case ArrivalProcess::poisson:
+            case ArrivalProcess::timeVarying:
+                if(process.getType() == ArrivalProcess::timeVarying){
+                    out.binTicks = secondsToTicks(process.getBinDuration(), refreshRateHzGlobal);
+                }
+
+                if(out.binTicks <= 0){
+                    throw std::domain_error("ArrivalGenerator::compile() time varying bin is shorter than a tick");
+                }
+
+                for(double rate : process.getRates()){
+                    double mean = rate / (SECONDS_PER_HOUR * refreshRateHzGlobal);
+
+                    if(mean > ARRIVAL_MAX_MEAN_PER_TICK){
+                        throw std::domain_error("ArrivalGenerator::compile() arrival rate exceeds ARRIVAL_MAX_MEAN_PER_TICK vehicles per tick");
+                    }
+
+                    out.meanPerTick.push_back(mean);
+                    out.expNegMean.push_back(exp(-mean));
+                }
+                break;
+
+            case ArrivalProcess::platoon:
+                out.platoonPeriodTicks = secondsToTicks(process.getPlatoonPeriod(), refreshRateHzGlobal);
+                out.platoonOffsetTicks = secondsToTicks(process.getPlatoonOffset(), refreshRateHzGlobal);
+
+                if(out.platoonPeriodTicks <= 0){
+                    throw std::domain_error("ArrivalGenerator::compile() platoon period is shorter than a tick");
+                }
+                break;
+
+            default:
+                throw std::out_of_range("ArrivalGenerator::compile() encountered an unhandled ArrivalProcess::Type");
+        }
+    }
+
+    compiled = newCompiled;
+    compiledRefreshRate = refreshRateHzGlobal;
+    batchIsValid = false;
+}
+
+int ArrivalGenerator::samplePoisson(double u, double mean, double expNegMean){
+    double probability = expNegMean;
+    double cumulative = probability;
+    int numArrived = 0;
+
+    while(u > cumulative && probability > 0 && numArrived < UINT16_MAX){
+        numArrived++;
+        probability *= mean / numArrived;
+        cumulative += probability;
+    }
+
+    return numArrived;
+}
+
+void ArrivalGenerator::generate(unsigned long startTick, int numTicks, std::vector<uint16_t>& counts){
+    Philox4x32::Key key = {(uint32_t)seed, (uint32_t)(seed >> 32)};
+    std::vector<double> uniforms(numTicks);
+
+    if(compiledRefreshRate != refreshRateHzGlobal){
+        compile();
+    }
+
+    counts.assign((size_t)numTicks * NUM_LANE_GROUPS, 0);
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        const CompiledProcess& process = compiled[lane];
+
+        switch(process.type){
+            case ArrivalProcess::none:
+                break;
+
+            case ArrivalProcess::poisson:
+            case ArrivalProcess::timeVarying:
+                /// Draw the whole batch for this lane group first, every draw is independent of the others
+                for(unsigned long draw = startTick / ARRIVAL_TICKS_PER_DRAW; draw * ARRIVAL_TICKS_PER_DRAW < startTick + numTicks; draw++){
+                    Philox4x32::Counter counter = {(uint32_t)draw, (uint32_t)(draw >> 32), (uint32_t)lane, intersectionId};
+                    Philox4x32::Counter drawn = Philox4x32::generate(counter, key);
+
+                    for(int word=0; word < ARRIVAL_TICKS_PER_DRAW; word++){
+                        unsigned long tick = draw * ARRIVAL_TICKS_PER_DRAW + word;
+
+                        if(tick >= startTick && tick < startTick + numTicks){
+                            uniforms[tick - startTick] = Philox4x32::toUniform(drawn[word]);
+                        }
+                    }
+                }
+
+                for(int t=0; t < numTicks; t++){
+                    size_t bin = ((startTick + t) / process.binTicks) % process.meanPerTick.size();
+
+                    counts[(size_t)t * NUM_LANE_GROUPS + lane] = samplePoisson(uniforms[t], process.meanPerTick[bin], process.expNegMean[bin]);
+                }
+                break;
+
+            case ArrivalProcess::platoon:
+                for(int t=0; t < numTicks; t++){
+                    unsigned long tick = startTick + t;
+
+                    if(tick >= (unsigned long)process.platoonOffsetTicks && (tick - process.platoonOffsetTicks) % process.platoonPeriodTicks == 0){
+                        counts[(size_t)t * NUM_LANE_GROUPS + lane] = processes[lane].getPlatoonSize();
+                    }
+                }
+                break;
+
+            default:
+                throw std::out_of_range("ArrivalGenerator::generate() encountered an unhandled ArrivalProcess::Type");
+        }
+    }
+}
+
+int ArrivalGenerator::arrivalsAt(unsigned long tick, int laneGroup){
+    std::vector<uint16_t> counts;
+
+    generate(tick, 1, counts);
+
+    return counts.at(laneGroup);
+}
+
+long ArrivalGenerator::repeatStart(long period){
+    long start = 0;
+
+    if(compiledRefreshRate != refreshRateHzGlobal){
+        compile();
+    }
+
+    for(const CompiledProcess& process : compiled){
+        if(process.type == ArrivalProcess::none){
+            continue;
+        }
+
+        if(process.type != ArrivalProcess::platoon || period % process.platoonPeriodTicks != 0){
+            return -1;
+        }
+        start = std::max(start, process.platoonOffsetTicks);
+    }
+
+    return start;
+}
+
+int ArrivalGenerator::inject(Intersection& inter){
+    unsigned long tick = inter.time();
+    int numAdded = 0;
+
+    if( ! batchIsValid || compiledRefreshRate != refreshRateHzGlobal || tick < batchStartTick || tick >= batchStartTick + ARRIVAL_BATCH_TICKS){
+        generate(tick, ARRIVAL_BATCH_TICKS, batch);
+        batchStartTick = tick;
+        batchIsValid = true;
+    }
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        int numArriving = batch[(tick - batchStartTick) * NUM_LANE_GROUPS + lane];
+        Road* rd;
+        TurnOption* turnOpt;
+        int numToAdd;
+
+        if(numArriving == 0){
+            continue;
+        }
+
+        rd = inter.getRoad(Road::laneGroupDirection(lane));
+        if(rd == NULL || ! rd->getTurnOption(Road::laneGroupTurn(lane))->isValid()){
+            continue;
+        }
+
+        turnOpt = rd->getTurnOption(Road::laneGroupTurn(lane));
+        numToAdd = std::min(numArriving, (int)(turnOpt->getMaxNumVehicles() - turnOpt->getQueuedVehicles()));
+
+        if(numToAdd > 0){
+            turnOpt->addVehicles(numToAdd);
+            numAdded += numToAdd;
+        }
+
+        numBlockedArrivals += numArriving - numToAdd;
+    }
+
+    numArrivals += numAdded;
+
+    return numAdded;
+}
@@ -0,0 +1,197 @@
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "CompactIntersection.h"
+
+/**
+ * @brief Converts "value" to the narrower type T.
+ *
+ * @param value the value to be narrowed
+ * @param field name of the field being narrowed, used in the error message
+ *
+ * @throws std::overflow_error if "value" is out of the range of T
+ */
+template<typename T>
+static T narrow(long long value, const char* field){
+    if(value < (long long)std::numeric_limits<T>::min() || value > (long long)std::numeric_limits<T>::max()){
+        throw std::overflow_error(std::string("CompactIntersection::pack() ") + field + " = " + std::to_string(value) + " does not fit");
+    }
+
+    return (T)value;
+}
+
+CompactIntersection::CompactIntersection(){
+    ticksSinceStart = 0;
+    configScheduleIdx = 0;
+    numUnfinishedLights = 0;
+    roadMask = 0;
+    clearanceTicksRemaining = -1;
+    phaseGreenTicks = 0;
+    phaseIdleTicks = 0;
+    hasController = 0;
+    reserved = {};
+    laneGroups = {};
+}
+
+void CompactIntersection::pack(Intersection& inter){
+    ticksSinceStart = inter.ticksSinceStart;
+    configScheduleIdx = narrow<uint16_t>(inter.configScheduleIdx, "configScheduleIdx");
+    numUnfinishedLights = narrow<uint8_t>(inter.numUnfinishedLights, "numUnfinishedLights");
+    clearanceTicksRemaining = inter.clearanceTicksRemaining;
+    phaseGreenTicks = narrow<uint32_t>(inter.phaseGreenTicks, "phaseGreenTicks");
+    phaseIdleTicks = narrow<uint32_t>(inter.phaseIdleTicks, "phaseIdleTicks");
+    hasController = (inter.controller != NULL);
+    roadMask = 0;
+    laneGroups = {};
+
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        Road* rd = inter.roads[dir];
+
+        if(rd == NULL){
+            continue;
+        }
+
+        roadMask |= (1 << dir);
+
+        for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+            TurnOption* turnOpt = rd->getTurnOption((TurnOption::Type)opt);
+            LaneGroup& group = laneGroups[laneGroupIdx((Road::RoadDirection)dir, (TurnOption::Type)opt)];
+
+            if( ! turnOpt->isValid()){
+                continue;
+            }
+
+            TrafficLight* light = turnOpt->getLight();
+
+            group.valid = 1;
+            group.color = light->color;
+            group.onColor = light->onColor;
+            group.numLanes = narrow<uint8_t>(turnOpt->numLanes, "numLanes");
+            group.maxVehiclesPerLane = narrow<uint8_t>(turnOpt->maxVehiclesPerLane, "maxVehiclesPerLane");
+            group.timeToCross = narrow<uint16_t>(turnOpt->getTimeToCross(), "timeToCross");
+            group.queuedVehicles = narrow<uint16_t>(turnOpt->queuedVehicles, "queuedVehicles");
+            group.currentVehicleProgress = narrow<uint16_t>(turnOpt->currentVehicleProgress, "currentVehicleProgress");
+            group.numVehiclesCurrentlyCrossing = narrow<uint16_t>(turnOpt->numVehiclesCurrentlyCrossing, "numVehiclesCurrentlyCrossing");
+            group.ticksRemaining = light->ticksRemaining;
+            group.durationTicks[onSlot] = light->getColorDurationTicks(light->onColor);
+            group.durationTicks[yellowSlot] = light->getColorDurationTicks(TrafficLight::yellow);
+            group.durationTicks[redSlot] = light->getColorDurationTicks(TrafficLight::red);
+            group.numVehiclesDirected = light->numVehiclesDirected;
+            group.cumulativeArrivals = turnOpt->cumulativeArrivals;
+            group.cumulativeDepartures = turnOpt->cumulativeDepartures;
+        }
+    }
+}
+
+void CompactIntersection::unpack(Intersection& inter){
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        Road* rd = inter.roads[dir];
+
+        if((rd != NULL) != roadExists((Road::RoadDirection)dir)){
+            throw std::logic_error("CompactIntersection::unpack() Road layout does not match the packed Intersection\n");
+        }
+
+        if(rd == NULL){
+            continue;
+        }
+
+        for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+            TurnOption* turnOpt = rd->getTurnOption((TurnOption::Type)opt);
+            const LaneGroup& group = laneGroups[laneGroupIdx((Road::RoadDirection)dir, (TurnOption::Type)opt)];
+
+            if(turnOpt->isValid() != (bool)group.valid || (group.valid && turnOpt->numLanes != group.numLanes)){
+                throw std::logic_error("CompactIntersection::unpack() TurnOption layout does not match the packed Intersection\n");
+            }
+
+            if( ! group.valid){
+                continue;
+            }
+
+            TrafficLight* light = turnOpt->getLight();
+
+            light->color = (TrafficLight::AvailableColors)group.color;
+            light->ticksRemaining = group.ticksRemaining;
+            light->numVehiclesDirected = group.numVehiclesDirected;
+            turnOpt->queuedVehicles = group.queuedVehicles;
+            turnOpt->currentVehicleProgress = group.currentVehicleProgress;
+            turnOpt->numVehiclesCurrentlyCrossing = group.numVehiclesCurrentlyCrossing;
+            turnOpt->cumulativeArrivals = group.cumulativeArrivals;
+            turnOpt->cumulativeDepartures = group.cumulativeDepartures;
+        }
+    }
+
+    inter.ticksSinceStart = ticksSinceStart;
+    inter.configScheduleIdx = configScheduleIdx;
+    inter.numUnfinishedLights = numUnfinishedLights;
+    inter.clearanceTicksRemaining = clearanceTicksRemaining;
+    inter.phaseGreenTicks = phaseGreenTicks;
+    inter.phaseIdleTicks = phaseIdleTicks;
+}
+
+bool CompactIntersection::sameState(const CompactIntersection& other) const{
+    CompactIntersection otherState = other;
+
+    /// None of the counters feeds back into the simulation
+    otherState.ticksSinceStart = ticksSinceStart;
+    for(int i=0; i < NUM_LANE_GROUPS; i++){
+        otherState.laneGroups[i].numVehiclesDirected = laneGroups[i].numVehiclesDirected;
+        otherState.laneGroups[i].cumulativeArrivals = laneGroups[i].cumulativeArrivals;
+        otherState.laneGroups[i].cumulativeDepartures = laneGroups[i].cumulativeDepartures;
+    }
+
+    return otherState == *this;
+}
+
+uint64_t CompactIntersection::hash() const{
+    const unsigned char* bytes = (const unsigned char*)this;
+    uint64_t digest = 0xcbf29ce484222325ull;
+
+    /// Every byte is defined, pack() zeroes the lane groups and the header has no padding
+    for(size_t i=0; i < sizeof(CompactIntersection); i++){
+        digest ^= bytes[i];
+        digest *= 0x100000001b3ull;
+    }
+
+    return digest;
+}
+
+int CompactIntersection::getNumLaneGroups(){
+    int numValid = 0;
+
+    for(const LaneGroup& group : laneGroups){
+        numValid += group.valid;
+    }
+
+    return numValid;
+}
+
+size_t CompactIntersection::laneGroupFootprint(){
+    return sizeof(TurnOption) + ALLOC_OVERHEAD_BYTES + sizeof(TrafficLight) + ALLOC_OVERHEAD_BYTES;
+}
+
+size_t CompactIntersection::footprint(Intersection& inter){
+    size_t totalBytes = sizeof(Intersection);
+
+    for(Road* rd : inter.roads){
+        if(rd == NULL){
+            continue;
+        }
+
+        totalBytes += sizeof(Road) + ALLOC_OVERHEAD_BYTES;
+
+        for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+            /// Every TurnOption is allocated, only valid ones own a TrafficLight
+            totalBytes += sizeof(TurnOption) + ALLOC_OVERHEAD_BYTES;
+
+            if(rd->getTurnOption((TurnOption::Type)opt)->getLight() != NULL){
+                totalBytes += sizeof(TrafficLight) + ALLOC_OVERHEAD_BYTES;
+            }
+        }
+    }
+
+    totalBytes += inter.configSchedule.capacity() * sizeof(LightConfig*);
+    totalBytes += inter.configSchedule.size() * (sizeof(LightConfig) + ALLOC_OVERHEAD_BYTES);
+
+    return totalBytes;
+}
@@ -0,0 +1,468 @@
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "CorridorCoordinator.h"
+#include "SignalPlan.h"
+
+CorridorCoordinator::CorridorCoordinator(const std::vector<Intersection*>& corridor, Road::RoadDirection approach, unsigned int threads){
+    if(corridor.size() < 2){
+        throw std::invalid_argument("CorridorCoordinator() a corridor needs at least 2 Intersections");
+    }
+
+    nodes = corridor;
+    outboundRoad = approach;
+    inboundRoad = Road::roadOppositeOf(approach);
+    twoWay = true;
+
+    for(Intersection* inter : nodes){
+        Road* outRoad = inter->getRoad(outboundRoad);
+        Road* inRoad = inter->getRoad(inboundRoad);
+
+        if(outRoad == NULL || ! outRoad->getTurnOption(TurnOption::straight)->isValid()){
+            throw std::invalid_argument("CorridorCoordinator() every Intersection needs a straight TurnOption on the approach");
+        }
+
+        twoWay = twoWay && inRoad != NULL && inRoad->getTurnOption(TurnOption::straight)->isValid();
+    }
+
+    linkSeconds.assign(nodes.size() - 1, 0);
+    outboundWeight = 1;
+    inboundWeight = 1;
+    numThreads = (threads == 0) ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+    cycleLength = 0;
+    offsets.assign(nodes.size(), 0);
+    outboundBandwidth = 0;
+    inboundBandwidth = 0;
+    numPasses = 0;
+}
+
+void CorridorCoordinator::setLinkSeconds(const std::vector<double>& seconds){
+    if(seconds.size() != nodes.size() - 1 || std::any_of(seconds.begin(), seconds.end(), [](double s){ return ! (s >= 0); })){
+        throw std::invalid_argument("CorridorCoordinator::setLinkSeconds() requires one time >= 0 per link");
+    }
+
+    linkSeconds = seconds;
+}
+
+void CorridorCoordinator::setWeights(double outbound, double inbound){
+    if( ! (outbound >= 0 && inbound >= 0)){
+        throw std::domain_error("CorridorCoordinator::setWeights() weights must be >= 0");
+    }
+
+    outboundWeight = outbound;
+    inboundWeight = inbound;
+}
+
+long CorridorCoordinator::linkTicks(int link, bool outbound){
+    Intersection* from = outbound ? nodes[link] : nodes[link + 1];
+    Road::RoadDirection dir = outbound ? outboundRoad : inboundRoad;
+
+    return from->getRoad(dir)->getTurnOption(TurnOption::straight)->getTimeToCross() + secondsToTicks(linkSeconds[link], refreshRateHzGlobal) + 1;
+}
+
+std::vector<CorridorCoordinator::Interval> CorridorCoordinator::toIntervals(const std::vector<char>& band){
+    std::vector<Interval> intervals;
+    long size = band.size();
+
+    for(long t=0; t < size; t++){
+        if(band[t] && (t == 0 || ! band[t - 1])){
+            intervals.push_back({t, 0});
+        }
+        if(band[t]){
+            intervals.back().length++;
+        }
+    }
+
+    return intervals;
+}
+
+void CorridorCoordinator::compile(){
+    int numNodes = nodes.size();
+
+    cycleLength = nodes[0]->getSignalPlan().getCycleLength();
+    outboundGreens.assign(numNodes, {});
+    inboundGreens.assign(numNodes, {});
+    outboundArrival.assign(numNodes, 0);
+    inboundArrival.assign(numNodes, 0);
+
+    for(int k=0; k < numNodes; k++){
+        SignalPlan& plan = nodes[k]->getSignalPlan();
+        std::vector<char> green(std::max(0L, cycleLength));
+
+        if(plan.getCycleLength() <= 0 || plan.getCycleLength() != cycleLength){
+            throw std::invalid_argument("CorridorCoordinator::optimize() every schedule must have the same finite cycle length");
+        }
+
+        /// The green intervals come from the SignalPlan, which only knows the default TransitionTables
+        for(TrafficLight* light : nodes[k]->getLights()){
+            if( ! light->hasDefaultTransitions()){
+                throw std::invalid_argument("CorridorCoordinator::optimize() every TrafficLight must follow its default TransitionTable");
+            }
+        }
+
+        for(long t=0; t < cycleLength; t++){
+            green[t] = plan.colorAt(t, outboundRoad, TurnOption::straight) == TrafficLight::green;
+        }
+        outboundGreens[k] = toIntervals(green);
+
+        for(long t=0; twoWay && t < cycleLength; t++){
+            green[t] = plan.colorAt(t, inboundRoad, TurnOption::straight) == TrafficLight::green;
+        }
+        inboundGreens[k] = twoWay ? toIntervals(green) : std::vector<Interval>();
+
+        if(k > 0){
+            outboundArrival[k] = outboundArrival[k - 1] + linkTicks(k - 1, true);
+        }
+    }
+
+    for(int k=numNodes - 2; k >= 0; k--){
+        inboundArrival[k] = inboundArrival[k + 1] + linkTicks(k, false);
+    }
+}
+
+void CorridorCoordinator::nodeBand(int node, unsigned long offset, bool outbound, std::vector<char>& band){
+    long shift = ((outbound ? outboundArrival[node] : inboundArrival[node]) + (long)offset) % cycleLength;
+
+    band.assign(cycleLength, 0);
+    for(const Interval& green : (outbound ? outboundGreens[node] : inboundGreens[node])){
+        for(long t=green.start; t < green.start + green.length; t++){
+            band[((t - shift) % cycleLength + cycleLength) % cycleLength] = 1;
+        }
+    }
+}
+
+void CorridorCoordinator::correlate(const std::vector<Interval>& band, const std::vector<Interval>& greens, std::vector<long>& counts){
+    std::vector<long> slopeChanges(3 * cycleLength + 2, 0);
+    long slope = 0, value = 0;
+
+    /// Every pair of intervals overlaps on a trapezoid of shifts: its slope changes are placed on 3 cycles and folded
+    for(const Interval& a : band){
+        for(const Interval& g : greens){
+            long first = g.start - a.start - a.length + cycleLength;
+            long shorter = std::min(a.length, g.length);
+            long longer = std::max(a.length, g.length);
+
+            slopeChanges[first]++;
+            slopeChanges[first + shorter]--;
+            slopeChanges[first + longer]--;
+            slopeChanges[first + a.length + g.length]++;
+        }
+    }
+
+    counts.assign(cycleLength, 0);
+    for(long i=0; i < 3 * cycleLength; i++){
+        counts[i % cycleLength] += value;
+        slope += slopeChanges[i];
+        value += slope;
+    }
+}
+
+long CorridorCoordinator::bandwidth(const std::vector<unsigned long>& corridorOffsets, bool outbound){
+    std::vector<char> band, nodeGreen;
+
+    if(corridorOffsets.size() != nodes.size()){
+        throw std::invalid_argument("CorridorCoordinator::bandwidth() requires one offset per Intersection");
+    }
+
+    if( ! outbound && ! twoWay){
+        return 0;
+    }
+
+    compile();
+    band.assign(cycleLength, 1);
+    for(size_t k=0; k < nodes.size(); k++){
+        nodeBand(k, corridorOffsets[k], outbound, nodeGreen);
+
+        for(long t=0; t < cycleLength; t++){
+            band[t] &= nodeGreen[t];
+        }
+    }
+
+    return std::count(band.begin(), band.end(), 1);
+}
+
+double CorridorCoordinator::descend(double firstOutWeight, double firstInWeight, std::vector<unsigned long>& result, long& outBand, long& inBand){
+    int numNodes = nodes.size();
+    std::vector<std::vector<char>> outSuffix(numNodes + 1), inSuffix(numNodes + 1);
+    std::vector<char> outPrefix, inPrefix, outOthers, inOthers, nodeGreen;
+    std::vector<long> outCounts(cycleLength, 0), inCounts(cycleLength, 0);
+    bool changed = true;
+    int pass;
+
+    result.assign(numNodes, 0);
+
+    /// Scores every offset of "node" against the band of the other nodes, keeping "current" on a tie
+    auto bestOffset = [&](int node, unsigned long current, double outWeight, double inWeight){
+        unsigned long best = current;
+        double bestScore = -1;
+
+        correlate(toIntervals(outOthers), outboundGreens[node], outCounts);
+        if(twoWay){
+            correlate(toIntervals(inOthers), inboundGreens[node], inCounts);
+        }
+
+        for(long phi=0; phi < cycleLength; phi++){
+            double score = outWeight * outCounts[(outboundArrival[node] + phi) % cycleLength];
+
+            if(twoWay){
+                score += inWeight * inCounts[(inboundArrival[node] + phi) % cycleLength];
+            }
+
+            if(score > bestScore || (score == bestScore && (unsigned long)phi == current)){
+                best = phi;
+                bestScore = score;
+            }
+        }
+
+        return best;
+    };
+
+    for(pass=0; changed && pass < CORRIDOR_MAX_PASSES; pass++){
+        changed = false;
+
+        /// The band of the nodes after each one, with the offsets of the last pass
+        outSuffix[numNodes].assign(cycleLength, 1);
+        inSuffix[numNodes].assign(cycleLength, 1);
+        for(int k=numNodes - 1; k >= 0; k--){
+            outSuffix[k] = outSuffix[k + 1];
+            inSuffix[k] = inSuffix[k + 1];
+
+            nodeBand(k, result[k], true, nodeGreen);
+            for(long t=0; t < cycleLength; t++){
+                outSuffix[k][t] &= nodeGreen[t];
+            }
+
+            if(twoWay){
+                nodeBand(k, result[k], false, nodeGreen);
+                for(long t=0; t < cycleLength; t++){
+                    inSuffix[k][t] &= nodeGreen[t];
+                }
+            }
+        }
+
+        /// The first pass places each node against the ones before it only, later passes against all others
+        outPrefix.assign(cycleLength, 1);
+        inPrefix.assign(cycleLength, 1);
+        for(int k=0; k < numNodes; k++){
+            if(k > 0){
+                outOthers = outPrefix;
+                inOthers = inPrefix;
+
+                for(long t=0; pass > 0 && t < cycleLength; t++){
+                    outOthers[t] &= outSuffix[k + 1][t];
+                    inOthers[t] &= inSuffix[k + 1][t];
+                }
+
+                unsigned long best = (pass == 0) ? bestOffset(k, result[k], firstOutWeight, firstInWeight) : bestOffset(k, result[k], outboundWeight, inboundWeight);
+
+                changed = changed || best != result[k];
+                result[k] = best;
+            }
+
+            nodeBand(k, result[k], true, nodeGreen);
+            for(long t=0; t < cycleLength; t++){
+                outPrefix[t] &= nodeGreen[t];
+            }
+
+            if(twoWay){
+                nodeBand(k, result[k], false, nodeGreen);
+                for(long t=0; t < cycleLength; t++){
+                    inPrefix[t] &= nodeGreen[t];
+                }
+            }
+        }
+    }
+
+    numPasses += pass;
+    outBand = std::count(outPrefix.begin(), outPrefix.end(), 1);
+    inBand = twoWay ? std::count(inPrefix.begin(), inPrefix.end(), 1) : 0;
+
+    return outboundWeight * outBand + inboundWeight * inBand;
+}
+
+const std::vector<unsigned long>& CorridorCoordinator::optimize(){
+    std::vector<unsigned long> candidate;
+    double bestScore = -1;
+    long outBand, inBand;
+
+    compile();
+    numPasses = 0;
+
+    /// Coordinate descent stops at a local optimum: start it from both directions and from both at once
+    for(int start=0; start < (twoWay ? 3 : 1); start++){
+        double score = descend((start == 2) ? 0 : outboundWeight, (start == 1) ? 0 : inboundWeight, candidate, outBand, inBand);
+
+        if(score > bestScore){
+            bestScore = score;
+            offsets = candidate;
+            outboundBandwidth = outBand;
+            inboundBandwidth = inBand;
+        }
+    }
+
+    return offsets;
+}
+
+void CorridorCoordinator::apply(){
+    for(size_t k=0; k < nodes.size(); k++){
+        nodes[k]->startAt(offsets[k]);
+    }
+}
+
+CorridorCoordinator::Verification CorridorCoordinator::verify(const std::vector<unsigned long>& corridorOffsets, double seconds){
+    int numNodes = nodes.size();
+    long numTicks = secondsToTicks(seconds, refreshRateHzGlobal);
+    std::vector<Intersection*> clones(numNodes);
+    std::vector<std::vector<unsigned int>> outLinks(numNodes - 1), inLinks(numNodes - 1);
+    std::vector<long> linkDelays(numNodes - 1);
+    std::vector<unsigned long> queued(numNodes, 0);
+    Verification result = {0, 0, 0};
+
+    if(corridorOffsets.size() != nodes.size()){
+        throw std::invalid_argument("CorridorCoordinator::verify() requires one offset per Intersection");
+    }
+
+    /// Copies are taken and started serially, only the ticks run in parallel
+    for(int k=0; k < numNodes; k++){
+        clones[k] = nodes[k]->fork();
+        clones[k]->setSignalController(NULL);
+        clones[k]->setAutoSequence(true);
+        clones[k]->startAt(corridorOffsets[k]);
+    }
+
+    for(int j=0; j < numNodes - 1; j++){
+        linkDelays[j] = secondsToTicks(linkSeconds[j], refreshRateHzGlobal) + 1;
+        outLinks[j].assign(linkDelays[j] + 1, 0);
+        inLinks[j].assign(linkDelays[j] + 1, 0);
+    }
+
+    /// A link is written by the node before it and read by the node after it, on slots at least one tick apart
+    auto stepNode = [&](int k, long t){
+        Intersection& inter = *clones[k];
+
+        if(k > 0){
+            std::vector<unsigned int>& link = outLinks[k - 1];
+            unsigned int& arriving = link[t % link.size()];
+
+            if(arriving > 0){
+                inter.addVehicles(outboundRoad, TurnOption::straight, arriving);
+            }
+            arriving = 0;
+        }
+
+        if(twoWay && k < numNodes - 1){
+            std::vector<unsigned int>& link = inLinks[k];
+            unsigned int& arriving = link[t % link.size()];
+
+            if(arriving > 0){
+                inter.addVehicles(inboundRoad, TurnOption::straight, arriving);
+            }
+            arriving = 0;
+        }
+
+        inter.tick();
+
+        TurnOption* outExit = inter.getExitTurnOption(outboundRoad, TurnOption::straight);
+        TurnOption* inExit = twoWay ? inter.getExitTurnOption(inboundRoad, TurnOption::straight) : NULL;
+
+        if(outExit != NULL && k < numNodes - 1){
+            outLinks[k][(t + linkDelays[k]) % outLinks[k].size()] += outExit->getQueuedVehicles();
+        }
+        else if(outExit != NULL){
+            result.outboundDepartures += outExit->getQueuedVehicles();
+        }
+
+        if(inExit != NULL && k > 0){
+            inLinks[k - 1][(t + linkDelays[k - 1]) % inLinks[k - 1].size()] += inExit->getQueuedVehicles();
+        }
+        else if(inExit != NULL){
+            result.inboundDepartures += inExit->getQueuedVehicles();
+        }
+
+        for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+            Road* exitRoad = inter.getExitRoad(dir);
+
+            for(int turn=0; exitRoad != NULL && turn < TurnOption::numTurnOptions; turn++){
+                exitRoad->getTurnOption((TurnOption::Type)turn)->queuedVehicles = 0;
+            }
+        }
+
+        queued[k] += inter.getRoad(outboundRoad)->getTurnOption(TurnOption::straight)->getQueuedVehicles();
+        if(twoWay){
+            queued[k] += inter.getRoad(inboundRoad)->getTurnOption(TurnOption::straight)->getQueuedVehicles();
+        }
+    };
+
+    unsigned int threads = std::min(numThreads, std::max(1u, (unsigned int)(numNodes / CORRIDOR_MIN_NODES_PER_THREAD)));
+
+    std::exception_ptr error;
+
+    if(threads == 1){
+        try{
+            for(long t=0; t < numTicks; t++){
+                for(int k=0; k < numNodes; k++){
+                    stepNode(k, t);
+                }
+            }
+        }
+        catch(...){
+            error = std::current_exception();
+        }
+    }
+    else{
+        std::barrier<> tickDone(threads);
+        std::vector<std::thread> workers;
+        std::mutex errorMutex;
+        std::atomic<bool> failed(false);
+
+        for(unsigned int w=0; w < threads; w++){
+            workers.emplace_back([&, w](){
+                int first = numNodes * w / threads;
+                int last = numNodes * (w + 1) / threads;
+
+                for(long t=0; t < numTicks; t++){
+                    try{
+                        for(int k=first; ! failed.load(std::memory_order_relaxed) && k < last; k++){
+                            stepNode(k, t);
+                        }
+                    }
+                    catch(...){
+                        {
+                            std::lock_guard<std::mutex> lock(errorMutex);
+                            if( ! error){
+                                error = std::current_exception();
+                            }
+                        }
+                        failed.store(true, std::memory_order_relaxed);
+
+                        /// The others keep meeting at the barrier without this thread until their last tick
+                        tickDone.arrive_and_drop();
+                        return;
+                    }
+                    tickDone.arrive_and_wait();
+                }
+            });
+        }
+
+        for(std::thread& worker : workers){
+            worker.join();
+        }
+    }
+
+    for(int k=0; k < numNodes; k++){
+        result.delay += (double)queued[k] / refreshRateHzGlobal;
+        nodes[k]->releaseFork(clones[k]);
+    }
+
+    if(error){
+        std::rethrow_exception(error);
+    }
+
+    return result;
+}
@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "ArrivalGenerator.h"
+#include "DelayMetrics.h"
+
+DelayMetrics::DelayMetrics(double window, double bucket, double sketchAccuracy)
+    : intersectionQueueSketch(sketchAccuracy), intersectionDelaySketch(sketchAccuracy){
+    if( ! (bucket > 0) || ! (window >= bucket)){
+        throw std::domain_error("DelayMetrics() bucket must be > 0 and no longer than the window");
+    }
+
+    windowSeconds = window;
+    bucketSeconds = bucket;
+    bucketTicks = 0;
+    numBuckets = std::max(1L, std::lround(window / bucket));
+    refreshRate = 0;
+    numTicks = 0;
+    numBucketsFinished = 0;
+
+    for(Lane& lane : lanes){
+        lane = {};
+    }
+
+    queueSketches.fill(QuantileSketch(sketchAccuracy));
+    delaySketches.fill(QuantileSketch(sketchAccuracy));
+}
+
+void DelayMetrics::attach(Intersection& inter){
+    bucketTicks = secondsToTicks(bucketSeconds, refreshRateHzGlobal);
+    if(bucketTicks <= 0){
+        throw std::domain_error("DelayMetrics::attach() bucket is shorter than a tick");
+    }
+
+    refreshRate = refreshRateHzGlobal;
+    numTicks = 0;
+    numBucketsFinished = 0;
+
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        queueSketches[dir].clear();
+        delaySketches[dir].clear();
+    }
+    intersectionQueueSketch.clear();
+    intersectionDelaySketch.clear();
+
+    for(int idx=0; idx < NUM_LANE_GROUPS; idx++){
+        Lane& lane = lanes[idx];
+        Road* rd = inter.getRoad(Road::laneGroupDirection(idx));
+        TurnOption* turnOpt = (rd == NULL) ? NULL : rd->getTurnOption(Road::laneGroupTurn(idx));
+
+        lane.valid = (turnOpt != NULL && turnOpt->isValid());
+        lane.current = {};
+        lane.windowStart = {};
+        lane.maxQueue = 0;
+        lane.bucketMaxQueue = 0;
+        lane.maxQueuesHead = 0;
+        lane.maxQueuesSize = 0;
+        lane.arrivalTicksHead = 0;
+        lane.arrivalTicksSize = 0;
+
+        if( ! lane.valid){
+            lane.bucketSamples.clear();
+            lane.maxQueues.clear();
+            lane.arrivalTicks.clear();
+            continue;
+        }
+
+        lane.baseArrivals = turnOpt->getCumulativeArrivals();
+        lane.baseDepartures = turnOpt->getCumulativeDepartures();
+        lane.maxQueue = turnOpt->getQueuedVehicles();
+        lane.bucketMaxQueue = turnOpt->getQueuedVehicles();
+
+        /// The samples before the first boundaries are the curves at attach(), all 0
+        lane.bucketSamples.assign(numBuckets, Sample{});
+        lane.maxQueues.resize(numBuckets);
+
+        /// The queue never holds more than its maximum, vehicles already queued arrived at attach()
+        lane.arrivalTicks.assign(turnOpt->getMaxNumVehicles(), 0);
+        lane.arrivalTicksSize = std::min((size_t)turnOpt->getQueuedVehicles(), lane.arrivalTicks.size());
+    }
+}
+
+void DelayMetrics::updateDelays(Lane& lane, Road::RoadDirection dir, unsigned long numArrived, unsigned long numDeparted){
+    size_t capacity = lane.arrivalTicks.size();
+
+    for(unsigned long i=0; i < numArrived && lane.arrivalTicksSize < capacity; i++){
+        lane.arrivalTicks[(lane.arrivalTicksHead + lane.arrivalTicksSize) % capacity] = numTicks;
+        lane.arrivalTicksSize++;
+    }
+
+    for(unsigned long i=0; i < numDeparted && lane.arrivalTicksSize > 0; i++){
+        double delay = (numTicks - lane.arrivalTicks[lane.arrivalTicksHead]) / (double)refreshRate;
+
+        delaySketches[dir].add(delay);
+        intersectionDelaySketch.add(delay);
+        lane.arrivalTicksHead = (lane.arrivalTicksHead + 1) % capacity;
+        lane.arrivalTicksSize--;
+    }
+}
+
+void DelayMetrics::update(Intersection& inter){
+    std::array<unsigned int, Road::numRoadDirections> approachQueues = {};
+    bool bucketFinished;
+
+    numTicks++;
+    bucketFinished = (numTicks % bucketTicks == 0);
+    if(bucketFinished){
+        numBucketsFinished++;
+    }
+
+    for(int idx=0; idx < NUM_LANE_GROUPS; idx++){
+        Lane& lane = lanes[idx];
+        TurnOption* turnOpt;
+        unsigned int queue;
+
+        if( ! lane.valid){
+            continue;
+        }
+
+        turnOpt = inter.getRoad(Road::laneGroupDirection(idx))->getTurnOption(Road::laneGroupTurn(idx));
+        queue = turnOpt->getQueuedVehicles();
+        approachQueues[Road::laneGroupDirection(idx)] += queue;
+
+        unsigned long arrivals = turnOpt->getCumulativeArrivals() - lane.baseArrivals;
+        unsigned long departures = turnOpt->getCumulativeDepartures() - lane.baseDepartures;
+
+        updateDelays(lane, Road::laneGroupDirection(idx), arrivals - lane.current.arrivals, departures - lane.current.departures);
+        lane.current.arrivals = arrivals;
+        lane.current.departures = departures;
+        lane.current.delayTicks += queue;
+        lane.maxQueue = std::max(lane.maxQueue, queue);
+        lane.bucketMaxQueue = std::max(lane.bucketMaxQueue, queue);
+
+        if( ! bucketFinished){
+            continue;
+        }
+
+        /// The slot holds the boundary numBuckets ago, which becomes the start of the window
+        size_t slot = numBucketsFinished % numBuckets;
+        lane.windowStart = lane.bucketSamples[slot];
+        lane.bucketSamples[slot] = lane.current;
+
+        /// Buckets before the window leave from the front, maxima no larger than the new one from the back
+        unsigned long finishedBucket = numBucketsFinished - 1;
+
+        while(lane.maxQueuesSize > 0 && lane.maxQueues[lane.maxQueuesHead].first + numBuckets <= finishedBucket){
+            lane.maxQueuesHead = (lane.maxQueuesHead + 1) % numBuckets;
+            lane.maxQueuesSize--;
+        }
+
+        while(lane.maxQueuesSize > 0 && lane.maxQueues[(lane.maxQueuesHead + lane.maxQueuesSize - 1) % numBuckets].second <= lane.bucketMaxQueue){
+            lane.maxQueuesSize--;
+        }
+
+        lane.maxQueues[(lane.maxQueuesHead + lane.maxQueuesSize) % numBuckets] = {finishedBucket, lane.bucketMaxQueue};
+        lane.maxQueuesSize++;
+        lane.bucketMaxQueue = 0;
+    }
+
+    unsigned int intersectionQueue = 0;
+
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        if(inter.getRoad((Road::RoadDirection)dir) != NULL){
+            queueSketches[dir].add(approachQueues[dir]);
+            intersectionQueue += approachQueues[dir];
+        }
+    }
+    intersectionQueueSketch.add(intersectionQueue);
+}
+
+const QuantileSketch& DelayMetrics::getQueueSketch(Road::RoadDirection dir){
+    Road::isValidRoadDirection(dir);
+
+    return queueSketches[dir];
+}
+
+const QuantileSketch& DelayMetrics::getDelaySketch(Road::RoadDirection dir){
+    Road::isValidRoadDirection(dir);
+
+    return delaySketches[dir];
+}
+
+unsigned long DelayMetrics::windowStartTick(){
+    if(numBucketsFinished <= numBuckets){
+        return 0;
+    }
+
+    return (numBucketsFinished - numBuckets) * bucketTicks;
+}
+
+DelayMetrics::Summary DelayMetrics::summarize(const Sample& from, const Sample& to, unsigned int maxQueue, unsigned long spanTicks){
+    Summary summary;
+    double rate = (refreshRate > 0) ? refreshRate : refreshRateHzGlobal;
+
+    summary.arrivals = to.arrivals - from.arrivals;
+    summary.departures = to.departures - from.departures;
+    summary.totalDelay = (to.delayTicks - from.delayTicks) / rate;
+    summary.averageDelay = (summary.departures > 0) ? summary.totalDelay / summary.departures : 0;
+    summary.maxQueue = maxQueue;
+    summary.duration = spanTicks / rate;
+    summary.throughput = (spanTicks > 0) ? summary.departures * SECONDS_PER_HOUR / summary.duration : 0;
+
+    return summary;
+}
+
+DelayMetrics::Lane& DelayMetrics::getLane(Road::RoadDirection dir, TurnOption::Type turn){
+    Lane& lane = lanes.at(Road::laneGroupIdx(dir, turn));
+
+    if( ! lane.valid){
+        throw std::invalid_argument("DelayMetrics there is no TurnOption for this Road and TurnOption::Type");
+    }
+
+    return lane;
+}
+
+DelayMetrics::Summary DelayMetrics::getTotal(Road::RoadDirection dir, TurnOption::Type turn){
+    Lane& lane = getLane(dir, turn);
+
+    return summarize(Sample{}, lane.current, lane.maxQueue, numTicks);
+}
+
+DelayMetrics::Summary DelayMetrics::getWindow(Road::RoadDirection dir, TurnOption::Type turn){
+    Lane& lane = getLane(dir, turn);
+    unsigned int maxQueue = lane.bucketMaxQueue;
+
+    if(lane.maxQueuesSize > 0){
+        maxQueue = std::max(maxQueue, lane.maxQueues[lane.maxQueuesHead].second);
+    }
+
+    return summarize(lane.windowStart, lane.current, maxQueue, numTicks - windowStartTick());
+}
+
+DelayMetrics::Summary DelayMetrics::getIntersectionTotal(){
+    Sample total = {};
+    unsigned int maxQueue = 0;
+
+    for(Lane& lane : lanes){
+        if(lane.valid){
+            total.arrivals += lane.current.arrivals;
+            total.departures += lane.current.departures;
+            total.delayTicks += lane.current.delayTicks;
+            maxQueue = std::max(maxQueue, lane.maxQueue);
+        }
+    }
+
+    return summarize(Sample{}, total, maxQueue, numTicks);
+}
+
+DelayMetrics::Summary DelayMetrics::getIntersectionWindow(){
+    Sample from = {}, to = {};
+    unsigned int maxQueue = 0;
+
+    for(int idx=0; idx < NUM_LANE_GROUPS; idx++){
+        if( ! lanes[idx].valid){
+            continue;
+        }
+
+        Summary window = getWindow(Road::laneGroupDirection(idx), Road::laneGroupTurn(idx));
+
+        from.arrivals += lanes[idx].windowStart.arrivals;
+        from.departures += lanes[idx].windowStart.departures;
+        from.delayTicks += lanes[idx].windowStart.delayTicks;
+        to.arrivals += lanes[idx].current.arrivals;
+        to.departures += lanes[idx].current.departures;
+        to.delayTicks += lanes[idx].current.delayTicks;
+        maxQueue = std::max(maxQueue, window.maxQueue);
+    }
+
+    return summarize(from, to, maxQueue, numTicks - windowStartTick());
+}
+
+void DelayMetrics::printSummary(std::ostream& out){
+    static const char* turnNames[TurnOption::numTurnOptions] = {"left", "straight", "right"};
+    auto printLine = [&out](const Summary& summary){
+        out << std::setw(7) << summary.arrivals << " arrived " << std::setw(7) << summary.departures << " departed   avg delay "
+            << std::fixed << std::setprecision(1) << std::setw(6) << summary.averageDelay << " s   max queue " << std::setw(4) << summary.maxQueue
+            << "   " << std::setprecision(0) << std::setw(6) << summary.throughput << " veh/h\n";
+    };
+
+    out << "Delay summary over " << std::fixed << std::setprecision(0) << numTicks / (double)refreshRate << "s (" << numTicks << " ticks)\n";
+
+    for(int idx=0; idx < NUM_LANE_GROUPS; idx++){
+        if( ! lanes[idx].valid){
+            continue;
+        }
+
+        std::ostringstream name;
+
+        name << Road::laneGroupDirection(idx) << " " << turnNames[Road::laneGroupTurn(idx)];
+        out << "  " << std::left << std::setw(16) << name.str() << std::right;
+        printLine(getTotal(Road::laneGroupDirection(idx), Road::laneGroupTurn(idx)));
+    }
+
+    out << "  " << std::left << std::setw(16) << "intersection" << std::right;
+    printLine(getIntersectionTotal());
+
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        const QuantileSketch& queues = queueSketches[dir];
+        const QuantileSketch& delays = delaySketches[dir];
+        std::ostringstream name;
+
+        if(queues.getCount() == 0){
+            continue;
+        }
+
+        name << (Road::RoadDirection)dir << " approach";
+        out << "  " << std::left << std::setw(16) << name.str() << std::right << std::setprecision(0)
+            << "queue p50 " << std::setw(4) << queues.quantile(0.5) << " p95 " << std::setw(4) << queues.quantile(0.95)
+            << " p99 " << std::setw(4) << queues.quantile(0.99);
+
+        if(delays.getCount() > 0){
+            out << std::setprecision(1) << "   delay p50 " << std::setw(6) << delays.quantile(0.5) << " s p95 " << std::setw(6)
+                << delays.quantile(0.95) << " s p99 " << std::setw(6) << delays.quantile(0.99) << " s";
+        }
+        out << "\n";
+    }
+}
@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+#include "DemandReader.h"
+
+/**
+ * @brief Parses "token" as a Road::RoadDirection name or number.
+ *
+ * @return false if "token" is neither
+ */
+static bool parseDirection(std::string_view token, Road::RoadDirection& dir){
+    static const char* names[Road::numRoadDirections] = {"north", "east", "south", "west"};
+
+    for(int d=0; d < Road::numRoadDirections; d++){
+        if(token == names[d] || (token.size() == 1 && token[0] == '0' + d)){
+            dir = (Road::RoadDirection)d;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Parses "token" as a TurnOption::Type name or number.
+ *
+ * @return false if "token" is neither
+ */
+static bool parseTurn(std::string_view token, TurnOption::Type& turn){
+    static const char* names[TurnOption::numTurnOptions] = {"left", "straight", "right"};
+
+    for(int t=0; t < TurnOption::numTurnOptions; t++){
+        if(token == names[t] || (token.size() == 1 && token[0] == '0' + t)){
+            turn = (TurnOption::Type)t;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Removes spaces, tabs and a trailing carriage return from both ends of "token"
+ */
+static std::string_view trim(std::string_view token){
+    while( ! token.empty() && (token.front() == ' ' || token.front() == '\t')){
+        token.remove_prefix(1);
+    }
+
+    while( ! token.empty() && (token.back() == ' ' || token.back() == '\t' || token.back() == '\r')){
+        token.remove_suffix(1);
+    }
+
+    return token;
+}
+
+DemandReader::DemandReader(const std::string& filePath, double binSeconds, size_t chunkBytes){
+    if( ! (binSeconds > 0) || chunkBytes == 0){
+        throw std::domain_error("DemandReader() bin duration and chunk size must be > 0");
+    }
+
+    file = std::fopen(filePath.c_str(), "rb");
+    if(file == NULL){
+        throw std::runtime_error("DemandReader() could not open " + filePath);
+    }
+
+    path = filePath;
+    binDuration = binSeconds;
+    buffer.resize(chunkBytes);
+    bufferPos = 0;
+    bufferEnd = 0;
+    endOfFile = false;
+    lineNumber = 0;
+    bytesRead = 0;
+    numRecords = 0;
+    lastStartSeconds = 0;
+    hasPending = false;
+    bins = {};
+    numFed = 0;
+    numBlocked = 0;
+}
+
+DemandReader::~DemandReader(){
+    std::fclose(file);
+}
+
+void DemandReader::parseError(const std::string& reason){
+    throw std::runtime_error("DemandReader " + path + ":" + std::to_string(lineNumber) + " " + reason);
+}
+
+bool DemandReader::nextLine(std::string_view& line){
+    while(true){
+        const char* start = buffer.data() + bufferPos;
+        const char* newline = (const char*)std::memchr(start, '\n', bufferEnd - bufferPos);
+
+        if(newline != NULL){
+            line = std::string_view(start, newline - start);
+            bufferPos = (newline - buffer.data()) + 1;
+            lineNumber++;
+            return true;
+        }
+
+        if(endOfFile){
+            if(bufferPos == bufferEnd){
+                return false;
+            }
+
+            /// Last line without a newline
+            line = std::string_view(start, bufferEnd - bufferPos);
+            bufferPos = bufferEnd;
+            lineNumber++;
+            return true;
+        }
+
+        /// Keep the partial line and read the next chunk behind it
+        std::memmove(buffer.data(), start, bufferEnd - bufferPos);
+        bufferEnd -= bufferPos;
+        bufferPos = 0;
+
+        if(bufferEnd == buffer.size()){
+            /// The line is longer than a chunk
+            buffer.resize(buffer.size() * 2);
+        }
+
+        size_t numRead = std::fread(buffer.data() + bufferEnd, 1, buffer.size() - bufferEnd, file);
+        if(numRead == 0){
+            if(std::ferror(file)){
+                parseError("read error");
+            }
+            endOfFile = true;
+        }
+
+        bufferEnd += numRead;
+        bytesRead += numRead;
+    }
+}
+
+bool DemandReader::parseLine(std::string_view line, DemandRecord& record){
+    std::array<std::string_view, 4> fields;
+    size_t numFields = 0;
+
+    line = trim(line);
+    if(line.empty() || line.front() == '#'){
+        return false;
+    }
+
+    if(lineNumber == 1 && ! std::isdigit((unsigned char)line.front())){
+        /// Header row
+        return false;
+    }
+
+    while(numFields < fields.size()){
+        size_t comma = line.find(',');
+
+        fields[numFields++] = trim(line.substr(0, comma));
+
+        if(comma == std::string_view::npos){
+            line = std::string_view();
+            break;
+        }
+        line.remove_prefix(comma + 1);
+    }
+
+    if(numFields != fields.size() || ! line.empty()){
+        parseError("expected 4 fields: startSeconds,direction,turn,count");
+    }
+
+    auto timeResult = std::from_chars(fields[0].data(), fields[0].data() + fields[0].size(), record.startSeconds);
+    if(timeResult.ec != std::errc() || timeResult.ptr != fields[0].data() + fields[0].size()){
+        parseError("invalid startSeconds '" + std::string(fields[0]) + "'");
+    }
+
+    if( ! parseDirection(fields[1], record.direction)){
+        parseError("invalid direction '" + std::string(fields[1]) + "'");
+    }
+
+    if( ! parseTurn(fields[2], record.turn)){
+        parseError("invalid turn '" + std::string(fields[2]) + "'");
+    }
+
+    auto countResult = std::from_chars(fields[3].data(), fields[3].data() + fields[3].size(), record.count);
+    if(countResult.ec != std::errc() || countResult.ptr != fields[3].data() + fields[3].size()){
+        parseError("invalid count '" + std::string(fields[3]) + "'");
+    }
+
+    if(record.startSeconds < 0 || record.startSeconds < lastStartSeconds){
+        parseError("rows must be ordered by startSeconds >= 0");
+    }
+
+    return true;
+}
+
+bool DemandReader::nextRecord(DemandRecord& record){
+    std::string_view line;
+
+    while(nextLine(line)){
+        if(parseLine(line, record)){
+            lastStartSeconds = record.startSeconds;
+            numRecords++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int DemandReader::feed(Intersection& inter){
+    unsigned long now = inter.time();
+    long binTicks = secondsToTicks(binDuration, refreshRateHzGlobal);
+    int numAdded = 0;
+
+    if(binTicks <= 0){
+        throw std::domain_error("DemandReader::feed() bin duration is shorter than a tick");
+    }
+
+    /// Start every bin that has begun by now
+    while(hasPending || nextRecord(pending)){
+        unsigned long startTick = secondsToTicks(pending.startSeconds, refreshRateHzGlobal);
+        ActiveBin& bin = bins[Road::laneGroupIdx(pending.direction, pending.turn)];
+
+        hasPending = true;
+        if(startTick > now){
+            break;
+        }
+
+        if(bin.active && bin.startTick == startTick){
+            /// Several rows for the same bin add up
+            bin.count += pending.count;
+        }
+        else{
+            bin = {startTick, pending.count, true};
+        }
+
+        hasPending = false;
+    }
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        ActiveBin& bin = bins[lane];
+        unsigned long ticksIntoBin, numArriving;
+        Road* rd;
+        TurnOption* turnOpt;
+        int numToAdd;
+
+        if( ! bin.active || now >= bin.startTick + binTicks){
+            continue;
+        }
+
+        /// This tick's share, the shares of a bin add up to exactly its count
+        ticksIntoBin = now - bin.startTick;
+        numArriving = ((ticksIntoBin + 1) * bin.count) / binTicks - (ticksIntoBin * bin.count) / binTicks;
+        if(numArriving == 0){
+            continue;
+        }
+
+        rd = inter.getRoad(Road::laneGroupDirection(lane));
+        if(rd == NULL || ! rd->getTurnOption(Road::laneGroupTurn(lane))->isValid()){
+            numBlocked += numArriving;
+            continue;
+        }
+
+        turnOpt = rd->getTurnOption(Road::laneGroupTurn(lane));
+        numToAdd = std::min(numArriving, (unsigned long)(turnOpt->getMaxNumVehicles() - turnOpt->getQueuedVehicles()));
+
+        if(numToAdd > 0){
+            inter.addVehicles(Road::laneGroupDirection(lane), Road::laneGroupTurn(lane), numToAdd);
+            numAdded += numToAdd;
+        }
+
+        numBlocked += numArriving - numToAdd;
+    }
+
+    numFed += numAdded;
+
+    return numAdded;
+}
@@ -0,0 +1,283 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "InputJournal.h"
+#include "CompactIntersection.h"
+#include "Varint.h"
+
+InputJournal::InputJournal(unsigned long firstTick, unsigned long checkpointTicks){
+    startTick = firstTick;
+    lastTick = firstTick;
+    numEvents = 0;
+    checkpointInterval = checkpointTicks;
+}
+
+void InputJournal::beginEvent(unsigned long tick, Opcode op){
+    if(tick < lastTick){
+        throw std::logic_error("InputJournal::beginEvent() events must be recorded in tick order");
+    }
+
+    putVarint(events, tick - lastTick);
+    events.push_back((uint8_t)op);
+
+    lastTick = tick;
+    numEvents++;
+}
+
+void InputJournal::recordAddVehicles(unsigned long tick, Road::RoadDirection dir, TurnOption::Type turn, int numVehiclesToAdd){
+    beginEvent(tick, addVehiclesOp);
+    putVarint(events, Road::laneGroupIdx(dir, turn));
+    putVarint(events, zigzagEncode(numVehiclesToAdd));
+}
+
+void InputJournal::recordAddMaxVehicles(unsigned long tick){
+    beginEvent(tick, addMaxVehiclesOp);
+}
+
+void InputJournal::recordSchedule(unsigned long tick, LightConfig::Option configOpt, Road::RoadDirection direction, double duration, double yellowDuration){
+    beginEvent(tick, scheduleOp);
+    putVarint(events, configOpt);
+    putVarint(events, direction);
+    putDouble(events, duration);
+    putDouble(events, yellowDuration);
+}
+
+void InputJournal::recordClearSchedule(unsigned long tick){
+    beginEvent(tick, clearScheduleOp);
+}
+
+void InputJournal::recordSetAllLightDurations(unsigned long tick, int onDur, int yellowDur){
+    beginEvent(tick, setAllLightDurationsOp);
+    putVarint(events, zigzagEncode(onDur));
+    putVarint(events, zigzagEncode(yellowDur));
+}
+
+void InputJournal::recordStart(unsigned long tick){
+    beginEvent(tick, startOp);
+}
+
+void InputJournal::recordNextLightConfig(unsigned long tick){
+    beginEvent(tick, nextLightConfigOp);
+}
+
+void InputJournal::recordSetAllRedDuration(unsigned long tick, double seconds){
+    beginEvent(tick, setAllRedDurationOp);
+    putDouble(events, seconds);
+}
+
+void InputJournal::recordSetAutoSequence(unsigned long tick, bool enable){
+    beginEvent(tick, setAutoSequenceOp);
+    events.push_back(enable);
+}
+
+void InputJournal::recordCheckpoint(Intersection& inter){
+    CompactIntersection state;
+
+    try{
+        state.pack(inter);
+    }
+    catch(const std::overflow_error&){
+        /// States CompactIntersection can not hold are not checkpointed
+        return;
+    }
+
+    beginEvent(inter.time(), checkpointOp);
+    putFixed64(events, state.hash());
+}
+
+void InputJournal::applyEvent(Opcode op, const uint8_t*& pos, const uint8_t* end, Intersection& inter){
+    switch(op){
+        case addVehiclesOp:{
+            uint64_t lane = getVarint(pos, end);
+            int numVehiclesToAdd = zigzagDecode(getVarint(pos, end));
+
+            if(lane >= NUM_LANE_GROUPS){
+                throw std::runtime_error("InputJournal::replay() invalid lane group in addVehicles event");
+            }
+
+            inter.addVehicles(Road::laneGroupDirection(lane), Road::laneGroupTurn(lane), numVehiclesToAdd);
+            break;
+        }
+
+        case addMaxVehiclesOp:
+            inter.addMaxVehicles();
+            break;
+
+        case scheduleOp:{
+            uint64_t configOpt = getVarint(pos, end);
+            uint64_t direction = getVarint(pos, end);
+            double duration = getDouble(pos, end);
+            double yellowDuration = getDouble(pos, end);
+
+            if(configOpt >= LightConfig::numConfigOptions || direction >= Road::numRoadDirections){
+                throw std::runtime_error("InputJournal::replay() invalid LightConfig in schedule event");
+            }
+
+            inter.schedule((LightConfig::Option)configOpt, (Road::RoadDirection)direction, duration, yellowDuration);
+            break;
+        }
+
+        case clearScheduleOp:
+            inter.clearSchedule();
+            break;
+
+        case setAllLightDurationsOp:{
+            int onDur = zigzagDecode(getVarint(pos, end));
+            int yellowDur = zigzagDecode(getVarint(pos, end));
+
+            inter.setAllLightDurations(onDur, yellowDur);
+            break;
+        }
+
+        case startOp:
+            inter.start();
+            break;
+
+        case nextLightConfigOp:
+            inter.nextLightConfig();
+            break;
+
+        case setAllRedDurationOp:
+            inter.setAllRedDuration(getDouble(pos, end));
+            break;
+
+        case setAutoSequenceOp:
+            if(pos == end){
+                throw std::runtime_error("InputJournal::replay() setAutoSequence event is truncated");
+            }
+            inter.setAutoSequence(*pos++ != 0);
+            break;
+
+        case checkpointOp:{
+            CompactIntersection state;
+            uint64_t digest = getFixed64(pos, end);
+
+            state.pack(inter);
+            if(state.hash() != digest){
+                throw std::runtime_error("InputJournal::replay() diverged from the recorded run at tick " + std::to_string(inter.time()));
+            }
+            break;
+        }
+
+        default:
+            throw std::runtime_error("InputJournal::replay() encountered an unknown opcode");
+    }
+}
+
+unsigned long InputJournal::replay(Intersection& inter, unsigned long endTick){
+    const uint8_t* pos = events.data();
+    const uint8_t* end = events.data() + events.size();
+    unsigned long eventTick = startTick;
+    unsigned long numReplayed = 0;
+    InputJournal* recording = inter.getJournal();
+
+    if(inter.time() != startTick){
+        throw std::logic_error("InputJournal::replay() Intersection must be at the tick the journal started at");
+    }
+
+    /// The replayed calls must not be journaled again
+    inter.setJournal(NULL);
+
+    try{
+        while(pos != end){
+            Opcode op;
+
+            eventTick += getVarint(pos, end);
+            if(eventTick > endTick){
+                break;
+            }
+
+            if(pos == end){
+                throw std::runtime_error("InputJournal::replay() event is truncated");
+            }
+            op = (Opcode)*pos++;
+
+            /// Nothing external happens in between, skip ahead as fast as the Intersection allows
+            if(eventTick > inter.time()){
+                inter.advance(eventTick - inter.time());
+            }
+
+            applyEvent(op, pos, end, inter);
+            numReplayed++;
+        }
+
+        if(endTick > inter.time()){
+            inter.advance(endTick - inter.time());
+        }
+    }
+    catch(...){
+        inter.setJournal(recording);
+        throw;
+    }
+
+    inter.setJournal(recording);
+
+    return numReplayed;
+}
+
+void InputJournal::save(const std::string& path){
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    Header header = {};
+
+    if( ! out){
+        throw std::runtime_error("InputJournal::save() could not open " + path);
+    }
+
+    std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+    header.version = JOURNAL_VERSION;
+    header.startTick = startTick;
+    header.lastTick = lastTick;
+    header.numEvents = numEvents;
+    header.numBytes = events.size();
+    header.checkpointInterval = checkpointInterval;
+
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)events.data(), events.size());
+
+    if( ! out.good()){
+        throw std::runtime_error("InputJournal::save() error writing " + path);
+    }
+}
+
+InputJournal InputJournal::load(const std::string& path){
+    std::ifstream in(path, std::ios::binary);
+    Header header;
+    InputJournal journal;
+
+    if( ! in){
+        throw std::runtime_error("InputJournal::load() could not open " + path);
+    }
+
+    if( ! in.read((char*)&header, sizeof(header))){
+        throw std::runtime_error("InputJournal::load() " + path + " is too short to be a journal");
+    }
+
+    if(std::memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) != 0){
+        throw std::runtime_error("InputJournal::load() " + path + " is not a journal");
+    }
+
+    if(header.version != JOURNAL_VERSION){
+        throw std::runtime_error("InputJournal::load() " + path + " has an unsupported version");
+    }
+
+    /// Check the size before allocating for it
+    std::streamoff eventsOffset = in.tellg();
+    in.seekg(0, std::ios::end);
+    if(header.numBytes > (uint64_t)(in.tellg() - eventsOffset)){
+        throw std::runtime_error("InputJournal::load() " + path + " is truncated");
+    }
+    in.seekg(eventsOffset);
+
+    journal.startTick = header.startTick;
+    journal.lastTick = header.lastTick;
+    journal.numEvents = header.numEvents;
+    journal.checkpointInterval = header.checkpointInterval;
+    journal.events.resize(header.numBytes);
+
+    if( ! in.read((char*)journal.events.data(), header.numBytes)){
+        throw std::runtime_error("InputJournal::load() " + path + " is truncated");
+    }
+
+    return journal;
+}
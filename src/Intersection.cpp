@@ -3,12 +3,35 @@
 #include <sstream>
 #include <vector>
 #include "Intersection.h"
+#include "CompactIntersection.h"
+#include "ArrivalGenerator.h"
+#include "InputJournal.h"
+#include "LightHistory.h"
+#include "DelayMetrics.h"
+#include "VehiclePool.h"
+#include "RoadNetwork.h"
+#include "SignalController.h"
 
 Intersection::Intersection(){
     numRoads = 0;
     configScheduleIdx = 0;
     numUnfinishedLights = 0;
     ticksSinceStart = 0;
+    planIsStale = true;
+    autoSequence = false;
+    allRedDuration = 0;
+    clearanceTicksRemaining = -1;
+    arrivals = NULL;
+    journal = NULL;
+    lightHistory = NULL;
+    metrics = NULL;
+    vehiclePool = NULL;
+    network = NULL;
+    networkNode = -1;
+    controller = NULL;
+    phaseGreenTicks = 0;
+    phaseIdleTicks = 0;
+    layoutVersion = 0;
 
     for(int i=0; i<Road::numRoadDirections; i++){
         roads[i] = NULL;
@@ -25,6 +48,10 @@ Intersection::~Intersection(){
     for(LightConfig *cfg : configSchedule){
         delete cfg;
     }
+
+    for(Fork& fork : forks){
+        deleteFork(fork);
+    }
 }
 
 bool Intersection::validate(){
@@ -55,9 +82,27 @@ bool Intersection::validate(){
     return true;
 }
 
-int Intersection::tick(){
+void Intersection::beginTick(){
     TrafficLight *roadLight;
 
+    if(vehiclePool != NULL){
+        /// Vehicles arriving and departing during this tick are stamped with the tick it ends on
+        vehiclePool->now = ticksSinceStart + 1;
+    }
+
+    if(arrivals != NULL){
+        arrivals->inject(*this);
+    }
+
+    if(network != NULL){
+        network->inject(*this);
+    }
+
+    if(lightHistory != NULL){
+        /// Colors set during this tick are first shown once it is over
+        lightHistory->now = ticksSinceStart + 1;
+    }
+
     for(Road *rd : roads){
         /// Skip Road if its NULL
         if(rd == NULL){
@@ -80,9 +125,158 @@ int Intersection::tick(){
             handleLightTick(roadLight);
         }
     }
+}
+
+int Intersection::tick(){
+    beginTick();
+
+    if(controller != NULL && numUnfinishedLights > 0){
+        actuate(*controller);
+    }
 
+    if(autoSequence){
+        sequenceLightConfigs(controller);
+    }
+
+    return endTick();
+}
+
+int Intersection::endTick(){
     ticksSinceStart++;
 
+    if(metrics != NULL){
+        metrics->update(*this);
+    }
+
+    if(journal != NULL && journal->checkpointDue(ticksSinceStart)){
+        journal->recordCheckpoint(*this);
+    }
+
+    return numUnfinishedLights;
+}
+
+void Intersection::setSignalController(SignalController* signalController){
+    controller = signalController;
+    phaseGreenTicks = 0;
+    phaseIdleTicks = 0;
+}
+
+long Intersection::repeatPeriod(){
+    if(autoSequence && getSignalPlan().getCycleLength() > 0){
+        return getSignalPlan().getCycleLength();
+    }
+
+    return 1;
+}
+
+void Intersection::getExitQueues(std::array<unsigned int, NUM_LANE_GROUPS>& queues){
+    queues.fill(0);
+
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        if(exitRoads[dir] == NULL){
+            continue;
+        }
+
+        for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+            queues[Road::laneGroupIdx((Road::RoadDirection)dir, (TurnOption::Type)opt)] = exitRoads[dir]->getTurnOption((TurnOption::Type)opt)->getQueuedVehicles();
+        }
+    }
+}
+
+void Intersection::getCumulativeCurves(std::array<unsigned long, NUM_LANE_GROUPS>& cumulativeArrivals, std::array<unsigned long, NUM_LANE_GROUPS>& cumulativeDepartures){
+    cumulativeArrivals.fill(0);
+    cumulativeDepartures.fill(0);
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        Road* rd = roads[Road::laneGroupDirection(lane)];
+
+        if(rd != NULL && rd->getTurnOption(Road::laneGroupTurn(lane))->isValid()){
+            cumulativeArrivals[lane] = rd->getTurnOption(Road::laneGroupTurn(lane))->getCumulativeArrivals();
+            cumulativeDepartures[lane] = rd->getTurnOption(Road::laneGroupTurn(lane))->getCumulativeDepartures();
+        }
+    }
+}
+
+int Intersection::advance(unsigned long ticks){
+    CompactIntersection periodStart, periodEnd;
+    std::array<unsigned int, NUM_LANE_GROUPS> exitQueuesStart, exitQueuesEnd;
+    std::array<unsigned long, NUM_LANE_GROUPS> arrivalsStart, departuresStart;
+    unsigned long generatedStart = 0, blockedStart = 0;
+    unsigned long period = repeatPeriod();
+    long arrivalsRepeatFrom = (arrivals != NULL) ? arrivals->repeatStart(period) : 0;
+
+    /// Periodic arrivals only repeat once every first platoon is out
+    for(; arrivalsRepeatFrom > 0 && ticksSinceStart < (unsigned long)arrivalsRepeatFrom && ticks > 0; ticks--){
+        tick();
+    }
+
+    /// Probing only pays off when at least one whole period is left after it
+    while(arrivalsRepeatFrom >= 0 && journal == NULL && lightHistory == NULL && metrics == NULL && vehiclePool == NULL && network == NULL && controller == NULL &&
+          ticks >= 2 * period){
+        try{
+            periodStart.pack(*this);
+        }
+        catch(const std::overflow_error&){
+            /// States CompactIntersection can not hold are stepped tick by tick
+            break;
+        }
+        getExitQueues(exitQueuesStart);
+        getCumulativeCurves(arrivalsStart, departuresStart);
+        if(arrivals != NULL){
+            generatedStart = arrivals->getNumArrivals();
+            blockedStart = arrivals->getNumBlockedArrivals();
+        }
+
+        for(unsigned long i=0; i < period; i++){
+            tick();
+        }
+        ticks -= period;
+
+        try{
+            periodEnd.pack(*this);
+        }
+        catch(const std::overflow_error&){
+            break;
+        }
+        getExitQueues(exitQueuesEnd);
+
+        if(periodEnd.sameState(periodStart) && exitQueuesEnd == exitQueuesStart){
+            unsigned long numPeriods = ticks / period;
+
+            for(int dir=0; dir < Road::numRoadDirections; dir++){
+                for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+                    TrafficLight* light = getLight((Road::RoadDirection)dir, (TurnOption::Type)opt);
+                    long directedPerPeriod = periodEnd.getLaneGroup((Road::RoadDirection)dir, (TurnOption::Type)opt).numVehiclesDirected -
+                                             periodStart.getLaneGroup((Road::RoadDirection)dir, (TurnOption::Type)opt).numVehiclesDirected;
+
+                    if(light != NULL && directedPerPeriod > 0){
+                        light->addVehiclesDirected(numPeriods * directedPerPeriod);
+                    }
+
+                    if(light != NULL){
+                        TurnOption* turnOpt = roads[dir]->getTurnOption((TurnOption::Type)opt);
+                        int lane = Road::laneGroupIdx((Road::RoadDirection)dir, (TurnOption::Type)opt);
+
+                        turnOpt->addCumulative(numPeriods * (turnOpt->getCumulativeArrivals() - arrivalsStart[lane]),
+                                               numPeriods * (turnOpt->getCumulativeDepartures() - departuresStart[lane]));
+                    }
+                }
+            }
+
+            if(arrivals != NULL){
+                arrivals->addSkipped(numPeriods * (arrivals->getNumArrivals() - generatedStart),
+                                     numPeriods * (arrivals->getNumBlockedArrivals() - blockedStart));
+            }
+
+            ticksSinceStart += numPeriods * period;
+            ticks -= numPeriods * period;
+        }
+    }
+
+    for(unsigned long i=0; i < ticks; i++){
+        tick();
+    }
+
     return numUnfinishedLights;
 }
 
@@ -106,6 +300,7 @@ void Intersection::handleLightTick(TrafficLight* light){
 void Intersection::handleVehicles(Road* rd, TurnOption::Type opt){
     TurnOption* turnOpt;
     TurnOption* exitTurnOpt;
+    long routeState = -1;
 
     turnOpt = rd->getTurnOption((TurnOption::Type)opt);
 
@@ -119,21 +314,30 @@ void Intersection::handleVehicles(Road* rd, TurnOption::Type opt){
         turnOpt->progressVehicles();
     }
 
-    exitTurnOpt = getExitRoad(rd->getDirection(), turnOpt->getType())->getTurnOption(opt);
+    exitTurnOpt = getExitTurnOption(rd->getDirection(), turnOpt->getType());
     if(exitTurnOpt == NULL){
         throw std::logic_error("Exit Road in Intersection::handleVehicles() is NULL, Intersection is invalid\n");
         return;
     }
-    if( ! exitTurnOpt->isValid()){
-        /// This turnOpt does not exist in the exit Road, use the straight TurnOpt by default
-        exitTurnOpt = getExitRoad(rd->getDirection(), turnOpt->getType())->getTurnOption(TurnOption::straight);
+
+    if(network != NULL && turnOpt->getVehicles() != NULL){
+        routeState = network->downstreamState(networkNode, Road::exitRoadDirection(rd->getDirection(), turnOpt->getType()));
+
+        /// The oldest vehicle crosses first, its next hop has to have room
+        if(routeState >= 0 && turnOpt->getVehicles()->getSize() > 0){
+            TurnOption* nextHop = network->laneFor(turnOpt->getVehicles()->at(0), routeState);
+
+            if(nextHop != NULL){
+                exitTurnOpt = nextHop;
+            }
+        }
     }
 
     if( ! turnOpt->getLight()->isRed() && 
         ! turnOpt->vehiclesAreCrossing() && 
         ! exitTurnOpt->queueIsFull())
     {
-        turnOpt->nextVehiclesBeginCrossing(exitTurnOpt);
+        turnOpt->nextVehiclesBeginCrossing(exitTurnOpt, network, routeState);
     }
     else if(turnOpt->getLight()->isRed() && 
             turnOpt->vehiclesAreCrossing())
@@ -145,6 +349,10 @@ void Intersection::handleVehicles(Road* rd, TurnOption::Type opt){
 bool Intersection::schedule(LightConfig::Option configOpt, Road::RoadDirection direction, double duration, double yellowDuration){
     LightConfig *interConfig = new LightConfig(configOpt, direction, duration, yellowDuration);
 
+    if(journal != NULL){
+        journal->recordSchedule(ticksSinceStart, configOpt, direction, duration, yellowDuration);
+    }
+
     try{
         configSchedule.push_back(interConfig);
     }
@@ -153,6 +361,9 @@ bool Intersection::schedule(LightConfig::Option configOpt, Road::RoadDirection d
         return false;
     }
 
+    planIsStale = true;
+    layoutVersion++;
+
     return true;
 }
 
@@ -161,12 +372,42 @@ bool Intersection::schedule(LightConfig& config){
 }
 
 void Intersection::clearSchedule(){
+    if(journal != NULL){
+        journal->recordClearSchedule(ticksSinceStart);
+    }
+
+    for(LightConfig *cfg : configSchedule){
+        delete cfg;
+    }
     configSchedule.clear();
+    planIsStale = true;
+    layoutVersion++;
+}
+
+SignalPlan& Intersection::compileSchedule(){
+    plan.compile(*this, configSchedule, allRedDuration);
+    planIsStale = false;
+
+    return plan;
+}
+
+SignalPlan& Intersection::getSignalPlan(){
+    if(planIsStale || ! plan.isCurrent()){
+        compileSchedule();
+    }
+
+    return plan;
 }
 
 bool Intersection::start(){
-    bool configSuccess = setLightConfig(0);
-    
+    bool configSuccess;
+
+    if(journal != NULL){
+        journal->recordStart(ticksSinceStart);
+    }
+
+    configSuccess = setLightConfig(0);
+
     if( ! configSuccess){
         throw std::runtime_error("Intersection::start() error, invalid LightConfig\n");
     }
@@ -174,48 +415,136 @@ bool Intersection::start(){
     return configSuccess;
 }
 
-bool Intersection::setLightConfig(int idx){
-    bool configSuccess = false;
-    LightConfig *config;
-    
-    config = configSchedule.at(idx);
+bool Intersection::startAt(unsigned long cycleTick){
+    long cycleLength = getSignalPlan().getCycleLength();
+    FixedPolicy policy;
+    Intersection* clone;
+    bool configSuccess;
 
-    switch(config->getConfigOption()){
-        case LightConfig::doubleGreen:
-            configSuccess = doubleGreen(config->getDirection(), config->getDuration(), config->getYellowDuration());
-            break;
+    if(journal != NULL){
+        throw std::logic_error("Intersection::startAt() the offset can not be journaled");
+    }
 
-        case LightConfig::singleGreen:
-            configSuccess = singleGreen(config->getDirection(), config->getDuration(), config->getYellowDuration());
-            break;
+    for(TrafficLight* light : getLights()){
+        light->color = TrafficLight::red;
+        light->ticksRemaining = 0;
+    }
+    /// start() lights the first LightConfig but leaves the index where an earlier run stopped
+    configScheduleIdx = 0;
+    numUnfinishedLights = 0;
+    clearanceTicksRemaining = 0;
 
-        case LightConfig::doubleGreenLeft:
-            configSuccess = doubleGreenLeft(config->getDirection(), config->getDuration(), config->getYellowDuration());
-            break;
+    configSuccess = start();
+    if(cycleLength > 0){
+        cycleTick %= cycleLength;
+    }
 
-        default:
-            throw std::out_of_range("Intersection::nextLightConfig() encountered an unhandled LightConfig::Option");
-            break;
+    if(cycleTick == 0){
+        return configSuccess;
     }
 
+    /// Only the lights are copied back, the vehicles of the copy may do as they please
+    clone = fork();
+    clone->arrivals = NULL;
+    for(unsigned long t=0; t < cycleTick; t++){
+        clone->tick(policy);
+    }
+
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        for(int opt=0; opt < TurnOption::numTurnOptions && roads[dir] != NULL; opt++){
+            TrafficLight* light = roads[dir]->getTurnOption((TurnOption::Type)opt)->getLight();
+            TrafficLight* cloneLight = clone->roads[dir]->getTurnOption((TurnOption::Type)opt)->getLight();
+
+            if(light == NULL || cloneLight == NULL){
+                continue;
+            }
+
+            light->yellowDuration = cloneLight->yellowDuration;
+            light->color = cloneLight->color;
+            light->ticksRemaining = cloneLight->ticksRemaining;
+            light->colorDuration = cloneLight->colorDuration;
+            light->colorDurationTicks = cloneLight->colorDurationTicks;
+            light->ticksRefreshRate = cloneLight->ticksRefreshRate;
+            light->ticksRounding = cloneLight->ticksRounding;
+        }
+    }
+
+    configScheduleIdx = clone->configScheduleIdx;
+    numUnfinishedLights = clone->numUnfinishedLights;
+    clearanceTicksRemaining = clone->clearanceTicksRemaining;
+    phaseGreenTicks = clone->phaseGreenTicks;
+    phaseIdleTicks = clone->phaseIdleTicks;
+    releaseFork(clone);
+
     return configSuccess;
 }
 
-bool Intersection::nextLightConfig(){
-    bool configSuccess;
-    configScheduleIdx++;
+bool Intersection::setLightConfig(int idx, int greenTicks){
+    const SignalPlan::Phase& phase = getSignalPlan().getPhase(idx);
 
-    if(configScheduleIdx >= configSchedule.size()){
-        /// Loop the LightConfigs in configSchedule
-        configScheduleIdx = 0;
+    if( ! phase.valid){
+        return false;
     }
 
-    configSuccess = setLightConfig(configScheduleIdx);
-    if( ! configSuccess){
-        throw std::runtime_error("Intersection::nextLightConfig() error, invalid LightConfig\n");
+    phaseGreenTicks = 0;
+    phaseIdleTicks = 0;
+
+    /// Durations were converted to ticks when the plan was compiled
+    for(const SignalPlan::LightStart& lightStart : phase.lightStarts){
+        TrafficLight* light = lightStart.light;
+
+        if(greenTicks >= 0){
+            light->setDurationTicks(light->getOnColor(), (double)greenTicks / refreshRateHzGlobal, greenTicks);
+        }
+        else{
+            light->setDurationTicks(light->getOnColor(), lightStart.onDuration, lightStart.onTicks);
+        }
+        if(lightStart.yellowDuration != DONT_SET){
+            light->setDurationTicks(TrafficLight::yellow, lightStart.yellowDuration, lightStart.yellowTicks);
+        }
+        light->start();
+
+        numUnfinishedLights++;
     }
 
-    return configSuccess;
+    /// A LightConfig with no lights to finish goes straight to the clearance
+    clearanceTicksRemaining = (numUnfinishedLights == 0) ? getSignalPlan().getClearanceTicks() : -1;
+
+    return true;
+}
+
+void Intersection::setAllRedDuration(double seconds){
+    if(seconds < 0){
+        throw std::domain_error("Intersection::setAllRedDuration() all-red clearance can not be negative");
+    }
+
+    if(journal != NULL){
+        journal->recordSetAllRedDuration(ticksSinceStart, seconds);
+    }
+
+    allRedDuration = seconds;
+    planIsStale = true;
+    layoutVersion++;
+}
+
+void Intersection::setAutoSequence(bool enable){
+    if(journal != NULL){
+        journal->recordSetAutoSequence(ticksSinceStart, enable);
+    }
+
+    autoSequence = enable;
+}
+
+bool Intersection::nextLightConfig(){
+    if(journal != NULL){
+        journal->recordNextLightConfig(ticksSinceStart);
+    }
+
+    return stepLightConfig();
+}
+
+bool Intersection::stepLightConfig(){
+    return stepLightConfig(controller);
 }
 
 bool Intersection::doubleGreen(Road::RoadDirection dir, double onDuration, double yellowDuration){
@@ -272,6 +601,21 @@ Road* Intersection::getExitRoad(Road::RoadDirection startDir, TurnOption::Type t
     return exitRoads[exitRoadDir];
 }
 
+TurnOption* Intersection::getExitTurnOption(Road::RoadDirection startDir, TurnOption::Type turnOpt){
+    Road* exitRoad = getExitRoad(startDir, turnOpt);
+
+    if(exitRoad == NULL){
+        return NULL;
+    }
+
+    if( ! exitRoad->getTurnOption(turnOpt)->isValid()){
+        /// This turnOpt does not exist in the exit Road, use the straight TurnOpt by default
+        return exitRoad->getTurnOption(TurnOption::straight);
+    }
+
+    return exitRoad->getTurnOption(turnOpt);
+}
+
 bool Intersection::newTurnIsPossible(Road::RoadDirection endRoadDir, int numNewLanes, bool* roadIsExpected){
     bool turnIsPossible;
     Road::isValidRoadDirection(endRoadDir);
@@ -326,6 +670,8 @@ int Intersection::addRoad(Road::RoadDirection dir, std::array<int, TurnOption::n
     roads[dir] = new Road(dir, numLanesArr, onDuration, yellowDuration);
     expectedRoads[dir] = false;     /// If we were expecting this road before, we now no longer are.
     numRoads++;
+    planIsStale = true;
+    layoutVersion++;
 
     return success;
 }
@@ -334,6 +680,10 @@ long Intersection::addMaxVehicles(){
     long totalVehiclesAdded = 0;
     int numVehiclesToMax;
 
+    if(journal != NULL){
+        journal->recordAddMaxVehicles(ticksSinceStart);
+    }
+
     for(Road* rd : roads){
         if(rd == NULL){
             continue;
@@ -358,6 +708,10 @@ long Intersection::addMaxVehicles(){
 bool Intersection::addVehicles(Road::RoadDirection dir, TurnOption::Type turn, int numVehiclesToAdd){
     Road* rd = getRoad(dir);
 
+    if(journal != NULL){
+        journal->recordAddVehicles(ticksSinceStart, dir, turn, numVehiclesToAdd);
+    }
+
     if(rd != NULL){
         TurnOption* turnOpt = rd->getTurnOption(turn);
         return turnOpt->addVehicles(numVehiclesToAdd);
@@ -369,20 +723,216 @@ bool Intersection::addVehicles(Road::RoadDirection dir, TurnOption::Type turn, i
 int Intersection::setAllLightDurations(int onDur, int yellowDir){    
     int numRoadsSet = 0;
     int redDur = -1;
-    
+
+    if(journal != NULL){
+        journal->recordSetAllLightDurations(ticksSinceStart, onDur, yellowDir);
+    }
+
     for(Road* rd : roads){
         if(rd != NULL){
             rd->setAllLightDurations(onDur, redDur, yellowDir);
         }
         numRoadsSet++;
     }
+
+    /// LightConfigs that leave the yellow DONT_SET take it from the lights
+    planIsStale = true;
+    layoutVersion++;
     
     return numRoadsSet;
 }
 
+void Intersection::setLightHistory(LightHistory* history){
+    if(lightHistory != NULL){
+        for(TrafficLight* light : getLights()){
+            light->setHistory(NULL);
+        }
+    }
+
+    lightHistory = NULL;
+
+    if(history != NULL){
+        history->attach(*this);
+        lightHistory = history;
+    }
+}
+
+void Intersection::setDelayMetrics(DelayMetrics* delayMetrics){
+    if(delayMetrics != NULL){
+        delayMetrics->attach(*this);
+    }
+
+    metrics = delayMetrics;
+}
+
+void Intersection::setVehiclePool(VehiclePool* pool){
+    if(vehiclePool != NULL){
+        vehiclePool->detach(*this);
+    }
+
+    vehiclePool = NULL;
+
+    if(pool != NULL){
+        pool->attach(*this);
+        vehiclePool = pool;
+    }
+}
+
 void Intersection::setExitRoad(Road::RoadDirection dir, Road* exitRd){
     Road::isValidRoadDirection(dir);
     exitRoads[dir] = exitRd;
+    layoutVersion++;
+}
+
+Intersection* Intersection::fork(){
+    Fork* free = NULL;
+
+    for(Fork& fork : forks){
+        if( ! fork.inUse && (free == NULL || fork.layoutVersion == layoutVersion)){
+            free = &fork;
+        }
+    }
+
+    if(free == NULL){
+        forks.push_back({NULL, {NULL, NULL, NULL, NULL}, NULL, 0, false});
+        free = &forks.back();
+    }
+
+    if(free->clone == NULL || free->layoutVersion != layoutVersion){
+        deleteFork(*free);
+        buildFork(*free);
+    }
+
+    copyToFork(*free);
+    free->inUse = true;
+
+    return free->clone;
+}
+
+void Intersection::releaseFork(Intersection* clone){
+    for(Fork& fork : forks){
+        if(fork.clone == clone && fork.inUse){
+            fork.inUse = false;
+            return;
+        }
+    }
+
+    throw std::invalid_argument("Intersection::releaseFork() not a copy of this Intersection in use");
+}
+
+void Intersection::buildFork(Fork& fork){
+    Intersection* clone = new Intersection();
+
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        for(Road* rd : {roads[dir], exitRoads[dir]}){
+            std::array<int, TurnOption::numTurnOptions> numLanesArr;
+
+            if(rd == NULL){
+                continue;
+            }
+
+            for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+                numLanesArr[opt] = rd->getTurnOption((TurnOption::Type)opt)->getNumLanes();
+            }
+
+            /// Durations and limits are copied with the state
+            if(rd == roads[dir]){
+                clone->roads[dir] = new Road((Road::RoadDirection)dir, numLanesArr, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION);
+            }
+            else{
+                fork.exitRoads[dir] = new Road((Road::RoadDirection)dir, numLanesArr, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION);
+                clone->exitRoads[dir] = fork.exitRoads[dir];
+            }
+        }
+    }
+
+    for(LightConfig* cfg : configSchedule){
+        clone->configSchedule.push_back(new LightConfig(*cfg));
+    }
+
+    clone->numRoads = numRoads;
+    clone->expectedRoads = expectedRoads;
+    clone->allRedDuration = allRedDuration;
+    fork.clone = clone;
+    fork.arrivals = (arrivals != NULL) ? new ArrivalGenerator(*arrivals) : NULL;
+    fork.layoutVersion = layoutVersion;
+}
+
+void Intersection::deleteFork(Fork& fork){
+    for(Road*& exitRoad : fork.exitRoads){
+        delete exitRoad;
+        exitRoad = NULL;
+    }
+
+    delete fork.clone;
+    delete fork.arrivals;
+    fork.clone = NULL;
+    fork.arrivals = NULL;
+}
+
+void Intersection::copyToFork(Fork& fork){
+    Intersection* clone = fork.clone;
+
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        for(int opt=0; opt < TurnOption::numTurnOptions && roads[dir] != NULL; opt++){
+            TurnOption* from = roads[dir]->getTurnOption((TurnOption::Type)opt);
+            TurnOption* to = clone->roads[dir]->getTurnOption((TurnOption::Type)opt);
+            TrafficLight* fromLight = from->getLight();
+            TrafficLight* toLight = to->getLight();
+
+            if( ! from->isValid()){
+                continue;
+            }
+
+            to->maxVehiclesPerLane = from->maxVehiclesPerLane;
+            to->timeToCross = from->timeToCross;
+            to->timeToCrossTicks = from->timeToCrossTicks;
+            to->ticksRefreshRate = from->ticksRefreshRate;
+            to->queuedVehicles = from->queuedVehicles;
+            to->currentVehicleProgress = from->currentVehicleProgress;
+            to->numVehiclesCurrentlyCrossing = from->numVehiclesCurrentlyCrossing;
+            to->cumulativeArrivals = from->cumulativeArrivals;
+            to->cumulativeDepartures = from->cumulativeDepartures;
+
+            toLight->yellowDuration = fromLight->yellowDuration;
+            toLight->color = fromLight->color;
+            toLight->ticksRemaining = fromLight->ticksRemaining;
+            toLight->colorDuration = fromLight->colorDuration;
+            toLight->colorDurationTicks = fromLight->colorDurationTicks;
+            toLight->ticksRefreshRate = fromLight->ticksRefreshRate;
+            toLight->ticksRounding = fromLight->ticksRounding;
+            toLight->transitions = fromLight->transitions;
+            toLight->numVehiclesDirected = fromLight->numVehiclesDirected;
+        }
+
+        for(int opt=0; opt < TurnOption::numTurnOptions && exitRoads[dir] != NULL; opt++){
+            TurnOption* from = exitRoads[dir]->getTurnOption((TurnOption::Type)opt);
+            TurnOption* to = clone->exitRoads[dir]->getTurnOption((TurnOption::Type)opt);
+
+            to->maxVehiclesPerLane = from->maxVehiclesPerLane;
+            to->queuedVehicles = from->queuedVehicles;
+            to->cumulativeArrivals = from->cumulativeArrivals;
+        }
+    }
+
+    clone->configScheduleIdx = configScheduleIdx;
+    clone->numUnfinishedLights = numUnfinishedLights;
+    clone->ticksSinceStart = ticksSinceStart;
+    clone->autoSequence = autoSequence;
+    clone->clearanceTicksRemaining = clearanceTicksRemaining;
+    clone->controller = controller;
+    clone->phaseGreenTicks = phaseGreenTicks;
+    clone->phaseIdleTicks = phaseIdleTicks;
+
+    if(arrivals != NULL){
+        if(fork.arrivals == NULL){
+            fork.arrivals = new ArrivalGenerator(*arrivals);
+        }
+        else{
+            *fork.arrivals = *arrivals;
+        }
+    }
+    clone->arrivals = (arrivals != NULL) ? fork.arrivals : NULL;
 }
 
 Road* Intersection::getRoad(Road::RoadDirection dir){
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "LightHistory.h"
+
+LightLog::LightLog(LightHistory* owner, TrafficLight::AvailableColors initialColor){
+    history = owner;
+    runs.push_back(packRun(history->now, initialColor));
+}
+
+void LightLog::record(TrafficLight::AvailableColors color){
+    Run last = unpackRun(runs.back());
+
+    if(last.color == color){
+        /// Restarting the same color continues the run
+        return;
+    }
+
+    if(last.startTick == history->now){
+        /// Changed twice in one tick, only the final color was shown
+        runs.pop_back();
+
+        if( ! runs.empty() && unpackRun(runs.back()).color == color){
+            return;
+        }
+    }
+
+    runs.push_back(packRun(history->now, color));
+
+    if(history->retentionTicks != 0 && history->now > history->retentionTicks){
+        uint64_t windowStart = packRun(history->now - history->retentionTicks, 7);
+
+        /// Keep the run covering the start of the window
+        while(runs.size() >= 2 && runs[1] <= windowStart){
+            runs.pop_front();
+        }
+    }
+}
+
+size_t LightLog::findRun(unsigned long tick) const{
+    if(tick < getOldestTick() || tick > history->now){
+        throw std::out_of_range("LightLog tick " + std::to_string(tick) + " is outside the recorded history");
+    }
+
+    /// The last run starting at or before "tick"
+    return (std::upper_bound(runs.begin(), runs.end(), packRun(tick, 7)) - runs.begin()) - 1;
+}
+
+TrafficLight::AvailableColors LightLog::colorAt(unsigned long tick) const{
+    return unpackRun(runs[findRun(tick)]).color;
+}
+
+void LightLog::getRuns(unsigned long fromTick, unsigned long toTick, std::vector<Run>& out) const{
+    out.clear();
+
+    if(toTick <= fromTick){
+        return;
+    }
+
+    findRun(toTick - 1);
+
+    for(size_t i=findRun(fromTick); i < runs.size(); i++){
+        Run run = unpackRun(runs[i]);
+
+        if(run.startTick >= toTick){
+            break;
+        }
+
+        out.push_back(run);
+    }
+}
+
+LightHistory::LightHistory(unsigned long retention){
+    logs.fill(NULL);
+    now = 0;
+    retentionTicks = retention;
+}
+
+LightHistory::~LightHistory(){
+    for(LightLog* log : logs){
+        delete log;
+    }
+}
+
+void LightHistory::attach(Intersection& inter){
+    for(LightLog* log : logs){
+        if(log != NULL){
+            throw std::logic_error("LightHistory::attach() history is already attached to an Intersection");
+        }
+    }
+
+    now = inter.time();
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        TrafficLight* light = inter.getLight(Road::laneGroupDirection(lane), Road::laneGroupTurn(lane));
+
+        if(light == NULL){
+            continue;
+        }
+
+        logs[lane] = new LightLog(this, light->getColor());
+        light->setHistory(logs[lane]);
+    }
+}
+
+TrafficLight::AvailableColors LightHistory::colorAt(Road::RoadDirection dir, TurnOption::Type turn, unsigned long tick){
+    LightLog* log = getLog(dir, turn);
+
+    if(log == NULL){
+        throw std::invalid_argument("LightHistory::colorAt() there is no light for this Road and TurnOption");
+    }
+
+    return log->colorAt(tick);
+}
+
+size_t LightHistory::getNumRuns(){
+    size_t numRuns = 0;
+
+    for(LightLog* log : logs){
+        if(log != NULL){
+            numRuns += log->getNumRuns();
+        }
+    }
+
+    return numRuns;
+}
@@ -0,0 +1,646 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "LockstepVariants.h"
+#include "SignalPlan.h"
+#include "Philox.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+typedef uint32_t Words __attribute__((vector_size(LOCKSTEP_WIDTH * sizeof(uint32_t))));
+typedef uint64_t WideWords __attribute__((vector_size(LOCKSTEP_WIDTH * sizeof(uint64_t))));
+
+LockstepVariants::LockstepVariants(const std::vector<Intersection*>& scenarioVariants, bool drainExitRoads, unsigned int threads){
+    if(scenarioVariants.empty()){
+        throw std::invalid_argument("LockstepVariants() requires at least one variant");
+    }
+
+    variants = scenarioVariants;
+    drainExits = drainExitRoads;
+    numThreads = (threads == 0) ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+
+    load();
+}
+
+bool LockstepVariants::anyLane(const Lanes& mask){
+    for(int lane=0; lane < LOCKSTEP_WIDTH; lane++){
+        if(mask[lane] != 0){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void LockstepVariants::readLayout(Intersection& inter, bool isFirst){
+    std::vector<int> groups, starts, firstStarts;
+    std::array<int, NUM_LANE_GROUPS> lanes, colors, exits;
+    SignalPlan& plan = inter.getSignalPlan();
+
+    if(inter.controller != NULL || inter.journal != NULL || inter.lightHistory != NULL || inter.metrics != NULL || inter.vehiclePool != NULL || inter.network != NULL){
+        throw std::invalid_argument("LockstepVariants::load() variants must run the fixed schedule on their own, without a SignalController, journal, LightHistory, DelayMetrics, VehiclePool or RoadNetwork");
+    }
+
+    lanes.fill(0);
+    colors.fill(TrafficLight::red);
+    exits.fill(-1);
+
+    for(int group=0; group < NUM_LANE_GROUPS; group++){
+        Road::RoadDirection dir = Road::laneGroupDirection(group);
+        TurnOption::Type turn = Road::laneGroupTurn(group);
+        TurnOption* turnOpt = (inter.roads[dir] != NULL) ? inter.roads[dir]->getTurnOption(turn) : NULL;
+        TurnOption* exitTurnOpt;
+
+        if(turnOpt == NULL || ! turnOpt->isValid()){
+            continue;
+        }
+
+        exitTurnOpt = inter.getExitTurnOption(dir, turn);
+        if(exitTurnOpt == NULL){
+            throw std::invalid_argument("LockstepVariants::load() every TurnOption needs an exit Road");
+        }
+
+        if( ! turnOpt->getLight()->hasDefaultTransitions()){
+            throw std::invalid_argument("LockstepVariants::load() every TrafficLight must follow its default TransitionTable");
+        }
+
+        groups.push_back(group);
+        lanes[group] = turnOpt->getNumLanes();
+        colors[group] = turnOpt->getLight()->getOnColor();
+        exits[group] = Road::laneGroupIdx(Road::exitRoadDirection(dir, turn), exitTurnOpt->getType());
+    }
+
+    for(int phase=0; phase < plan.getNumPhases(); phase++){
+        if( ! plan.getPhase(phase).valid){
+            throw std::invalid_argument("LockstepVariants::load() a LightConfig of the schedule needs a missing Road");
+        }
+
+        firstStarts.push_back(starts.size());
+        for(const SignalPlan::LightStart& lightStart : plan.getPhase(phase).lightStarts){
+            starts.push_back(lightStart.laneGroup);
+        }
+    }
+    firstStarts.push_back(starts.size());
+
+    if(isFirst){
+        validGroups = groups;
+        numLanes = lanes;
+        onColor = colors;
+        exitGroup = exits;
+        startGroups = starts;
+        phaseFirstStart = firstStarts;
+        autoSequence = inter.autoSequence;
+        ticksSinceStart = inter.ticksSinceStart;
+
+        exitGroups.clear();
+        for(int group : validGroups){
+            if(std::find(exitGroups.begin(), exitGroups.end(), exitGroup[group]) == exitGroups.end()){
+                exitGroups.push_back(exitGroup[group]);
+            }
+        }
+        return;
+    }
+
+    if(groups != validGroups || lanes != numLanes || colors != onColor || exits != exitGroup || starts != startGroups || firstStarts != phaseFirstStart){
+        throw std::invalid_argument("LockstepVariants::load() the variants must share their Roads, exit Roads and LightConfig options and directions");
+    }
+
+    if(inter.autoSequence != autoSequence || inter.ticksSinceStart != ticksSinceStart){
+        throw std::invalid_argument("LockstepVariants::load() the variants must all sequence automatically or not, at the same time()");
+    }
+}
+
+void LockstepVariants::loadLane(Block& blk, int lane, Intersection& inter){
+    SignalPlan& plan = inter.getSignalPlan();
+
+    for(int group : validGroups){
+        TurnOption* turnOpt = inter.roads[Road::laneGroupDirection(group)]->getTurnOption(Road::laneGroupTurn(group));
+        TrafficLight* light = turnOpt->getLight();
+
+        blk.color[group][lane] = light->color;
+        blk.ticksRemaining[group][lane] = light->ticksRemaining;
+        blk.onTicks[group][lane] = light->getColorDurationTicks(light->onColor);
+        blk.yellowTicks[group][lane] = light->getColorDurationTicks(TrafficLight::yellow);
+        blk.redTicks[group][lane] = light->getColorDurationTicks(TrafficLight::red);
+        blk.lastPhase[group][lane] = -1;
+        blk.lastYellowPhase[group][lane] = -1;
+        blk.queued[group][lane] = turnOpt->queuedVehicles;
+        blk.progress[group][lane] = turnOpt->currentVehicleProgress;
+        blk.crossing[group][lane] = turnOpt->numVehiclesCurrentlyCrossing;
+        blk.timeToCross[group][lane] = turnOpt->getTimeToCross();
+        blk.maxQueued[group][lane] = turnOpt->getMaxNumVehicles();
+        blk.arrivals[group][lane] = 0;
+        blk.departures[group][lane] = 0;
+    }
+
+    for(int group : exitGroups){
+        TurnOption* exitTurnOpt = inter.exitRoads[Road::laneGroupDirection(group)]->getTurnOption(Road::laneGroupTurn(group));
+
+        blk.exitQueued[group][lane] = exitTurnOpt->queuedVehicles;
+        blk.exitMaxQueued[group][lane] = exitTurnOpt->getMaxNumVehicles();
+        blk.exitArrivals[group][lane] = 0;
+    }
+
+    blk.configScheduleIdx[lane] = inter.configScheduleIdx;
+    blk.numUnfinishedLights[lane] = inter.numUnfinishedLights;
+    blk.clearanceTicksRemaining[lane] = inter.clearanceTicksRemaining;
+    blk.clearanceTicks[lane] = plan.getClearanceTicks();
+    blk.cycles[lane] = (plan.getCycleLength() != 0) ? -1 : 0;
+    blk.injected[lane] = 0;
+    blk.blocked[lane] = 0;
+    blk.queuedTicks[lane] = 0;
+    blk.vehicleTicks[lane] = 0;
+    blk.keyLow[lane] = (inter.arrivals != NULL) ? (int32_t)(uint32_t)inter.arrivals->seed : 0;
+    blk.keyHigh[lane] = (inter.arrivals != NULL) ? (int32_t)(uint32_t)(inter.arrivals->seed >> 32) : 0;
+    blk.streamId[lane] = (inter.arrivals != NULL) ? (int32_t)inter.arrivals->intersectionId : 0;
+
+    for(int phase=0; phase < plan.getNumPhases(); phase++){
+        const std::vector<SignalPlan::LightStart>& lightStarts = plan.getPhase(phase).lightStarts;
+
+        for(size_t i=0; i < lightStarts.size(); i++){
+            int start = phaseFirstStart[phase] + i;
+
+            blk.startOnTicks[start][lane] = lightStarts[i].onTicks;
+            blk.startYellowTicks[start][lane] = lightStarts[i].yellowTicks;
+            blk.startSetsYellow[start][lane] = (lightStarts[i].yellowDuration != DONT_SET) ? -1 : 0;
+        }
+    }
+}
+
+void LockstepVariants::load(){
+    size_t numVariants = variants.size();
+
+    for(size_t variant=0; variant < numVariants; variant++){
+        readLayout(*variants[variant], variant == 0);
+    }
+
+    blocks.clear();
+    blocks.resize((numVariants + LOCKSTEP_WIDTH - 1) / LOCKSTEP_WIDTH);
+
+    for(size_t b=0; b < blocks.size(); b++){
+        Block& blk = blocks[b];
+
+        blk.startOnTicks.assign(startGroups.size(), Lanes{});
+        blk.startYellowTicks.assign(startGroups.size(), Lanes{});
+        blk.startSetsYellow.assign(startGroups.size(), Lanes{});
+        blk.arrivalBatch.assign((size_t)ARRIVAL_BATCH_TICKS * NUM_LANE_GROUPS, Lanes{});
+        blk.batchIsValid = false;
+
+        for(int lane=0; lane < LOCKSTEP_WIDTH; lane++){
+            loadLane(blk, lane, *variants[std::min(b * LOCKSTEP_WIDTH + lane, numVariants - 1)]);
+        }
+    }
+
+    /// Threads share ArrivalGenerators, compile them here so generate() only reads them
+    for(Intersection* inter : variants){
+        if(inter->arrivals != NULL && inter->arrivals->compiledRefreshRate != refreshRateHzGlobal){
+            inter->arrivals->compile();
+        }
+    }
+
+    loadedRefreshRate = refreshRateHzGlobal;
+}
+
+void LockstepVariants::drawWords(const Block& blk, unsigned long draw, int group, std::array<Lanes, ARRIVAL_TICKS_PER_DRAW>& words){
+#ifdef __SSE2__
+    /// pmuludq gives the 64 bit products of the even words, four variants per register
+    const __m128i multiplier0 = _mm_set1_epi32((int)PHILOX_M0);
+    const __m128i multiplier1 = _mm_set1_epi32((int)PHILOX_M1);
+
+    for(int chunk=0; chunk < LOCKSTEP_WIDTH / 4; chunk++){
+        __m128i counter0 = _mm_set1_epi32((int)(uint32_t)draw);
+        __m128i counter1 = _mm_set1_epi32((int)(uint32_t)(draw >> 32));
+        __m128i counter2 = _mm_set1_epi32(group);
+        __m128i counter3 = _mm_loadu_si128((const __m128i*)&blk.streamId + chunk);
+        __m128i key0 = _mm_loadu_si128((const __m128i*)&blk.keyLow + chunk);
+        __m128i key1 = _mm_loadu_si128((const __m128i*)&blk.keyHigh + chunk);
+
+        for(int round=0; round < PHILOX_ROUNDS; round++){
+            __m128i even0 = _mm_mul_epu32(counter0, multiplier0);
+            __m128i odd0 = _mm_mul_epu32(_mm_srli_epi64(counter0, 32), multiplier0);
+            __m128i even1 = _mm_mul_epu32(counter2, multiplier1);
+            __m128i odd1 = _mm_mul_epu32(_mm_srli_epi64(counter2, 32), multiplier1);
+            __m128i low0 = _mm_unpacklo_epi64(_mm_shuffle_epi32(even0, 0x08), _mm_shuffle_epi32(odd0, 0x08));
+            __m128i high0 = _mm_unpacklo_epi64(_mm_shuffle_epi32(even0, 0x0D), _mm_shuffle_epi32(odd0, 0x0D));
+            __m128i low1 = _mm_unpacklo_epi64(_mm_shuffle_epi32(even1, 0x08), _mm_shuffle_epi32(odd1, 0x08));
+            __m128i high1 = _mm_unpacklo_epi64(_mm_shuffle_epi32(even1, 0x0D), _mm_shuffle_epi32(odd1, 0x0D));
+
+            /// The words come out as 0 2 1 3, put them back in order
+            low0 = _mm_shuffle_epi32(low0, 0xD8);
+            high0 = _mm_shuffle_epi32(high0, 0xD8);
+            low1 = _mm_shuffle_epi32(low1, 0xD8);
+            high1 = _mm_shuffle_epi32(high1, 0xD8);
+
+            counter0 = _mm_xor_si128(_mm_xor_si128(high1, counter1), key0);
+            counter1 = low1;
+            counter2 = _mm_xor_si128(_mm_xor_si128(high0, counter3), key1);
+            counter3 = low0;
+
+            key0 = _mm_add_epi32(key0, _mm_set1_epi32((int)PHILOX_W0));
+            key1 = _mm_add_epi32(key1, _mm_set1_epi32((int)PHILOX_W1));
+        }
+
+        _mm_storeu_si128((__m128i*)&words[0] + chunk, counter0);
+        _mm_storeu_si128((__m128i*)&words[1] + chunk, counter1);
+        _mm_storeu_si128((__m128i*)&words[2] + chunk, counter2);
+        _mm_storeu_si128((__m128i*)&words[3] + chunk, counter3);
+    }
+#else
+    const Words zero = {};
+    Words counter0 = zero + (uint32_t)draw;
+    Words counter1 = zero + (uint32_t)(draw >> 32);
+    Words counter2 = zero + (uint32_t)group;
+    Words counter3 = (Words)blk.streamId;
+    Words key0 = (Words)blk.keyLow;
+    Words key1 = (Words)blk.keyHigh;
+
+    /// Philox4x32::generate() with every word a vector, the products widened to 64 bits
+    for(int round=0; round < PHILOX_ROUNDS; round++){
+        WideWords product0 = __builtin_convertvector(counter0, WideWords) * PHILOX_M0;
+        WideWords product1 = __builtin_convertvector(counter2, WideWords) * PHILOX_M1;
+
+        counter0 = __builtin_convertvector(product1 >> 32, Words) ^ counter1 ^ key0;
+        counter1 = __builtin_convertvector(product1, Words);
+        counter2 = __builtin_convertvector(product0 >> 32, Words) ^ counter3 ^ key1;
+        counter3 = __builtin_convertvector(product0, Words);
+
+        key0 += PHILOX_W0;
+        key1 += PHILOX_W1;
+    }
+
+    words = {(Lanes)counter0, (Lanes)counter1, (Lanes)counter2, (Lanes)counter3};
+#endif
+}
+
+void LockstepVariants::generateArrivals(size_t block, unsigned long tick){
+    Block& blk = blocks[block];
+    std::array<ArrivalGenerator*, LOCKSTEP_WIDTH> generators;
+    std::array<Lanes, ARRIVAL_BATCH_TICKS> words;
+    std::array<Lanes, ARRIVAL_TICKS_PER_DRAW> drawn;
+
+    std::fill(blk.arrivalBatch.begin(), blk.arrivalBatch.end(), Lanes{});
+
+    for(int lane=0; lane < LOCKSTEP_WIDTH; lane++){
+        size_t variant = block * LOCKSTEP_WIDTH + lane;
+
+        generators[lane] = (variant < variants.size()) ? variants[variant]->arrivals : NULL;
+    }
+
+    for(int group : validGroups){
+        bool isRandom = false;
+
+        for(ArrivalGenerator* gen : generators){
+            if(gen != NULL && (gen->compiled[group].type == ArrivalProcess::poisson || gen->compiled[group].type == ArrivalProcess::timeVarying)){
+                isRandom = true;
+            }
+        }
+
+        if(isRandom){
+            for(unsigned long draw = tick / ARRIVAL_TICKS_PER_DRAW; draw * ARRIVAL_TICKS_PER_DRAW < tick + ARRIVAL_BATCH_TICKS; draw++){
+                drawWords(blk, draw, group, drawn);
+
+                for(int word=0; word < ARRIVAL_TICKS_PER_DRAW; word++){
+                    unsigned long drawTick = draw * ARRIVAL_TICKS_PER_DRAW + word;
+
+                    if(drawTick >= tick && drawTick < tick + ARRIVAL_BATCH_TICKS){
+                        words[drawTick - tick] = drawn[word];
+                    }
+                }
+            }
+        }
+
+        for(int lane=0; lane < LOCKSTEP_WIDTH; lane++){
+            if(generators[lane] == NULL){
+                continue;
+            }
+
+            const ArrivalGenerator::CompiledProcess& process = generators[lane]->compiled[group];
+
+            switch(process.type){
+                case ArrivalProcess::none:
+                    break;
+
+                case ArrivalProcess::poisson:
+                case ArrivalProcess::timeVarying:{
+                    /// Step through the bins instead of dividing every tick
+                    size_t bin = (tick / process.binTicks) % process.meanPerTick.size();
+                    long ticksLeftInBin = process.binTicks - (long)(tick % process.binTicks);
+
+                    for(int t=0; t < ARRIVAL_BATCH_TICKS; t++){
+                        double uniform = Philox4x32::toUniform((uint32_t)words[t][lane]);
+
+                        if(ticksLeftInBin == 0){
+                            bin = (bin + 1) % process.meanPerTick.size();
+                            ticksLeftInBin = process.binTicks;
+                        }
+                        ticksLeftInBin--;
+
+                        blk.arrivalBatch[(size_t)t * NUM_LANE_GROUPS + group][lane] = ArrivalGenerator::samplePoisson(uniform, process.meanPerTick[bin], process.expNegMean[bin]);
+                    }
+                    break;
+                }
+
+                case ArrivalProcess::platoon:
+                    for(int t=0; t < ARRIVAL_BATCH_TICKS; t++){
+                        unsigned long arrivalTick = tick + t;
+
+                        if(arrivalTick >= (unsigned long)process.platoonOffsetTicks && (arrivalTick - process.platoonOffsetTicks) % process.platoonPeriodTicks == 0){
+                            blk.arrivalBatch[(size_t)t * NUM_LANE_GROUPS + group][lane] = generators[lane]->processes[group].getPlatoonSize();
+                        }
+                    }
+                    break;
+
+                default:
+                    throw std::out_of_range("LockstepVariants::generateArrivals() encountered an unhandled ArrivalProcess::Type");
+            }
+        }
+    }
+
+    blk.batchStartTick = tick;
+    blk.batchIsValid = true;
+}
+
+void LockstepVariants::flushQueuedTicks(Block& blk){
+    for(int lane=0; lane < LOCKSTEP_WIDTH; lane++){
+        blk.vehicleTicks[lane] += (uint32_t)blk.queuedTicks[lane];
+    }
+
+    blk.queuedTicks = Lanes{};
+}
+
+void LockstepVariants::tickBlock(Block& blk, unsigned long tick){
+    const Lanes zero = {};
+    const Lanes one = zero + 1;
+    const Lanes yellow = zero + (int)TrafficLight::yellow;
+    const Lanes red = zero + (int)TrafficLight::red;
+    const Lanes* arriving = &blk.arrivalBatch[(tick - blk.batchStartTick) * NUM_LANE_GROUPS];
+    int numPhases = (int)phaseFirstStart.size() - 1;
+
+    /// ArrivalGenerator::inject(): only what fits is added, the rest is turned away
+    for(int group : validGroups){
+        Lanes room = blk.maxQueued[group] - blk.queued[group];
+        Lanes added = (arriving[group] < room) ? arriving[group] : room;
+        Lanes admitted = added & (added > 0);
+
+        blk.queued[group] += admitted;
+        blk.arrivals[group] += admitted;
+        blk.injected += admitted;
+        blk.blocked += (arriving[group] - added) & (arriving[group] != 0);
+    }
+
+    /// Intersection::handleVehicles() then Intersection::handleLightTick() for every lane group in order, every
+    /// branch a mask. Exit TurnOptions are shared, so the order matters.
+    for(int group : validGroups){
+        int exit = exitGroup[group];
+        const Lanes lanes = zero + numLanes[group];
+        Lanes& color = blk.color[group];
+        Lanes& ticksRemaining = blk.ticksRemaining[group];
+        Lanes& queued = blk.queued[group];
+        Lanes& progress = blk.progress[group];
+        Lanes& crossing = blk.crossing[group];
+        Lanes& exitQueued = blk.exitQueued[exit];
+        Lanes& exitMaxQueued = blk.exitMaxQueued[exit];
+
+        Lanes active = (queued != 0);
+        progress -= one & active & (progress > 0);
+
+        Lanes isRed = (color == red);
+        Lanes areCrossing = (progress > 0);
+        Lanes begin = active & ~isRed & ~areCrossing & (exitQueued < exitMaxQueued);
+        Lanes abandon = active & isRed & areCrossing;
+
+        /// TurnOption::nextVehiclesBeginCrossing(), the exit admits what fits
+        Lanes finished = crossing & begin;
+        Lanes total = exitQueued + finished;
+        Lanes fits = (total <= exitMaxQueued);
+        Lanes admit = begin & (finished > 0);
+        Lanes admitted = fits ? finished : ((exitQueued < exitMaxQueued) ? exitMaxQueued - exitQueued : zero);
+
+        queued -= finished;
+        blk.departures[group] += finished;
+        exitQueued = admit ? (fits ? total : exitMaxQueued) : exitQueued;
+        blk.exitArrivals[exit] += admitted & admit;
+
+        Lanes startCrossing = begin & (color < yellow);
+        crossing = startCrossing ? ((queued > lanes) ? lanes : queued) : crossing;
+        progress = startCrossing ? blk.timeToCross[group] : progress;
+        crossing = (begin & (color == yellow)) ? zero : crossing;
+
+        /// TurnOption::vehiclesLeftInIntersection()
+        progress = abandon ? zero : progress;
+        crossing = abandon ? zero : crossing;
+
+        /// TrafficLight::tick() on lights that are not red
+        Lanes lit = (color != red);
+        ticksRemaining -= one & lit & (ticksRemaining > 0);
+
+        Lanes expired = lit & (ticksRemaining == 0);
+        Lanes toYellow = expired & (color < yellow);
+        Lanes toRed = expired & (color == yellow);
+
+        color = toYellow ? yellow : color;
+        ticksRemaining = toYellow ? blk.yellowTicks[group] : ticksRemaining;
+        color = toRed ? red : color;
+        ticksRemaining = toRed ? blk.redTicks[group] : ticksRemaining;
+        blk.numUnfinishedLights -= one & toRed;
+    }
+
+    /// Intersection::sequenceLightConfigs() without a policy
+    if(autoSequence && numPhases > 0){
+        const Lanes numPhasesLanes = zero + numPhases;
+        Lanes idle = (blk.numUnfinishedLights == 0);
+        Lanes& clearance = blk.clearanceTicksRemaining;
+
+        clearance = (idle & (clearance < 0)) ? blk.clearanceTicks : ((idle & (clearance > 0)) ? clearance - 1 : clearance);
+
+        /// A cycle with a length always reaches a phase with lights or a clearance within one round
+        Lanes stepping = idle & (clearance == 0) & blk.cycles;
+        for(int round=0; round <= numPhases && anyLane(stepping); round++){
+            Lanes next = blk.configScheduleIdx + 1;
+
+            next = (next >= numPhasesLanes) ? zero : next;
+            blk.configScheduleIdx = stepping ? next : blk.configScheduleIdx;
+
+            for(int phase=0; phase < numPhases; phase++){
+                Lanes starting = stepping & (blk.configScheduleIdx == phase);
+                const Lanes phaseLanes = zero + phase;
+
+                if( ! anyLane(starting)){
+                    continue;
+                }
+
+                /// Intersection::setLightConfig()
+                for(int start=phaseFirstStart[phase]; start < phaseFirstStart[phase + 1]; start++){
+                    int group = startGroups[start];
+                    const Lanes onColorLanes = zero + onColor[group];
+                    Lanes setsYellow = starting & blk.startSetsYellow[start];
+
+                    blk.onTicks[group] = starting ? blk.startOnTicks[start] : blk.onTicks[group];
+                    blk.yellowTicks[group] = setsYellow ? blk.startYellowTicks[start] : blk.yellowTicks[group];
+                    blk.color[group] = starting ? onColorLanes : blk.color[group];
+                    blk.ticksRemaining[group] = starting ? blk.startOnTicks[start] : blk.ticksRemaining[group];
+                    blk.lastPhase[group] = starting ? phaseLanes : blk.lastPhase[group];
+                    blk.lastYellowPhase[group] = setsYellow ? phaseLanes : blk.lastYellowPhase[group];
+                    blk.numUnfinishedLights += one & starting;
+                }
+            }
+
+            clearance = stepping ? ((blk.numUnfinishedLights == 0) ? blk.clearanceTicks : zero - 1) : clearance;
+            stepping &= (clearance == 0);
+        }
+    }
+
+    for(int group : validGroups){
+        blk.queuedTicks += blk.queued[group];
+    }
+
+    if(drainExits){
+        for(int group : exitGroups){
+            blk.exitQueued[group] = zero;
+        }
+    }
+}
+
+template <typename Fn>
+void LockstepVariants::forEachBlock(Fn fn){
+    size_t numBlocks = blocks.size();
+    unsigned int threads = std::min(numThreads, std::max(1u, (unsigned int)(numBlocks / LOCKSTEP_MIN_BLOCKS_PER_THREAD)));
+    std::vector<std::thread> workers;
+
+    if(threads == 1){
+        fn(0, numBlocks);
+        return;
+    }
+
+    for(unsigned int t=0; t < threads; t++){
+        workers.emplace_back(fn, numBlocks * t / threads, numBlocks * (t + 1) / threads);
+    }
+
+    for(std::thread& worker : workers){
+        worker.join();
+    }
+}
+
+void LockstepVariants::tick(unsigned long ticks){
+    unsigned long startTick = ticksSinceStart;
+
+    if(refreshRateHzGlobal != loadedRefreshRate){
+        throw std::logic_error("LockstepVariants::tick() refreshRateHzGlobal changed since load()");
+    }
+
+    /// Blocks never interact, each runs all its ticks while its state is in cache
+    forEachBlock([this, startTick, ticks](size_t first, size_t last){
+        for(size_t b=first; b < last; b++){
+            Block& blk = blocks[b];
+
+            for(unsigned long tick=startTick; tick < startTick + ticks; tick++){
+                if( ! blk.batchIsValid || tick < blk.batchStartTick || tick >= blk.batchStartTick + ARRIVAL_BATCH_TICKS){
+                    flushQueuedTicks(blk);
+                    generateArrivals(b, tick);
+                }
+
+                tickBlock(blk, tick);
+            }
+
+            flushQueuedTicks(blk);
+        }
+    });
+
+    ticksSinceStart += ticks;
+}
+
+void LockstepVariants::store(){
+    for(size_t variant=0; variant < variants.size(); variant++){
+        Intersection& inter = *variants[variant];
+        Block& blk = blocks[variant / LOCKSTEP_WIDTH];
+        int lane = variant % LOCKSTEP_WIDTH;
+        SignalPlan& plan = inter.getSignalPlan();
+
+        for(int group : validGroups){
+            TurnOption* turnOpt = inter.roads[Road::laneGroupDirection(group)]->getTurnOption(Road::laneGroupTurn(group));
+            TrafficLight* light = turnOpt->getLight();
+            int phase = blk.lastPhase[group][lane];
+            int yellowPhase = blk.lastYellowPhase[group][lane];
+
+            light->color = (TrafficLight::AvailableColors)blk.color[group][lane];
+            light->ticksRemaining = blk.ticksRemaining[group][lane];
+            light->colorDurationTicks[light->onColor] = blk.onTicks[group][lane];
+            light->colorDurationTicks[TrafficLight::yellow] = blk.yellowTicks[group][lane];
+            light->numVehiclesDirected += (uint32_t)blk.departures[group][lane];
+
+            /// The seconds are those of the light start that set the ticks
+            for(int start=0; phase >= 0 && start < (int)startGroups.size(); start++){
+                if(startGroups[start] != group){
+                    continue;
+                }
+
+                if(start >= phaseFirstStart[phase] && start < phaseFirstStart[phase + 1]){
+                    light->colorDuration[light->onColor] = plan.getPhase(phase).lightStarts[start - phaseFirstStart[phase]].onDuration;
+                }
+                if(yellowPhase >= 0 && start >= phaseFirstStart[yellowPhase] && start < phaseFirstStart[yellowPhase + 1]){
+                    light->colorDuration[TrafficLight::yellow] = plan.getPhase(yellowPhase).lightStarts[start - phaseFirstStart[yellowPhase]].yellowDuration;
+                }
+            }
+
+            turnOpt->queuedVehicles = blk.queued[group][lane];
+            turnOpt->currentVehicleProgress = blk.progress[group][lane];
+            turnOpt->numVehiclesCurrentlyCrossing = blk.crossing[group][lane];
+            turnOpt->cumulativeArrivals += (uint32_t)blk.arrivals[group][lane];
+            turnOpt->cumulativeDepartures += (uint32_t)blk.departures[group][lane];
+            blk.arrivals[group][lane] = 0;
+            blk.departures[group][lane] = 0;
+        }
+
+        for(int group : exitGroups){
+            TurnOption* exitTurnOpt = inter.exitRoads[Road::laneGroupDirection(group)]->getTurnOption(Road::laneGroupTurn(group));
+
+            exitTurnOpt->queuedVehicles = blk.exitQueued[group][lane];
+            exitTurnOpt->cumulativeArrivals += (uint32_t)blk.exitArrivals[group][lane];
+            blk.exitArrivals[group][lane] = 0;
+        }
+
+        inter.configScheduleIdx = blk.configScheduleIdx[lane];
+        inter.numUnfinishedLights = blk.numUnfinishedLights[lane];
+        inter.clearanceTicksRemaining = blk.clearanceTicksRemaining[lane];
+        inter.ticksSinceStart = ticksSinceStart;
+
+        if(inter.arrivals != NULL){
+            inter.arrivals->numArrivals += (uint32_t)blk.injected[lane];
+            inter.arrivals->numBlockedArrivals += (uint32_t)blk.blocked[lane];
+        }
+    }
+
+    /// The ArrivalGenerators hold them now
+    for(Block& blk : blocks){
+        blk.injected = Lanes{};
+        blk.blocked = Lanes{};
+    }
+}
+
+double LockstepVariants::getDelay(size_t variant){
+    variants.at(variant);
+
+    return (double)blocks[variant / LOCKSTEP_WIDTH].vehicleTicks[variant % LOCKSTEP_WIDTH] / loadedRefreshRate;
+}
+
+unsigned int LockstepVariants::getQueuedVehicles(size_t variant, Road::RoadDirection dir, TurnOption::Type turn){
+    variants.at(variant);
+
+    return blocks[variant / LOCKSTEP_WIDTH].queued[Road::laneGroupIdx(dir, turn)][variant % LOCKSTEP_WIDTH];
+}
+
+TrafficLight::AvailableColors LockstepVariants::getColor(size_t variant, Road::RoadDirection dir, TurnOption::Type turn){
+    variants.at(variant);
+
+    return (TrafficLight::AvailableColors)blocks[variant / LOCKSTEP_WIDTH].color[Road::laneGroupIdx(dir, turn)][variant % LOCKSTEP_WIDTH];
+}
+
+int LockstepVariants::getTicksRemaining(size_t variant, Road::RoadDirection dir, TurnOption::Type turn){
+    variants.at(variant);
+
+    return blocks[variant / LOCKSTEP_WIDTH].ticksRemaining[Road::laneGroupIdx(dir, turn)][variant % LOCKSTEP_WIDTH];
+}
@@ -0,0 +1,18 @@
+#include "Philox.h"
+
+Philox4x32::Counter Philox4x32::generate(Counter counter, Key key){
+    for(int round=0; round < PHILOX_ROUNDS; round++){
+        uint64_t product0 = (uint64_t)PHILOX_M0 * counter[0];
+        uint64_t product1 = (uint64_t)PHILOX_M1 * counter[2];
+
+        counter = {(uint32_t)(product1 >> 32) ^ counter[1] ^ key[0],
+                   (uint32_t)product1,
+                   (uint32_t)(product0 >> 32) ^ counter[3] ^ key[1],
+                   (uint32_t)product0};
+
+        key[0] += PHILOX_W0;
+        key[1] += PHILOX_W1;
+    }
+
+    return counter;
+}
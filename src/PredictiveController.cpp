@@ -0,0 +1,183 @@
+#include <chrono>
+#include <stdexcept>
+
+#include "PredictiveController.h"
+
+PredictiveController::PredictiveController(int phases, double seconds, unsigned int threads){
+    if(phases < 1 || phases > MPC_MAX_HORIZON_PHASES || ! (seconds > 0)){
+        throw std::domain_error("PredictiveController() requires 1 to MPC_MAX_HORIZON_PHASES phases and a positive horizon");
+    }
+
+    horizonPhases = phases;
+    horizonSeconds = seconds;
+    numThreads = (threads == 0) ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+    rolloutTicks = 0;
+    generation = 0;
+    numFinished = 0;
+    numActive = 0;
+    stopping = false;
+    nextRollout = 0;
+    numDecisions = 0;
+    rollouts.reserve(MPC_MAX_CANDIDATES);
+
+    for(unsigned int t=1; t < numThreads; t++){
+        workers.emplace_back(&PredictiveController::workerLoop, this);
+    }
+}
+
+PredictiveController::~PredictiveController(){
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        stopping = true;
+    }
+    workReady.notify_all();
+
+    for(std::thread& worker : workers){
+        worker.join();
+    }
+}
+
+void PredictiveController::runRollout(Rollout& rollout){
+    SequencePolicy policy = {rollout.phases.data(), horizonPhases, 0};
+    Intersection& clone = *rollout.clone;
+
+    rollout.cost = 0;
+
+    /// The copy is at the boundary the live Intersection is deciding on
+    clone.stepLightConfig(&policy);
+
+    for(int t=0; t < rolloutTicks; t++){
+        clone.tick(policy);
+
+        for(Road* rd : clone.roads){
+            for(int opt=0; rd != NULL && opt < TurnOption::numTurnOptions; opt++){
+                rollout.cost += rd->getTurnOption((TurnOption::Type)opt)->getQueuedVehicles();
+            }
+        }
+    }
+}
+
+void PredictiveController::takeRollouts(){
+    size_t idx;
+    size_t numTaken = 0;
+
+    while((idx = nextRollout.fetch_add(1)) < rollouts.size()){
+        runRollout(rollouts[idx]);
+        numTaken++;
+    }
+
+    if(numTaken > 0){
+        std::lock_guard<std::mutex> lock(poolMutex);
+
+        numFinished += numTaken;
+        if(numFinished == rollouts.size()){
+            workDone.notify_all();
+        }
+    }
+}
+
+void PredictiveController::workerLoop(){
+    unsigned long seen = 0;
+
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(poolMutex);
+
+            workReady.wait(lock, [this, seen](){ return stopping || generation != seen; });
+            if(stopping){
+                return;
+            }
+            seen = generation;
+            numActive++;
+        }
+
+        takeRollouts();
+
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+
+            numActive--;
+            if(numActive == 0){
+                workDone.notify_all();
+            }
+        }
+    }
+}
+
+SignalController::Decision PredictiveController::nextPhase(Intersection& inter, int current){
+    auto startTime = std::chrono::steady_clock::now();
+    SignalPlan& plan = inter.getSignalPlan();
+    int numPhases = plan.getNumPhases();
+    size_t numCandidates = 1;
+    size_t best = 0;
+
+    validPhases.clear();
+    for(int i=1; i <= numPhases; i++){
+        int idx = (current + i) % numPhases;
+
+        if(plan.getPhase(idx).valid){
+            validPhases.push_back(idx);
+        }
+    }
+
+    if(validPhases.empty()){
+        return {(current + 1) % numPhases, -1};
+    }
+
+    for(int i=0; i < horizonPhases; i++){
+        numCandidates *= validPhases.size();
+
+        if(numCandidates > MPC_MAX_CANDIDATES){
+            throw std::invalid_argument("PredictiveController::nextPhase() more candidate sequences than MPC_MAX_CANDIDATES");
+        }
+    }
+
+    /// Candidate "c" is "c" written in base validPhases.size(), its first LightConfig the most significant digit
+    rollouts.resize(numCandidates);
+    for(size_t c=0; c < numCandidates; c++){
+        size_t digits = c;
+
+        for(int i=horizonPhases - 1; i >= 0; i--){
+            rollouts[c].phases[i] = validPhases[digits % validPhases.size()];
+            digits /= validPhases.size();
+        }
+        rollouts[c].clone = inter.fork();
+    }
+    rolloutTicks = std::max(1, secondsToTicks(horizonSeconds, refreshRateHzGlobal));
+
+    auto forkedTime = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+
+        nextRollout = 0;
+        numFinished = 0;
+        generation++;
+    }
+    workReady.notify_all();
+
+    takeRollouts();
+
+    /// A worker woken late may still be about to take a rollout, the next decision must not reset them under it
+    {
+        std::unique_lock<std::mutex> lock(poolMutex);
+
+        workDone.wait(lock, [this](){ return numFinished == rollouts.size() && numActive == 0; });
+    }
+
+    for(size_t c=0; c < numCandidates; c++){
+        if(rollouts[c].cost < rollouts[best].cost){
+            best = c;
+        }
+        inter.releaseFork(rollouts[c].clone);
+    }
+
+    auto endTime = std::chrono::steady_clock::now();
+
+    forkLatencies.add(std::chrono::duration<double, std::nano>(forkedTime - startTime).count());
+    rolloutLatencies.add(std::chrono::duration<double, std::nano>(endTime - forkedTime).count());
+    latencies.add(std::chrono::duration<double, std::nano>(endTime - startTime).count());
+    numDecisions++;
+
+    return {rollouts[best].phases[0], -1};
+}
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "QuantileSketch.h"
+#include "Varint.h"
+
+QuantileSketch::QuantileSketch(double accuracy, size_t numBuckets){
+    if( ! (accuracy > 0 && accuracy < 1) || numBuckets < 2){
+        throw std::domain_error("QuantileSketch() accuracy must be in (0, 1) and the bucket limit at least 2");
+    }
+
+    relativeAccuracy = accuracy;
+    logGamma = std::log((1 + accuracy) / (1 - accuracy));
+    maxBuckets = numBuckets;
+    clear();
+}
+
+void QuantileSketch::clear(){
+    buckets.clear();
+    minIndex = 0;
+    zeroCount = 0;
+    count = 0;
+    minValue = std::numeric_limits<double>::infinity();
+    maxValue = -std::numeric_limits<double>::infinity();
+}
+
+int QuantileSketch::bucketIndex(double value) const{
+    return (int)std::ceil(std::log(value) / logGamma);
+}
+
+double QuantileSketch::bucketValue(int index) const{
+    /// Halfway between the bounds in relative terms, within relativeAccuracy of both
+    return 2 * std::exp(index * logGamma) / (1 + std::exp(logGamma));
+}
+
+void QuantileSketch::addToBucket(int index, uint64_t n){
+    if(buckets.empty()){
+        minIndex = index;
+        buckets.assign(1, n);
+        return;
+    }
+
+    int maxIndex = std::max(minIndex + (int)buckets.size() - 1, index);
+    int lowestKept = maxIndex - (int)maxBuckets + 1;
+
+    if(minIndex < lowestKept){
+        /// Fold the buckets below lowestKept into it
+        size_t numFolded = std::min(buckets.size(), (size_t)(lowestKept - minIndex));
+        uint64_t folded = 0;
+
+        for(size_t i=0; i < numFolded; i++){
+            folded += buckets[i];
+        }
+        buckets.erase(buckets.begin(), buckets.begin() + numFolded);
+
+        if(buckets.empty()){
+            buckets.assign(1, folded);
+        }
+        else{
+            buckets[0] += folded;
+        }
+        minIndex = lowestKept;
+    }
+
+    index = std::max(index, lowestKept);
+
+    if(index < minIndex){
+        buckets.insert(buckets.begin(), minIndex - index, 0);
+        minIndex = index;
+    }
+    else if(index >= minIndex + (int)buckets.size()){
+        buckets.resize(index - minIndex + 1, 0);
+    }
+
+    buckets[index - minIndex] += n;
+}
+
+void QuantileSketch::add(double value, uint64_t n){
+    if( ! std::isfinite(value) || value < 0){
+        throw std::domain_error("QuantileSketch::add() value must be finite and >= 0");
+    }
+
+    if(n == 0){
+        return;
+    }
+
+    if(value == 0){
+        zeroCount += n;
+    }
+    else{
+        addToBucket(bucketIndex(value), n);
+    }
+
+    count += n;
+    minValue = std::min(minValue, value);
+    maxValue = std::max(maxValue, value);
+}
+
+void QuantileSketch::merge(const QuantileSketch& other){
+    if(other.relativeAccuracy != relativeAccuracy || other.maxBuckets != maxBuckets){
+        throw std::invalid_argument("QuantileSketch::merge() sketches have a different accuracy or bucket limit");
+    }
+
+    /// Highest first so the buckets grow and fold at most once
+    for(size_t i=other.buckets.size(); i > 0; i--){
+        if(other.buckets[i - 1] > 0){
+            addToBucket(other.minIndex + (int)i - 1, other.buckets[i - 1]);
+        }
+    }
+
+    zeroCount += other.zeroCount;
+    count += other.count;
+    minValue = std::min(minValue, other.minValue);
+    maxValue = std::max(maxValue, other.maxValue);
+}
+
+double QuantileSketch::quantile(double q) const{
+    uint64_t rank, seen;
+
+    if( ! (q >= 0 && q <= 1)){
+        throw std::domain_error("QuantileSketch::quantile() q must be in [0, 1]");
+    }
+
+    if(count == 0){
+        throw std::logic_error("QuantileSketch::quantile() called on an empty sketch");
+    }
+
+    /// The value with "rank" smaller values
+    rank = (uint64_t)(q * (count - 1));
+    seen = zeroCount;
+
+    if(rank < seen){
+        return 0;
+    }
+
+    for(size_t i=0; i < buckets.size(); i++){
+        seen += buckets[i];
+
+        if(rank < seen){
+            return std::clamp(bucketValue(minIndex + (int)i), minValue, maxValue);
+        }
+    }
+
+    return maxValue;
+}
+
+bool QuantileSketch::operator==(const QuantileSketch& other) const{
+    return relativeAccuracy == other.relativeAccuracy && maxBuckets == other.maxBuckets && buckets == other.buckets
+           && (buckets.empty() || minIndex == other.minIndex) && zeroCount == other.zeroCount && count == other.count
+           && (count == 0 || (minValue == other.minValue && maxValue == other.maxValue));
+}
+
+void QuantileSketch::serialize(std::vector<uint8_t>& out) const{
+    putDouble(out, relativeAccuracy);
+    putVarint(out, maxBuckets);
+    putVarint(out, count);
+    putVarint(out, zeroCount);
+    putDouble(out, minValue);
+    putDouble(out, maxValue);
+    putVarint(out, zigzagEncode(minIndex));
+    putVarint(out, buckets.size());
+
+    for(uint64_t bucket : buckets){
+        putVarint(out, bucket);
+    }
+}
+
+QuantileSketch QuantileSketch::deserialize(const uint8_t* data, size_t size){
+    const uint8_t* pos = data;
+    const uint8_t* end = data + size;
+    double accuracy = getDouble(pos, end);
+    uint64_t numBuckets = getVarint(pos, end);
+    uint64_t total = 0;
+
+    if( ! (accuracy > 0 && accuracy < 1) || numBuckets < 2){
+        throw std::runtime_error("QuantileSketch::deserialize() invalid accuracy or bucket limit");
+    }
+
+    QuantileSketch sketch = QuantileSketch(accuracy, numBuckets);
+
+    sketch.count = getVarint(pos, end);
+    sketch.zeroCount = getVarint(pos, end);
+    sketch.minValue = getDouble(pos, end);
+    sketch.maxValue = getDouble(pos, end);
+    sketch.minIndex = (int)zigzagDecode(getVarint(pos, end));
+
+    uint64_t numUsed = getVarint(pos, end);
+    if(numUsed > numBuckets || numUsed > (uint64_t)(end - pos)){
+        throw std::runtime_error("QuantileSketch::deserialize() too many buckets");
+    }
+
+    sketch.buckets.resize(numUsed);
+    for(uint64_t& bucket : sketch.buckets){
+        bucket = getVarint(pos, end);
+        total += bucket;
+    }
+
+    if(pos != end || total + sketch.zeroCount != sketch.count){
+        throw std::runtime_error("QuantileSketch::deserialize() counts do not add up");
+    }
+
+    return sketch;
+}
@@ -59,8 +59,9 @@ Road::RoadDirection Road::roadRightOf(RoadDirection dir){
         rightRoadDir = 0;
     }
 
-    isValidRoadDirection((Road::RoadDirection&)rightRoadDir);
-    return (Road::RoadDirection)rightRoadDir;
+    RoadDirection rightDir = (RoadDirection)rightRoadDir;
+    isValidRoadDirection(rightDir);
+    return rightDir;
 }
 
 Road::RoadDirection Road::roadLeftOf(RoadDirection dir){
@@ -70,8 +71,9 @@ Road::RoadDirection Road::roadLeftOf(RoadDirection dir){
         leftRoadDir = numRoadDirections - 1;
     }
 
-    isValidRoadDirection((Road::RoadDirection&)leftRoadDir);
-    return (Road::RoadDirection)leftRoadDir;
+    RoadDirection leftDir = (RoadDirection)leftRoadDir;
+    isValidRoadDirection(leftDir);
+    return leftDir;
 }
 
 Road::RoadDirection Road::roadOppositeOf(RoadDirection dir){
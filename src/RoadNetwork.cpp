@@ -0,0 +1,513 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "RoadNetwork.h"
+#include "ArrivalGenerator.h"
+#include "Philox.h"
+
+RoadNetwork::RoadNetwork(uint64_t rngSeed, unsigned int threads){
+    numStates = 0;
+    numRows = 0;
+    tablesAreStale = true;
+    numThreads = (threads == 0) ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+    numRebuilt = 0;
+    seed = rngSeed;
+    compiledRefreshRate = 0;
+    numODArrivals = 0;
+    numBlockedArrivals = 0;
+    numUnroutable = 0;
+
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        for(int turn=0; turn < TurnOption::numTurnOptions; turn++){
+            approaches[Road::exitRoadDirection((Road::RoadDirection)dir, (TurnOption::Type)turn)][turn] = (Road::RoadDirection)dir;
+        }
+    }
+}
+
+RoadNetwork::~RoadNetwork(){
+    for(Intersection* inter : nodes){
+        inter->network = NULL;
+        inter->networkNode = -1;
+    }
+}
+
+size_t RoadNetwork::linkIdx(int node, Road::RoadDirection exitDir){
+    if(node < 0 || node >= (int)nodes.size()){
+        throw std::out_of_range("RoadNetwork: node " + std::to_string(node) + " is not in the network");
+    }
+    Road::isValidRoadDirection(exitDir);
+
+    return (size_t)node * Road::numRoadDirections + exitDir;
+}
+
+int RoadNetwork::addIntersection(Intersection& inter){
+    int node = (int)nodes.size();
+
+    if(inter.network != NULL){
+        throw std::logic_error("RoadNetwork::addIntersection() the Intersection is already part of a network");
+    }
+
+    nodes.push_back(&inter);
+    demands.emplace_back();
+
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        links.push_back({-1, Road::north, true});
+        upstreamLinks.push_back(-1);
+    }
+
+    inter.network = this;
+    inter.networkNode = node;
+    tablesAreStale = true;
+
+    return node;
+}
+
+void RoadNetwork::connect(int fromNode, Road::RoadDirection exitDir, int toNode, Road::RoadDirection roadDir){
+    size_t link = linkIdx(fromNode, exitDir);
+    size_t state = linkIdx(toNode, roadDir);
+    Road* rd = nodes[toNode]->getRoad(roadDir);
+
+    if(rd == NULL){
+        throw std::invalid_argument("RoadNetwork::connect() the Intersection has no Road facing " + std::to_string(roadDir));
+    }
+
+    if(links[link].toNode >= 0 || upstreamLinks[state] >= 0){
+        throw std::logic_error("RoadNetwork::connect() the link or the Road is already connected");
+    }
+
+    nodes[fromNode]->setExitRoad(exitDir, rd);
+
+    /// The link stops being a destination
+    linkRemoved(link);
+
+    links[link].toNode = toNode;
+    links[link].toRoad = roadDir;
+    upstreamLinks[state] = (int)link;
+
+    if(links[link].open){
+        linkAdded(link);
+    }
+}
+
+void RoadNetwork::closeRoad(int node, Road::RoadDirection exitDir){
+    size_t link = linkIdx(node, exitDir);
+
+    if( ! links[link].open){
+        return;
+    }
+
+    linkRemoved(link);
+    links[link].open = false;
+}
+
+void RoadNetwork::openRoad(int node, Road::RoadDirection exitDir){
+    size_t link = linkIdx(node, exitDir);
+
+    if(links[link].open){
+        return;
+    }
+
+    links[link].open = true;
+    linkAdded(link);
+}
+
+void RoadNetwork::linkRemoved(size_t link){
+    int node = (int)(link / Road::numRoadDirections);
+    Road::RoadDirection exitDir = (Road::RoadDirection)(link % Road::numRoadDirections);
+
+    if(tablesAreStale){
+        return;
+    }
+
+    if(destinationRows[link] >= 0){
+        staleDestinations[link] = true;
+    }
+
+    if(links[link].toNode < 0){
+        /// Leaving the network anywhere else is never on the way to another destination
+        return;
+    }
+
+    /// Only the destinations with a next hop onto the link change
+    for(size_t dest=0; dest < numStates; dest++){
+        const uint8_t* hops;
+
+        if(destinationRows[dest] < 0 || staleDestinations[dest]){
+            continue;
+        }
+
+        hops = nextHops.data() + (size_t)destinationRows[dest] * numStates;
+
+        for(int turn=0; turn < TurnOption::numTurnOptions; turn++){
+            if(hops[(size_t)node * Road::numRoadDirections + approaches[exitDir][turn]] == turn){
+                staleDestinations[dest] = true;
+                break;
+            }
+        }
+    }
+}
+
+void RoadNetwork::linkAdded(size_t link){
+    int node = (int)(link / Road::numRoadDirections);
+    Road::RoadDirection exitDir = (Road::RoadDirection)(link % Road::numRoadDirections);
+    size_t downstream;
+
+    if(tablesAreStale){
+        return;
+    }
+
+    if(links[link].toNode < 0){
+        staleDestinations[link] = destinationRows[link] >= 0;
+        return;
+    }
+
+    downstream = (size_t)links[link].toNode * Road::numRoadDirections + links[link].toRoad;
+
+    for(size_t dest=0; dest < numStates; dest++){
+        const uint16_t* counts;
+
+        if(destinationRows[dest] < 0 || staleDestinations[dest]){
+            continue;
+        }
+
+        counts = hopCounts.data() + (size_t)destinationRows[dest] * numStates;
+        if(counts[downstream] == UNREACHABLE_HOPS){
+            continue;
+        }
+
+        /// A path that ties could still be found first by the search, so ties are rebuilt too
+        for(int turn=0; turn < TurnOption::numTurnOptions; turn++){
+            size_t state = (size_t)node * Road::numRoadDirections + approaches[exitDir][turn];
+
+            if((validTurns[state] & (1 << turn)) && counts[downstream] + 1 <= counts[state]){
+                staleDestinations[dest] = true;
+                break;
+            }
+        }
+    }
+}
+
+void RoadNetwork::buildDestination(uint32_t dest, std::vector<uint32_t>& queue){
+    uint8_t* hops = nextHops.data() + (size_t)destinationRows[dest] * numStates;
+    uint16_t* counts = hopCounts.data() + (size_t)destinationRows[dest] * numStates;
+    size_t head = 0;
+
+    std::fill(hops, hops + numStates, NO_NEXT_HOP);
+    std::fill(counts, counts + numStates, UNREACHABLE_HOPS);
+    queue.clear();
+
+    /// Reaches every state with a turn onto "link" that has no next hop yet
+    auto reach = [&](size_t link, uint16_t numHops){
+        size_t node = link / Road::numRoadDirections;
+        Road::RoadDirection exitDir = (Road::RoadDirection)(link % Road::numRoadDirections);
+
+        for(int turn=0; turn < TurnOption::numTurnOptions; turn++){
+            size_t state = node * Road::numRoadDirections + approaches[exitDir][turn];
+
+            if((validTurns[state] & (1 << turn)) && counts[state] == UNREACHABLE_HOPS){
+                hops[state] = turn;
+                counts[state] = numHops;
+                queue.push_back(state);
+            }
+        }
+    };
+
+    if(links[dest].toNode >= 0 || ! links[dest].open || nodes[dest / Road::numRoadDirections]->getExitRoad((Road::RoadDirection)(dest % Road::numRoadDirections)) == NULL){
+        /// No longer a way out of the network
+        return;
+    }
+
+    reach(dest, 1);
+
+    while(head < queue.size()){
+        uint32_t state = queue[head++];
+        int link = upstreamLinks[state];
+
+        if(link >= 0 && links[link].open && counts[state] < UNREACHABLE_HOPS - 1){
+            reach(link, counts[state] + 1);
+        }
+    }
+}
+
+int RoadNetwork::updateTables(){
+    std::vector<uint32_t> stale;
+    unsigned int threads;
+
+    if(tablesAreStale){
+        numStates = links.size();
+        numRows = 0;
+        validTurns.assign(numStates, 0);
+        destinationRows.assign(numStates, -1);
+
+        for(size_t state=0; state < numStates; state++){
+            Road* rd = nodes[state / Road::numRoadDirections]->getRoad((Road::RoadDirection)(state % Road::numRoadDirections));
+
+            for(int turn=0; rd != NULL && turn < TurnOption::numTurnOptions; turn++){
+                if(rd->getTurnOption((TurnOption::Type)turn)->isValid()){
+                    validTurns[state] |= 1 << turn;
+                }
+            }
+
+            /// Only links leaving the network get a row, a link connected later keeps its row empty
+            if(links[state].toNode < 0){
+                destinationRows[state] = (int)numRows++;
+            }
+        }
+
+        nextHops.assign(numRows * numStates, NO_NEXT_HOP);
+        hopCounts.assign(numRows * numStates, UNREACHABLE_HOPS);
+        staleDestinations.assign(numStates, true);
+        tablesAreStale = false;
+    }
+
+    for(size_t dest=0; dest < numStates; dest++){
+        if(staleDestinations[dest] && destinationRows[dest] >= 0){
+            stale.push_back(dest);
+        }
+        staleDestinations[dest] = false;
+    }
+
+    if(stale.empty()){
+        return 0;
+    }
+
+    threads = std::min(numThreads, std::max(1u, (unsigned int)(stale.size() / ROUTING_MIN_DESTINATIONS_PER_THREAD)));
+
+    if(threads == 1){
+        std::vector<uint32_t> queue;
+
+        for(uint32_t dest : stale){
+            buildDestination(dest, queue);
+        }
+    }
+    else{
+        /// Every destination writes only its own rows of the tables
+        std::vector<std::thread> workers;
+
+        for(unsigned int t=0; t < threads; t++){
+            workers.emplace_back([this, &stale, t, threads](){
+                std::vector<uint32_t> queue;
+
+                for(size_t i=t; i < stale.size(); i += threads){
+                    buildDestination(stale[i], queue);
+                }
+            });
+        }
+
+        for(std::thread& worker : workers){
+            worker.join();
+        }
+    }
+
+    numRebuilt += stale.size();
+
+    return (int)stale.size();
+}
+
+long RoadNetwork::tableIdx(uint32_t dest, size_t state){
+    if(dest >= numStates || state >= numStates || destinationRows[dest] < 0){
+        return -1;
+    }
+
+    return (long)destinationRows[dest] * numStates + state;
+}
+
+TurnOption::Type RoadNetwork::nextTurn(int node, Road::RoadDirection road, uint32_t dest){
+    size_t state = linkIdx(node, road);
+
+    if(dest >= links.size()){
+        throw std::out_of_range("RoadNetwork::nextTurn() destination " + std::to_string(dest) + " is not in the network");
+    }
+
+    long idx = tableIdx(dest, state);
+
+    if(idx < 0 || nextHops[idx] == NO_NEXT_HOP){
+        return TurnOption::numTurnOptions;
+    }
+
+    return (TurnOption::Type)nextHops[idx];
+}
+
+int RoadNetwork::hopCount(int node, Road::RoadDirection road, uint32_t dest){
+    size_t state = linkIdx(node, road);
+
+    if(dest >= links.size()){
+        throw std::out_of_range("RoadNetwork::hopCount() destination " + std::to_string(dest) + " is not in the network");
+    }
+
+    long idx = tableIdx(dest, state);
+
+    if(idx < 0 || hopCounts[idx] == UNREACHABLE_HOPS){
+        return -1;
+    }
+
+    return hopCounts[idx];
+}
+
+long RoadNetwork::downstreamState(int node, Road::RoadDirection exitDir){
+    const Link& link = links[linkIdx(node, exitDir)];
+
+    if(link.toNode < 0){
+        return -1;
+    }
+
+    return (long)link.toNode * Road::numRoadDirections + link.toRoad;
+}
+
+TurnOption* RoadNetwork::laneFor(const VehicleRecord& vehicle, long state){
+    long idx;
+    uint8_t turn;
+
+    if( ! (vehicle.routeIndex & ROUTE_DESTINATION_FLAG) || state < 0){
+        return NULL;
+    }
+
+    idx = tableIdx(vehicle.routeIndex & ~ROUTE_DESTINATION_FLAG, state);
+    if(idx < 0 || (turn = nextHops[idx]) == NO_NEXT_HOP){
+        return NULL;
+    }
+
+    return nodes[state / Road::numRoadDirections]->getRoad((Road::RoadDirection)(state % Road::numRoadDirections))->getTurnOption((TurnOption::Type)turn);
+}
+
+unsigned int RoadNetwork::routeVehicles(VehicleRing* from, unsigned int numFinished, long state, TurnOption* fallback){
+    unsigned int numAdmitted = 0;
+
+    for(unsigned int i=0; i < numFinished && from->getSize() > 0; i++){
+        VehicleRecord vehicle = from->pop();
+        TurnOption* lane = laneFor(vehicle, state);
+
+        if(lane == NULL){
+            lane = fallback;
+        }
+
+        if(lane->admitVehicles(1) == 0){
+            from->getPool()->finishTrip(vehicle, false);
+            continue;
+        }
+
+        numAdmitted++;
+
+        if(lane->getVehicles() != NULL){
+            lane->getVehicles()->push(vehicle);
+        }
+        else{
+            from->getPool()->finishTrip(vehicle, true);
+        }
+    }
+
+    return numAdmitted;
+}
+
+void RoadNetwork::addDemand(int node, Road::RoadDirection road, uint32_t dest, double vehiclesPerHour){
+    linkIdx(node, road);
+
+    if(dest >= links.size()){
+        throw std::out_of_range("RoadNetwork::addDemand() destination " + std::to_string(dest) + " is not in the network");
+    }
+
+    if(nodes[node]->getRoad(road) == NULL){
+        throw std::invalid_argument("RoadNetwork::addDemand() the Intersection has no Road facing " + std::to_string(road));
+    }
+
+    if(vehiclesPerHour < 0){
+        throw std::domain_error("RoadNetwork::addDemand() vehiclesPerHour must be >= 0");
+    }
+
+    demands[node].push_back({road, dest, vehiclesPerHour, 0, 1});
+    compiledRefreshRate = 0;
+}
+
+void RoadNetwork::clearDemand(){
+    for(std::vector<Demand>& nodeDemands : demands){
+        nodeDemands.clear();
+    }
+}
+
+void RoadNetwork::compileDemand(){
+    for(std::vector<Demand>& nodeDemands : demands){
+        for(Demand& demand : nodeDemands){
+            double mean = demand.vehiclesPerHour / (SECONDS_PER_HOUR * refreshRateHzGlobal);
+
+            if(mean > ARRIVAL_MAX_MEAN_PER_TICK){
+                throw std::domain_error("RoadNetwork::compileDemand() demand exceeds ARRIVAL_MAX_MEAN_PER_TICK vehicles per tick");
+            }
+
+            demand.meanPerTick = mean;
+            demand.expNegMean = exp(-mean);
+        }
+    }
+
+    compiledRefreshRate = refreshRateHzGlobal;
+}
+
+int RoadNetwork::inject(Intersection& inter){
+    unsigned long tick = inter.time();
+    Philox4x32::Key key = {(uint32_t)seed, (uint32_t)(seed >> 32)};
+    int node = inter.networkNode;
+    int numAdded = 0;
+
+    if(inter.network != this){
+        throw std::logic_error("RoadNetwork::inject() the Intersection is not part of this network");
+    }
+
+    if(compiledRefreshRate != refreshRateHzGlobal){
+        compileDemand();
+    }
+
+    for(size_t i=0; i < demands[node].size(); i++){
+        Demand& demand = demands[node][i];
+        Philox4x32::Counter counter = {(uint32_t)tick, (uint32_t)(tick >> 32), (uint32_t)i, (uint32_t)node};
+        size_t state = (size_t)node * Road::numRoadDirections + demand.road;
+        long idx = tableIdx(demand.destination, state);
+        TurnOption* turnOpt;
+        int numArriving, numToAdd;
+
+        if(demand.meanPerTick == 0){
+            continue;
+        }
+
+        numArriving = ArrivalGenerator::samplePoisson(Philox4x32::toUniform(Philox4x32::generate(counter, key)[0]), demand.meanPerTick, demand.expNegMean);
+        if(numArriving == 0){
+            continue;
+        }
+
+        if(idx < 0 || nextHops[idx] == NO_NEXT_HOP){
+            numUnroutable += numArriving;
+            continue;
+        }
+
+        turnOpt = inter.getRoad(demand.road)->getTurnOption((TurnOption::Type)nextHops[idx]);
+        numToAdd = std::min(numArriving, (int)(turnOpt->getMaxNumVehicles() - turnOpt->getQueuedVehicles()));
+        numBlockedArrivals += numArriving - std::max(numToAdd, 0);
+
+        if(numToAdd > 0){
+            turnOpt->admitVehicles(numToAdd);
+
+            if(turnOpt->getVehicles() != NULL){
+                turnOpt->getVehicles()->spawn(numToAdd, ROUTE_DESTINATION_FLAG | demand.destination);
+            }
+
+            numAdded += numToAdd;
+        }
+    }
+
+    numODArrivals += numAdded;
+
+    return numAdded;
+}
+
+int RoadNetwork::tick(){
+    int numUnfinished = 0;
+
+    updateTables();
+
+    for(Intersection* inter : nodes){
+        numUnfinished += inter->tick();
+    }
+
+    return numUnfinished;
+}
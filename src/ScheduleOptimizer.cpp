@@ -0,0 +1,464 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "ScheduleOptimizer.h"
+#include "Philox.h"
+
+ScheduleOptimizer::ScheduleOptimizer(const Builder& build, double evalSeconds, Objective goal, uint64_t rngSeed, unsigned int threads){
+    unsigned int numThreads = (threads == 0) ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+
+    evalTicks = secondsToTicks(evalSeconds, refreshRateHzGlobal);
+    if(evalTicks < 1){
+        throw std::domain_error("ScheduleOptimizer() the evaluation must last at least one tick");
+    }
+
+    objective = goal;
+    seed = rngSeed;
+    population = DEFAULT_OPT_POPULATION;
+    eliteFraction = DEFAULT_OPT_ELITE_FRACTION;
+    smoothing = DEFAULT_OPT_SMOOTHING;
+    resolution = DEFAULT_OPT_RESOLUTION;
+    pruneMargin = DEFAULT_OPT_PRUNE_MARGIN;
+    minGreen = DEFAULT_OPT_MIN_GREEN;
+    maxGreen = DEFAULT_OPT_MAX_GREEN;
+    minYellow = 0;
+    maxYellow = 0;
+    searchYellows = false;
+    hasCutoffs = false;
+    cutoffs.fill(0);
+    numGenerations = 0;
+    numSimulated = 0;
+    numDropped = 0;
+    numMemoHits = 0;
+
+    for(unsigned int t=0; t < numThreads; t++){
+        Workspace* space = new Workspace();
+        Intersection& inter = space->inter;
+
+        workspaces.push_back(space);
+        build(inter, space->arrivals);
+
+        for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+            Road* rd = inter.getRoad(dir);
+
+            if(inter.getExitRoad(dir) == NULL && rd != NULL){
+                std::array<int, TurnOption::numTurnOptions> numLanes;
+
+                for(int turn=0; turn < TurnOption::numTurnOptions; turn++){
+                    numLanes[turn] = rd->getTurnOption((TurnOption::Type)turn)->getNumLanes();
+                }
+
+                space->ownedExitRoads.push_back(new Road(dir, numLanes, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+                inter.setExitRoad(dir, space->ownedExitRoads.back());
+            }
+        }
+
+        if(inter.configSchedule.empty()){
+            throw std::invalid_argument("ScheduleOptimizer() the Intersection was built without LightConfigs");
+        }
+
+        inter.setArrivals(&space->arrivals);
+        inter.setAutoSequence(true);
+        space->initial.pack(inter);
+    }
+
+    for(LightConfig* config : workspaces[0]->inter.configSchedule){
+        configs.push_back(*config);
+    }
+
+    bestEvaluation = {0, 0, std::numeric_limits<double>::infinity(), false, {}};
+}
+
+ScheduleOptimizer::~ScheduleOptimizer(){
+    for(Workspace* space : workspaces){
+        space->inter.setArrivals(NULL);
+
+        for(Road* exitRoad : space->ownedExitRoads){
+            delete exitRoad;
+        }
+        delete space;
+    }
+}
+
+void ScheduleOptimizer::setPopulation(int size, double fraction){
+    if(size < 2 || ! (fraction > 0 && fraction <= 1)){
+        throw std::domain_error("ScheduleOptimizer::setPopulation() requires at least 2 candidates and an elite fraction in (0, 1]");
+    }
+
+    population = size;
+    eliteFraction = fraction;
+}
+
+void ScheduleOptimizer::setGreenBounds(double low, double high){
+    if( ! (low > 0 && low <= high)){
+        throw std::domain_error("ScheduleOptimizer::setGreenBounds() requires 0 < low <= high");
+    }
+
+    minGreen = low;
+    maxGreen = high;
+}
+
+void ScheduleOptimizer::setYellowBounds(double low, double high){
+    if( ! (low >= 0 && low <= high)){
+        throw std::domain_error("ScheduleOptimizer::setYellowBounds() requires 0 <= low <= high");
+    }
+
+    minYellow = low;
+    maxYellow = high;
+    searchYellows = true;
+}
+
+void ScheduleOptimizer::setResolution(double seconds){
+    if( ! (seconds > 0)){
+        throw std::domain_error("ScheduleOptimizer::setResolution() requires a positive resolution");
+    }
+
+    resolution = seconds;
+}
+
+int ScheduleOptimizer::toSteps(double seconds, double low, double high){
+    int steps = (int)std::lround(std::clamp(seconds, low, high) / resolution);
+
+    /// Rounding must not leave the bounds
+    while(steps * resolution < low - 1e-9){
+        steps++;
+    }
+    while(steps > 0 && steps * resolution > high + 1e-9){
+        steps--;
+    }
+
+    return steps;
+}
+
+std::vector<int> ScheduleOptimizer::makeKey(const std::vector<double>& priority, const std::vector<double>& green, const std::vector<double>& yellow){
+    int numConfigs = configs.size();
+    std::vector<int> key(numConfigs);
+
+    for(int i=0; i < numConfigs; i++){
+        key[i] = i;
+    }
+    std::stable_sort(key.begin(), key.end(), [&priority](int a, int b){ return priority[a] < priority[b]; });
+
+    for(int i=0; i < numConfigs; i++){
+        key.push_back(toSteps(green[i], minGreen, maxGreen));
+    }
+
+    for(int i=0; searchYellows && i < numConfigs; i++){
+        key.push_back(toSteps(yellow[i], minYellow, maxYellow));
+    }
+
+    return key;
+}
+
+ScheduleOptimizer::Evaluation ScheduleOptimizer::simulate(Workspace& space, const std::vector<int>& key, bool prune){
+    Intersection& inter = space.inter;
+    int numConfigs = configs.size();
+    Evaluation eval = {0, 0, 0, false, {}};
+    unsigned long queuedTicks = 0;
+    unsigned long startDepartures = 0;
+    int checkpoint = 0;
+
+    inter.clearSchedule();
+    for(int pos=0; pos < numConfigs; pos++){
+        int idx = key[pos];
+        double yellow = searchYellows ? key[2 * numConfigs + idx] * resolution : configs[idx].getYellowDuration();
+
+        inter.schedule(configs[idx].getConfigOption(), configs[idx].getDirection(), key[numConfigs + idx] * resolution, yellow);
+    }
+
+    space.initial.unpack(inter);
+    space.arrivals.reseed(seed);
+    inter.start();
+
+    for(Road* rd : inter.roads){
+        for(int turn=0; rd != NULL && turn < TurnOption::numTurnOptions; turn++){
+            startDepartures += rd->getTurnOption((TurnOption::Type)turn)->getCumulativeDepartures();
+        }
+    }
+
+    for(int t=1; t <= evalTicks; t++){
+        inter.tick();
+
+        for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+            Road* rd = inter.getRoad(dir);
+            Road* exitRoad = inter.getExitRoad(dir);
+
+            for(int turn=0; turn < TurnOption::numTurnOptions; turn++){
+                if(rd != NULL){
+                    queuedTicks += rd->getTurnOption((TurnOption::Type)turn)->getQueuedVehicles();
+                }
+                if(exitRoad != NULL){
+                    exitRoad->getTurnOption((TurnOption::Type)turn)->queuedVehicles = 0;
+                }
+            }
+        }
+
+        if(t * OPT_CHECKPOINTS < (checkpoint + 1) * evalTicks){
+            continue;
+        }
+
+        eval.delay = (double)queuedTicks / refreshRateHzGlobal;
+        eval.departures = 0;
+        for(Road* rd : inter.roads){
+            for(int turn=0; rd != NULL && turn < TurnOption::numTurnOptions; turn++){
+                eval.departures += rd->getTurnOption((TurnOption::Type)turn)->getCumulativeDepartures();
+            }
+        }
+        eval.departures -= startDepartures;
+        eval.score = (objective == minimizeDelay) ? eval.delay : -(double)eval.departures;
+        eval.partialScores[checkpoint] = eval.score;
+
+        if(prune && checkpoint < OPT_CHECKPOINTS - 1 && pruneMargin >= 0 && eval.score > cutoffs[checkpoint] + pruneMargin * std::fabs(cutoffs[checkpoint])){
+            eval.score = std::numeric_limits<double>::infinity();
+            eval.dropped = true;
+            break;
+        }
+        checkpoint++;
+    }
+
+    return eval;
+}
+
+void ScheduleOptimizer::simulateAll(const std::vector<std::vector<int>>& keys, bool prune){
+    std::vector<const std::vector<int>*> pending;
+    std::vector<Evaluation> results;
+    std::atomic<size_t> next(0);
+
+    for(const std::vector<int>& key : keys){
+        if(memo.count(key) > 0 || std::any_of(pending.begin(), pending.end(), [&key](const std::vector<int>* other){ return *other == key; })){
+            numMemoHits++;
+            continue;
+        }
+        pending.push_back(&key);
+    }
+
+    results.resize(pending.size());
+    auto work = [this, &pending, &results, &next, prune](Workspace* space){
+        size_t idx;
+
+        while((idx = next.fetch_add(1)) < pending.size()){
+            results[idx] = simulate(*space, *pending[idx], prune);
+        }
+    };
+
+    size_t threads = std::min(workspaces.size(), pending.size());
+
+    if(threads <= 1){
+        work(workspaces[0]);
+    }
+    else{
+        std::vector<std::thread> workers;
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        for(size_t t=0; t < threads; t++){
+            workers.emplace_back([&work, &error, &errorMutex](Workspace* space){
+                try{
+                    work(space);
+                }
+                catch(...){
+                    std::lock_guard<std::mutex> lock(errorMutex);
+
+                    if( ! error){
+                        error = std::current_exception();
+                    }
+                }
+            }, workspaces[t]);
+        }
+
+        for(std::thread& worker : workers){
+            worker.join();
+        }
+
+        /// Nothing is added to the memo, as on one thread
+        if(error){
+            std::rethrow_exception(error);
+        }
+    }
+
+    for(size_t i=0; i < pending.size(); i++){
+        memo[*pending[i]] = results[i];
+        numSimulated++;
+        numDropped += results[i].dropped;
+    }
+}
+
+double ScheduleOptimizer::gaussian(unsigned long gen, int sample, int dim){
+    Philox4x32::Counter words = Philox4x32::generate({(uint32_t)gen, (uint32_t)sample, (uint32_t)dim, 0}, {(uint32_t)seed, (uint32_t)(seed >> 32)});
+
+    /// Box-Muller
+    return std::sqrt(-2.0 * std::log(Philox4x32::toUniform(words[0]))) * std::cos(2.0 * M_PI * Philox4x32::toUniform(words[1]));
+}
+
+void ScheduleOptimizer::step(){
+    int numConfigs = configs.size();
+    std::vector<std::vector<int>> keys;
+    std::vector<double> priority(numConfigs), green(numConfigs), yellow(numConfigs);
+
+    if(numGenerations == 0){
+        greens.clear();
+        yellows.clear();
+        priorities.clear();
+
+        for(int i=0; i < numConfigs; i++){
+            greens.push_back({std::clamp(configs[i].getDuration(), minGreen, maxGreen), (maxGreen - minGreen) / 4});
+            yellows.push_back({searchYellows ? std::clamp(configs[i].getYellowDuration(), minYellow, maxYellow) : configs[i].getYellowDuration(), (maxYellow - minYellow) / 4});
+            priorities.push_back({(double)i, 1.0});
+            priority[i] = priorities[i].mean;
+            green[i] = greens[i].mean;
+            yellow[i] = yellows[i].mean;
+        }
+
+        /// The built schedule is scored first, the result is never worse than it
+        keys.push_back(makeKey(priority, green, yellow));
+    }
+
+    for(int s=0; s < population; s++){
+        for(int i=0; i < numConfigs; i++){
+            priority[i] = priorities[i].mean + priorities[i].stddev * gaussian(numGenerations, s, i);
+            green[i] = greens[i].mean + greens[i].stddev * gaussian(numGenerations, s, numConfigs + i);
+            yellow[i] = yellows[i].mean + yellows[i].stddev * gaussian(numGenerations, s, 2 * numConfigs + i);
+        }
+        keys.push_back(makeKey(priority, green, yellow));
+    }
+
+    simulateAll(keys, hasCutoffs);
+
+    /// Lowest score first, ties to the earliest sampled
+    std::vector<size_t> ranks(keys.size());
+    for(size_t i=0; i < ranks.size(); i++){
+        ranks[i] = i;
+    }
+    std::stable_sort(ranks.begin(), ranks.end(), [this, &keys](size_t a, size_t b){ return memo[keys[a]].score < memo[keys[b]].score; });
+
+    size_t numElites = std::max<size_t>(1, (size_t)std::ceil(eliteFraction * population));
+    while(numElites > 0 && memo[keys[ranks[numElites - 1]]].dropped){
+        numElites--;
+    }
+
+    numGenerations++;
+    if(numElites == 0){
+        return;
+    }
+
+    const Evaluation& best = memo[keys[ranks[0]]];
+    if(best.score < bestEvaluation.score){
+        bestEvaluation = best;
+        bestKey = keys[ranks[0]];
+    }
+
+    cutoffs = memo[keys[ranks[numElites - 1]]].partialScores;
+    hasCutoffs = true;
+
+    /// Refit every quantity to the elites, keeping part of the old distribution so it does not collapse at once
+    auto refit = [this, numElites](Normal& normal, const std::function<double(const std::vector<int>& key)>& value, const std::vector<std::vector<int>>& eliteKeys, double minStddev){
+        double mean = 0, var = 0;
+
+        for(const std::vector<int>& key : eliteKeys){
+            mean += value(key);
+        }
+        mean /= numElites;
+
+        for(const std::vector<int>& key : eliteKeys){
+            var += (value(key) - mean) * (value(key) - mean);
+        }
+
+        normal.mean = smoothing * mean + (1 - smoothing) * normal.mean;
+        normal.stddev = std::max(minStddev, smoothing * std::sqrt(var / numElites) + (1 - smoothing) * normal.stddev);
+    };
+
+    std::vector<std::vector<int>> eliteKeys;
+    for(size_t e=0; e < numElites; e++){
+        eliteKeys.push_back(keys[ranks[e]]);
+    }
+
+    for(int i=0; i < numConfigs; i++){
+        refit(priorities[i], [i, numConfigs](const std::vector<int>& key){ return (double)(std::find(key.begin(), key.begin() + numConfigs, i) - key.begin()); }, eliteKeys, 0.1);
+        refit(greens[i], [this, i, numConfigs](const std::vector<int>& key){ return key[numConfigs + i] * resolution; }, eliteKeys, resolution / 2);
+
+        if(searchYellows){
+            refit(yellows[i], [this, i, numConfigs](const std::vector<int>& key){ return key[2 * numConfigs + i] * resolution; }, eliteKeys, resolution / 2);
+        }
+    }
+}
+
+std::vector<LightConfig> ScheduleOptimizer::optimize(int generations){
+    for(int g=0; g < generations; g++){
+        step();
+    }
+
+    return getBestSchedule();
+}
+
+ScheduleOptimizer::Evaluation ScheduleOptimizer::evaluate(const std::vector<LightConfig>& schedule){
+    int numConfigs = configs.size();
+    std::vector<double> priority(numConfigs, -1), green(numConfigs), yellow(numConfigs);
+
+    if((int)schedule.size() != numConfigs){
+        throw std::invalid_argument("ScheduleOptimizer::evaluate() the schedule must hold every built LightConfig once");
+    }
+
+    for(int pos=0; pos < numConfigs; pos++){
+        LightConfig config = schedule[pos];
+        int idx = 0;
+
+        while(idx < numConfigs && (priority[idx] >= 0 || configs[idx].getConfigOption() != config.getConfigOption() || configs[idx].getDirection() != config.getDirection())){
+            idx++;
+        }
+
+        if(idx == numConfigs){
+            throw std::invalid_argument("ScheduleOptimizer::evaluate() the schedule must hold every built LightConfig once");
+        }
+
+        priority[idx] = pos;
+        green[idx] = config.getDuration();
+        yellow[idx] = config.getYellowDuration();
+    }
+
+    std::vector<int> key = makeKey(priority, green, yellow);
+    auto found = memo.find(key);
+
+    if(found != memo.end() && ! found->second.dropped){
+        numMemoHits++;
+        return found->second;
+    }
+
+    Evaluation eval = simulate(*workspaces[0], key, false);
+
+    memo[key] = eval;
+    numSimulated++;
+
+    return eval;
+}
+
+std::vector<LightConfig> ScheduleOptimizer::getBestSchedule(){
+    int numConfigs = configs.size();
+    std::vector<LightConfig> schedule;
+
+    if(bestKey.empty()){
+        return configs;
+    }
+
+    for(int pos=0; pos < numConfigs; pos++){
+        int idx = bestKey[pos];
+        double yellow = searchYellows ? bestKey[2 * numConfigs + idx] * resolution : configs[idx].getYellowDuration();
+
+        schedule.emplace_back(configs[idx].getConfigOption(), configs[idx].getDirection(), bestKey[numConfigs + idx] * resolution, yellow);
+    }
+
+    return schedule;
+}
+
+void ScheduleOptimizer::apply(Intersection& inter){
+    inter.clearSchedule();
+
+    for(LightConfig& config : getBestSchedule()){
+        inter.schedule(config);
+    }
+}
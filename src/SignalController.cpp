@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "SignalController.h"
+
+ActuatedController::ActuatedController(double minGreenSeconds, double maxGreenSeconds, double gapSeconds){
+    if( ! (minGreenSeconds >= 0 && minGreenSeconds <= maxGreenSeconds && maxGreenSeconds > 0 && gapSeconds >= 0)){
+        throw std::domain_error("ActuatedController() requires 0 <= minimum green <= maximum green, a positive maximum green and a gap >= 0");
+    }
+
+    minGreen = minGreenSeconds;
+    maxGreen = maxGreenSeconds;
+    gap = gapSeconds;
+    minGreenTicks = 0;
+    maxGreenTicks = 0;
+    gapTicks = 0;
+    compiledRefreshRate = 0;
+}
+
+void ActuatedController::compileTicks(){
+    minGreenTicks = secondsToTicks(minGreen, refreshRateHzGlobal);
+    maxGreenTicks = std::max(1, secondsToTicks(maxGreen, refreshRateHzGlobal));
+    gapTicks = secondsToTicks(gap, refreshRateHzGlobal);
+    compiledRefreshRate = refreshRateHzGlobal;
+}
+
+unsigned long ActuatedController::phaseDemand(Intersection& inter, const SignalPlan::Phase& phase){
+    unsigned long demand = 0;
+
+    for(const SignalPlan::LightStart& lightStart : phase.lightStarts){
+        demand += inter.getRoad(Road::laneGroupDirection(lightStart.laneGroup))->getTurnOption(Road::laneGroupTurn(lightStart.laneGroup))->getQueuedVehicles();
+    }
+
+    return demand;
+}
+
+SignalController::Decision ActuatedController::nextPhase(Intersection& inter, int current){
+    SignalPlan& plan = inter.getSignalPlan();
+    int numPhases = plan.getNumPhases();
+    int firstValid = -1;
+
+    refreshTicks();
+
+    /// The phases after "current" in schedule order, ending with "current" itself
+    for(int i=1; i <= numPhases; i++){
+        int idx = (current + i) % numPhases;
+        const SignalPlan::Phase& phase = plan.getPhase(idx);
+
+        if( ! phase.valid){
+            continue;
+        }
+
+        if(phaseDemand(inter, phase) > 0){
+            return {idx, maxGreenTicks};
+        }
+
+        if(firstValid < 0){
+            firstValid = idx;
+        }
+    }
+
+    /// No demand anywhere, keep cycling at the minimum green
+    return {(firstValid < 0) ? (current + 1) % numPhases : firstValid, std::max(1, minGreenTicks)};
+}
+
+MaxPressureController::MaxPressureController(RoadNetwork& net, unsigned int threads){
+    network = &net;
+    numThreads = (threads == 0) ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+    numSweeps = 0;
+}
+
+template <typename Fn>
+void MaxPressureController::forEachNode(Fn fn){
+    int numNodes = network->getNumIntersections();
+    unsigned int threads = std::min(numThreads, std::max(1u, (unsigned int)(numNodes / PRESSURE_MIN_NODES_PER_THREAD)));
+
+    if(threads == 1){
+        for(int node=0; node < numNodes; node++){
+            fn(node);
+        }
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    for(unsigned int t=0; t < threads; t++){
+        workers.emplace_back([&fn, &error, &errorMutex, numNodes, t, threads](){
+            try{
+                for(int node=t; node < numNodes; node += threads){
+                    fn(node);
+                }
+            }
+            catch(...){
+                std::lock_guard<std::mutex> lock(errorMutex);
+
+                if( ! error){
+                    error = std::current_exception();
+                }
+            }
+        });
+    }
+
+    for(std::thread& worker : workers){
+        worker.join();
+    }
+
+    if(error){
+        std::rethrow_exception(error);
+    }
+}
+
+void MaxPressureController::snapshotNode(int node){
+    Intersection* inter = network->getIntersection(node);
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        Road::RoadDirection dir = Road::laneGroupDirection(lane);
+        TurnOption::Type turn = Road::laneGroupTurn(lane);
+        Road* rd = inter->getRoad(dir);
+        TurnOption* exitTurnOpt = inter->getExitTurnOption(dir, turn);
+
+        upstreamQueues[node * NUM_LANE_GROUPS + lane] = (rd != NULL) ? rd->getTurnOption(turn)->getQueuedVehicles() : 0;
+        downstreamQueues[node * NUM_LANE_GROUPS + lane] = (exitTurnOpt != NULL) ? exitTurnOpt->getQueuedVehicles() : 0;
+    }
+}
+
+void MaxPressureController::decideNode(int node){
+    Intersection* inter = network->getIntersection(node);
+    SignalPlan& plan = inter->getSignalPlan();
+    int best = NO_PRESSURE_DECISION;
+    long bestPressure = 0;
+
+    for(int idx=0; idx < plan.getNumPhases(); idx++){
+        const SignalPlan::Phase& phase = plan.getPhase(idx);
+        long pressure = 0;
+
+        if( ! phase.valid){
+            continue;
+        }
+
+        for(const SignalPlan::LightStart& lightStart : phase.lightStarts){
+            int lane = node * NUM_LANE_GROUPS + lightStart.laneGroup;
+            int numLanes = inter->getRoad(Road::laneGroupDirection(lightStart.laneGroup))->getTurnOption(Road::laneGroupTurn(lightStart.laneGroup))->getNumLanes();
+
+            pressure += (long)(upstreamQueues[lane] - downstreamQueues[lane]) * numLanes;
+        }
+
+        if(best == NO_PRESSURE_DECISION || pressure > bestPressure){
+            best = idx;
+            bestPressure = pressure;
+        }
+    }
+
+    decisions[node] = best;
+    pressures[node] = bestPressure;
+}
+
+void MaxPressureController::sweep(){
+    size_t numNodes = network->getNumIntersections();
+
+    upstreamQueues.resize(numNodes * NUM_LANE_GROUPS);
+    downstreamQueues.resize(numNodes * NUM_LANE_GROUPS);
+    decisions.resize(numNodes, NO_PRESSURE_DECISION);
+    pressures.resize(numNodes, 0);
+
+    /// Every queue is read before any decision is made
+    forEachNode([this](int node){ snapshotNode(node); });
+    forEachNode([this](int node){ decideNode(node); });
+
+    numSweeps++;
+}
+
+long MaxPressureController::phasePressure(Intersection& inter, const SignalPlan::Phase& phase){
+    long pressure = 0;
+
+    for(const SignalPlan::LightStart& lightStart : phase.lightStarts){
+        Road::RoadDirection dir = Road::laneGroupDirection(lightStart.laneGroup);
+        TurnOption::Type turn = Road::laneGroupTurn(lightStart.laneGroup);
+        TurnOption* turnOpt = inter.getRoad(dir)->getTurnOption(turn);
+        TurnOption* exitTurnOpt = inter.getExitTurnOption(dir, turn);
+        long downstream = (exitTurnOpt != NULL) ? exitTurnOpt->getQueuedVehicles() : 0;
+
+        pressure += ((long)turnOpt->getQueuedVehicles() - downstream) * turnOpt->getNumLanes();
+    }
+
+    return pressure;
+}
+
+SignalController::Decision MaxPressureController::nextPhase(Intersection& inter, int current){
+    int node = inter.getNetworkNode();
+    SignalPlan& plan = inter.getSignalPlan();
+    int numPhases = plan.getNumPhases();
+
+    if(node >= 0 && node < (int)decisions.size() && network->getIntersection(node) == &inter && decisions[node] != NO_PRESSURE_DECISION){
+        return {decisions[node], -1};
+    }
+
+    for(int i=1; i <= numPhases; i++){
+        int idx = (current + i) % numPhases;
+
+        if(plan.getPhase(idx).valid){
+            return {idx, -1};
+        }
+    }
+
+    return {(current + 1) % numPhases, -1};
+}
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+
+#include "Intersection.h"
+#include "SignalPlan.h"
+
+/**
+ * @brief Gets the number of ticks a light started with "onTicks" and "yellowTicks" takes to turn red.
+ *          A duration of 0 still lasts one tick since TrafficLight::tick() changes state at most once per tick.
+ *
+ * @return the ticks until red, -1 if the light never turns red
+ */
+static long ticksUntilRed(int onTicks, int yellowTicks){
+    if(onTicks < 0 || yellowTicks < 0){
+        return -1;
+    }
+
+    return std::max(onTicks, 1) + std::max(yellowTicks, 1);
+}
+
+void SignalPlan::addLight(Phase& phase, Road* rd, TurnOption::Type turn, LightConfig* config){
+    TrafficLight* light = rd->getLight(turn);
+    LightStart lightStart;
+    long lightLength;
+
+    if(light == NULL){
+        /// This Road does not have the light, same as Road::startLight()
+        return;
+    }
+
+    lightStart.light = light;
+    lightStart.laneGroup = Road::laneGroupIdx(rd->getDirection(), turn);
+    lightStart.onDuration = config->getDuration();
+    lightStart.onTicks = secondsToTicks(config->getDuration(), refreshRateHzGlobal);
+    lightStart.yellowDuration = config->getYellowDuration();
+
+    if(config->getYellowDuration() != DONT_SET){
+        lightStart.yellowTicks = secondsToTicks(config->getYellowDuration(), refreshRateHzGlobal);
+    }
+    else{
+        lightStart.yellowTicks = light->getColorDurationTicks(TrafficLight::yellow);
+    }
+
+    phase.lightStarts.push_back(lightStart);
+    phase.targetColor[lightStart.laneGroup] = light->getOnColor();
+
+    lightLength = ticksUntilRed(lightStart.onTicks, lightStart.yellowTicks);
+    if(lightLength < 0 || phase.lengthTicks < 0){
+        phase.lengthTicks = -1;
+    }
+    else{
+        phase.lengthTicks = std::max(phase.lengthTicks, lightLength);
+    }
+}
+
+void SignalPlan::compile(Intersection& inter, const std::vector<LightConfig*>& schedule, double allRedDuration){
+    unsigned long startTick = 0;
+
+    if(allRedDuration < 0){
+        throw std::domain_error("SignalPlan::compile() all-red clearance can not be negative");
+    }
+
+    phases.clear();
+    cycleLength = 0;
+    clearanceTicks = secondsToTicks(allRedDuration, refreshRateHzGlobal);
+
+    for(LightConfig* config : schedule){
+        Phase phase;
+        Road::RoadDirection dir = config->getDirection();
+        Road* rd = inter.getRoad(dir);
+        Road* oppRd = inter.getRoad(Road::roadOppositeOf(dir));
+
+        phase.valid = true;
+        phase.lengthTicks = 0;
+        phase.targetColor.fill(TrafficLight::red);
+
+        /// Same lights, in the same order, as Intersection::doubleGreen(), singleGreen() and doubleGreenLeft()
+        switch(config->getConfigOption()){
+            case LightConfig::doubleGreen:
+                phase.valid = (rd != NULL && oppRd != NULL);
+                if(phase.valid){
+                    addLight(phase, rd, TurnOption::right, config);
+                    addLight(phase, rd, TurnOption::straight, config);
+                    addLight(phase, oppRd, TurnOption::right, config);
+                    addLight(phase, oppRd, TurnOption::straight, config);
+                }
+                break;
+
+            case LightConfig::singleGreen:
+                phase.valid = (rd != NULL);
+                if(phase.valid){
+                    addLight(phase, rd, TurnOption::right, config);
+                    addLight(phase, rd, TurnOption::straight, config);
+                    addLight(phase, rd, TurnOption::left, config);
+                }
+                break;
+
+            case LightConfig::doubleGreenLeft:
+                phase.valid = (rd != NULL && oppRd != NULL);
+                if(phase.valid){
+                    addLight(phase, rd, TurnOption::left, config);
+                    addLight(phase, oppRd, TurnOption::left, config);
+                }
+                break;
+
+            default:
+                throw std::out_of_range("SignalPlan::compile() encountered an unhandled LightConfig::Option");
+                break;
+        }
+
+        if(phase.lengthTicks >= 0){
+            phase.lengthTicks += clearanceTicks;
+        }
+
+        if(cycleLength < 0){
+            /// A previous phase never ends, this one is never reached
+            phase.startTick = ULONG_MAX;
+        }
+        else{
+            phase.startTick = startTick;
+
+            if(phase.lengthTicks < 0){
+                cycleLength = -1;
+            }
+            else{
+                startTick += phase.lengthTicks;
+                cycleLength += phase.lengthTicks;
+            }
+        }
+
+        phases.push_back(phase);
+    }
+
+    compiledRefreshRate = refreshRateHzGlobal;
+    compiledRounding = tickRoundingGlobal;
+}
+
+int SignalPlan::phaseAt(unsigned long tick){
+    if(phases.empty()){
+        throw std::out_of_range("SignalPlan::phaseAt() called on a plan with no phases");
+    }
+
+    if(cycleLength > 0){
+        tick %= cycleLength;
+    }
+
+    /// The last phase starting at or before "tick". Zero length phases share their start with the next phase and are skipped.
+    auto nextPhase = std::upper_bound(phases.begin(), phases.end(), tick, [](unsigned long t, const Phase& phase){ return t < phase.startTick; });
+
+    return (nextPhase - phases.begin()) - 1;
+}
+
+TrafficLight::AvailableColors SignalPlan::colorAt(unsigned long tick, Road::RoadDirection dir, TurnOption::Type turn){
+    int phaseIdx = phaseAt(tick);
+    int laneGroup = Road::laneGroupIdx(dir, turn);
+    unsigned long ticksIntoPhase;
+
+    if(cycleLength > 0){
+        tick %= cycleLength;
+    }
+    ticksIntoPhase = tick - phases[phaseIdx].startTick;
+
+    for(const LightStart& lightStart : phases[phaseIdx].lightStarts){
+        if(lightStart.laneGroup != laneGroup){
+            continue;
+        }
+
+        if(lightStart.onTicks < 0 || ticksIntoPhase < (unsigned long)std::max(lightStart.onTicks, 1)){
+            return lightStart.light->getOnColor();
+        }
+
+        if(lightStart.yellowTicks < 0 || ticksIntoPhase < (unsigned long)ticksUntilRed(lightStart.onTicks, lightStart.yellowTicks)){
+            return TrafficLight::yellow;
+        }
+    }
+
+    return TrafficLight::red;
+}
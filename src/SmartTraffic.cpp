@@ -1,11 +1,23 @@
 #include "Timer_Linux.h"
 #include "SmartTraffic.h"
+#include "DelayMetrics.h"
 
 int refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
 
 bool commenceTraffic(Intersection& inter, int refreshRateHz, int runTime, bool printToConsole){
     long long totalSecondsElapsed = 0;
-    int secondsSinceLightConfigStart = 0;
+    DelayMetrics runMetrics;
+    DelayMetrics* previousMetrics = inter.getDelayMetrics();
+    bool previousAutoSequence = inter.getAutoSequence();
+    bool ownMetrics = false;
+
+    /// The caller gets "inter" back configured as it was handed over, only its state has moved on
+    auto restore = [&](){
+        if(ownMetrics){
+            inter.setDelayMetrics(previousMetrics);
+        }
+        inter.setAutoSequence(previousAutoSequence);
+    };
 
     refreshRateHzGlobal = refreshRateHz;
 
@@ -13,42 +25,54 @@ bool commenceTraffic(Intersection& inter, int refreshRateHz, int runTime, bool p
         return false;
     }
 
-    inter.start();
+    /// tick() starts each LightConfig on the tick the previous one finishes
+    inter.setAutoSequence(true);
 
-    while(runTime == FOREVER || totalSecondsElapsed < runTime){
-        auto startTime = currentTime();
+    try{
+        inter.start();
 
-        if(printToConsole){
-            inter.print();
+        /// Measure the run for the closing summary unless the caller attached their own DelayMetrics
+        ownMetrics = printToConsole && previousMetrics == NULL;
+        if(ownMetrics){
+            inter.setDelayMetrics(&runMetrics);
         }
 
-        ///tick() "refreshRateHz" times
-        for(int i=0; i < refreshRateHz; i++){
-            inter.tick();
+        while(runTime == FOREVER || totalSecondsElapsed < runTime){
+            auto startTime = currentTime();
 
-            if(oneSecondElapsed(startTime)){
-                throw std::runtime_error("commenceTraffic: inter.tick() did not run refreshRateHz times in 1 second\n");
-                return false;
+            if(printToConsole){
+                inter.print();
             }
-        }
 
-        ///while timer has not finished, wait
-        while( ! oneSecondElapsed(startTime)){
-            waitSleep();
-        }
+            ///tick() "refreshRateHz" times
+            for(int i=0; i < refreshRateHz; i++){
+                inter.tick();
 
-        totalSecondsElapsed++;
-        secondsSinceLightConfigStart++;
+                if(oneSecondElapsed(startTime)){
+                    throw std::runtime_error("commenceTraffic: inter.tick() did not run refreshRateHz times in 1 second\n");
+                    return false;
+                }
+            }
 
-        if(secondsSinceLightConfigStart > inter.currentLightConfig()->getTotalDuration()){
-            inter.nextLightConfig();
-            secondsSinceLightConfigStart = 0;
+            ///while timer has not finished, wait
+            while( ! oneSecondElapsed(startTime)){
+                waitSleep();
+            }
+
+            totalSecondsElapsed++;
         }
     }
+    catch(...){
+        restore();
+        throw;
+    }
 
     if(printToConsole){
         inter.print();
+        inter.getDelayMetrics()->printSummary();
     }
 
+    restore();
+
     return true;
 }
@@ -1,11 +1,39 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "../doctest/doctest/doctest.h"
 
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+
 #include "TrafficLight.h"
 #include "Intersection.h"
 #include "LightConfig.h"
 #include "Timer_Linux.h"
 #include "SmartTraffic.h"
+#include "CompactIntersection.h"
+#include "Timebase.h"
+#include "SignalPlan.h"
+#include "Philox.h"
+#include "ArrivalGenerator.h"
+#include "DemandReader.h"
+#include "Snapshot.h"
+#include "InputJournal.h"
+#include "Telemetry.h"
+#include "LightHistory.h"
+#include "DelayMetrics.h"
+#include "QuantileSketch.h"
+#include "VehiclePool.h"
+#include "RoadNetwork.h"
+#include "SignalController.h"
+#include "PredictiveController.h"
+#include "ScheduleOptimizer.h"
+#include "CorridorCoordinator.h"
+#include "LockstepVariants.h"
+#include "TrafficEnv.h"
 
 TEST_CASE("TC_1-1_TF_start"){
     TrafficLightLeft tf = TrafficLightLeft();
@@ -1167,4 +1195,3899 @@ TEST_CASE("TC_17-1_INT_handleVehicles"){
 
 
 }
-*/
\ No newline at end of file
+*/
+
+TEST_CASE("TC_18-1_CI_pack_unpack"){
+    int onDuration = 2;
+    TurnOption* turnOptNorth;
+    Intersection inter = Intersection();
+    CompactIntersection compact = CompactIntersection();
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+
+    // In a full implementation these would be objects from another Intersection
+    inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+
+    turnOptNorth = inter.getRoad(Road::north)->getTurnOption(TurnOption::left);
+
+    inter.addVehicles(Road::north, TurnOption::left, 8);
+    inter.addVehicles(Road::south, TurnOption::left, 2);
+    inter.schedule(LightConfig::doubleGreenLeft, Road::north, onDuration, DEFAULT_YELLOW_DURATION);
+    inter.start();
+    inter.tick();
+
+    compact.pack(inter);
+
+    CHECK(compact.time() == 1);
+    CHECK(compact.getNumUnfinishedLights() == 2);
+    CHECK(compact.getNumLaneGroups() == 10);
+    CHECK(compact.roadExists(Road::east) == true);
+
+    const CompactIntersection::LaneGroup& group = compact.getLaneGroup(Road::north, TurnOption::left);
+    CHECK(group.valid == 1);
+    CHECK(group.color == TrafficLight::greenLeft);
+    CHECK(group.onColor == TrafficLight::greenLeft);
+    CHECK(group.ticksRemaining == 1);
+    CHECK(group.queuedVehicles == 8);
+    CHECK(group.numVehiclesCurrentlyCrossing == 3);
+    CHECK(group.currentVehicleProgress == DEFAULT_TIME_TO_CROSS);
+    CHECK(group.durationTicks[CompactIntersection::onSlot] == onDuration);
+    CHECK(group.durationTicks[CompactIntersection::yellowSlot] == DEFAULT_YELLOW_DURATION);
+    CHECK(group.durationTicks[CompactIntersection::redSlot] == -1);
+    CHECK(compact.getLaneGroup(Road::east, TurnOption::left).valid == 0);
+
+    for(int i=0; i<3; i++){
+        inter.tick();
+    }
+
+    CHECK(turnOptNorth->getQueuedVehicles() == 5);
+    CHECK(turnOptNorth->getLight()->getNumVehiclesDirected() == 3);
+
+    /// Restoring the packed state rewinds the Intersection
+    compact.unpack(inter);
+
+    CHECK(inter.time() == 1);
+    CHECK(inter.getNumUnfinishedLights() == 2);
+    CHECK(turnOptNorth->getLight()->getColor() == TrafficLight::greenLeft);
+    CHECK(turnOptNorth->getLight()->getTicksRemaining() == 1);
+    CHECK(turnOptNorth->getQueuedVehicles() == 8);
+    CHECK(turnOptNorth->getLight()->getNumVehiclesDirected() == 0);
+
+    /// And ticking it again repeats the same run
+    for(int i=0; i<3; i++){
+        inter.tick();
+    }
+
+    CHECK(turnOptNorth->getQueuedVehicles() == 5);
+    CHECK(turnOptNorth->getLight()->getNumVehiclesDirected() == 3);
+    CHECK(inter.getNumUnfinishedLights() == 0);
+}
+
+TEST_CASE("TC_18-2_CI_unpack_mismatch"){
+    Intersection inter = Intersection();
+    Intersection inter2 = Intersection();
+    Intersection inter3 = Intersection();
+    CompactIntersection compact = CompactIntersection();
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+
+    /// Missing a Road
+    inter2.addRoad(Road::north, {3, 4, 5});
+    inter2.addRoad(Road::west, {2, 3, 1});
+
+    /// Different lanes
+    inter3.addRoad(Road::north, {3, 4, 5});
+    inter3.addRoad(Road::east, {0, 2, 0});
+    inter3.addRoad(Road::west, {2, 3, 1});
+
+    compact.pack(inter);
+
+    CHECK_THROWS_AS(compact.unpack(inter2), std::logic_error);
+    CHECK_THROWS_AS(compact.unpack(inter3), std::logic_error);
+    CHECK_NOTHROW(compact.unpack(inter));
+}
+
+TEST_CASE("TC_18-3_CI_pack_overflow"){
+    Intersection inter = Intersection();
+    CompactIntersection compact = CompactIntersection();
+    TrafficLight* light;
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+
+    light = inter.getLight(Road::north, TurnOption::straight);
+
+    /// 1e9 seconds at 50Hz does not fit in int32_t ticks
+    refreshRateHzGlobal = 50;
+    light->setOnDuration(1e9);
+    CHECK_THROWS_AS(compact.pack(inter), std::overflow_error);
+
+    light->setOnDuration(1e6);
+    CHECK_NOTHROW(compact.pack(inter));
+    CHECK(compact.getLaneGroup(Road::north, TurnOption::straight).durationTicks[CompactIntersection::onSlot] == 50000000);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+
+    /// Running totals keep 64 bits, past what a 32 bit counter holds
+    light->addVehiclesDirected(INT32_MAX);
+    light->addVehiclesDirected(INT32_MAX);
+    light->addVehiclesDirected(INT32_MAX);
+    inter.getRoad(Road::north)->getTurnOption(TurnOption::straight)->addCumulative(5000000000ul, 4000000000ul);
+    CHECK_NOTHROW(compact.pack(inter));
+    CHECK(compact.getLaneGroup(Road::north, TurnOption::straight).numVehiclesDirected == 3ul * INT32_MAX);
+    CHECK(compact.getLaneGroup(Road::north, TurnOption::straight).cumulativeArrivals == 5000000000ul);
+    CHECK(compact.getLaneGroup(Road::north, TurnOption::straight).cumulativeDepartures == 4000000000ul);
+}
+
+TEST_CASE("TC_18-4_CI_footprint"){
+    Intersection inter = Intersection();
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+
+    CHECK(CompactIntersection::laneGroupFootprint() >= 4 * sizeof(CompactIntersection::LaneGroup));
+    CHECK(CompactIntersection::footprint(inter) >= 4 * sizeof(CompactIntersection));
+}
+
+TEST_CASE("TC_19-1_TB_secondsToTicks"){
+    /// Truncating the floating point product loses a tick, the microsecond rational does not
+    CHECK(static_cast<int>(0.29 * 100) == 28);
+    CHECK(secondsToTicks(0.29, 100) == 29);
+    CHECK(secondsToTicks(3.5, 50) == 175);
+    CHECK(secondsToTicks(0, 50) == 0);
+
+    /// 0.0125s at 50Hz is 0.625 ticks
+    CHECK(secondsToTicks(0.0125, 50, roundDown) == 0);
+    CHECK(secondsToTicks(0.0125, 50, roundNearest) == 1);
+    CHECK(secondsToTicks(0.0125, 50, roundUp) == 1);
+
+    /// 0.01s at 50Hz is exactly half a tick, halves round up
+    CHECK(secondsToTicks(0.01, 50, roundNearest) == 1);
+    CHECK(secondsToTicks(0.03, 50, roundUp) == 2);
+    CHECK(secondsToTicks(0.04, 50, roundUp) == 2);
+
+    /// Negative durations are infinite
+    CHECK(secondsToTicks(-1, 50) == -1);
+    CHECK(secondsToTicks(-0.5, 50) == -1);
+
+    CHECK_THROWS_AS(secondsToTicks(1e9, 50), std::overflow_error);
+    CHECK_THROWS_AS(secondsToTicks(1e300, 50), std::overflow_error);
+    CHECK_THROWS_AS(secondsToTicks(1, 0), std::domain_error);
+}
+
+TEST_CASE("TC_19-2_TB_TF_durationTicks"){
+    TrafficLight tl = TrafficLight(TrafficLight::green, 0.29, -1.0);
+
+    refreshRateHzGlobal = 100;
+    tl.start();
+    CHECK(tl.getTicksRemaining() == 29);
+    CHECK(tl.getColorDurationTicks(TrafficLight::green) == 29);
+    CHECK(tl.getColorDurationTicks(TrafficLight::red) == -1);
+    CHECK(tl.durationTicksAreCurrent());
+
+    /// Durations are converted as soon as they are set
+    tl.setDuration(TrafficLight::yellow, 0.5);
+    CHECK(tl.getColorDurationTicks(TrafficLight::yellow) == 50);
+
+    /// A new refresh rate converts the durations again
+    refreshRateHzGlobal = 1;
+    CHECK( ! tl.durationTicksAreCurrent());
+    tl.start();
+    CHECK(tl.getTicksRemaining() == 0);
+    CHECK(tl.getColorDurationTicks(TrafficLight::yellow) == 0);
+
+    /// So does a new rounding policy
+    tickRoundingGlobal = roundUp;
+    tl.start();
+    CHECK(tl.getTicksRemaining() == 1);
+    CHECK(tl.getColorDurationTicks(TrafficLight::yellow) == 1);
+
+    tickRoundingGlobal = roundDown;
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_19-3_TB_TF_duration_overflow"){
+    TrafficLight tl = TrafficLight(TrafficLight::green, 3, -1.0);
+
+    refreshRateHzGlobal = 50;
+    tl.start();
+    CHECK(tl.getTicksRemaining() == 150);
+
+    /// The duration that does not fit is rejected and the old one is kept
+    CHECK_THROWS_AS(tl.setOnDuration(1e9), std::overflow_error);
+    CHECK(tl.getColorDuration(TrafficLight::green) == 3);
+    CHECK(tl.getColorDurationTicks(TrafficLight::green) == 150);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_19-4_TB_TurnOption_timeToCross"){
+    TurnOption turnOpt = TurnOption(TurnOption::straight, 2, 5, 2, 4);
+
+    CHECK(turnOpt.getTimeToCross() == 2);
+
+    refreshRateHzGlobal = 50;
+    CHECK(turnOpt.getTimeToCross() == 100);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+    CHECK(turnOpt.getTimeToCross() == 2);
+}
+
+TEST_CASE("TC_20-1_SP_compile"){
+    int onDuration1 = 10;
+    int onDuration2 = 5;
+    SignalPlan* plan;
+    Intersection inter = Intersection();
+    Intersection* fork;
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {1, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+
+    inter.schedule(LightConfig::doubleGreenLeft, Road::east, onDuration1, DEFAULT_YELLOW_DURATION);
+    inter.schedule(LightConfig::singleGreen, Road::south, onDuration2, DEFAULT_YELLOW_DURATION);
+
+    plan = &inter.getSignalPlan();
+
+    CHECK(plan->getNumPhases() == 2);
+    CHECK(plan->getPhase(0).lightStarts.size() == 2);
+    CHECK(plan->getPhase(1).lightStarts.size() == 3);
+
+    /// Each phase lasts until its last light is red: onDuration + yellowDuration ticks
+    CHECK(plan->getPhaseLength(0) == onDuration1 + DEFAULT_YELLOW_DURATION);
+    CHECK(plan->getPhaseLength(1) == onDuration2 + DEFAULT_YELLOW_DURATION);
+    CHECK(plan->getPhaseStart(1) == (unsigned long)(onDuration1 + DEFAULT_YELLOW_DURATION));
+    CHECK(plan->getCycleLength() == onDuration1 + onDuration2 + 2 * DEFAULT_YELLOW_DURATION);
+
+    /// Target colors at the phase boundaries
+    CHECK(plan->getPhase(0).targetColor[Road::laneGroupIdx(Road::east, TurnOption::left)] == TrafficLight::greenLeft);
+    CHECK(plan->getPhase(0).targetColor[Road::laneGroupIdx(Road::west, TurnOption::left)] == TrafficLight::greenLeft);
+    CHECK(plan->getPhase(0).targetColor[Road::laneGroupIdx(Road::south, TurnOption::straight)] == TrafficLight::red);
+    CHECK(plan->getPhase(1).targetColor[Road::laneGroupIdx(Road::south, TurnOption::straight)] == TrafficLight::green);
+
+    CHECK(plan->phaseAt(0) == 0);
+    CHECK(plan->phaseAt(10) == 0);
+    CHECK(plan->phaseAt(11) == 1);
+    CHECK(plan->phaseAt(16) == 1);
+    CHECK(plan->phaseAt(17) == 0);
+    CHECK(plan->phaseAt(17 * 1000 + 12) == 1);
+
+    CHECK(plan->colorAt(9, Road::east, TurnOption::left) == TrafficLight::greenLeft);
+    CHECK(plan->colorAt(10, Road::east, TurnOption::left) == TrafficLight::yellow);
+    CHECK(plan->colorAt(11, Road::east, TurnOption::left) == TrafficLight::red);
+    CHECK(plan->colorAt(11, Road::south, TurnOption::left) == TrafficLight::greenLeft);
+    CHECK(plan->colorAt(16, Road::south, TurnOption::straight) == TrafficLight::yellow);
+    CHECK(plan->colorAt(16, Road::north, TurnOption::straight) == TrafficLight::red);
+
+    /// Scheduling again recompiles the plan
+    inter.schedule(LightConfig::doubleGreen, Road::north, 3, 2);
+    CHECK(inter.getSignalPlan().getNumPhases() == 3);
+    CHECK(inter.getSignalPlan().getCycleLength() == 17 + 5);
+
+    /// Changing the light durations recompiles the plan and the copies: a DONT_SET yellow is the light's own
+    inter.schedule(LightConfig::singleGreen, Road::west, 4, DONT_SET);
+    fork = inter.fork();
+    CHECK(fork->getSignalPlan().getCycleLength() == inter.getSignalPlan().getCycleLength());
+    inter.releaseFork(fork);
+    inter.setAllLightDurations(4, 6);
+    CHECK(inter.getSignalPlan().getCycleLength() == 22 + 4 + 6);
+    fork = inter.fork();
+    CHECK(fork->getSignalPlan().getCycleLength() == 22 + 4 + 6);
+    inter.releaseFork(fork);
+}
+
+TEST_CASE("TC_20-2_SP_matches_simulation"){
+    long ticksSinceLightConfigStart = 0;
+    Intersection inter = Intersection();
+    SignalPlan* plan;
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {1, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+
+    // In a full implementation these would be objects from another Intersection
+    inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+
+    /// Yellow of north straight is longer than the rest, the doubleGreen phase lasts until it is red
+    inter.getLight(Road::north, TurnOption::straight)->setDuration(TrafficLight::yellow, 1.5);
+
+    refreshRateHzGlobal = 10;
+    inter.schedule(LightConfig::doubleGreen, Road::north, 0.75, DONT_SET);
+    inter.schedule(LightConfig::doubleGreenLeft, Road::north, 1.0, 0.2);
+    inter.schedule(LightConfig::doubleGreen, Road::east, 1.25, 0.3);
+    inter.schedule(LightConfig::singleGreen, Road::west, 0.5, 0.1);
+    inter.start();
+
+    plan = &inter.getSignalPlan();
+    CHECK(plan->getPhaseLength(0) == 7 + 15);
+    CHECK(plan->getCycleLength() == (7 + 15) + (10 + 2) + (12 + 3) + (5 + 1));
+
+    /// Three cycles, every light agrees with the table on every tick
+    for(unsigned long t=0; t < 3 * (unsigned long)plan->getCycleLength(); t++){
+        for(int dir=0; dir < Road::numRoadDirections; dir++){
+            for(int turn=0; turn < TurnOption::numTurnOptions; turn++){
+                TrafficLight* light = inter.getLight((Road::RoadDirection)dir, (TurnOption::Type)turn);
+
+                if(light != NULL){
+                    CHECK(light->getColor() == plan->colorAt(t, (Road::RoadDirection)dir, (TurnOption::Type)turn));
+                }
+            }
+        }
+
+        CHECK(inter.getConfigScheduleIdx() == (unsigned long)plan->phaseAt(t));
+
+        inter.tick();
+        ticksSinceLightConfigStart++;
+
+        if(ticksSinceLightConfigStart == plan->getPhaseLength(inter.getConfigScheduleIdx())){
+            CHECK(inter.getNumUnfinishedLights() == 0);
+            inter.nextLightConfig();
+            ticksSinceLightConfigStart = 0;
+        }
+    }
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_20-3_SP_refreshRate"){
+    Intersection inter = Intersection();
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+
+    inter.schedule(LightConfig::doubleGreen, Road::north, 3.5, 1.5);
+
+    CHECK(inter.getSignalPlan().getCycleLength() == 3 + 1);
+
+    /// A new refresh rate recompiles the plan
+    refreshRateHzGlobal = 50;
+    CHECK(inter.getSignalPlan().getCycleLength() == 175 + 75);
+
+    inter.start();
+    CHECK(inter.getLight(Road::north, TurnOption::straight)->getTicksRemaining() == 175);
+    CHECK(inter.getLight(Road::north, TurnOption::straight)->getColorDuration(TrafficLight::green) == 3.5);
+    CHECK(inter.getLight(Road::north, TurnOption::straight)->getColorDurationTicks(TrafficLight::yellow) == 75);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_20-4_SP_infinite_phase"){
+    Intersection inter = Intersection();
+    SignalPlan* plan;
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+
+    inter.schedule(LightConfig::doubleGreen, Road::north, 2, 1);
+    inter.schedule(LightConfig::doubleGreen, Road::east, -1, 1);
+    inter.schedule(LightConfig::singleGreen, Road::west, 2, 1);
+
+    plan = &inter.getSignalPlan();
+
+    CHECK(plan->getCycleLength() == -1);
+    CHECK(plan->getPhaseLength(1) == -1);
+    CHECK(plan->phaseAt(2) == 0);
+    CHECK(plan->phaseAt(3) == 1);
+    CHECK(plan->phaseAt(1000000) == 1);
+    CHECK(plan->colorAt(1000000, Road::east, TurnOption::straight) == TrafficLight::green);
+}
+
+TEST_CASE("TC_21-1_Intersection_autoSequence"){
+    Intersection inter = Intersection();
+    SignalPlan* plan;
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {1, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+
+    inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+
+    refreshRateHzGlobal = 10;
+    inter.schedule(LightConfig::doubleGreen, Road::north, 0.75, DONT_SET);
+    inter.schedule(LightConfig::doubleGreenLeft, Road::north, 1.0, 0.2);
+    inter.schedule(LightConfig::doubleGreen, Road::east, 1.25, 0.3);
+    inter.schedule(LightConfig::singleGreen, Road::west, 0.5, 0.1);
+    inter.addMaxVehicles();
+
+    CHECK_FALSE(inter.getAutoSequence());
+    inter.setAutoSequence(true);
+    inter.start();
+
+    plan = &inter.getSignalPlan();
+    CHECK(plan->getClearanceTicks() == 0);
+
+    /// No nextLightConfig() calls, tick() alone follows the table
+    for(unsigned long t=0; t < 3 * (unsigned long)plan->getCycleLength(); t++){
+        for(int dir=0; dir < Road::numRoadDirections; dir++){
+            for(int turn=0; turn < TurnOption::numTurnOptions; turn++){
+                TrafficLight* light = inter.getLight((Road::RoadDirection)dir, (TurnOption::Type)turn);
+
+                if(light != NULL){
+                    CHECK(light->getColor() == plan->colorAt(t, (Road::RoadDirection)dir, (TurnOption::Type)turn));
+                }
+            }
+        }
+
+        CHECK(inter.getConfigScheduleIdx() == (unsigned long)plan->phaseAt(t));
+        inter.tick();
+    }
+
+    /// Without the sequencer the Intersection stays all red once the LightConfig finishes
+    inter.setAutoSequence(false);
+    for(int i=0; i < 2 * plan->getCycleLength(); i++){
+        inter.tick();
+    }
+    CHECK(inter.getConfigScheduleIdx() == 0);
+    CHECK(inter.getNumUnfinishedLights() == 0);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_21-2_Intersection_allRedClearance"){
+    Intersection inter = Intersection();
+    SignalPlan* plan;
+    CompactIntersection snapshot;
+    int allRedTicks = 0;
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {1, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+
+    inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+
+    CHECK_THROWS_AS(inter.setAllRedDuration(-1), std::domain_error);
+
+    refreshRateHzGlobal = 10;
+    inter.schedule(LightConfig::doubleGreen, Road::north, 2, 1);
+    inter.schedule(LightConfig::doubleGreen, Road::east, 1, 0.5);
+    inter.setAllRedDuration(0.3);
+    inter.setAutoSequence(true);
+    inter.start();
+
+    plan = &inter.getSignalPlan();
+    CHECK(plan->getClearanceTicks() == 3);
+    CHECK(plan->getPhaseLength(0) == 20 + 10 + 3);
+    CHECK(plan->getPhaseLength(1) == 10 + 5 + 3);
+    CHECK(plan->getCycleLength() == 33 + 18);
+
+    for(unsigned long t=0; t < 4 * (unsigned long)plan->getCycleLength(); t++){
+        bool allRed = true;
+
+        for(TrafficLight* light : inter.getLights()){
+            allRed = allRed && light->isRed();
+        }
+        allRedTicks += allRed;
+
+        CHECK(inter.getLight(Road::north, TurnOption::straight)->getColor() == plan->colorAt(t, Road::north, TurnOption::straight));
+        CHECK(inter.getLight(Road::west, TurnOption::right)->getColor() == plan->colorAt(t, Road::west, TurnOption::right));
+        CHECK(inter.getConfigScheduleIdx() == (unsigned long)plan->phaseAt(t));
+
+        /// Snapshot in the middle of the first clearance
+        if(t == 31){
+            snapshot.pack(inter);
+        }
+
+        inter.tick();
+    }
+
+    /// Every phase ends with exactly the clearance interval
+    CHECK(allRedTicks == 4 * 2 * 3);
+
+    /// The clearance countdown survives a pack/unpack
+    snapshot.unpack(inter);
+    inter.tick();
+    CHECK(inter.getConfigScheduleIdx() == 0);
+    inter.tick();
+    CHECK(inter.getConfigScheduleIdx() == 1);
+    CHECK(inter.getLight(Road::east, TurnOption::straight)->getColor() == TrafficLight::green);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_21-3_Intersection_autoSequence_emptyConfig"){
+    Intersection inter = Intersection();
+    SignalPlan* plan;
+
+    inter.addRoad(Road::north, {0, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {0, 3, 1});
+    inter.addRoad(Road::south, {0, 2, 3});
+
+    inter.setExitRoad(Road::north, new Road(Road::north, {0,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::west, new Road(Road::west, {0,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::south, new Road(Road::south, {0,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+
+    /// No left lanes, the doubleGreenLeft LightConfig has no lights and lasts only its clearance
+    for(int allRed=0; allRed <= 1; allRed++){
+        inter.setAllRedDuration(allRed);
+        inter.clearSchedule();
+        inter.schedule(LightConfig::doubleGreen, Road::north, 2, 1);
+        inter.schedule(LightConfig::doubleGreenLeft, Road::north, 2, 1);
+        inter.schedule(LightConfig::doubleGreen, Road::east, 1, 1);
+
+        plan = &inter.getSignalPlan();
+        CHECK(plan->getPhaseLength(1) == allRed);
+
+        /// Wait for the previous iteration to finish before starting again
+        while(inter.getNumUnfinishedLights() > 0){
+            inter.setAutoSequence(false);
+            inter.tick();
+        }
+        inter.setAutoSequence(true);
+        inter.start();
+
+        for(unsigned long t=0; t < 3 * (unsigned long)plan->getCycleLength(); t++){
+            CHECK(inter.getLight(Road::north, TurnOption::straight)->getColor() == plan->colorAt(t, Road::north, TurnOption::straight));
+            CHECK(inter.getLight(Road::east, TurnOption::straight)->getColor() == plan->colorAt(t, Road::east, TurnOption::straight));
+            CHECK(inter.getConfigScheduleIdx() == (unsigned long)plan->phaseAt(t));
+            inter.tick();
+        }
+    }
+}
+
+TEST_CASE("TC_22-1_Intersection_advance_matches_tick"){
+    auto buildIntersection = [](Intersection& inter, bool autoSequence, double allRedDuration){
+        inter.addRoad(Road::north, {3, 4, 5});
+        inter.addRoad(Road::east, {0, 1, 0});
+        inter.addRoad(Road::west, {2, 3, 1});
+        inter.addRoad(Road::south, {1, 2, 3});
+
+        inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+
+        inter.schedule(LightConfig::doubleGreen, Road::north, 3.0, 3.0);
+        inter.schedule(LightConfig::doubleGreenLeft, Road::north, 3.0, DEFAULT_YELLOW_DURATION);
+        inter.schedule(LightConfig::doubleGreen, Road::east, 3.0, DEFAULT_YELLOW_DURATION);
+        inter.schedule(LightConfig::singleGreen, Road::west, 3.0, DEFAULT_YELLOW_DURATION);
+
+        inter.addMaxVehicles();
+        inter.setAllRedDuration(allRedDuration);
+        inter.setAutoSequence(autoSequence);
+        inter.start();
+    };
+    unsigned long steps[] = {1, 5, 37, 250, 1000, 10007, 3, 123457};
+
+    refreshRateHzGlobal = 10;
+
+    for(int autoSequence=0; autoSequence <= 1; autoSequence++){
+        for(double allRedDuration : {0.0, 0.5}){
+            Intersection stepped = Intersection();
+            Intersection advanced = Intersection();
+            CompactIntersection steppedState, advancedState;
+
+            buildIntersection(stepped, autoSequence, allRedDuration);
+            buildIntersection(advanced, autoSequence, allRedDuration);
+
+            for(unsigned long numTicks : steps){
+                for(unsigned long i=0; i < numTicks; i++){
+                    stepped.tick();
+                }
+                CHECK(advanced.advance(numTicks) == stepped.getNumUnfinishedLights());
+
+                steppedState.pack(stepped);
+                advancedState.pack(advanced);
+
+                CHECK(advanced.time() == stepped.time());
+                CHECK(advancedState == steppedState);
+                CHECK(advanced.getConfigScheduleIdx() == stepped.getConfigScheduleIdx());
+
+                for(int dir=0; dir < Road::numRoadDirections; dir++){
+                    for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+                        CHECK(advanced.getExitRoad((Road::RoadDirection)dir)->getTurnOption((TurnOption::Type)opt)->getQueuedVehicles() ==
+                              stepped.getExitRoad((Road::RoadDirection)dir)->getTurnOption((TurnOption::Type)opt)->getQueuedVehicles());
+                    }
+                }
+            }
+        }
+    }
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_22-2_Intersection_advance_longHorizon"){
+    Intersection inter = Intersection();
+    unsigned long ninetyDays = 90UL * 24 * 60 * 60 * 50 + 17;
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+
+    inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+
+    refreshRateHzGlobal = 50;
+    inter.schedule(LightConfig::doubleGreen, Road::north, 3.0, 3.0);
+    inter.schedule(LightConfig::singleGreen, Road::west, 3.0, DEFAULT_YELLOW_DURATION);
+    inter.addMaxVehicles();
+    inter.setAutoSequence(true);
+    inter.start();
+
+    /// 90 days at 50Hz, only the periods before the queues settle are stepped
+    inter.advance(ninetyDays);
+
+    CHECK(inter.time() == ninetyDays);
+    CHECK(inter.getConfigScheduleIdx() == (unsigned long)inter.getSignalPlan().phaseAt(ninetyDays));
+    CHECK(inter.getLight(Road::north, TurnOption::straight)->getColor() == inter.getSignalPlan().colorAt(ninetyDays, Road::north, TurnOption::straight));
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_22-3_Intersection_advance_unpackable"){
+    auto build = [](Intersection& inter){
+        inter.addRoad(Road::north, {3, 4, 5});
+        inter.addRoad(Road::east, {0, 1, 0});
+        inter.addRoad(Road::west, {2, 3, 1});
+        inter.addRoad(Road::south, {1, 2, 3});
+
+        inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+
+        inter.schedule(LightConfig::doubleGreen, Road::north, 3.0, 3.0);
+        inter.schedule(LightConfig::singleGreen, Road::west, 3.0, DEFAULT_YELLOW_DURATION);
+        inter.getRoad(Road::north)->getTurnOption(TurnOption::straight)->setMaxVehiclesPerLane(300);
+        inter.addMaxVehicles();
+        inter.setAutoSequence(true);
+        inter.start();
+    };
+    Intersection stepped = Intersection();
+    Intersection advanced = Intersection();
+    CompactIntersection state;
+    int numDifferent = 0;
+
+    refreshRateHzGlobal = 10;
+    build(stepped);
+    build(advanced);
+
+    /// 300 vehicles per lane do not fit a packed lane group, advance() falls back to ticking
+    CHECK_THROWS_AS(state.pack(advanced), std::overflow_error);
+
+    for(int i=0; i < 5000; i++){
+        stepped.tick();
+    }
+    CHECK_NOTHROW(advanced.advance(5000));
+
+    CHECK(advanced.time() == stepped.time());
+    CHECK(advanced.getConfigScheduleIdx() == stepped.getConfigScheduleIdx());
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        TurnOption* steppedOpt = stepped.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane));
+        TurnOption* advancedOpt = advanced.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane));
+
+        if(steppedOpt->isValid()){
+            numDifferent += advancedOpt->getQueuedVehicles() != steppedOpt->getQueuedVehicles() ||
+                            advancedOpt->getLight()->getColor() != steppedOpt->getLight()->getColor() ||
+                            advancedOpt->getCumulativeDepartures() != steppedOpt->getCumulativeDepartures();
+        }
+    }
+    CHECK(numDifferent == 0);
+    CHECK(advanced.getRoad(Road::north)->getTurnOption(TurnOption::straight)->getQueuedVehicles() > 255);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_23-1_Philox_knownAnswers"){
+    /// Known answer tests from the Random123 distribution
+    CHECK(Philox4x32::generate({0, 0, 0, 0}, {0, 0}) == Philox4x32::Counter{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8});
+    CHECK(Philox4x32::generate({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff}) == Philox4x32::Counter{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd});
+    CHECK(Philox4x32::generate({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0}) == Philox4x32::Counter{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1});
+
+    CHECK(Philox4x32::toUniform(0) > 0.0);
+    CHECK(Philox4x32::toUniform(0xffffffff) < 1.0);
+}
+
+TEST_CASE("TC_23-2_AG_processes"){
+    ArrivalGenerator gen = ArrivalGenerator(42);
+    std::vector<uint16_t> counts;
+    int laneGroup = Road::laneGroupIdx(Road::north, TurnOption::straight);
+    int numTicks = 100000;
+    long total = 0;
+
+    refreshRateHzGlobal = 10;
+
+    CHECK_THROWS_AS(ArrivalProcess::poissonArrivals(-1), std::domain_error);
+    CHECK_THROWS_AS(ArrivalProcess::platoonArrivals(2, 0), std::domain_error);
+    CHECK_THROWS_AS(ArrivalProcess::timeVaryingArrivals({}, 10), std::domain_error);
+
+    /// 3600 vehicles/hour at 10Hz is a mean of 0.1 per tick
+    gen.setArrivals(Road::north, TurnOption::straight, ArrivalProcess::poissonArrivals(3600));
+    gen.generate(0, numTicks, counts);
+    CHECK(counts.size() == (size_t)numTicks * NUM_LANE_GROUPS);
+
+    for(int t=0; t < numTicks; t++){
+        total += counts[t * NUM_LANE_GROUPS + laneGroup];
+        CHECK(counts[t * NUM_LANE_GROUPS + Road::laneGroupIdx(Road::south, TurnOption::straight)] == 0);
+    }
+    CHECK(total > 0.97 * 0.1 * numTicks);
+    CHECK(total < 1.03 * 0.1 * numTicks);
+
+    /// A platoon of 3 every 2s starting at 1s
+    gen.setArrivals(Road::east, TurnOption::left, ArrivalProcess::platoonArrivals(3, 2, 1));
+    laneGroup = Road::laneGroupIdx(Road::east, TurnOption::left);
+    for(unsigned long tick=0; tick < 60; tick++){
+        CHECK(gen.arrivalsAt(tick, laneGroup) == ((tick == 10 || tick == 30 || tick == 50) ? 3 : 0));
+    }
+
+    /// No arrivals for 10s then 1 per tick on average for 10s, repeating
+    gen.setArrivals(Road::west, TurnOption::right, ArrivalProcess::timeVaryingArrivals({0, 36000}, 10));
+    laneGroup = Road::laneGroupIdx(Road::west, TurnOption::right);
+    gen.generate(0, 400, counts);
+    total = 0;
+    for(int t=0; t < 400; t++){
+        if((t / 100) % 2 == 0){
+            CHECK(counts[t * NUM_LANE_GROUPS + laneGroup] == 0);
+        }
+        else{
+            total += counts[t * NUM_LANE_GROUPS + laneGroup];
+        }
+    }
+    CHECK(total > 150);
+    CHECK(total < 250);
+
+    /// 1000 vehicles per tick is rejected
+    gen.setArrivals(Road::west, TurnOption::right, ArrivalProcess::poissonArrivals(1000.0 * 3600 * 10));
+    CHECK_THROWS_AS(gen.generate(0, 1, counts), std::domain_error);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_23-3_AG_reproducible"){
+    ArrivalGenerator gen = ArrivalGenerator(7, 1);
+    ArrivalGenerator sameGen = ArrivalGenerator(7, 1);
+    ArrivalGenerator otherId = ArrivalGenerator(7, 2);
+    ArrivalGenerator otherSeed = ArrivalGenerator(8, 1);
+    std::vector<uint16_t> counts, tailCounts, sameCounts, otherIdCounts, otherSeedCounts;
+
+    for(ArrivalGenerator* g : {&gen, &sameGen, &otherId, &otherSeed}){
+        g->setAllArrivals(ArrivalProcess::poissonArrivals(1800));
+    }
+
+    gen.generate(0, 1000, counts);
+    sameGen.generate(0, 1000, sameCounts);
+    otherId.generate(0, 1000, otherIdCounts);
+    otherSeed.generate(0, 1000, otherSeedCounts);
+
+    CHECK(counts == sameCounts);
+    CHECK(counts != otherIdCounts);
+    CHECK(counts != otherSeedCounts);
+
+    /// Arrivals only depend on the tick, not on where the batch starts
+    gen.generate(637, 363, tailCounts);
+    CHECK(std::equal(tailCounts.begin(), tailCounts.end(), counts.begin() + 637 * NUM_LANE_GROUPS));
+}
+
+TEST_CASE("TC_23-4_AG_Intersection"){
+    auto buildIntersection = [](Intersection& inter){
+        inter.addRoad(Road::north, {3, 4, 5});
+        inter.addRoad(Road::east, {0, 1, 0});
+        inter.addRoad(Road::west, {2, 3, 1});
+        inter.addRoad(Road::south, {1, 2, 3});
+
+        inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+
+        inter.schedule(LightConfig::doubleGreen, Road::north, 3.0, 3.0);
+        inter.schedule(LightConfig::doubleGreenLeft, Road::north, 3.0, DEFAULT_YELLOW_DURATION);
+        inter.schedule(LightConfig::doubleGreen, Road::east, 3.0, DEFAULT_YELLOW_DURATION);
+        inter.schedule(LightConfig::singleGreen, Road::west, 3.0, DEFAULT_YELLOW_DURATION);
+        inter.setAutoSequence(true);
+        inter.start();
+    };
+    Intersection stepped = Intersection();
+    Intersection advanced = Intersection();
+    Intersection restarted = Intersection();
+    ArrivalGenerator steppedGen = ArrivalGenerator(99);
+    ArrivalGenerator advancedGen = ArrivalGenerator(99);
+    ArrivalGenerator restartedGen = ArrivalGenerator(99);
+    ArrivalGenerator coldGen = ArrivalGenerator(99);
+    Intersection platoonStepped = Intersection();
+    Intersection platoonAdvanced = Intersection();
+    Intersection platoonLong = Intersection();
+    ArrivalGenerator platoonSteppedGen = ArrivalGenerator(99);
+    ArrivalGenerator platoonAdvancedGen = ArrivalGenerator(99);
+    ArrivalGenerator platoonLongGen = ArrivalGenerator(99);
+    CompactIntersection steppedState, otherState;
+    long cycleTicks;
+
+    refreshRateHzGlobal = 10;
+
+    for(ArrivalGenerator* gen : {&steppedGen, &advancedGen, &restartedGen, &coldGen}){
+        gen->setAllArrivals(ArrivalProcess::poissonArrivals(900));
+        gen->setArrivals(Road::north, TurnOption::straight, ArrivalProcess::platoonArrivals(2, 7.5));
+    }
+
+    buildIntersection(stepped);
+    buildIntersection(advanced);
+    buildIntersection(restarted);
+    stepped.setArrivals(&steppedGen);
+    advanced.setArrivals(&advancedGen);
+    restarted.setArrivals(&restartedGen);
+
+    for(int i=0; i < 5000; i++){
+        stepped.tick();
+
+        CHECK(stepped.getRoad(Road::west)->getTurnOption(TurnOption::straight)->getQueuedVehicles() <=
+              stepped.getRoad(Road::west)->getTurnOption(TurnOption::straight)->getMaxNumVehicles());
+    }
+    CHECK(steppedGen.getNumArrivals() > 0);
+    CHECK(steppedGen.getNumBlockedArrivals() > 0);
+
+    /// advance() steps every tick while arrivals are set
+    advanced.advance(5000);
+
+    /// Swapping in a generator with an empty batch part way through changes nothing
+    restarted.advance(1234);
+    restarted.setArrivals(&coldGen);
+    restarted.advance(5000 - 1234);
+
+    steppedState.pack(stepped);
+    otherState.pack(advanced);
+    CHECK(otherState == steppedState);
+    otherState.pack(restarted);
+    CHECK(otherState == steppedState);
+    CHECK(advancedGen.getNumArrivals() == steppedGen.getNumArrivals());
+    CHECK(restartedGen.getNumArrivals() + coldGen.getNumArrivals() == steppedGen.getNumArrivals());
+
+    /// Platoons whose period divides the cycle repeat with it, advance() skips periods once the queues do
+    buildIntersection(platoonStepped);
+    buildIntersection(platoonAdvanced);
+    buildIntersection(platoonLong);
+    cycleTicks = platoonStepped.getSignalPlan().getCycleLength();
+    for(ArrivalGenerator* gen : {&platoonSteppedGen, &platoonAdvancedGen, &platoonLongGen}){
+        gen->setArrivals(Road::north, TurnOption::straight, ArrivalProcess::platoonArrivals(3, (double)cycleTicks / 10, 0.5));
+        gen->setArrivals(Road::west, TurnOption::left, ArrivalProcess::platoonArrivals(1, (double)cycleTicks / 20, 2.0));
+    }
+    platoonStepped.setArrivals(&platoonSteppedGen);
+    platoonAdvanced.setArrivals(&platoonAdvancedGen);
+    platoonLong.setArrivals(&platoonLongGen);
+    CHECK(platoonSteppedGen.repeatStart(cycleTicks) == 20);
+    CHECK(platoonSteppedGen.repeatStart(cycleTicks / 4) == -1);
+    CHECK(steppedGen.repeatStart(cycleTicks) == -1);
+
+    for(int i=0; i < 20000; i++){
+        platoonStepped.tick();
+    }
+    platoonAdvanced.advance(20000);
+    steppedState.pack(platoonStepped);
+    otherState.pack(platoonAdvanced);
+    CHECK(otherState == steppedState);
+    CHECK(platoonAdvancedGen.getNumArrivals() == platoonSteppedGen.getNumArrivals());
+    CHECK(platoonAdvancedGen.getNumBlockedArrivals() == platoonSteppedGen.getNumBlockedArrivals());
+
+    /// Every platoon of a billion ticks is counted, queued or turned away
+    platoonLong.advance(1000000000);
+    CHECK(platoonLong.time() == 1000000000);
+    CHECK(platoonLongGen.getNumArrivals() + platoonLongGen.getNumBlockedArrivals() ==
+          (unsigned long)(3 * ((1000000000 - 1 - 5) / cycleTicks + 1) + ((1000000000 - 1 - 20) / (cycleTicks / 2) + 1)));
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_24-1_DR_parse"){
+    std::string path = (std::filesystem::temp_directory_path() / "TC_24-1_demand.csv").string();
+    DemandRecord record;
+
+    {
+        std::ofstream out(path);
+        out << "startSeconds,direction,turn,count\n";
+        out << "# loop detector 17\n";
+        out << "0,north,straight,12\r\n";
+        out << "\n";
+        out << "  0 , 3 , 0 , 4\n";
+        out << "900,east,right,7\n";
+        out << "1800.5,south,left,123456";
+    }
+
+    /// An 8 byte chunk splits every row and grows the buffer
+    DemandReader reader = DemandReader(path, DEFAULT_DEMAND_BIN_SECONDS, 8);
+
+    REQUIRE(reader.nextRecord(record));
+    CHECK(record.startSeconds == 0);
+    CHECK(record.direction == Road::north);
+    CHECK(record.turn == TurnOption::straight);
+    CHECK(record.count == 12);
+
+    REQUIRE(reader.nextRecord(record));
+    CHECK(record.direction == Road::west);
+    CHECK(record.turn == TurnOption::left);
+    CHECK(record.count == 4);
+
+    REQUIRE(reader.nextRecord(record));
+    CHECK(record.startSeconds == 900);
+    CHECK(record.direction == Road::east);
+    CHECK(record.turn == TurnOption::right);
+
+    REQUIRE(reader.nextRecord(record));
+    CHECK(record.startSeconds == 1800.5);
+    CHECK(record.count == 123456);
+
+    CHECK_FALSE(reader.nextRecord(record));
+    CHECK(reader.getNumRecords() == 4);
+    CHECK(reader.getBytesRead() == std::filesystem::file_size(path));
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("TC_24-2_DR_errors"){
+    std::string path = (std::filesystem::temp_directory_path() / "TC_24-2_demand.csv").string();
+    DemandRecord record;
+    const char* badRows[] = {"0,north,straight\n", "0,north,straight,1,2\n", "0,up,straight,1\n", "0,north,uturn,1\n",
+                             "0,north,straight,-1\n", "10,north,straight,1\n5,north,straight,1\n", "1,north,straight,1\nabc,north,straight,1\n"};
+
+    CHECK_THROWS_AS(DemandReader("/nonexistent/demand.csv"), std::runtime_error);
+
+    for(const char* rows : badRows){
+        {
+            std::ofstream out(path);
+            out << rows;
+        }
+
+        DemandReader reader = DemandReader(path);
+        auto readAll = [&](){ while(reader.nextRecord(record)){} };
+        CHECK_THROWS_AS(readAll(), std::runtime_error);
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("TC_24-3_DR_feed"){
+    std::string path = (std::filesystem::temp_directory_path() / "TC_24-3_demand.csv").string();
+    Intersection inter = Intersection();
+    TurnOption* northStraight;
+    TurnOption* eastStraight;
+    int added = 0;
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+
+    inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+
+    northStraight = inter.getRoad(Road::north)->getTurnOption(TurnOption::straight);
+    eastStraight = inter.getRoad(Road::east)->getTurnOption(TurnOption::straight);
+
+    {
+        std::ofstream out(path);
+        out << "0,north,straight,10\n";
+        out << "0,north,straight,2\n";
+        out << "2,east,straight,3\n";
+        out << "2,east,left,3\n";
+        out << "4,east,straight,20\n";
+    }
+
+    refreshRateHzGlobal = 10;
+    DemandReader reader = DemandReader(path, 2);
+
+    /// Lights are red so every vehicle stays queued
+    for(int t=0; t < 20; t++){
+        CHECK(inter.time() == (unsigned long)t);
+        added += reader.feed(inter);
+        inter.tick();
+
+        /// 12 vehicles spread evenly over 20 ticks
+        CHECK(northStraight->getQueuedVehicles() == (unsigned int)(((t + 1) * 12) / 20));
+    }
+    CHECK(added == 12);
+    CHECK(eastStraight->getQueuedVehicles() == 0);
+
+    for(int t=0; t < 20; t++){
+        added += reader.feed(inter);
+        inter.tick();
+    }
+    CHECK(eastStraight->getQueuedVehicles() == 3);
+    CHECK(northStraight->getQueuedVehicles() == 12);
+
+    /// The east straight queue holds 5 vehicles, east has no left lane
+    for(int t=0; t < 40; t++){
+        added += reader.feed(inter);
+        inter.tick();
+    }
+    CHECK(eastStraight->getQueuedVehicles() == eastStraight->getMaxNumVehicles());
+    CHECK(reader.getNumFed() == (unsigned long)added);
+    CHECK(reader.getNumFed() + reader.getNumBlocked() == 12 + 3 + 3 + 20);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("TC_25-1_Snapshot_roundTrip"){
+    auto addExitRoads = [](Intersection& inter){
+        inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    };
+    std::string path = (std::filesystem::temp_directory_path() / "TC_25-1.snapshot").string();
+    Intersection original = Intersection();
+    Intersection threeWay = Intersection();
+    Intersection restored = Intersection();
+    Intersection restoredThreeWay = Intersection();
+    CompactIntersection originalState, restoredState;
+
+    refreshRateHzGlobal = 10;
+
+    original.addRoad(Road::north, {3, 4, 5});
+    original.addRoad(Road::east, {0, 1, 0});
+    original.addRoad(Road::west, {2, 3, 1});
+    original.addRoad(Road::south, {1, 2, 3});
+    addExitRoads(original);
+    original.schedule(LightConfig::doubleGreen, Road::north, 3.0, 3.0);
+    original.schedule(LightConfig::doubleGreenLeft, Road::north, 2.5, DONT_SET);
+    original.schedule(LightConfig::singleGreen, Road::west, 3.0, 0.7);
+    original.getLight(Road::west, TurnOption::left)->setDuration(TrafficLight::yellow, 1.3);
+    original.setAllRedDuration(0.4);
+    original.setAutoSequence(true);
+    original.addMaxVehicles();
+    original.start();
+
+    threeWay.addRoad(Road::north, {0, 2, 1});
+    threeWay.addRoad(Road::east, {1, 0, 1});
+    threeWay.schedule(LightConfig::singleGreen, Road::east, 1.0, 1.0);
+
+    for(int i=0; i < 137; i++){
+        original.tick();
+    }
+
+    Snapshot::save(path, {&original, &threeWay});
+
+    Snapshot snapshot = Snapshot(path);
+    CHECK(snapshot.getNumIntersections() == 2);
+    CHECK(snapshot.getRefreshRate() == 10);
+    CHECK(snapshot.getRecord(0).numLightConfigs == 3);
+    CHECK(snapshot.getRecord(1).firstLightConfig == 3);
+    CHECK(snapshot.getRecord(0).state.time() == 137);
+
+    snapshot.restore(0, restored);
+    snapshot.restore(1, restoredThreeWay);
+
+    /// Exit roads belong to the neighboring Intersections, they are restored with them
+    addExitRoads(restored);
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+            restored.getExitRoad((Road::RoadDirection)dir)->getTurnOption((TurnOption::Type)opt)->addVehicles(
+                original.getExitRoad((Road::RoadDirection)dir)->getTurnOption((TurnOption::Type)opt)->getQueuedVehicles());
+        }
+    }
+
+    CHECK(restored.getNumRoads() == 4);
+    CHECK(restored.time() == 137);
+    CHECK(restored.getConfigScheduleIdx() == original.getConfigScheduleIdx());
+    CHECK(restored.getAutoSequence());
+    CHECK(restored.getAllRedDuration() == 0.4);
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+            if(original.getLight((Road::RoadDirection)dir, (TurnOption::Type)opt) == NULL){
+                CHECK(restored.getLight((Road::RoadDirection)dir, (TurnOption::Type)opt) == NULL);
+                continue;
+            }
+
+            for(int color=0; color < TrafficLight::numColors; color++){
+                CHECK(restored.getLight((Road::RoadDirection)dir, (TurnOption::Type)opt)->getColorDuration((TrafficLight::AvailableColors)color) ==
+                      original.getLight((Road::RoadDirection)dir, (TurnOption::Type)opt)->getColorDuration((TrafficLight::AvailableColors)color));
+            }
+        }
+    }
+    CHECK(restored.getSignalPlan().getCycleLength() == original.getSignalPlan().getCycleLength());
+
+    CHECK(restoredThreeWay.getNumRoads() == 2);
+    CHECK(restoredThreeWay.roadIsExpected(Road::south) == threeWay.roadIsExpected(Road::south));
+    CHECK(restoredThreeWay.roadIsExpected(Road::west) == threeWay.roadIsExpected(Road::west));
+    CHECK(restoredThreeWay.getRoad(Road::east)->getTurnOption(TurnOption::straight)->isValid() == false);
+    CHECK(restoredThreeWay.getSignalPlan().getNumPhases() == 1);
+
+    /// The restored Intersection continues exactly like the original
+    for(int i=0; i < 500; i++){
+        original.tick();
+        restored.tick();
+
+        originalState.pack(original);
+        restoredState.pack(restored);
+        CHECK(restoredState == originalState);
+    }
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("TC_25-2_Snapshot_errors"){
+    std::string path = (std::filesystem::temp_directory_path() / "TC_25-2.snapshot").string();
+    Intersection inter = Intersection();
+    Intersection notEmpty = Intersection();
+    Snapshot::Header header;
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+    notEmpty.addRoad(Road::north, {3, 4, 5});
+
+    CHECK_THROWS_AS(Snapshot("/nonexistent/snapshot"), std::runtime_error);
+
+    Snapshot::save(path, {&inter});
+    {
+        Snapshot snapshot = Snapshot(path);
+
+        CHECK_THROWS_AS(snapshot.restore(0, notEmpty), std::logic_error);
+        CHECK_THROWS_AS(snapshot.restore(1, notEmpty), std::out_of_range);
+
+        refreshRateHzGlobal = 20;
+        Intersection otherRate = Intersection();
+        CHECK_THROWS_AS(snapshot.restore(0, otherRate), std::logic_error);
+        refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+    }
+
+    /// Truncated
+    std::filesystem::resize_file(path, sizeof(Snapshot::Header) + sizeof(Snapshot::Record) / 2);
+    CHECK_THROWS_AS(Snapshot(path), std::runtime_error);
+
+    /// Another version
+    Snapshot::save(path, {&inter});
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.read((char*)&header, sizeof(header));
+        header.version++;
+        file.seekp(0);
+        file.write((const char*)&header, sizeof(header));
+    }
+    CHECK_THROWS_AS(Snapshot(path), std::runtime_error);
+
+    /// Not a snapshot
+    {
+        std::ofstream out(path, std::ios::trunc);
+        out << "startSeconds,direction,turn,count\n0,north,straight,12\n0,north,straight,12\n0,north,straight,12\n";
+    }
+    CHECK_THROWS_AS(Snapshot(path), std::runtime_error);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("TC_26-1_IJ_recordReplay"){
+    auto build = [](Intersection& inter){
+        inter.addRoad(Road::north, {3, 4, 5});
+        inter.addRoad(Road::east, {0, 1, 0});
+        inter.addRoad(Road::west, {2, 3, 1});
+        inter.addRoad(Road::south, {1, 2, 3});
+        inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    };
+    std::string path = (std::filesystem::temp_directory_path() / "TC_26-1.journal").string();
+    Intersection original = Intersection();
+    Intersection replayed = Intersection();
+    InputJournal journal = InputJournal(0, 20);
+    CompactIntersection originalState, replayedState;
+    std::array<unsigned int, NUM_LANE_GROUPS> originalExits, replayedExits;
+    unsigned int lcg = 12345;
+
+    refreshRateHzGlobal = 10;
+    build(original);
+    build(replayed);
+
+    original.setJournal(&journal);
+    original.schedule(LightConfig::doubleGreen, Road::north, 3.0, 3.0);
+    original.schedule(LightConfig::doubleGreenLeft, Road::north, 2.5, DONT_SET);
+    original.schedule(LightConfig::singleGreen, Road::west, 3.0, 0.7);
+    original.setAllRedDuration(0.4);
+    original.setAutoSequence(true);
+    original.start();
+
+    for(int i=0; i < 2000; i++){
+        /// Irregular demand from a fixed sequence
+        lcg = lcg * 1103515245 + 12345;
+        if((lcg >> 16) % 3 == 0){
+            int lane = (lcg >> 8) % NUM_LANE_GROUPS;
+            original.addVehicles(Road::laneGroupDirection(lane), Road::laneGroupTurn(lane), 1 + (lcg >> 20) % 4);
+        }
+
+        if(i == 700){
+            original.clearSchedule();
+            original.schedule(LightConfig::singleGreen, Road::north, 1.7, 1.1);
+            original.schedule(LightConfig::singleGreen, Road::south, 2.2, DONT_SET);
+        }
+        if(i == 1300){
+            original.setAllLightDurations(4, 2);
+            original.addMaxVehicles();
+        }
+
+        original.tick();
+    }
+    original.setJournal(NULL);
+
+    CHECK(journal.getStartTick() == 0);
+    CHECK(journal.getLastTick() == 2000);
+    /// Tick deltas, lane groups and counts all fit in a byte each
+    CHECK(journal.getNumBytes() < 5 * journal.getNumEvents());
+
+    journal.save(path);
+    InputJournal loaded = InputJournal::load(path);
+    CHECK(loaded.getNumEvents() == journal.getNumEvents());
+    CHECK(loaded.getNumBytes() == journal.getNumBytes());
+    CHECK(loaded.getCheckpointInterval() == 20);
+
+    /// Every checkpoint is verified along the way
+    CHECK(loaded.replay(replayed, 2000) == journal.getNumEvents());
+    CHECK(replayed.getJournal() == NULL);
+
+    originalState.pack(original);
+    replayedState.pack(replayed);
+    CHECK(replayedState == originalState);
+    CHECK(replayedState.hash() == originalState.hash());
+
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+            int lane = Road::laneGroupIdx((Road::RoadDirection)dir, (TurnOption::Type)opt);
+            originalExits[lane] = original.getExitRoad((Road::RoadDirection)dir)->getTurnOption((TurnOption::Type)opt)->getQueuedVehicles();
+            replayedExits[lane] = replayed.getExitRoad((Road::RoadDirection)dir)->getTurnOption((TurnOption::Type)opt)->getQueuedVehicles();
+        }
+    }
+    CHECK(replayedExits == originalExits);
+
+    /// advance() steps every tick while journaling, so no checkpoint is missed
+    InputJournal steppedJournal = InputJournal(replayed.time(), 20);
+    InputJournal advancedJournal = InputJournal(replayed.time(), 20);
+
+    replayed.setJournal(&steppedJournal);
+    original.setJournal(&advancedJournal);
+    for(int i=0; i < 2000; i++){
+        replayed.tick();
+    }
+    original.advance(2000);
+    replayed.setJournal(NULL);
+    original.setJournal(NULL);
+
+    CHECK(advancedJournal.getNumEvents() == 100);
+    CHECK(advancedJournal.getNumEvents() == steppedJournal.getNumEvents());
+    CHECK(advancedJournal.getNumBytes() == steppedJournal.getNumBytes());
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("TC_26-2_IJ_errors"){
+    std::string path = (std::filesystem::temp_directory_path() / "TC_26-2.journal").string();
+    InputJournal small = InputJournal();
+    InputJournal journal = InputJournal(0, 5);
+    Intersection original = Intersection();
+    Intersection diverged = Intersection();
+    Intersection late = Intersection();
+
+    /// Tick delta, opcode, lane group and count
+    small.recordAddVehicles(0, Road::north, TurnOption::straight, 3);
+    CHECK(small.getNumBytes() == 4);
+    small.recordAddVehicles(2, Road::north, TurnOption::straight, 3);
+    CHECK_THROWS_AS(small.recordAddVehicles(1, Road::north, TurnOption::straight, 3), std::logic_error);
+
+    for(Intersection* inter : {&original, &diverged, &late}){
+        inter->addRoad(Road::north, {0, 2, 0});
+        inter->addRoad(Road::south, {0, 2, 0});
+        inter->addRoad(Road::east, {0, 0, 0});
+        inter->setExitRoad(Road::north, new Road(Road::north, {0,2,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter->setExitRoad(Road::south, new Road(Road::south, {0,2,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    }
+
+    original.setJournal(&journal);
+    original.schedule(LightConfig::doubleGreen, Road::north, 1.0, 1.0);
+    original.setAutoSequence(true);
+    original.start();
+    original.addVehicles(Road::north, TurnOption::straight, 10);
+    for(int i=0; i < 50; i++){
+        original.tick();
+    }
+
+    /// State the journal does not know about
+    diverged.addVehicles(Road::south, TurnOption::straight, 1);
+    CHECK_THROWS_AS(journal.replay(diverged, 50), std::runtime_error);
+    CHECK(diverged.getJournal() == NULL);
+
+    late.tick();
+    CHECK_THROWS_AS(journal.replay(late, 50), std::logic_error);
+
+    CHECK_THROWS_AS(InputJournal::load("/nonexistent/journal"), std::runtime_error);
+
+    journal.save(path);
+    std::filesystem::resize_file(path, sizeof(InputJournal::Header) + journal.getNumBytes() / 2);
+    CHECK_THROWS_AS(InputJournal::load(path), std::runtime_error);
+
+    {
+        std::ofstream out(path, std::ios::trunc);
+        out << "startSeconds,direction,turn,count\n0,north,straight,12\n0,north,straight,12\n0,north,straight,12\n";
+    }
+    CHECK_THROWS_AS(InputJournal::load(path), std::runtime_error);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("TC_27-1_Telemetry_roundTrip"){
+    std::string path = (std::filesystem::temp_directory_path() / "TC_27-1.telemetry").string();
+    Intersection inters[2];
+    TelemetryBlock expected, block;
+    size_t numRead = 0;
+
+    refreshRateHzGlobal = 10;
+    expected.resize(0);
+
+    for(Intersection& inter : inters){
+        inter.addRoad(Road::north, {3, 4, 5});
+        inter.addRoad(Road::east, {0, 1, 0});
+        inter.addRoad(Road::west, {2, 3, 1});
+        inter.addRoad(Road::south, {1, 2, 3});
+        inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        inter.schedule(LightConfig::doubleGreen, Road::north, 3.0, 3.0);
+        inter.schedule(LightConfig::singleGreen, Road::west, 2.0, 1.0);
+        inter.setAutoSequence(true);
+        inter.start();
+    }
+    inters[1].addMaxVehicles();
+
+    {
+        /// Blocks that do not line up with the samples, and a writer thread that is often behind
+        TelemetryWriter writer = TelemetryWriter(path, 7, 1);
+
+        for(int i=0; i < 300; i++){
+            for(uint32_t id=0; id < 2; id++){
+                inters[id].tick();
+                writer.sample(inters[id], id + 40);
+
+                for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+                    TurnOption* turnOpt;
+
+                    if(inters[id].getLight(Road::laneGroupDirection(lane), Road::laneGroupTurn(lane)) == NULL){
+                        continue;
+                    }
+                    turnOpt = inters[id].getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane));
+
+                    expected.ticks.push_back(inters[id].time());
+                    expected.laneGroups.push_back(TelemetryWriter::laneGroupId(id + 40, lane));
+                    expected.colors.push_back(turnOpt->getLight()->getColor());
+                    expected.queuedVehicles.push_back(turnOpt->getQueuedVehicles());
+                    expected.numVehiclesCrossing.push_back(turnOpt->getNumVehiclesCurrentlyCrossing());
+                    expected.numVehiclesDirected.push_back(turnOpt->getLight()->getNumVehiclesDirected());
+                }
+            }
+        }
+
+        CHECK(writer.getNumRows() == 300 * 2 * 10);
+        writer.flush();
+        CHECK(writer.getBytesWritten() == std::filesystem::file_size(path));
+        /// Most values take one byte, the block headers take the rest
+        CHECK(writer.getBytesWritten() < sizeof(TelemetryWriter::FileHeader) + (writer.getNumRows() / 7 + 1) * sizeof(TelemetryWriter::BlockHeader) +
+                                         writer.getNumRows() * TelemetryBlock::numColumns * 2);
+    }
+
+    TelemetryReader reader = TelemetryReader(path);
+    while(reader.nextBlock(block)){
+        CHECK(block.numRows <= 7);
+
+        for(size_t row=0; row < block.numRows; row++, numRead++){
+            REQUIRE(numRead < expected.ticks.size());
+            CHECK(block.ticks[row] == expected.ticks[numRead]);
+            CHECK(block.laneGroups[row] == expected.laneGroups[numRead]);
+            CHECK(block.colors[row] == expected.colors[numRead]);
+            CHECK(block.queuedVehicles[row] == expected.queuedVehicles[numRead]);
+            CHECK(block.numVehiclesCrossing[row] == expected.numVehiclesCrossing[numRead]);
+            CHECK(block.numVehiclesDirected[row] == expected.numVehiclesDirected[numRead]);
+        }
+    }
+    CHECK(numRead == expected.ticks.size());
+    CHECK(reader.getNumRows() == numRead);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("TC_27-2_Telemetry_errors"){
+    std::string path = (std::filesystem::temp_directory_path() / "TC_27-2.telemetry").string();
+    Intersection inter = Intersection();
+    TelemetryBlock block;
+
+    inter.addRoad(Road::north, {0, 2, 0});
+    inter.addRoad(Road::south, {0, 2, 0});
+    inter.addRoad(Road::east, {0, 0, 0});
+
+    CHECK_THROWS_AS(TelemetryWriter("/nonexistent/telemetry"), std::runtime_error);
+    CHECK_THROWS_AS(TelemetryWriter(path, 0), std::domain_error);
+    CHECK_THROWS_AS(TelemetryReader("/nonexistent/telemetry"), std::runtime_error);
+
+    {
+        TelemetryWriter writer = TelemetryWriter(path, 2);
+
+        writer.sample(inter);
+        writer.sample(inter);
+        writer.close();
+        CHECK_THROWS_AS(writer.sample(inter), std::logic_error);
+    }
+
+    /// Truncated block
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    {
+        TelemetryReader reader = TelemetryReader(path);
+        CHECK(reader.nextBlock(block));
+        CHECK_THROWS_AS(reader.nextBlock(block), std::runtime_error);
+    }
+
+    /// Not telemetry
+    {
+        std::ofstream out(path, std::ios::trunc);
+        out << "startSeconds,direction,turn,count\n0,north,straight,12\n";
+    }
+    CHECK_THROWS_AS(TelemetryReader(path), std::runtime_error);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("TC_28-1_LH_queries"){
+    Intersection inter = Intersection();
+    LightHistory history = LightHistory();
+    std::vector<std::array<int, NUM_LANE_GROUPS>> observed;
+    std::vector<LightLog::Run> runs;
+    const int numTicks = 600;
+
+    refreshRateHzGlobal = 10;
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+    inter.schedule(LightConfig::doubleGreen, Road::north, 3.0, 3.0);
+    inter.schedule(LightConfig::doubleGreenLeft, Road::north, 2.5, DONT_SET);
+    inter.schedule(LightConfig::singleGreen, Road::west, 3.0, 0.7);
+    inter.setAllRedDuration(0.4);
+    inter.setAutoSequence(true);
+    inter.setLightHistory(&history);
+    CHECK(history.getLog(Road::east, TurnOption::left) == NULL);
+    CHECK(inter.getLight(Road::north, TurnOption::left)->getHistory() == history.getLog(Road::north, TurnOption::left));
+
+    /// Colors seen from outside after every tick, -1 where there is no light
+    auto observe = [&](){
+        std::array<int, NUM_LANE_GROUPS> colors;
+
+        for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+            TrafficLight* light = inter.getLight(Road::laneGroupDirection(lane), Road::laneGroupTurn(lane));
+            colors[lane] = (light == NULL) ? -1 : light->getColor();
+        }
+        observed.push_back(colors);
+    };
+
+    inter.start();
+    observe();
+    for(int i=0; i < numTicks; i++){
+        inter.tick();
+        observe();
+    }
+
+    for(unsigned long tick=0; tick <= numTicks; tick++){
+        for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+            if(observed[tick][lane] >= 0){
+                CHECK(history.colorAt(Road::laneGroupDirection(lane), Road::laneGroupTurn(lane), tick) == observed[tick][lane]);
+            }
+        }
+    }
+
+    /// One run per color change
+    LightLog* log = history.getLog(Road::west, TurnOption::left);
+    size_t numChanges = 0;
+    for(unsigned long tick=1; tick <= numTicks; tick++){
+        numChanges += observed[tick][Road::laneGroupIdx(Road::west, TurnOption::left)] != observed[tick - 1][Road::laneGroupIdx(Road::west, TurnOption::left)];
+    }
+    CHECK(log->getNumRuns() == numChanges + 1);
+
+    log->getRuns(100, 300, runs);
+    REQUIRE( ! runs.empty());
+    CHECK(runs.front().startTick <= 100);
+    CHECK(runs.back().startTick < 300);
+    for(size_t i=0; i < runs.size(); i++){
+        CHECK(runs[i].color == observed[std::max(runs[i].startTick, 100ul)][Road::laneGroupIdx(Road::west, TurnOption::left)]);
+        if(i > 0){
+            CHECK(runs[i].startTick > runs[i - 1].startTick);
+            CHECK(runs[i].color != runs[i - 1].color);
+        }
+    }
+
+    inter.setLightHistory(NULL);
+    CHECK(inter.getLight(Road::north, TurnOption::left)->getHistory() == NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_28-2_LH_retention"){
+    Intersection inter = Intersection();
+    Intersection stepped = Intersection();
+    Intersection other = Intersection();
+    LightHistory history = LightHistory(50);
+    LightHistory steppedHistory = LightHistory(50);
+    size_t maxRuns = 0;
+
+    refreshRateHzGlobal = 10;
+
+    for(Intersection* i : {&inter, &stepped, &other}){
+        i->addRoad(Road::north, {0, 2, 0});
+        i->addRoad(Road::south, {0, 2, 0});
+        i->addRoad(Road::east, {0, 0, 0});
+        i->schedule(LightConfig::doubleGreen, Road::north, 1.0, 1.0);
+        i->setAllRedDuration(1.0);
+        i->setAutoSequence(true);
+    }
+
+    inter.setLightHistory(&history);
+    stepped.setLightHistory(&steppedHistory);
+    CHECK_THROWS_AS(other.setLightHistory(&history), std::logic_error);
+    CHECK(other.getLightHistory() == NULL);
+
+    inter.start();
+    stepped.start();
+
+    /// The history keeps advance() stepping every tick
+    inter.advance(2000);
+    for(int i=0; i < 2000; i++){
+        stepped.tick();
+        maxRuns = std::max(maxRuns, steppedHistory.getNumRuns());
+    }
+    CHECK(inter.time() == 2000);
+    CHECK(history.getNumRuns() == steppedHistory.getNumRuns());
+
+    /// A 30 tick cycle of green, yellow and red: at most 3 runs per 50 ticks per light, plus the one covering the window start
+    CHECK(maxRuns <= 2 * 6);
+    CHECK(history.getLog(Road::north, TurnOption::straight)->getOldestTick() <= 2000 - 50);
+
+    for(unsigned long tick=1950; tick <= 2000; tick++){
+        CHECK(history.colorAt(Road::north, TurnOption::straight, tick) == steppedHistory.colorAt(Road::north, TurnOption::straight, tick));
+    }
+
+    CHECK_THROWS_AS(history.colorAt(Road::north, TurnOption::straight, 100), std::out_of_range);
+    CHECK_THROWS_AS(history.colorAt(Road::north, TurnOption::straight, 2001), std::out_of_range);
+    CHECK_THROWS_AS(history.colorAt(Road::north, TurnOption::left, 1990), std::invalid_argument);
+
+    inter.setLightHistory(NULL);
+    stepped.setLightHistory(NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_29-1_DM_curves"){
+    Intersection inter = Intersection();
+    ArrivalGenerator gen = ArrivalGenerator(29);
+    DelayMetrics metrics = DelayMetrics(5.0, 0.5);
+    const int numTicks = 1500;
+    const unsigned long bucketTicks = 5, numBuckets = 10;
+    std::vector<int> lanes = {Road::laneGroupIdx(Road::north, TurnOption::left), Road::laneGroupIdx(Road::north, TurnOption::straight),
+                              Road::laneGroupIdx(Road::west, TurnOption::right), Road::laneGroupIdx(Road::east, TurnOption::straight)};
+    /// Per lane and tick since attach: the queue and both curves
+    std::vector<std::vector<unsigned long>> queues(NUM_LANE_GROUPS), curveA(NUM_LANE_GROUPS), curveD(NUM_LANE_GROUPS);
+
+    refreshRateHzGlobal = 10;
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.addRoad(Road::south, {1, 2, 3});
+    inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.schedule(LightConfig::doubleGreen, Road::north, 3.0, 1.0);
+    inter.schedule(LightConfig::singleGreen, Road::west, 3.0, 1.0);
+    inter.setAllRedDuration(0.5);
+    inter.setAutoSequence(true);
+
+    gen.setArrivals(Road::north, TurnOption::left, ArrivalProcess::poissonArrivals(1800));
+    gen.setArrivals(Road::north, TurnOption::straight, ArrivalProcess::poissonArrivals(3600));
+    gen.setArrivals(Road::west, TurnOption::right, ArrivalProcess::platoonArrivals(4, 7, 1));
+    gen.setArrivals(Road::east, TurnOption::straight, ArrivalProcess::poissonArrivals(2400));
+    inter.setArrivals(&gen);
+
+    /// Vehicles queued before attach() are not arrivals but are delayed
+    inter.getRoad(Road::north)->getTurnOption(TurnOption::straight)->addVehicles(5);
+    inter.getRoad(Road::north)->getTurnOption(TurnOption::straight)->addCumulative(100, 100);
+    inter.setDelayMetrics(&metrics);
+    inter.start();
+
+    auto observe = [&](){
+        for(int lane : lanes){
+            TurnOption* turnOpt = inter.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane));
+
+            queues[lane].push_back(turnOpt->getQueuedVehicles());
+            curveA[lane].push_back(turnOpt->getCumulativeArrivals());
+            curveD[lane].push_back(turnOpt->getCumulativeDepartures());
+        }
+    };
+
+    observe();
+    for(unsigned long t=1; t <= numTicks; t++){
+        unsigned long finished = t / bucketTicks;
+        unsigned long start = (finished <= numBuckets) ? 0 : (finished - numBuckets) * bucketTicks;
+        unsigned long sumDepartures = 0, sumWindowDelay = 0;
+
+        inter.tick();
+        observe();
+        CHECK(metrics.getNumTicks() == t);
+
+        for(int lane : lanes){
+            DelayMetrics::Summary total = metrics.getTotal(Road::laneGroupDirection(lane), Road::laneGroupTurn(lane));
+            DelayMetrics::Summary window = metrics.getWindow(Road::laneGroupDirection(lane), Road::laneGroupTurn(lane));
+            unsigned long delayTicks = 0, windowDelayTicks = 0, maxQueue = 0, windowMaxQueue = 0;
+
+            for(unsigned long k=0; k <= t; k++){
+                maxQueue = std::max(maxQueue, queues[lane][k]);
+                if(k > 0){
+                    delayTicks += queues[lane][k];
+                }
+                if(k > start || (start == 0 && k == 0)){
+                    windowMaxQueue = std::max(windowMaxQueue, queues[lane][k]);
+                }
+                if(k > start){
+                    windowDelayTicks += queues[lane][k];
+                }
+            }
+
+            /// The queue is the gap between the curves
+            CHECK(total.arrivals == curveA[lane][t] - curveA[lane][0]);
+            CHECK(total.departures == curveD[lane][t] - curveD[lane][0]);
+            CHECK((long)total.arrivals - (long)total.departures == (long)queues[lane][t] - (long)queues[lane][0]);
+            CHECK(total.totalDelay == doctest::Approx(delayTicks / 10.0));
+            CHECK(total.maxQueue == maxQueue);
+            CHECK(total.duration == doctest::Approx(t / 10.0));
+
+            CHECK(window.arrivals == curveA[lane][t] - curveA[lane][start]);
+            CHECK(window.departures == curveD[lane][t] - curveD[lane][start]);
+            CHECK(window.totalDelay == doctest::Approx(windowDelayTicks / 10.0));
+            CHECK(window.maxQueue == windowMaxQueue);
+            CHECK(window.duration == doctest::Approx((t - start) / 10.0));
+            CHECK(window.throughput == doctest::Approx(window.departures * 3600.0 / window.duration));
+
+            sumDepartures += total.departures;
+            sumWindowDelay += windowDelayTicks;
+        }
+
+        CHECK(metrics.getIntersectionTotal().departures >= sumDepartures);
+        CHECK(metrics.getIntersectionWindow().totalDelay >= sumWindowDelay / 10.0 - 1e-9);
+    }
+
+    DelayMetrics::Summary northStraight = metrics.getTotal(Road::north, TurnOption::straight);
+    CHECK(northStraight.departures > 0);
+    CHECK(northStraight.averageDelay == doctest::Approx(northStraight.totalDelay / northStraight.departures));
+
+    /// Detached metrics stop counting
+    inter.setDelayMetrics(NULL);
+    inter.tick();
+    CHECK(metrics.getNumTicks() == numTicks);
+    CHECK(inter.getDelayMetrics() == NULL);
+
+    inter.setArrivals(NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_29-2_DM_advanceErrors"){
+    Intersection inter = Intersection();
+    Intersection stepped = Intersection();
+    Intersection skipped = Intersection();
+    Intersection run = Intersection();
+    DelayMetrics metrics = DelayMetrics(10.0, 1.0);
+    DelayMetrics steppedMetrics = DelayMetrics(10.0, 1.0);
+    DelayMetrics runMetrics = DelayMetrics(10.0, 1.0);
+    DelayMetrics tooShort = DelayMetrics(1.0, 0.04);
+
+    refreshRateHzGlobal = 10;
+
+    CHECK_THROWS_AS(DelayMetrics(5.0, 0), std::domain_error);
+    CHECK_THROWS_AS(DelayMetrics(5.0, 10.0), std::domain_error);
+
+    for(Intersection* i : {&inter, &stepped, &skipped}){
+        i->addRoad(Road::north, {0, 2, 0});
+        i->addRoad(Road::south, {0, 2, 1});
+        i->addRoad(Road::east, {0, 0, 0});
+        i->setExitRoad(Road::north, new Road(Road::north, {0,2,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        i->setExitRoad(Road::south, new Road(Road::south, {0,2,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        i->setExitRoad(Road::east, new Road(Road::east, {0,0,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        i->setExitRoad(Road::west, new Road(Road::west, {0,2,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        i->schedule(LightConfig::doubleGreen, Road::north, 2.0, 1.0);
+        i->setAllRedDuration(1.0);
+        i->setAutoSequence(true);
+        i->getRoad(Road::north)->getTurnOption(TurnOption::straight)->addVehicles(2 * DEFAULT_MAX_LANE_VEHICLES);
+        i->getRoad(Road::south)->getTurnOption(TurnOption::right)->addVehicles(DEFAULT_MAX_LANE_VEHICLES);
+    }
+
+    CHECK_THROWS_AS(inter.setDelayMetrics(&tooShort), std::domain_error);
+    CHECK(inter.getDelayMetrics() == NULL);
+
+    inter.setDelayMetrics(&metrics);
+    stepped.setDelayMetrics(&steppedMetrics);
+    CHECK_THROWS_AS(metrics.getTotal(Road::east, TurnOption::left), std::invalid_argument);
+    CHECK_THROWS_AS(metrics.getWindow(Road::west, TurnOption::straight), std::invalid_argument);
+
+    inter.start();
+    stepped.start();
+    skipped.start();
+
+    /// Metrics keep advance() stepping every tick
+    inter.advance(3000);
+    skipped.advance(3000);
+    for(int i=0; i < 3000; i++){
+        stepped.tick();
+    }
+    CHECK(inter.time() == 3000);
+    CHECK(skipped.time() == 3000);
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        Road* rd = inter.getRoad(Road::laneGroupDirection(lane));
+        TurnOption* turnOpt = (rd == NULL) ? NULL : rd->getTurnOption(Road::laneGroupTurn(lane));
+
+        if(turnOpt == NULL || ! turnOpt->isValid()){
+            continue;
+        }
+
+        /// Skipped periods still add to the curves
+        TurnOption* skippedOpt = skipped.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane));
+        CHECK(skippedOpt->getCumulativeArrivals() == turnOpt->getCumulativeArrivals());
+        CHECK(skippedOpt->getCumulativeDepartures() == turnOpt->getCumulativeDepartures());
+
+        DelayMetrics::Summary advanced = metrics.getWindow(Road::laneGroupDirection(lane), Road::laneGroupTurn(lane));
+        DelayMetrics::Summary ticked = steppedMetrics.getWindow(Road::laneGroupDirection(lane), Road::laneGroupTurn(lane));
+        CHECK(advanced.departures == ticked.departures);
+        CHECK(advanced.totalDelay == doctest::Approx(ticked.totalDelay));
+        CHECK(advanced.maxQueue == ticked.maxQueue);
+    }
+
+    DelayMetrics::Summary total = metrics.getIntersectionTotal();
+    CHECK(total.arrivals == 0);
+    CHECK(total.departures == 2 * DEFAULT_MAX_LANE_VEHICLES + DEFAULT_MAX_LANE_VEHICLES);
+    CHECK(total.maxQueue == 2 * DEFAULT_MAX_LANE_VEHICLES);
+    CHECK(total.throughput == doctest::Approx(total.departures * 3600.0 / 300.0));
+
+    std::ostringstream summary;
+    metrics.printSummary(summary);
+    CHECK(summary.str().find("intersection") != std::string::npos);
+
+    /// commenceTraffic() measures its run with its own DelayMetrics unless one is attached, and hands both back
+    for(Road::RoadDirection dir : {Road::north, Road::south, Road::east}){
+        run.addRoad(dir, {0, 2, 0});
+        run.setExitRoad(dir, new Road(dir, {0,2,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    }
+    run.schedule(LightConfig::doubleGreen, Road::north, 2.0, 1.0);
+    CHECK(commenceTraffic(run, 10, 0, true));
+    CHECK(run.getDelayMetrics() == NULL);
+    CHECK_FALSE(run.getAutoSequence());
+    run.setDelayMetrics(&runMetrics);
+    run.setAutoSequence(true);
+    CHECK(commenceTraffic(run, 10, 0, true));
+    CHECK(run.getDelayMetrics() == &runMetrics);
+    CHECK(run.getAutoSequence());
+    run.setDelayMetrics(NULL);
+
+    inter.setDelayMetrics(NULL);
+    stepped.setDelayMetrics(NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_30-1_QS_sketch"){
+    QuantileSketch sketch = QuantileSketch();
+    QuantileSketch bounded = QuantileSketch(0.01, 64);
+    std::vector<QuantileSketch> parts(8), boundedParts(8, QuantileSketch(0.01, 64));
+    std::vector<double> values;
+    std::vector<uint8_t> bytes;
+
+    CHECK_THROWS_AS(QuantileSketch(0), std::domain_error);
+    CHECK_THROWS_AS(QuantileSketch(1), std::domain_error);
+    CHECK_THROWS_AS(QuantileSketch(0.01, 1), std::domain_error);
+    CHECK_THROWS_AS(sketch.add(-1), std::domain_error);
+    CHECK_THROWS_AS(sketch.add(std::nan("")), std::domain_error);
+    CHECK_THROWS_AS(sketch.add(INFINITY), std::domain_error);
+    CHECK_THROWS_AS(sketch.quantile(0.5), std::logic_error);
+
+    /// Zeros and a long tail from 0.1 to 10^4
+    for(uint32_t i=0; i < 100000; i++){
+        double u = Philox4x32::toUniform(Philox4x32::generate({i, 0, 0, 0}, {30, 0})[0]);
+        double value = (i % 10 == 0) ? 0 : 0.1 * std::pow(10.0, 5 * u * u);
+
+        values.push_back(value);
+        sketch.add(value);
+        bounded.add(value);
+        parts[i % parts.size()].add(value);
+        boundedParts[(i * 7) % boundedParts.size()].add(value);
+    }
+    std::sort(values.begin(), values.end());
+
+    CHECK(sketch.getCount() == values.size());
+    CHECK(sketch.getMin() == values.front());
+    CHECK(sketch.getMax() == values.back());
+    CHECK_THROWS_AS(sketch.quantile(1.5), std::domain_error);
+    CHECK_THROWS_AS(sketch.quantile(-0.1), std::domain_error);
+
+    for(double q : {0.0, 0.05, 0.1, 0.5, 0.9, 0.95, 0.99, 0.999, 1.0}){
+        double exact = values[(size_t)(q * (values.size() - 1))];
+
+        CHECK(std::fabs(sketch.quantile(q) - exact) <= 0.01 * exact + 1e-12);
+    }
+
+    /// Merging in any order gives the sketch of every value
+    QuantileSketch forward = QuantileSketch(), backward = QuantileSketch();
+    for(size_t i=0; i < parts.size(); i++){
+        forward.merge(parts[i]);
+        backward.merge(parts[parts.size() - 1 - i]);
+    }
+    CHECK(forward == sketch);
+    CHECK(backward == sketch);
+    CHECK(forward.quantile(0.99) == sketch.quantile(0.99));
+
+    /// Folding the lowest buckets depends only on the highest, merges of bounded sketches stay exact
+    QuantileSketch boundedMerge = QuantileSketch(0.01, 64);
+    QuantileSketch pairs[2] = {QuantileSketch(0.01, 64), QuantileSketch(0.01, 64)};
+    for(size_t i=0; i < boundedParts.size(); i++){
+        boundedMerge.merge(boundedParts[i]);
+        pairs[i % 2].merge(boundedParts[i]);
+    }
+    pairs[1].merge(pairs[0]);
+    CHECK(bounded.getNumBuckets() <= 64);
+    CHECK(boundedMerge == bounded);
+    CHECK(pairs[1] == bounded);
+    CHECK(std::fabs(bounded.quantile(0.99) - values[(size_t)(0.99 * (values.size() - 1))]) <= 0.01 * values[(size_t)(0.99 * (values.size() - 1))]);
+
+    CHECK_THROWS_AS(sketch.merge(bounded), std::invalid_argument);
+    CHECK_THROWS_AS(sketch.merge(QuantileSketch(0.02)), std::invalid_argument);
+
+    sketch.serialize(bytes);
+    CHECK(QuantileSketch::deserialize(bytes.data(), bytes.size()) == sketch);
+    CHECK_THROWS_AS(QuantileSketch::deserialize(bytes.data(), bytes.size() - 1), std::runtime_error);
+
+    sketch.clear();
+    CHECK(sketch.getCount() == 0);
+    CHECK(sketch.getNumBuckets() == 0);
+}
+
+TEST_CASE("TC_30-2_QS_delayMetrics"){
+    Intersection inter = Intersection();
+    ArrivalGenerator gen = ArrivalGenerator(30);
+    DelayMetrics metrics = DelayMetrics(60.0, 1.0);
+    const int numTicks = 3000;
+    std::array<QuantileSketch, Road::numRoadDirections> queueSketches, delaySketches;
+    std::array<std::vector<double>, Road::numRoadDirections> delays;
+    std::array<std::vector<unsigned long>, NUM_LANE_GROUPS> waiting;
+    std::array<unsigned long, NUM_LANE_GROUPS> lastA = {}, lastD = {};
+    QuantileSketch intersectionQueues = QuantileSketch();
+
+    refreshRateHzGlobal = 10;
+
+    inter.addRoad(Road::north, {3, 4, 5});
+    inter.addRoad(Road::east, {0, 1, 0});
+    inter.addRoad(Road::west, {2, 3, 1});
+    inter.setExitRoad(Road::north, new Road(Road::north, {3,4,5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::east, new Road(Road::east, {0,1,0}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::west, new Road(Road::west, {2,3,1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.setExitRoad(Road::south, new Road(Road::south, {1,2,3}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    inter.schedule(LightConfig::singleGreen, Road::north, 3.0, 1.0);
+    inter.schedule(LightConfig::singleGreen, Road::east, 2.0, 1.0);
+    inter.schedule(LightConfig::singleGreen, Road::west, 3.0, 1.0);
+    inter.setAllRedDuration(0.5);
+    inter.setAutoSequence(true);
+
+    gen.setAllArrivals(ArrivalProcess::poissonArrivals(400));
+    inter.setArrivals(&gen);
+    inter.setDelayMetrics(&metrics);
+    inter.start();
+
+    /// Replay the curves first in, first out to get every vehicle's delay
+    for(unsigned long t=1; t <= numTicks; t++){
+        std::array<unsigned int, Road::numRoadDirections> approachQueues = {};
+        unsigned int total = 0;
+
+        inter.tick();
+
+        for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+            Road* rd = inter.getRoad(Road::laneGroupDirection(lane));
+            TurnOption* turnOpt = (rd == NULL) ? NULL : rd->getTurnOption(Road::laneGroupTurn(lane));
+
+            if(turnOpt == NULL || ! turnOpt->isValid()){
+                continue;
+            }
+
+            for(; lastA[lane] < turnOpt->getCumulativeArrivals(); lastA[lane]++){
+                waiting[lane].push_back(t);
+            }
+            for(; lastD[lane] < turnOpt->getCumulativeDepartures(); lastD[lane]++){
+                delays[Road::laneGroupDirection(lane)].push_back((t - waiting[lane].front()) / 10.0);
+                delaySketches[Road::laneGroupDirection(lane)].add((t - waiting[lane].front()) / 10.0);
+                waiting[lane].erase(waiting[lane].begin());
+            }
+            approachQueues[Road::laneGroupDirection(lane)] += turnOpt->getQueuedVehicles();
+        }
+
+        for(int dir=0; dir < Road::numRoadDirections; dir++){
+            if(inter.getRoad((Road::RoadDirection)dir) != NULL){
+                queueSketches[dir].add(approachQueues[dir]);
+                total += approachQueues[dir];
+            }
+        }
+        intersectionQueues.add(total);
+    }
+
+    QuantileSketch allDelays = QuantileSketch();
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        CHECK(metrics.getQueueSketch(dir) == queueSketches[dir]);
+        CHECK(metrics.getDelaySketch(dir) == delaySketches[dir]);
+        allDelays.merge(metrics.getDelaySketch(dir));
+
+        if(delays[dir].empty()){
+            continue;
+        }
+
+        std::sort(delays[dir].begin(), delays[dir].end());
+        for(double q : {0.5, 0.95, 0.99}){
+            double exact = delays[dir][(size_t)(q * (delays[dir].size() - 1))];
+            CHECK(std::fabs(metrics.getDelaySketch(dir).quantile(q) - exact) <= 0.01 * exact);
+        }
+    }
+
+    CHECK(metrics.getQueueSketch(Road::north).getCount() == numTicks);
+    CHECK(metrics.getQueueSketch(Road::south).getCount() == 0);
+    CHECK(metrics.getIntersectionQueueSketch() == intersectionQueues);
+    CHECK(metrics.getIntersectionDelaySketch() == allDelays);
+    CHECK(allDelays.getCount() == metrics.getIntersectionTotal().departures);
+    CHECK(allDelays.getCount() > 0);
+    CHECK_THROWS_AS(metrics.getQueueSketch((Road::RoadDirection)7), std::out_of_range);
+    CHECK_THROWS_AS(DelayMetrics(60.0, 1.0, 1.0), std::domain_error);
+
+    std::ostringstream summary;
+    metrics.printSummary(summary);
+    CHECK(summary.str().find("approach") != std::string::npos);
+
+    inter.setDelayMetrics(NULL);
+    inter.setArrivals(NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Keeps every trip a VehiclePool finishes.
+ */
+class RecordingTripSink : public TripSink{
+public:
+    struct Trip{
+        VehicleRecord vehicle;
+        unsigned long departureTick;
+        bool completed;
+    };
+
+    std::vector<Trip> trips;
+
+    void trip(const VehicleRecord& vehicle, unsigned long departureTick, bool completed) override{
+        trips.push_back({vehicle, departureTick, completed});
+    }
+};
+
+/**
+ * @brief Checks every TurnOption of "inter" holds as many vehicle records as queued vehicles.
+ */
+static void checkRingsMatchQueues(Intersection& inter){
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        Road* rd = inter.getRoad(Road::laneGroupDirection(lane));
+        TurnOption* turnOpt = (rd == NULL) ? NULL : rd->getTurnOption(Road::laneGroupTurn(lane));
+
+        if(turnOpt != NULL && turnOpt->isValid()){
+            REQUIRE(turnOpt->getVehicles() != NULL);
+            CHECK(turnOpt->getVehicles()->getSize() == turnOpt->getQueuedVehicles());
+        }
+    }
+}
+
+/**
+ * @brief Gives "inter" empty exit Roads of 3, 4 and 5 lanes, more than any one tick's crossings can fill.
+ */
+static void emptyExitRoads(Intersection& inter){
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        Road* exitRoad = inter.getExitRoad(dir);
+
+        inter.setExitRoad(dir, new Road(dir, {3, 4, 5}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        delete exitRoad;
+    }
+}
+
+TEST_CASE("TC_31-1_VP_agentMode"){
+    Intersection agents = Intersection();
+    Intersection counts = Intersection();
+    ArrivalGenerator agentGen = ArrivalGenerator(31);
+    ArrivalGenerator countGen = ArrivalGenerator(31);
+    RecordingTripSink sink = RecordingTripSink();
+    VehiclePool pool = VehiclePool(1000, &sink);
+    DelayMetrics metrics = DelayMetrics();
+    QuantileSketch tripTimes = QuantileSketch();
+    const int numTicks = 4000;
+
+    refreshRateHzGlobal = 10;
+
+    for(Intersection* inter : {&agents, &counts}){
+        inter->addRoad(Road::north, {3, 4, 5});
+        inter->addRoad(Road::east, {0, 1, 0});
+        inter->addRoad(Road::west, {2, 3, 1});
+        inter->addRoad(Road::south, {1, 2, 3});
+        emptyExitRoads(*inter);
+        inter->schedule(LightConfig::doubleGreen, Road::north, 3.0, 1.0);
+        inter->schedule(LightConfig::doubleGreenLeft, Road::north, 2.0, 1.0);
+        inter->schedule(LightConfig::singleGreen, Road::west, 3.0, 1.0);
+        inter->schedule(LightConfig::singleGreen, Road::east, 2.0, 1.0);
+        inter->setAllRedDuration(0.5);
+        inter->setAutoSequence(true);
+    }
+    agentGen.setAllArrivals(ArrivalProcess::poissonArrivals(300));
+    countGen.setAllArrivals(ArrivalProcess::poissonArrivals(300));
+    agents.setArrivals(&agentGen);
+    counts.setArrivals(&countGen);
+
+    agents.setVehiclePool(&pool);
+    agents.setDelayMetrics(&metrics);
+    CHECK(pool.getNumAllocated() == (size_t)(12 + 1 + 6 + 6) * DEFAULT_MAX_LANE_VEHICLES);
+    checkRingsMatchQueues(agents);
+
+    agents.start();
+    counts.start();
+
+    for(int t=0; t < numTicks; t++){
+        agents.tick();
+        counts.tick();
+        emptyExitRoads(agents);
+        emptyExitRoads(counts);
+
+        for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+            Road* rd = agents.getRoad(Road::laneGroupDirection(lane));
+            TurnOption* turnOpt = rd->getTurnOption(Road::laneGroupTurn(lane));
+            TurnOption* countOpt = counts.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane));
+
+            CHECK(turnOpt->getQueuedVehicles() == countOpt->getQueuedVehicles());
+            CHECK(turnOpt->getCumulativeDepartures() == countOpt->getCumulativeDepartures());
+        }
+        checkRingsMatchQueues(agents);
+    }
+
+    /// Every vehicle leaves through a count-based exit Road, first in first out
+    unsigned long numDepartures = metrics.getIntersectionTotal().departures;
+    CHECK(sink.trips.size() == numDepartures);
+    CHECK(pool.getNumTrips() == numDepartures);
+    CHECK(pool.getNumLive() == metrics.getIntersectionTotal().arrivals - numDepartures);
+    CHECK(numDepartures > 50);
+
+    std::vector<uint32_t> ids;
+    for(RecordingTripSink::Trip& trip : sink.trips){
+        CHECK(trip.completed);
+        CHECK(trip.departureTick > trip.vehicle.arrivalTick);
+        CHECK(trip.departureTick <= (unsigned long)numTicks);
+        ids.push_back(trip.vehicle.id);
+        tripTimes.add((trip.departureTick - trip.vehicle.arrivalTick) / 10.0);
+    }
+    std::sort(ids.begin(), ids.end());
+    CHECK(std::adjacent_find(ids.begin(), ids.end()) == ids.end());
+
+    /// The trip times are the delays DelayMetrics matched from the curves
+    CHECK(tripTimes == metrics.getIntersectionDelaySketch());
+
+    /// Routes are the lane the vehicle entered by
+    VehicleRing* northLeft = agents.getRoad(Road::north)->getTurnOption(TurnOption::left)->getVehicles();
+    for(uint32_t i=0; i < northLeft->getSize(); i++){
+        CHECK(northLeft->at(i).routeIndex == northLeft->getLaneId());
+        if(i > 0){
+            CHECK(northLeft->at(i).arrivalTick >= northLeft->at(i - 1).arrivalTick);
+        }
+    }
+    CHECK_THROWS_AS(northLeft->at(northLeft->getSize()), std::out_of_range);
+
+    /// Back to counts only
+    agents.setVehiclePool(NULL);
+    CHECK(pool.getNumLive() == 0);
+    CHECK(agents.getRoad(Road::north)->getTurnOption(TurnOption::left)->getVehicles() == NULL);
+
+    agents.setDelayMetrics(NULL);
+    agents.setArrivals(NULL);
+    counts.setArrivals(NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_31-2_VP_chain"){
+    Intersection first = Intersection();
+    Intersection second = Intersection();
+    Intersection other = Intersection();
+    ArrivalGenerator gen = ArrivalGenerator(32);
+    RecordingTripSink sink = RecordingTripSink();
+    VehiclePool pool = VehiclePool(400, &sink);
+    VehiclePool tiny = VehiclePool(10);
+    std::ostringstream csv;
+    const int numTicks = 3000;
+    unsigned long numCreated = 0;
+
+    refreshRateHzGlobal = 10;
+
+    for(Intersection* inter : {&first, &second, &other}){
+        inter->addRoad(Road::north, {1, 2, 1});
+        inter->addRoad(Road::east, {1, 2, 1});
+        inter->addRoad(Road::west, {1, 2, 1});
+        inter->addRoad(Road::south, {1, 2, 1});
+        inter->schedule(LightConfig::doubleGreen, Road::north, 2.0, 1.0);
+        inter->schedule(LightConfig::doubleGreen, Road::east, 2.0, 1.0);
+        inter->setAllRedDuration(0.5);
+        inter->setAutoSequence(true);
+    }
+
+    /// Vehicles leaving "first" queue up on the roads of "second", then leave the network
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        first.setExitRoad(dir, second.getRoad(dir));
+        second.setExitRoad(dir, new Road(dir, {1, 2, 1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        other.setExitRoad(dir, new Road(dir, {1, 2, 1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    }
+
+    CHECK_THROWS_AS(other.setVehiclePool(&tiny), std::length_error);
+    CHECK(other.getVehiclePool() == NULL);
+    other.setVehiclePool(&pool);
+    CHECK_THROWS_AS(pool.attach(other), std::logic_error);
+    other.setVehiclePool(NULL);
+
+    gen.setAllArrivals(ArrivalProcess::poissonArrivals(600));
+    first.setArrivals(&gen);
+    first.getRoad(Road::north)->getTurnOption(TurnOption::straight)->addVehicles(4);
+    first.setVehiclePool(&pool);
+    second.setVehiclePool(&pool);
+    first.start();
+    second.start();
+
+    for(int t=0; t < numTicks; t++){
+        first.tick();
+        second.tick();
+        checkRingsMatchQueues(first);
+        checkRingsMatchQueues(second);
+    }
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        numCreated += first.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane))->getCumulativeArrivals();
+    }
+
+    /// Vehicles are only created on "first", none disappear
+    CHECK(pool.getNumLive() + pool.getNumTrips() == numCreated);
+    CHECK(sink.trips.size() == pool.getNumTrips());
+    CHECK(pool.getNumTrips() > 50);
+
+    unsigned long numCompleted = 0;
+    for(RecordingTripSink::Trip& trip : sink.trips){
+        /// Every route started on "first", whose lanes came after the 12 given to "other"
+        CHECK(trip.vehicle.routeIndex >= 12);
+        CHECK(trip.vehicle.routeIndex < 24);
+        numCompleted += trip.completed;
+    }
+    CHECK(numCompleted + pool.getNumLost() == pool.getNumTrips());
+
+    TripStream stream = TripStream(csv);
+    stream.trip({7, 10, 3}, 35, true);
+    CHECK(csv.str() == "id,route,arrivalTick,departureTick,tripSeconds,completed\n7,3,10,35,2.5,1\n");
+
+    first.setVehiclePool(NULL);
+    second.setVehiclePool(NULL);
+    CHECK(pool.getNumLive() == 0);
+    first.setArrivals(NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Adds a "rows" x "cols" grid of Intersections to "net", node r * cols + c, with every neighbor connected both
+ *          ways except exit "skipExit" of node "skipNode". The other exits leave the network.
+ */
+static void buildGrid(RoadNetwork& net, std::deque<Intersection>& inters, int rows, int cols, int skipNode=-1, Road::RoadDirection skipExit=Road::north){
+    for(int node=0; node < rows * cols; node++){
+        Intersection& inter = inters.emplace_back();
+
+        inter.addRoad(Road::north, {1, 2, 1});
+        inter.addRoad(Road::east, {1, 2, 1});
+        inter.addRoad(Road::west, {1, 2, 1});
+        inter.addRoad(Road::south, {1, 2, 1});
+        inter.schedule(LightConfig::doubleGreen, Road::north, 2.0, 1.0);
+        inter.schedule(LightConfig::doubleGreenLeft, Road::north, 2.0, 1.0);
+        inter.schedule(LightConfig::doubleGreen, Road::east, 2.0, 1.0);
+        inter.schedule(LightConfig::doubleGreenLeft, Road::east, 2.0, 1.0);
+        inter.setAllRedDuration(0.5);
+        inter.setAutoSequence(true);
+        CHECK(net.addIntersection(inter) == node);
+    }
+
+    for(int r=0; r < rows; r++){
+        for(int c=0; c < cols; c++){
+            int node = r * cols + c;
+            auto link = [&](Road::RoadDirection exitDir, int toNode, Road::RoadDirection roadDir){
+                if( ! (node == skipNode && exitDir == skipExit)){
+                    net.connect(node, exitDir, toNode, roadDir);
+                }
+            };
+
+            if(c + 1 < cols){ link(Road::east, node + 1, Road::west); }
+            if(c > 0){ link(Road::west, node - 1, Road::east); }
+            if(r + 1 < rows){ link(Road::south, node + cols, Road::north); }
+            if(r > 0){ link(Road::north, node - cols, Road::south); }
+
+            for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+                if(inters[node].getExitRoad(dir) == NULL){
+                    inters[node].setExitRoad(dir, new Road(dir, {1, 2, 1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Counts the entries of the next hop and hop count tables that differ between "a" and "b".
+ */
+static int countTableDifferences(RoadNetwork& a, RoadNetwork& b){
+    int numDifferent = 0;
+
+    for(int node=0; node < a.getNumIntersections(); node++){
+        for(Road::RoadDirection road : {Road::north, Road::east, Road::south, Road::west}){
+            for(uint32_t dest=0; dest < a.getNumDestinations(); dest++){
+                numDifferent += a.nextTurn(node, road, dest) != b.nextTurn(node, road, dest);
+                numDifferent += a.hopCount(node, road, dest) != b.hopCount(node, road, dest);
+            }
+        }
+    }
+
+    return numDifferent;
+}
+
+/**
+ * @brief Follows the next hops from every Road to every destination and counts the paths that do not leave by their
+ *          destination after hopCount() Intersections.
+ */
+static int countBrokenPaths(RoadNetwork& net){
+    int numBroken = 0;
+
+    for(int start=0; start < net.getNumIntersections(); start++){
+        for(Road::RoadDirection startRoad : {Road::north, Road::east, Road::south, Road::west}){
+            for(uint32_t dest=0; dest < net.getNumDestinations(); dest++){
+                int node = start;
+                Road::RoadDirection road = startRoad;
+                int numHops = net.hopCount(node, road, dest);
+
+                for(int hop=numHops; hop > 0; hop--){
+                    Road::RoadDirection exitDir = Road::exitRoadDirection(road, net.nextTurn(node, road, dest));
+
+                    if(net.hopCount(node, road, dest) != hop || ! net.roadIsOpen(node, exitDir)){
+                        numBroken++;
+                        break;
+                    }
+
+                    if(hop == 1){
+                        numBroken += net.destination(node, exitDir) != dest;
+                        break;
+                    }
+
+                    const RoadNetwork::Link& link = net.getLink(node, exitDir);
+                    if(link.toNode < 0){
+                        numBroken++;
+                        break;
+                    }
+
+                    node = link.toNode;
+                    road = link.toRoad;
+                }
+            }
+        }
+    }
+
+    return numBroken;
+}
+
+TEST_CASE("TC_32-1_RN_tables"){
+    std::deque<Intersection> inters;
+    RoadNetwork net = RoadNetwork(0, 4);
+    std::deque<Intersection> freshInters;
+    RoadNetwork fresh = RoadNetwork(0, 1);
+    Intersection extra = Intersection();
+
+    /// A 2x3 grid missing the link from node 1 east to node 2
+    buildGrid(net, inters, 2, 3, 1, Road::east);
+    CHECK(net.getNumDestinations() == 24);
+    CHECK(net.updateTables() == 11);
+    CHECK(net.updateTables() == 0);
+    CHECK(countBrokenPaths(net) == 0);
+
+    /// Leaving by the exit itself crosses one Intersection, from node 0 to the east edge of node 5 crosses four
+    uint32_t eastOf5 = net.destination(5, Road::east);
+    CHECK(net.hopCount(5, Road::west, eastOf5) == 1);
+    CHECK(net.nextTurn(5, Road::west, eastOf5) == TurnOption::straight);
+    CHECK(net.hopCount(0, Road::west, eastOf5) == 4);
+
+    /// Links inside the network are not destinations
+    CHECK(net.hopCount(0, Road::west, net.destination(0, Road::east)) == -1);
+    CHECK(net.hopCount(0, Road::west, net.destination(1, Road::east)) == 2);
+
+    /// Adding the missing road rebuilds only the destinations it shortens or ties
+    net.connect(1, Road::east, 2, Road::west);
+    int numRebuilt = net.updateTables();
+    CHECK(numRebuilt > 0);
+    CHECK(numRebuilt < 11);
+    CHECK(net.hopCount(0, Road::west, eastOf5) == 4);
+    CHECK(net.hopCount(0, Road::west, net.destination(1, Road::east)) == -1);
+
+    buildGrid(fresh, freshInters, 2, 3);
+    fresh.updateTables();
+    CHECK(countTableDifferences(net, fresh) == 0);
+
+    /// Closing a road takes it out of every path, opening it restores the tables
+    net.closeRoad(0, Road::east);
+    fresh.closeRoad(0, Road::east);
+    CHECK(net.roadIsOpen(0, Road::east) == false);
+    numRebuilt = net.updateTables();
+    CHECK(numRebuilt > 0);
+    CHECK(numRebuilt < 11);
+    CHECK(countBrokenPaths(net) == 0);
+
+    std::deque<Intersection> closedInters;
+    RoadNetwork closed = RoadNetwork(0, 1);
+    buildGrid(closed, closedInters, 2, 3);
+    closed.closeRoad(0, Road::east);
+    closed.updateTables();
+    CHECK(countTableDifferences(net, closed) == 0);
+
+    net.openRoad(0, Road::east);
+    net.updateTables();
+    fresh.openRoad(0, Road::east);
+    fresh.updateTables();
+    CHECK(countTableDifferences(net, fresh) == 0);
+
+    /// Closing an edge exit removes only that destination
+    net.closeRoad(5, Road::east);
+    CHECK(net.updateTables() == 1);
+    CHECK(net.hopCount(5, Road::west, eastOf5) == -1);
+    net.openRoad(5, Road::east);
+    CHECK(net.updateTables() == 1);
+
+    /// Built on one thread or several, the tables are the same
+    std::deque<Intersection> bigInters, bigSerialInters;
+    RoadNetwork big = RoadNetwork(0, 4);
+    RoadNetwork bigSerial = RoadNetwork(0, 1);
+    buildGrid(big, bigInters, 6, 6);
+    buildGrid(bigSerial, bigSerialInters, 6, 6);
+    CHECK(big.updateTables() == 24);
+    CHECK(bigSerial.updateTables() == 24);
+    CHECK(countTableDifferences(big, bigSerial) == 0);
+    CHECK(countBrokenPaths(big) == 0);
+    CHECK(big.hopCount(0, Road::west, big.destination(35, Road::east)) == 11);
+
+    CHECK_THROWS_AS(net.addIntersection(inters[0]), std::logic_error);
+    CHECK_THROWS_AS(net.connect(0, Road::east, 1, Road::west), std::logic_error);
+    CHECK_THROWS_AS(net.connect(6, Road::east, 1, Road::west), std::out_of_range);
+    CHECK_THROWS_AS(net.nextTurn(0, Road::west, 24), std::out_of_range);
+    CHECK_THROWS_AS(net.addDemand(0, Road::west, 0, -1), std::domain_error);
+
+    extra.addRoad(Road::north, {1, 2, 1});
+    extra.addRoad(Road::east, {1, 2, 1});
+    extra.addRoad(Road::south, {1, 2, 1});
+    int extraNode = net.addIntersection(extra);
+    CHECK(extra.getRoadNetwork() == &net);
+    CHECK(extra.getNetworkNode() == extraNode);
+    CHECK_THROWS_AS(net.connect(5, Road::east, extraNode, Road::west), std::invalid_argument);
+    CHECK_THROWS_AS(net.addDemand(extraNode, Road::west, 0, 100), std::invalid_argument);
+}
+
+TEST_CASE("TC_32-2_RN_demand"){
+    std::deque<Intersection> inters;
+    RoadNetwork net = RoadNetwork(32, 2);
+    RecordingTripSink sink = RecordingTripSink();
+    VehiclePool pool = VehiclePool(2000, &sink);
+    const int numTicks = 6000;
+    unsigned long numCompleted = 0;
+
+    refreshRateHzGlobal = 10;
+
+    buildGrid(net, inters, 2, 2);
+    uint32_t eastOf3 = net.destination(3, Road::east);
+    uint32_t westOf0 = net.destination(0, Road::west);
+    uint32_t southOf2 = net.destination(2, Road::south);
+
+    net.addDemand(0, Road::north, eastOf3, 300);
+    net.addDemand(3, Road::south, westOf0, 300);
+    net.addDemand(1, Road::east, southOf2, 300);
+    /// Not a way out of the network
+    net.addDemand(1, Road::north, net.destination(0, Road::east), 300);
+
+    for(Intersection& inter : inters){
+        inter.setVehiclePool(&pool);
+        inter.start();
+    }
+
+    for(int t=0; t < numTicks; t++){
+        if(t == numTicks / 2){
+            /// Vehicles for the east edge of node 3 now go south through node 2
+            net.closeRoad(0, Road::east);
+        }
+
+        net.tick();
+
+        for(Intersection& inter : inters){
+            checkRingsMatchQueues(inter);
+        }
+    }
+
+    CHECK(net.getNumODArrivals() > 100);
+    CHECK(net.getNumUnroutable() > 0);
+    CHECK(pool.getNumLive() + pool.getNumTrips() == net.getNumODArrivals());
+    CHECK(sink.trips.size() == pool.getNumTrips());
+    CHECK(pool.getNumTrips() > 30);
+
+    /// Every vehicle that made it left by its destination
+    std::map<uint32_t, unsigned long> completedTo;
+    for(RecordingTripSink::Trip& trip : sink.trips){
+        REQUIRE((trip.vehicle.routeIndex & ROUTE_DESTINATION_FLAG) != 0);
+
+        if(trip.completed){
+            completedTo[trip.vehicle.routeIndex & ~ROUTE_DESTINATION_FLAG]++;
+            numCompleted++;
+        }
+    }
+    CHECK(numCompleted + pool.getNumLost() == pool.getNumTrips());
+
+    for(int node=0; node < 4; node++){
+        for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+            unsigned long numLeft = 0;
+
+            if(net.getLink(node, dir).toNode >= 0){
+                continue;
+            }
+
+            for(int turn=0; turn < TurnOption::numTurnOptions; turn++){
+                numLeft += inters[node].getExitRoad(dir)->getTurnOption((TurnOption::Type)turn)->getCumulativeArrivals();
+            }
+
+            CHECK(numLeft == completedTo[net.destination(node, dir)]);
+        }
+    }
+    CHECK(completedTo[eastOf3] > 0);
+    CHECK(completedTo[westOf0] > 0);
+    CHECK(completedTo[southOf2] > 0);
+
+    /// In the count-based mode demand still joins the lane of its first hop
+    for(Intersection& inter : inters){
+        inter.setVehiclePool(NULL);
+    }
+    net.clearDemand();
+    net.addDemand(0, Road::north, eastOf3, 3600);
+
+    TurnOption* firstHop = inters[0].getRoad(Road::north)->getTurnOption(net.nextTurn(0, Road::north, eastOf3));
+    unsigned long arrivalsBefore = firstHop->getCumulativeArrivals();
+    unsigned long odArrivalsBefore = net.getNumODArrivals();
+    net.inject(inters[0]);
+    CHECK(firstHop->getCumulativeArrivals() - arrivalsBefore == net.getNumODArrivals() - odArrivalsBefore);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief A SignalController that picks a LightConfig that is not scheduled.
+ */
+class OutOfScheduleController : public SignalController{
+public:
+    Decision nextPhase(Intersection& inter, int current) override{ return {7, -1}; }
+    bool endGreen(Intersection& inter, int phase, unsigned long greenTicks, unsigned long idleTicks) override{ return false; }
+};
+
+/**
+ * @brief Adds four Roads with exit Roads to "inter" and schedules doubleGreen north then east, both 10 seconds.
+ */
+static void buildActuatedIntersection(Intersection& inter){
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        inter.addRoad(dir, {1, 2, 1});
+        inter.setExitRoad(dir, new Road(dir, {1, 2, 1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    }
+
+    inter.schedule(LightConfig::doubleGreen, Road::north, 10.0, 1.0);
+    inter.schedule(LightConfig::doubleGreen, Road::east, 10.0, 1.0);
+    inter.setAllRedDuration(0.5);
+    inter.setAutoSequence(true);
+}
+
+/**
+ * @brief Replaces every exit Road of "inter" with an empty one, as if the vehicles had driven off.
+ */
+static void drainExitRoads(Intersection& inter){
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        Road* exitRoad = inter.getExitRoad(dir);
+
+        inter.setExitRoad(dir, new Road(dir, {1, 2, 1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+        delete exitRoad;
+    }
+}
+
+/**
+ * @brief Ticks "inter" until the north straight light is no longer green and returns the number of ticks.
+ */
+static int ticksUntilNorthNotGreen(Intersection& inter, bool keepQueued){
+    int numTicks = 0;
+
+    while(inter.getLight(Road::north, TurnOption::straight)->isGreen() && numTicks < 1000){
+        if(keepQueued){
+            inter.addVehicles(Road::north, TurnOption::straight, 1);
+        }
+        inter.tick();
+        numTicks++;
+    }
+
+    return numTicks;
+}
+
+TEST_CASE("TC_33-1_SC_actuated"){
+    Intersection inter = Intersection();
+    Intersection busy = Intersection();
+    ActuatedController ctrl = ActuatedController(2.0, 20.0, 1.0);
+    ActuatedController shortMax = ActuatedController(2.0, 5.0, 1.0);
+    OutOfScheduleController outOfSchedule = OutOfScheduleController();
+    Intersection restored = Intersection();
+    Intersection uncontrolled = Intersection();
+    CompactIntersection busyState, restoredState;
+    std::string path = (std::filesystem::temp_directory_path() / "TC_33-1.snapshot").string();
+
+    refreshRateHzGlobal = 10;
+
+    CHECK_THROWS_AS(ActuatedController(5.0, 2.0, 1.0), std::domain_error);
+    CHECK_THROWS_AS(ActuatedController(0.0, 0.0, 1.0), std::domain_error);
+    CHECK_THROWS_AS(ActuatedController(1.0, 2.0, -1.0), std::domain_error);
+
+    buildActuatedIntersection(inter);
+    inter.schedule(LightConfig::singleGreen, Road::west, 10.0, 1.0);
+    inter.setSignalController(&ctrl);
+    CHECK(inter.getSignalController() == &ctrl);
+
+    /// Phases without queued vehicles are skipped, the chosen one may stay green up to the maximum
+    CHECK(ctrl.nextPhase(inter, 0).phase == 1);
+    CHECK(ctrl.nextPhase(inter, 0).greenTicks == 20);
+    inter.addVehicles(Road::west, TurnOption::left, 1);
+    CHECK(ctrl.nextPhase(inter, 0).phase == 2);
+    CHECK(ctrl.nextPhase(inter, 0).greenTicks == 200);
+    inter.addVehicles(Road::south, TurnOption::right, 1);
+    CHECK(ctrl.nextPhase(inter, 0).phase == 2);
+    CHECK(ctrl.nextPhase(inter, 2).phase == 0);
+    inter.addVehicles(Road::east, TurnOption::straight, 1);
+    CHECK(ctrl.nextPhase(inter, 0).phase == 1);
+
+    /// Gap-out: two vehicles cross together in 2 seconds, then the lanes stay empty for the 1 second gap
+    buildActuatedIntersection(busy);
+    busy.setSignalController(&ctrl);
+    busy.addVehicles(Road::north, TurnOption::straight, 2);
+    busy.start();
+    int greenTicks = ticksUntilNorthNotGreen(busy, false);
+    CHECK(greenTicks >= 20);
+    CHECK(greenTicks < 40);
+    CHECK(busy.getLight(Road::north, TurnOption::straight)->isYellow());
+    CHECK(busy.getLight(Road::north, TurnOption::right)->isYellow());
+
+    /// Max-out: a queue that never empties ends the green after the maximum, the idle east phase is skipped
+    busy.setSignalController(&shortMax);
+    while( ! busy.getLight(Road::north, TurnOption::straight)->isGreen()){
+        busy.addVehicles(Road::north, TurnOption::straight, 1);
+        CHECK_FALSE(busy.getLight(Road::east, TurnOption::straight)->isGreen());
+        busy.tick();
+    }
+    for(int i=0; i < 3; i++){
+        CHECK(ticksUntilNorthNotGreen(busy, true) == 50);
+
+        while( ! busy.getLight(Road::north, TurnOption::straight)->isGreen()){
+            busy.addVehicles(Road::north, TurnOption::straight, 1);
+            CHECK_FALSE(busy.getLight(Road::east, TurnOption::straight)->isGreen());
+            busy.tick();
+        }
+        CHECK(busy.getConfigScheduleIdx() == 0);
+    }
+
+    /// A snapshot taken mid-green carries the green and idle ticks, the restored copy ends the green on the same tick
+    for(int i=0; i < 20; i++){
+        busy.addVehicles(Road::north, TurnOption::straight, 1);
+        busy.tick();
+    }
+    busyState.pack(busy);
+    CHECK(busyState.isControlled());
+    CHECK(busyState.getPhaseGreenTicks() == 20);
+    Snapshot::save(path, {&busy});
+    {
+        Snapshot snapshot = Snapshot(path);
+
+        CHECK_THROWS_AS(snapshot.restore(0, uncontrolled), std::logic_error);
+        snapshot.restore(0, restored, &shortMax);
+    }
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        restored.setExitRoad(dir, new Road(dir, {1, 2, 1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+
+        for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+            restored.getExitRoad(dir)->getTurnOption((TurnOption::Type)opt)->addVehicles(busy.getExitRoad(dir)->getTurnOption((TurnOption::Type)opt)->getQueuedVehicles());
+        }
+    }
+    for(int i=0; i < 300; i++){
+        busy.addVehicles(Road::north, TurnOption::straight, i % 2);
+        restored.addVehicles(Road::north, TurnOption::straight, i % 2);
+        busy.tick();
+        restored.tick();
+
+        busyState.pack(busy);
+        restoredState.pack(restored);
+        CHECK(restoredState.hash() == busyState.hash());
+    }
+    std::filesystem::remove(path);
+
+    /// The controller also decides manual moves
+    busy.setSignalController(&outOfSchedule);
+    CHECK_THROWS_AS(busy.nextLightConfig(), std::out_of_range);
+    busy.setSignalController(NULL);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_33-2_SC_actuatedThroughput"){
+    Intersection fixed = Intersection();
+    Intersection actuated = Intersection();
+    ArrivalGenerator fixedGen = ArrivalGenerator(33);
+    ArrivalGenerator actuatedGen = ArrivalGenerator(33);
+    ActuatedController ctrl = ActuatedController(2.0, 20.0, 1.0);
+    unsigned long fixedDepartures = 0, actuatedDepartures = 0;
+    unsigned long fixedQueued = 0, actuatedQueued = 0;
+    const int numTicks = 12000;
+
+    refreshRateHzGlobal = 10;
+
+    /// Heavy north-south traffic, light east-west traffic
+    for(ArrivalGenerator* gen : {&fixedGen, &actuatedGen}){
+        gen->setArrivals(Road::north, TurnOption::straight, ArrivalProcess::poissonArrivals(900));
+        gen->setArrivals(Road::south, TurnOption::straight, ArrivalProcess::poissonArrivals(900));
+        gen->setArrivals(Road::east, TurnOption::straight, ArrivalProcess::poissonArrivals(60));
+        gen->setArrivals(Road::west, TurnOption::straight, ArrivalProcess::poissonArrivals(60));
+    }
+
+    buildActuatedIntersection(fixed);
+    buildActuatedIntersection(actuated);
+    fixed.setArrivals(&fixedGen);
+    actuated.setArrivals(&actuatedGen);
+    actuated.setSignalController(&ctrl);
+    fixed.start();
+    actuated.start();
+
+    for(int t=0; t < numTicks; t++){
+        fixed.tick();
+        actuated.tick();
+        drainExitRoads(fixed);
+        drainExitRoads(actuated);
+
+        for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+            fixedQueued += fixed.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane))->getQueuedVehicles();
+            actuatedQueued += actuated.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane))->getQueuedVehicles();
+        }
+    }
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        fixedDepartures += fixed.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane))->getCumulativeDepartures();
+        actuatedDepartures += actuated.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane))->getCumulativeDepartures();
+    }
+
+    /// Serves at least as many vehicles while they wait far less, east-west greens are cut short
+    CHECK(actuatedDepartures >= fixedDepartures);
+    CHECK(actuatedQueued * 3 < fixedQueued * 2);
+
+    fixed.setArrivals(NULL);
+    actuated.setArrivals(NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Replaces every exit Road of "net" leaving the network with an empty one.
+ */
+static void drainNetworkExits(RoadNetwork& net){
+    for(int node=0; node < net.getNumIntersections(); node++){
+        for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+            Intersection* inter = net.getIntersection(node);
+            Road* exitRoad = inter->getExitRoad(dir);
+
+            if(net.getLink(node, dir).toNode < 0){
+                inter->setExitRoad(dir, new Road(dir, {1, 2, 1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+                delete exitRoad;
+            }
+        }
+    }
+}
+
+TEST_CASE("TC_34-1_MP_pressure"){
+    RoadNetwork net = RoadNetwork(0, 1);
+    std::deque<Intersection> inters;
+    MaxPressureController ctrl = MaxPressureController(net, 1);
+    RoadNetwork bigNet = RoadNetwork(0, 1);
+    std::deque<Intersection> bigInters;
+    MaxPressureController serial = MaxPressureController(bigNet, 1);
+    MaxPressureController parallel = MaxPressureController(bigNet, 4);
+    uint32_t lcg = 34;
+    int numDifferent = 0;
+
+    refreshRateHzGlobal = 10;
+
+    /// Node 0 is west of node 1
+    buildGrid(net, inters, 1, 2);
+
+    /// Nothing swept yet, the schedule runs in order
+    inters[0].setSignalController(&ctrl);
+    CHECK(ctrl.nextPhase(inters[0], 0).phase == 1);
+    CHECK(ctrl.nextPhase(inters[0], 3).phase == 0);
+    CHECK(ctrl.nextPhase(inters[0], 0).greenTicks == -1);
+
+    /// Node 0: 7 left turns from north and south onto empty exits beat 3 vehicles on two straight lanes
+    inters[0].getRoad(Road::north)->getTurnOption(TurnOption::left)->addVehicles(4);
+    inters[0].getRoad(Road::south)->getTurnOption(TurnOption::left)->addVehicles(3);
+    inters[0].getRoad(Road::north)->getTurnOption(TurnOption::straight)->addVehicles(3);
+    /// Node 1: 4 vehicles on two straight lanes going west
+    inters[1].getRoad(Road::east)->getTurnOption(TurnOption::straight)->addVehicles(4);
+
+    ctrl.sweep();
+    CHECK(ctrl.getNumSweeps() == 1);
+    CHECK(ctrl.getDecision(0) == 1);
+    CHECK(ctrl.getPressure(0) == 7);
+    CHECK(ctrl.getDecision(1) == 2);
+    CHECK(ctrl.getPressure(1) == 8);
+    CHECK(ctrl.nextPhase(inters[0], 0).phase == 1);
+    CHECK(MaxPressureController::phasePressure(inters[0], inters[0].getSignalPlan().getPhase(1)) == 7);
+    CHECK(MaxPressureController::phasePressure(inters[0], inters[0].getSignalPlan().getPhase(0)) == 6);
+
+    /// Node 1's westbound vehicles would join 5 already queued on node 0's east Road, pushing node 0 to serve them
+    inters[0].getRoad(Road::east)->getTurnOption(TurnOption::straight)->addVehicles(5);
+    CHECK(MaxPressureController::phasePressure(inters[1], inters[1].getSignalPlan().getPhase(2)) == -2);
+
+    /// Decisions only change with a sweep
+    CHECK(ctrl.getDecision(1) == 2);
+    ctrl.sweep();
+    CHECK(ctrl.getDecision(0) == 2);
+    CHECK(ctrl.getPressure(0) == 10);
+    /// Every other phase of node 1 has no pressure, the earliest wins the tie
+    CHECK(ctrl.getDecision(1) == 0);
+    CHECK(ctrl.getPressure(1) == 0);
+
+    /// The decision starts at the next phase boundary
+    inters[0].start();
+    CHECK(inters[0].getConfigScheduleIdx() == 0);
+    for(int t=0; t < 1000 && inters[0].getConfigScheduleIdx() == 0; t++){
+        inters[0].tick();
+    }
+    CHECK(inters[0].getConfigScheduleIdx() == 2);
+    inters[0].setSignalController(NULL);
+
+    /// Parallel and serial sweeps of the same snapshot agree
+    buildGrid(bigNet, bigInters, 16, 16);
+    for(Intersection& inter : bigInters){
+        for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+            lcg = lcg * 1664525 + 1013904223;
+            inter.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane))->addVehicles((lcg >> 8) % 6);
+        }
+    }
+
+    serial.sweep();
+    parallel.sweep();
+    CHECK(parallel.getNumThreads() == 4);
+    for(int node=0; node < bigNet.getNumIntersections(); node++){
+        numDifferent += serial.getDecision(node) != parallel.getDecision(node) || serial.getPressure(node) != parallel.getPressure(node);
+        CHECK(serial.getPressure(node) == MaxPressureController::phasePressure(bigInters[node], bigInters[node].getSignalPlan().getPhase(serial.getDecision(node))));
+    }
+    CHECK(numDifferent == 0);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_34-2_MP_gridThroughput"){
+    RoadNetwork fixedNet = RoadNetwork(0, 1);
+    RoadNetwork pressureNet = RoadNetwork(0, 1);
+    std::deque<Intersection> fixedInters, pressureInters;
+    std::deque<ArrivalGenerator> fixedGens, pressureGens;
+    MaxPressureController ctrl = MaxPressureController(pressureNet, 2);
+    unsigned long fixedQueued = 0, pressureQueued = 0;
+
+    refreshRateHzGlobal = 10;
+
+    buildGrid(fixedNet, fixedInters, 3, 3);
+    buildGrid(pressureNet, pressureInters, 3, 3);
+
+    /// Heavy southbound traffic enters the top row, light eastbound traffic the left column
+    for(int node=0; node < 9; node++){
+        ArrivalGenerator& fixedGen = fixedGens.emplace_back(34, node);
+        ArrivalGenerator& pressureGen = pressureGens.emplace_back(34, node);
+
+        for(ArrivalGenerator* gen : {&fixedGen, &pressureGen}){
+            if(node < 3){
+                gen->setArrivals(Road::north, TurnOption::straight, ArrivalProcess::poissonArrivals(900));
+            }
+            if(node % 3 == 0){
+                gen->setArrivals(Road::west, TurnOption::straight, ArrivalProcess::poissonArrivals(120));
+            }
+        }
+
+        fixedInters[node].setArrivals(&fixedGen);
+        pressureInters[node].setArrivals(&pressureGen);
+        pressureInters[node].setSignalController(&ctrl);
+        fixedInters[node].start();
+        pressureInters[node].start();
+    }
+
+    for(int t=0; t < 6000; t++){
+        fixedNet.tick();
+        ctrl.tick();
+        drainNetworkExits(fixedNet);
+        drainNetworkExits(pressureNet);
+
+        for(int node=0; node < 9; node++){
+            for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+                fixedQueued += fixedInters[node].getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane))->getQueuedVehicles();
+                pressureQueued += pressureInters[node].getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane))->getQueuedVehicles();
+            }
+        }
+    }
+
+    /// Greens follow the southbound queues instead of serving empty phases in turn
+    CHECK(ctrl.getNumSweeps() == 6000);
+    CHECK(pressureQueued * 2 < fixedQueued);
+
+    for(int node=0; node < 9; node++){
+        fixedInters[node].setArrivals(NULL);
+        pressureInters[node].setArrivals(NULL);
+        pressureInters[node].setSignalController(NULL);
+    }
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+static_assert(SignalPolicy<FixedPolicy>);
+static_assert(SignalPolicy<ActuatedController>);
+static_assert(SignalPolicy<MaxPressureController>);
+static_assert(SignalPolicy<SignalController>);
+static_assert( ! SignalPolicy<int>);
+
+/**
+ * @brief Checks the lights and queues of "a" and "b" match, counting the lane groups that differ.
+ */
+static int countIntersectionDifferences(Intersection& a, Intersection& b){
+    int numDifferent = a.getConfigScheduleIdx() != b.getConfigScheduleIdx();
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        TurnOption* turnOptA = a.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane));
+        TurnOption* turnOptB = b.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane));
+
+        if(turnOptA->isValid()){
+            numDifferent += turnOptA->getQueuedVehicles() != turnOptB->getQueuedVehicles()
+                            || turnOptA->getLight()->getColor() != turnOptB->getLight()->getColor()
+                            || turnOptA->getCumulativeDepartures() != turnOptB->getCumulativeDepartures();
+        }
+    }
+
+    return numDifferent;
+}
+
+TEST_CASE("TC_35-1_SP_staticPolicy"){
+    Intersection plain = Intersection(), fixedStatic = Intersection(), fixedWrapped = Intersection();
+    Intersection actuatedVirtual = Intersection(), actuatedStatic = Intersection();
+    std::deque<ArrivalGenerator> gens;
+    FixedPolicy fixedPolicy = FixedPolicy();
+    PolicyController<FixedPolicy> wrapped = PolicyController<FixedPolicy>();
+    PolicyController<ActuatedController> wrappedActuated = PolicyController<ActuatedController>(1.0, 5.0, 0.5);
+    ActuatedController virtualCtrl = ActuatedController(2.0, 20.0, 1.0);
+    ActuatedController staticCtrl = ActuatedController(2.0, 20.0, 1.0);
+    int numFixedDifferent = 0, numActuatedDifferent = 0, numDiverged = 0;
+
+    refreshRateHzGlobal = 10;
+
+    CHECK(wrappedActuated.getPolicy().getMaxGreen() == 5.0);
+    CHECK(wrappedActuated.getPolicy().getGap() == 0.5);
+
+    for(Intersection* inter : {&plain, &fixedStatic, &fixedWrapped, &actuatedVirtual, &actuatedStatic}){
+        ArrivalGenerator& gen = gens.emplace_back(35);
+
+        gen.setArrivals(Road::north, TurnOption::straight, ArrivalProcess::poissonArrivals(900));
+        gen.setArrivals(Road::east, TurnOption::straight, ArrivalProcess::poissonArrivals(120));
+        buildActuatedIntersection(*inter);
+        inter->setArrivals(&gen);
+    }
+    fixedWrapped.setSignalController(&wrapped);
+    actuatedVirtual.setSignalController(&virtualCtrl);
+    CHECK(fixedWrapped.getSignalController() == &wrapped);
+
+    for(Intersection* inter : {&plain, &fixedStatic, &fixedWrapped, &actuatedVirtual, &actuatedStatic}){
+        inter->start();
+    }
+
+    /// The same strategy gives the same run whether it is called statically, through the wrapper or not at all
+    for(int t=0; t < 3000; t++){
+        plain.tick();
+        fixedStatic.tick(fixedPolicy);
+        fixedWrapped.tick();
+        actuatedVirtual.tick();
+        actuatedStatic.tick(staticCtrl);
+        drainExitRoads(plain);
+        drainExitRoads(fixedStatic);
+        drainExitRoads(fixedWrapped);
+        drainExitRoads(actuatedVirtual);
+        drainExitRoads(actuatedStatic);
+
+        numFixedDifferent += countIntersectionDifferences(plain, fixedStatic) + countIntersectionDifferences(plain, fixedWrapped);
+        numActuatedDifferent += countIntersectionDifferences(actuatedVirtual, actuatedStatic);
+        numDiverged += countIntersectionDifferences(plain, actuatedStatic);
+    }
+    CHECK(numFixedDifferent == 0);
+    CHECK(numActuatedDifferent == 0);
+    CHECK(plain.time() == 3000);
+    CHECK(actuatedStatic.time() == 3000);
+
+    /// Actuated control actually diverges from the fixed schedule
+    CHECK(numDiverged > 0);
+
+    for(Intersection* inter : {&plain, &fixedStatic, &fixedWrapped, &actuatedVirtual, &actuatedStatic}){
+        inter->setArrivals(NULL);
+    }
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Builds one TrafficEnv environment: north-south and east-west phases with straight demand on both,
+ *        plus a north left platoon that neither phase serves.
+ */
+static void buildEnv(Intersection& inter, ArrivalGenerator& gen){
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        inter.addRoad(dir, {1, 2, 1});
+    }
+
+    inter.schedule(LightConfig::doubleGreen, Road::north, 2.0, 1.0);
+    inter.schedule(LightConfig::doubleGreen, Road::east, 2.0, 1.0);
+    inter.setAllRedDuration(0.5);
+    gen.setArrivals(Road::north, TurnOption::straight, ArrivalProcess::poissonArrivals(600));
+    gen.setArrivals(Road::east, TurnOption::straight, ArrivalProcess::poissonArrivals(600));
+    gen.setArrivals(Road::north, TurnOption::left, ArrivalProcess::platoonArrivals(1, 5.0));
+}
+
+TEST_CASE("TC_36-1_ENV_step"){
+    const size_t batchSize = 600;
+    const int lane = Road::laneGroupIdx(Road::north, TurnOption::straight);
+    const int eastLane = Road::laneGroupIdx(Road::east, TurnOption::straight);
+    const int leftLane = Road::laneGroupIdx(Road::north, TurnOption::left);
+    std::vector<float> queues(batchSize * NUM_LANE_GROUPS), serialQueues(batchSize * NUM_LANE_GROUPS);
+    std::vector<int32_t> colors(batchSize * NUM_LANE_GROUPS), serialColors(batchSize * NUM_LANE_GROUPS);
+    std::vector<int32_t> ticksRemaining(batchSize * NUM_LANE_GROUPS), serialTicks(batchSize * NUM_LANE_GROUPS);
+    std::vector<float> rewards(batchSize);
+    std::vector<uint8_t> dones(batchSize);
+    std::vector<uint64_t> seeds(batchSize);
+    std::vector<int32_t> actions(batchSize, ENV_KEEP_SCHEDULE);
+    Intersection reference = Intersection();
+    ArrivalGenerator referenceGen = ArrivalGenerator(7);
+    int numDifferent = 0, numRewardsWrong = 0;
+    uint32_t lcg = 36;
+
+    refreshRateHzGlobal = 10;
+
+    CHECK_THROWS_AS(TrafficEnv(0, buildEnv), std::domain_error);
+    CHECK_THROWS_AS(TrafficEnv(1, buildEnv, 0), std::domain_error);
+    CHECK_THROWS_AS(TrafficEnv(1, [](Intersection& inter, ArrivalGenerator& gen){ inter.addRoad(Road::north, {0, 1, 0}); inter.addRoad(Road::south, {0, 1, 0}); inter.addRoad(Road::east, {0, 1, 0}); }), std::invalid_argument);
+
+    TrafficEnv env = TrafficEnv(batchSize, buildEnv, 5, 200, 2);
+    TrafficEnv serial = TrafficEnv(batchSize, buildEnv, 5, 200, 1);
+
+    CHECK(env.getBatchSize() == batchSize);
+    CHECK(env.getNumActions(0) == 2);
+    CHECK(env.getNumThreads() == 2);
+    env.setBuffers({queues.data(), colors.data(), ticksRemaining.data(), rewards.data(), dones.data()});
+    serial.setBuffers({serialQueues.data(), serialColors.data(), serialTicks.data(), NULL, NULL});
+
+    for(size_t i=0; i < batchSize; i++){
+        seeds[i] = (i == 3) ? 7 : 100 + i % 2;
+    }
+    env.reset(seeds.data());
+    serial.reset(seeds.data());
+
+    /// Every episode starts on the north-south green with empty queues
+    CHECK(env.getSeed(3) == 7);
+    CHECK(colors[lane] == TrafficLight::green);
+    CHECK(colors[eastLane] == TrafficLight::red);
+    CHECK(ticksRemaining[lane] == 20);
+    CHECK(queues[lane] == 0);
+
+    /// Following the schedule, environment 3 matches an Intersection ticked by hand
+    buildEnv(reference, referenceGen);
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        reference.setExitRoad(dir, new Road(dir, {1, 2, 1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    }
+    reference.setArrivals(&referenceGen);
+    reference.setAutoSequence(true);
+    reference.start();
+
+    for(int step=0; step < 30; step++){
+        env.step(actions.data());
+        serial.step(actions.data());
+
+        for(int t=0; t < 5; t++){
+            reference.tick();
+            drainExitRoads(reference);
+        }
+
+        for(int l=0; l < NUM_LANE_GROUPS; l++){
+            TurnOption* turnOpt = reference.getRoad(Road::laneGroupDirection(l))->getTurnOption(Road::laneGroupTurn(l));
+            size_t idx = 3 * NUM_LANE_GROUPS + l;
+
+            if(turnOpt->isValid()){
+                numDifferent += queues[idx] != turnOpt->getQueuedVehicles() || colors[idx] != turnOpt->getLight()->getColor()
+                                || ticksRemaining[idx] != turnOpt->getLight()->getTicksRemaining();
+            }
+        }
+    }
+    CHECK(numDifferent == 0);
+    CHECK(env.getNumSteps() == 30);
+    CHECK(env.getIntersection(3).time() == 150);
+
+    /// Environments with the same seed run the same episode, the reward is minus the vehicles queued
+    numDifferent = 0;
+    for(size_t i=0; i < batchSize; i++){
+        float numQueued = 0;
+
+        for(int l=0; l < NUM_LANE_GROUPS; l++){
+            numDifferent += (i != 3) && queues[i * NUM_LANE_GROUPS + l] != queues[(4 + i % 2) * NUM_LANE_GROUPS + l];
+            numQueued += queues[i * NUM_LANE_GROUPS + l];
+        }
+        numRewardsWrong += rewards[i] != -numQueued;
+    }
+    CHECK(numDifferent == 0);
+    CHECK(numRewardsWrong == 0);
+    CHECK(queues[4 * NUM_LANE_GROUPS + leftLane] == 3);
+
+    /// A bad action steps nothing
+    actions[5] = 2;
+    CHECK_THROWS_AS(env.step(actions.data()), std::out_of_range);
+    actions[5] = -2;
+    CHECK_THROWS_AS(env.step(actions.data()), std::out_of_range);
+    CHECK(env.getNumSteps() == 30);
+    CHECK(env.getIntersection(5).time() == 150);
+
+    /// Holding the east-west phase: once the north-south green in progress ends it never returns
+    std::fill(actions.begin(), actions.end(), 1);
+    for(int step=0; step < 6; step++){
+        env.step(actions.data());
+        serial.step(actions.data());
+    }
+    numDifferent = 0;
+    for(int step=0; step < 3; step++){
+        env.step(actions.data());
+        serial.step(actions.data());
+
+        for(size_t i=0; i < batchSize; i++){
+            numDifferent += colors[i * NUM_LANE_GROUPS + lane] != TrafficLight::red;
+        }
+    }
+    CHECK(numDifferent == 0);
+    CHECK(dones[0] == 0);
+
+    /// Random actions, two threads or one give the same observations
+    for(int step=39; step < 60; step++){
+        for(size_t i=0; i < batchSize; i++){
+            lcg = lcg * 1664525 + 1013904223;
+            actions[i] = (int32_t)((lcg >> 8) % 3) - 1;
+        }
+        env.step(actions.data());
+        serial.step(actions.data());
+
+        /// 200 tick episodes of 5 tick steps end on the 40th step and start over with the next seed
+        CHECK(dones[0] == (step == 39));
+    }
+    CHECK(env.getSeed(3) == 8);
+    CHECK(env.getSeed(0) == 101);
+    CHECK(env.getIntersection(0).time() == 100);
+    CHECK(queues == serialQueues);
+    CHECK(colors == serialColors);
+    CHECK(ticksRemaining == serialTicks);
+
+    /// A LightConfig aimed at a missing Road is no action, following the schedule skips it
+    TrafficEnv partial = TrafficEnv(1024, [](Intersection& inter, ArrivalGenerator& gen){
+        inter.addRoad(Road::north, {1, 2, 1});
+        inter.addRoad(Road::south, {1, 2, 1});
+        inter.schedule(LightConfig::doubleGreen, Road::north, 2.0, 1.0);
+        inter.schedule(LightConfig::singleGreen, Road::east, 2.0, 1.0);
+        gen.setArrivals(Road::north, TurnOption::straight, ArrivalProcess::poissonArrivals(600));
+    }, 5, 0, 4);
+    std::vector<int32_t> partialActions(1024, ENV_KEEP_SCHEDULE);
+
+    partialActions[700] = 1;
+    CHECK_THROWS_AS(partial.step(partialActions.data()), std::out_of_range);
+    CHECK(partial.getIntersection(0).time() == 0);
+    partialActions[700] = ENV_KEEP_SCHEDULE;
+    for(int step=0; step < 20; step++){
+        CHECK_NOTHROW(partial.step(partialActions.data()));
+    }
+    CHECK(partial.getIntersection(1023).time() == 100);
+
+    reference.setArrivals(NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_37-1_FORK_whatIf"){
+    Intersection live = Intersection();
+    ArrivalGenerator gen = ArrivalGenerator(37);
+    CompactIntersection before, after, forked;
+    Intersection* clone;
+    Intersection* second;
+    Intersection* first;
+    unsigned long numArrivals;
+
+    refreshRateHzGlobal = 10;
+
+    buildActuatedIntersection(live);
+    live.schedule(LightConfig::doubleGreenLeft, Road::north, 3.0, 1.0);
+    gen.setAllArrivals(ArrivalProcess::poissonArrivals(300));
+    live.setArrivals(&gen);
+    live.start();
+    for(int t=0; t < 137; t++){
+        live.tick();
+    }
+
+    /// The copy starts in the same state as the Intersection
+    clone = live.fork();
+    REQUIRE(clone != NULL);
+    CHECK(clone != &live);
+    CHECK(live.getNumForks() == 1);
+    before.pack(live);
+    forked.pack(*clone);
+    CHECK(forked == before);
+    CHECK(clone->getNumRoads() == live.getNumRoads());
+    CHECK(clone->getSignalPlan().getNumPhases() == 3);
+    CHECK(clone->getExitRoad(Road::north) != live.getExitRoad(Road::north));
+
+    /// Ticking the copy leaves the Intersection and its ArrivalGenerator alone, and it sees the same arrivals
+    numArrivals = gen.getNumArrivals();
+    for(int t=0; t < 600; t++){
+        clone->tick();
+    }
+    after.pack(live);
+    CHECK(after == before);
+    CHECK(gen.getNumArrivals() == numArrivals);
+    for(int t=0; t < 600; t++){
+        live.tick();
+    }
+    after.pack(live);
+    forked.pack(*clone);
+    CHECK(forked == after);
+    CHECK(forked.hash() == after.hash());
+
+    /// A what-if: starting the left turn phase now diverges from the schedule
+    second = live.fork();
+    CHECK(second != clone);
+    CHECK(live.getNumForks() == 2);
+    second->nextLightConfig();
+    CHECK(second->getConfigScheduleIdx() != live.getConfigScheduleIdx());
+    after.pack(live);
+    CHECK(after.getConfigScheduleIdx() == live.getConfigScheduleIdx());
+
+    /// Released copies are reused and take the current state
+    live.releaseFork(second);
+    live.releaseFork(clone);
+    CHECK_THROWS_AS(live.releaseFork(clone), std::invalid_argument);
+    CHECK_THROWS_AS(live.releaseFork(&live), std::invalid_argument);
+    for(int t=0; t < 50; t++){
+        live.tick();
+    }
+    first = clone;
+    clone = live.fork();
+    CHECK((clone == first || clone == second));
+    CHECK(live.getNumForks() == 2);
+    after.pack(live);
+    forked.pack(*clone);
+    CHECK(forked == after);
+
+    /// A copy built before the schedule changed is rebuilt
+    live.releaseFork(clone);
+    live.schedule(LightConfig::singleGreen, Road::west, 2.0, 1.0);
+    clone = live.fork();
+    CHECK(clone->getSignalPlan().getNumPhases() == 4);
+    forked.pack(*clone);
+    CHECK(forked.sameState(after));
+
+    live.setArrivals(NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_38-1_MPC_decide"){
+    Intersection inter = Intersection();
+    PredictiveController mpc = PredictiveController(2, 20.0, 3);
+    PredictiveController longHorizon = PredictiveController(4, 5.0, 1);
+    CompactIntersection before, after;
+
+    refreshRateHzGlobal = 10;
+
+    CHECK_THROWS_AS(PredictiveController(0, 20.0), std::domain_error);
+    CHECK_THROWS_AS(PredictiveController(MPC_MAX_HORIZON_PHASES + 1, 20.0), std::domain_error);
+    CHECK_THROWS_AS(PredictiveController(2, 0.0), std::domain_error);
+    CHECK(mpc.getNumThreads() == 3);
+
+    buildActuatedIntersection(inter);
+    inter.schedule(LightConfig::singleGreen, Road::west, 10.0, 1.0);
+    inter.start();
+
+    /// The phase serving the long queue wins wherever the schedule is
+    inter.addVehicles(Road::east, TurnOption::straight, 30);
+    inter.addVehicles(Road::north, TurnOption::straight, 2);
+    before.pack(inter);
+    CHECK(mpc.nextPhase(inter, 0).phase == 1);
+    CHECK(mpc.nextPhase(inter, 1).phase == 1);
+    CHECK(mpc.nextPhase(inter, 2).phase == 1);
+    CHECK(mpc.nextPhase(inter, 0).greenTicks == -1);
+
+    /// Rollouts run on copies, the Intersection is untouched and the copies are kept for the next decision
+    after.pack(inter);
+    CHECK(after == before);
+    CHECK(inter.getNumForks() == 9);
+    CHECK(mpc.getNumDecisions() == 4);
+    CHECK(mpc.getLatencies().getCount() == 4);
+    CHECK(mpc.getForkLatencies().getCount() == 4);
+    CHECK(mpc.getRolloutLatencies().getCount() == 4);
+    CHECK(mpc.getLatencies().getMin() > 0);
+    CHECK(mpc.getLatencies().quantile(0.5) >= mpc.getRolloutLatencies().quantile(0.5));
+
+    /// 3^4 sequences fit, 3^5 would not
+    CHECK(longHorizon.nextPhase(inter, 0).phase == 1);
+    CHECK(inter.getNumForks() == 81);
+    for(int i=0; i < 2; i++){
+        inter.schedule(LightConfig::singleGreen, (i == 0) ? Road::north : Road::south, 10.0, 1.0);
+    }
+    CHECK_THROWS_AS(longHorizon.nextPhase(inter, 0), std::invalid_argument);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+TEST_CASE("TC_38-2_MPC_throughput"){
+    Intersection fixed = Intersection();
+    Intersection serial = Intersection();
+    Intersection parallel = Intersection();
+    ArrivalGenerator fixedGen = ArrivalGenerator(38);
+    ArrivalGenerator serialGen = ArrivalGenerator(38);
+    ArrivalGenerator parallelGen = ArrivalGenerator(38);
+    PredictiveController serialMpc = PredictiveController(2, 15.0, 1);
+    PredictiveController parallelMpc = PredictiveController(2, 15.0, 4);
+    unsigned long fixedQueued = 0, mpcQueued = 0;
+    int numDifferences = 0;
+    const int numTicks = 6000;
+
+    refreshRateHzGlobal = 10;
+
+    /// Heavy north-south traffic, light east-west traffic
+    for(ArrivalGenerator* gen : {&fixedGen, &serialGen, &parallelGen}){
+        gen->setArrivals(Road::north, TurnOption::straight, ArrivalProcess::poissonArrivals(900));
+        gen->setArrivals(Road::south, TurnOption::straight, ArrivalProcess::poissonArrivals(900));
+        gen->setArrivals(Road::east, TurnOption::straight, ArrivalProcess::poissonArrivals(60));
+        gen->setArrivals(Road::west, TurnOption::straight, ArrivalProcess::poissonArrivals(60));
+    }
+
+    buildActuatedIntersection(fixed);
+    buildActuatedIntersection(serial);
+    buildActuatedIntersection(parallel);
+    fixed.setArrivals(&fixedGen);
+    serial.setArrivals(&serialGen);
+    parallel.setArrivals(&parallelGen);
+    serial.setSignalController(&serialMpc);
+    parallel.setSignalController(&parallelMpc);
+    fixed.start();
+    serial.start();
+    parallel.start();
+
+    for(int t=0; t < numTicks; t++){
+        fixed.tick();
+        serial.tick();
+        parallel.tick();
+        drainExitRoads(fixed);
+        drainExitRoads(serial);
+        drainExitRoads(parallel);
+        numDifferences += countIntersectionDifferences(serial, parallel);
+
+        for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+            fixedQueued += fixed.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane))->getQueuedVehicles();
+            mpcQueued += serial.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane))->getQueuedVehicles();
+        }
+    }
+
+    /// The same decisions on any number of threads, and far less waiting than the fixed schedule
+    CHECK(numDifferences == 0);
+    CHECK(serialMpc.getNumDecisions() > 0);
+    CHECK(serialMpc.getNumDecisions() == parallelMpc.getNumDecisions());
+    CHECK(mpcQueued * 3 < fixedQueued * 2);
+
+    fixed.setArrivals(NULL);
+    serial.setArrivals(NULL);
+    parallel.setArrivals(NULL);
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Builds the Intersection searched by ScheduleOptimizer: heavy north-south and light east-west demand, both
+ *          phases 10 seconds.
+ */
+static void buildOptimizerIntersection(Intersection& inter, ArrivalGenerator& gen){
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        inter.addRoad(dir, {1, 2, 1});
+    }
+
+    inter.schedule(LightConfig::doubleGreen, Road::east, 10.0, 1.0);
+    inter.schedule(LightConfig::doubleGreen, Road::north, 10.0, 1.0);
+    inter.setAllRedDuration(0.5);
+    gen.setArrivals(Road::north, TurnOption::straight, ArrivalProcess::poissonArrivals(900));
+    gen.setArrivals(Road::south, TurnOption::straight, ArrivalProcess::poissonArrivals(900));
+    gen.setArrivals(Road::east, TurnOption::straight, ArrivalProcess::poissonArrivals(120));
+    gen.setArrivals(Road::west, TurnOption::straight, ArrivalProcess::poissonArrivals(120));
+}
+
+TEST_CASE("TC_39-1_OPT_schedule"){
+    Intersection loaded = Intersection();
+    std::vector<LightConfig> best, parallelBest, built;
+    ScheduleOptimizer::Evaluation builtEval;
+
+    refreshRateHzGlobal = 10;
+
+    CHECK_THROWS_AS(ScheduleOptimizer(buildOptimizerIntersection, 0.01), std::domain_error);
+    CHECK_THROWS_AS(ScheduleOptimizer([](Intersection& inter, ArrivalGenerator& gen){ inter.addRoad(Road::north, {1, 2, 1}); }, 60.0), std::invalid_argument);
+
+    ScheduleOptimizer serial = ScheduleOptimizer(buildOptimizerIntersection, 300.0, ScheduleOptimizer::minimizeDelay, 39, 1);
+    ScheduleOptimizer parallel = ScheduleOptimizer(buildOptimizerIntersection, 300.0, ScheduleOptimizer::minimizeDelay, 39, 3);
+
+    CHECK_THROWS_AS(serial.setPopulation(1), std::domain_error);
+    CHECK_THROWS_AS(serial.setGreenBounds(0.0, 10.0), std::domain_error);
+    CHECK_THROWS_AS(serial.setYellowBounds(2.0, 1.0), std::domain_error);
+    CHECK_THROWS_AS(serial.setResolution(0.0), std::domain_error);
+    CHECK(parallel.getNumThreads() == 3);
+    CHECK(serial.getEvalTicks() == 3000);
+
+    /// Before searching the best schedule is the built one
+    built = serial.getBestSchedule();
+    REQUIRE(built.size() == 2);
+    CHECK(built[0].getDirection() == Road::east);
+    CHECK(built[1].getDuration() == 10.0);
+    builtEval = serial.evaluate(built);
+    CHECK(builtEval.delay > 0);
+    CHECK(builtEval.score == builtEval.delay);
+    CHECK_FALSE(builtEval.dropped);
+    CHECK_THROWS_AS(serial.evaluate({built[0], built[0]}), std::invalid_argument);
+    CHECK_THROWS_AS(serial.evaluate({built[0]}), std::invalid_argument);
+
+    for(ScheduleOptimizer* opt : {&serial, &parallel}){
+        opt->setPopulation(16);
+        opt->setGreenBounds(2.0, 40.0);
+    }
+    best = serial.optimize(8);
+    parallelBest = parallel.optimize(8);
+
+    /// The busy approach gets the longer green and the delay drops well below the built schedule
+    REQUIRE(best.size() == 2);
+    const LightConfig& northConfig = (best[0].getDirection() == Road::north) ? best[0] : best[1];
+    const LightConfig& eastConfig = (best[0].getDirection() == Road::north) ? best[1] : best[0];
+    CHECK(const_cast<LightConfig&>(northConfig).getDuration() > const_cast<LightConfig&>(eastConfig).getDuration());
+    CHECK(serial.getBestEvaluation().score * 4 < builtEval.score * 3);
+    CHECK(serial.evaluate(best).score == serial.getBestEvaluation().score);
+
+    /// Rounded candidates repeat once the search narrows, and hopeless ones stop early
+    CHECK(serial.getNumGenerations() == 8);
+    CHECK(serial.getNumMemoHits() > 0);
+    CHECK(serial.getNumDropped() > 0);
+    CHECK(serial.getNumSimulated() < 8 * 16 + 1);
+
+    /// The same search on any number of threads
+    REQUIRE(parallelBest.size() == best.size());
+    for(size_t i=0; i < best.size(); i++){
+        CHECK(parallelBest[i].getDirection() == best[i].getDirection());
+        CHECK(parallelBest[i].getDuration() == best[i].getDuration());
+    }
+    CHECK(parallel.getBestEvaluation().score == serial.getBestEvaluation().score);
+    CHECK(parallel.getNumSimulated() == serial.getNumSimulated());
+
+    /// The result loads straight into an Intersection
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        loaded.addRoad(dir, {1, 2, 1});
+    }
+    loaded.schedule(LightConfig::singleGreen, Road::north, 5.0, 1.0);
+    serial.apply(loaded);
+    REQUIRE(loaded.getSignalPlan().getNumPhases() == 2);
+    loaded.start();
+    CHECK(loaded.currentLightConfig()->getDirection() == best[0].getDirection());
+    CHECK(loaded.currentLightConfig()->getDuration() == best[0].getDuration());
+
+    /// Throughput, searching yellows too
+    ScheduleOptimizer throughput = ScheduleOptimizer(buildOptimizerIntersection, 120.0, ScheduleOptimizer::maximizeThroughput, 39, 2);
+    throughput.setPopulation(8);
+    throughput.setYellowBounds(1.0, 3.0);
+    best = throughput.optimize(4);
+    CHECK(throughput.getBestEvaluation().score == -(double)throughput.getBestEvaluation().departures);
+    CHECK(throughput.getBestEvaluation().departures >= throughput.evaluate(built).departures);
+    for(LightConfig& config : best){
+        CHECK(config.getYellowDuration() >= 1.0);
+        CHECK(config.getYellowDuration() <= 3.0);
+    }
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Builds an Intersection of a corridor running east-west: both phases double green with the given greens.
+ */
+static void buildCorridorIntersection(Intersection& inter, double northSouth, double eastWest){
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        inter.addRoad(dir, {1, 2, 1});
+        inter.setExitRoad(dir, new Road(dir, {1, 2, 1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    }
+
+    inter.schedule(LightConfig::doubleGreen, Road::east, eastWest, 1.0);
+    inter.schedule(LightConfig::doubleGreen, Road::north, northSouth, 1.0);
+    inter.setAllRedDuration(0.5);
+    inter.setAutoSequence(true);
+}
+
+/**
+ * @brief Checks every light of "inter" has the color of its SignalPlan at "cycleTick".
+ */
+static void checkColorsAt(Intersection& inter, unsigned long cycleTick){
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        for(int turn=0; turn < TurnOption::numTurnOptions; turn++){
+            TurnOption* opt = inter.getRoad(dir)->getTurnOption((TurnOption::Type)turn);
+
+            if(opt != NULL){
+                CHECK(opt->getLight()->getColor() == inter.getSignalPlan().colorAt(cycleTick, dir, (TurnOption::Type)turn));
+            }
+        }
+    }
+}
+
+TEST_CASE("TC_40-1_CORR_greenWave"){
+    std::deque<Intersection> inters(3), uniform(4), longCorridor(96);
+    std::vector<Intersection*> corridor, uniformCorridor, longPtrs;
+    std::vector<unsigned long> zero(3, 0), offsets;
+    std::vector<double> longLinks;
+    Intersection single = Intersection();
+    Intersection mismatched = Intersection();
+    ArrivalGenerator outbound = ArrivalGenerator(40, 0);
+    ArrivalGenerator inbound = ArrivalGenerator(40, 1);
+    CorridorCoordinator::Verification optimized, unoptimized, serialRun, parallelRun;
+    long cycle, green = 0;
+
+    refreshRateHzGlobal = 10;
+
+    buildCorridorIntersection(inters[0], 10.0, 9.0);
+    buildCorridorIntersection(inters[1], 7.0, 12.0);
+    buildCorridorIntersection(inters[2], 12.0, 7.0);
+    for(Intersection& inter : inters){
+        corridor.push_back(&inter);
+    }
+
+    CHECK_THROWS_AS(CorridorCoordinator({&inters[0]}, Road::west), std::invalid_argument);
+    single.addRoad(Road::north, {1, 2, 1});
+    CHECK_THROWS_AS(CorridorCoordinator({&inters[0], &single}, Road::west), std::invalid_argument);
+
+    CorridorCoordinator coord = CorridorCoordinator(corridor, Road::west, 1);
+    CHECK(coord.isTwoWay());
+    CHECK(coord.getNumIntersections() == 3);
+    CHECK_THROWS_AS(coord.setLinkSeconds({3.0}), std::invalid_argument);
+    CHECK_THROWS_AS(coord.setLinkSeconds({3.0, -1.0}), std::invalid_argument);
+    CHECK_THROWS_AS(coord.setWeights(-1.0, 1.0), std::domain_error);
+    CHECK_THROWS_AS(coord.bandwidth({0, 0}, true), std::invalid_argument);
+    coord.setLinkSeconds({3.0, 5.5});
+
+    /// Starting part way into the cycle matches the SignalPlan there, and ticking on keeps matching it
+    inters[1].startAt(137);
+    checkColorsAt(inters[1], 137);
+    for(int t=1; t <= 250; t++){
+        inters[1].tick();
+        if(t % 25 == 0){
+            checkColorsAt(inters[1], 137 + t);
+        }
+    }
+
+    /// The offsets found score what bandwidth() computes, and no worse than starting every Intersection together
+    offsets = coord.optimize();
+    cycle = coord.getCycleLength();
+    CHECK(cycle == 220);
+    REQUIRE(offsets.size() == 3);
+    CHECK(offsets[0] == 0);
+    CHECK(coord.getNumPasses() > 0);
+    CHECK(coord.getOutboundBandwidth() == coord.bandwidth(offsets, true));
+    CHECK(coord.getInboundBandwidth() == coord.bandwidth(offsets, false));
+    CHECK(coord.getOutboundBandwidth() + coord.getInboundBandwidth() >= coord.bandwidth(zero, true) + coord.bandwidth(zero, false));
+
+    /// Against every pair of offsets, one way
+    coord.setWeights(1.0, 0.0);
+    offsets = coord.optimize();
+    for(long a=0; a < cycle; a += 5){
+        for(long b=0; b < cycle; b += 5){
+            CHECK(coord.bandwidth({0, (unsigned long)a, (unsigned long)b}, true) <= coord.getOutboundBandwidth());
+        }
+    }
+
+    /// apply() starts the live Intersections at their offsets, also one already running
+    coord.apply();
+    for(int k=0; k < 3; k++){
+        checkColorsAt(inters[k], offsets[k]);
+    }
+
+    /// Through traffic waits less with the offsets
+    coord.setWeights(1.0, 1.0);
+    offsets = coord.optimize();
+    outbound.setArrivals(Road::west, TurnOption::straight, ArrivalProcess::poissonArrivals(700));
+    inbound.setArrivals(Road::east, TurnOption::straight, ArrivalProcess::poissonArrivals(700));
+    inters[0].setArrivals(&outbound);
+    inters[2].setArrivals(&inbound);
+    optimized = coord.verify(offsets, 300.0);
+    unoptimized = coord.verify(zero, 300.0);
+    CHECK(optimized.delay < unoptimized.delay);
+    CHECK(optimized.outboundDepartures > 0);
+    CHECK(optimized.inboundDepartures > 0);
+    CHECK(coord.verify(offsets, 300.0).delay == optimized.delay);
+    CHECK_THROWS_AS(coord.verify({0}, 300.0), std::invalid_argument);
+    inters[0].setArrivals(NULL);
+    inters[2].setArrivals(NULL);
+
+    /// The same splits everywhere with no links line up into a band the length of the green
+    for(Intersection& inter : uniform){
+        buildCorridorIntersection(inter, 10.0, 10.0);
+        uniformCorridor.push_back(&inter);
+    }
+    CorridorCoordinator uniformCoord = CorridorCoordinator(uniformCorridor, Road::west, 1);
+    uniformCoord.setWeights(1.0, 0.0);
+    uniformCoord.optimize();
+    for(long t=0; t < uniformCoord.getCycleLength(); t++){
+        if(uniform[0].getSignalPlan().colorAt(t, Road::west, TurnOption::straight) == TrafficLight::green){
+            green++;
+        }
+    }
+    CHECK(uniformCoord.getOutboundBandwidth() == green);
+
+    /// Cycles of different lengths cannot be coordinated
+    buildCorridorIntersection(mismatched, 10.0, 12.0);
+    CorridorCoordinator mismatchedCoord = CorridorCoordinator({&inters[0], &mismatched}, Road::west, 1);
+    CHECK_THROWS_AS(mismatchedCoord.optimize(), std::invalid_argument);
+
+    /// Verifying on several threads gives the same result as on one
+    for(int k=0; k < 96; k++){
+        buildCorridorIntersection(longCorridor[k], 10.0 + (k % 3), 10.0 - (k % 3));
+        longPtrs.push_back(&longCorridor[k]);
+        if(k < 95){
+            longLinks.push_back(2.0 + (k * 7) % 5);
+        }
+    }
+    longCorridor[0].setArrivals(&outbound);
+    longCorridor[95].setArrivals(&inbound);
+    CorridorCoordinator serialCoord = CorridorCoordinator(longPtrs, Road::west, 1);
+    CorridorCoordinator parallelCoord = CorridorCoordinator(longPtrs, Road::west, 4);
+    serialCoord.setLinkSeconds(longLinks);
+    parallelCoord.setLinkSeconds(longLinks);
+    offsets = serialCoord.optimize();
+    CHECK(parallelCoord.optimize() == offsets);
+    serialRun = serialCoord.verify(offsets, 120.0);
+    parallelRun = parallelCoord.verify(offsets, 120.0);
+    CHECK(serialRun.delay > 0);
+    CHECK(parallelRun.delay == serialRun.delay);
+    CHECK(parallelRun.outboundDepartures == serialRun.outboundDepartures);
+    CHECK(parallelRun.inboundDepartures == serialRun.inboundDepartures);
+    longCorridor[0].setArrivals(NULL);
+    longCorridor[95].setArrivals(NULL);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+/**
+ * @brief Builds variant "k" of the Intersection ticked in lockstep: its durations, all-red clearance and demand depend on "k".
+ */
+static void buildLockstepVariant(Intersection& inter, ArrivalGenerator& gen, int k){
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        inter.addRoad(dir, {1, 2, 1});
+        inter.setExitRoad(dir, new Road(dir, {1, 2, 1}, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+    }
+
+    inter.schedule(LightConfig::doubleGreen, Road::north, 4.0 + 0.5 * (k % 5), 1.0 + 0.1 * (k % 3));
+    inter.schedule(LightConfig::doubleGreenLeft, Road::east, 3.0, 1.0);
+    inter.schedule(LightConfig::doubleGreen, Road::east, 3.0 + 0.3 * (k % 7), 1.0);
+    inter.setAllRedDuration(0.5 * (k % 3));
+    inter.setAutoSequence(true);
+
+    gen.setAllArrivals(ArrivalProcess::poissonArrivals(300 + 60 * k));
+    gen.setArrivals(Road::north, TurnOption::straight, ArrivalProcess::platoonArrivals(4, 8.0 + k, 1.0));
+    inter.setArrivals(&gen);
+    inter.start();
+}
+
+/**
+ * @brief Gets the vehicles queued on every Road of "inter".
+ */
+static unsigned long countQueuedVehicles(Intersection& inter){
+    unsigned long queued = 0;
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        queued += inter.getRoad(Road::laneGroupDirection(lane))->getTurnOption(Road::laneGroupTurn(lane))->getQueuedVehicles();
+    }
+
+    return queued;
+}
+
+/**
+ * @brief Counts the lane groups whose cumulative curves or exit queue differ between "a" and "b".
+ */
+static int countCurveDifferences(Intersection& a, Intersection& b){
+    int numDifferent = 0;
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        Road::RoadDirection dir = Road::laneGroupDirection(lane);
+        TurnOption::Type turn = Road::laneGroupTurn(lane);
+        TurnOption* turnOptA = a.getRoad(dir)->getTurnOption(turn);
+        TurnOption* turnOptB = b.getRoad(dir)->getTurnOption(turn);
+
+        numDifferent += turnOptA->getCumulativeArrivals() != turnOptB->getCumulativeArrivals()
+                        || turnOptA->getCumulativeDepartures() != turnOptB->getCumulativeDepartures()
+                        || a.getExitRoad(dir)->getTurnOption(turn)->getQueuedVehicles() != b.getExitRoad(dir)->getTurnOption(turn)->getQueuedVehicles();
+    }
+
+    return numDifferent;
+}
+
+TEST_CASE("TC_41-1_LOCK_variants"){
+    const int numVariants = LOCKSTEP_WIDTH + 3;
+    std::deque<Intersection> lockstep(numVariants), scalar(numVariants), drained(numVariants), scalarDrained(numVariants);
+    std::deque<ArrivalGenerator> lockstepGens, scalarGens, drainedGens, scalarDrainedGens;
+    std::vector<Intersection*> ptrs, drainedPtrs;
+    std::vector<unsigned long> queuedTicks(numVariants, 0), drainedQueuedTicks(numVariants, 0);
+    CompactIntersection packedA, packedB;
+    Intersection odd = Intersection();
+    Intersection controlled = Intersection();
+    ActuatedController ctrl = ActuatedController(2.0, 20.0, 1.0);
+    int numDifferent = 0;
+
+    refreshRateHzGlobal = 10;
+
+    for(int k=0; k < numVariants; k++){
+        lockstepGens.emplace_back(11, k);
+        scalarGens.emplace_back(11, k);
+        drainedGens.emplace_back(12, k);
+        scalarDrainedGens.emplace_back(12, k);
+        buildLockstepVariant(lockstep[k], lockstepGens[k], k);
+        buildLockstepVariant(scalar[k], scalarGens[k], k);
+        buildLockstepVariant(drained[k], drainedGens[k], k);
+        buildLockstepVariant(scalarDrained[k], scalarDrainedGens[k], k);
+        ptrs.push_back(&lockstep[k]);
+        drainedPtrs.push_back(&drained[k]);
+    }
+
+    /// Variants must share a layout and run the fixed schedule on their own
+    CHECK_THROWS_AS(LockstepVariants({}), std::invalid_argument);
+    buildActuatedIntersection(controlled);
+    controlled.start();
+    controlled.setSignalController(&ctrl);
+    CHECK_THROWS_AS(LockstepVariants({&controlled}), std::invalid_argument);
+    buildActuatedIntersection(odd);
+    odd.start();
+    CHECK_THROWS_AS(LockstepVariants({&lockstep[0], &odd}), std::invalid_argument);
+    CHECK_NOTHROW(LockstepVariants({&odd}));
+
+    LockstepVariants lock = LockstepVariants(ptrs, false, 1);
+    CHECK(lock.getNumVariants() == (size_t)numVariants);
+    CHECK(lock.getNumBlocks() == 2);
+
+    /// Part way, every lane matches its variant ticked on its own
+    lock.tick(150);
+    for(int k=0; k < numVariants; k++){
+        for(int t=0; t < 150; t++){
+            scalar[k].tick();
+            queuedTicks[k] += countQueuedVehicles(scalar[k]);
+        }
+        for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+            Road::RoadDirection dir = Road::laneGroupDirection(lane);
+            TurnOption::Type turn = Road::laneGroupTurn(lane);
+            TurnOption* turnOpt = scalar[k].getRoad(dir)->getTurnOption(turn);
+
+            numDifferent += lock.getQueuedVehicles(k, dir, turn) != turnOpt->getQueuedVehicles()
+                            || lock.getColor(k, dir, turn) != turnOpt->getLight()->getColor();
+        }
+    }
+    CHECK(numDifferent == 0);
+    CHECK(lock.time() == scalar[0].time());
+
+    /// Stored, every variant is where ticking it on its own leaves it, and it goes on from there
+    for(int round=0; round < 2; round++){
+        lock.tick(200);
+        lock.store();
+        for(int k=0; k < numVariants; k++){
+            for(int t=0; t < 200; t++){
+                scalar[k].tick();
+                queuedTicks[k] += countQueuedVehicles(scalar[k]);
+            }
+            packedA.pack(lockstep[k]);
+            packedB.pack(scalar[k]);
+            CHECK(packedA == packedB);
+            CHECK(countCurveDifferences(lockstep[k], scalar[k]) == 0);
+            CHECK(lockstepGens[k].getNumArrivals() == scalarGens[k].getNumArrivals());
+            CHECK(lockstepGens[k].getNumBlockedArrivals() == scalarGens[k].getNumBlockedArrivals());
+            CHECK(lock.getDelay(k) == doctest::Approx(queuedTicks[k] / 10.0));
+        }
+    }
+    CHECK(scalarGens[0].getNumBlockedArrivals() > 0);
+
+    /// Emptying the exit queues every tick, on one thread or several
+    LockstepVariants drainedLock = LockstepVariants(drainedPtrs, true, 3);
+    LockstepVariants drainedSerial = LockstepVariants(drainedPtrs, true, 1);
+    drainedLock.tick(400);
+    drainedSerial.tick(400);
+    drainedLock.store();
+    for(int k=0; k < numVariants; k++){
+        for(int t=0; t < 400; t++){
+            scalarDrained[k].tick();
+            drainExitRoads(scalarDrained[k]);
+            drainedQueuedTicks[k] += countQueuedVehicles(scalarDrained[k]);
+        }
+        CHECK(drained[k].getExitRoad(Road::north)->getTurnOption(TurnOption::straight)->getQueuedVehicles() == 0);
+        CHECK(countIntersectionDifferences(drained[k], scalarDrained[k]) == 0);
+        CHECK(drainedLock.getDelay(k) == doctest::Approx(drainedQueuedTicks[k] / 10.0));
+        CHECK(drainedSerial.getDelay(k) == drainedLock.getDelay(k));
+    }
+
+    /// Durations were read at the refresh rate of load()
+    refreshRateHzGlobal = 20;
+    CHECK_THROWS_AS(lock.tick(), std::logic_error);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
+
+static constexpr TrafficLight::TransitionTable flashingYellow = TrafficLight::makeSequenceTransitions<1>({TrafficLight::yellow});
+static constexpr TrafficLight::TransitionTable protectedPermissiveLeft = TrafficLight::makeSequenceTransitions<4>({TrafficLight::greenLeft, TrafficLight::green, TrafficLight::yellow, TrafficLight::red});
+
+static_assert(flashingYellow[TrafficLight::yellow].next == TrafficLight::yellow);
+static_assert(flashingYellow[TrafficLight::green].next == TrafficLight::yellow);
+static_assert(protectedPermissiveLeft[TrafficLight::greenLeft].next == TrafficLight::green);
+static_assert(protectedPermissiveLeft[TrafficLight::greenLeft].durationOf == TrafficLight::green);
+static_assert(protectedPermissiveLeft[TrafficLight::red].next == TrafficLight::greenLeft);
+static_assert(protectedPermissiveLeft[TrafficLight::greenRight].next == TrafficLight::greenLeft);
+
+/**
+ * @brief Ticks "light" until its color changes and returns the number of ticks it took, at most "limit".
+ */
+static int ticksUntilColorChange(TrafficLight& light, int limit){
+    TrafficLight::AvailableColors startColor = light.getColor();
+
+    for(int t=1; t <= limit; t++){
+        light.tick();
+        if(light.getColor() != startColor){
+            return t;
+        }
+    }
+
+    return limit;
+}
+
+TEST_CASE("TC_42-1_TF_transitions"){
+    TrafficLight straight = TrafficLight(TrafficLight::green, 3.0, 5.0);
+    TrafficLightLeft left = TrafficLightLeft(2, 4);
+    TrafficLightLeft defaultLeft = TrafficLightLeft(2, 4);
+    TrafficLight flashing = TrafficLight(TrafficLight::green, 3.0, 5.0);
+    std::vector<TrafficLight::AvailableColors> leftColors;
+    Intersection inter = Intersection();
+    Intersection other = Intersection();
+    Intersection* clone;
+    TrafficLight* northLeft;
+    std::string path = (std::filesystem::temp_directory_path() / "TC_42-1.snapshot").string();
+    const std::array<TrafficLight::AvailableColors, 2> repeated = {TrafficLight::red, TrafficLight::red};
+
+    refreshRateHzGlobal = 10;
+
+    /// The default tables are the green -> yellow -> red -> onColor cycle of every light type
+    CHECK(straight.hasDefaultTransitions());
+    CHECK(&straight.getTransitions() == &TrafficLight::defaultTransitions[TrafficLight::green]);
+    CHECK(&left.getTransitions() == &TrafficLight::defaultTransitions[TrafficLight::greenLeft]);
+    straight.start();
+    CHECK(straight.getColor() == TrafficLight::green);
+    CHECK(ticksUntilColorChange(straight, 1000) == 30);
+    CHECK(straight.getColor() == TrafficLight::yellow);
+    CHECK(ticksUntilColorChange(straight, 1000) == 10);
+    CHECK(straight.getColor() == TrafficLight::red);
+    CHECK(ticksUntilColorChange(straight, 1000) == 50);
+    CHECK(straight.getColor() == TrafficLight::green);
+
+    /// Protected then permissive left, the permissive green lasting the green duration
+    left.setDuration(TrafficLight::green, 1.5);
+    left.setTransitions(&protectedPermissiveLeft);
+    CHECK( ! left.hasDefaultTransitions());
+    left.start();
+    defaultLeft.start();
+    leftColors.push_back(left.getColor());
+    CHECK(ticksUntilColorChange(left, 1000) == 20);
+    leftColors.push_back(left.getColor());
+    CHECK(ticksUntilColorChange(left, 1000) == 15);
+    leftColors.push_back(left.getColor());
+    CHECK(ticksUntilColorChange(left, 1000) == 10);
+    leftColors.push_back(left.getColor());
+    CHECK(ticksUntilColorChange(left, 1000) == 40);
+    leftColors.push_back(left.getColor());
+    CHECK(leftColors == std::vector<TrafficLight::AvailableColors>{TrafficLight::greenLeft, TrafficLight::green, TrafficLight::yellow, TrafficLight::red, TrafficLight::greenLeft});
+    CHECK(ticksUntilColorChange(defaultLeft, 1000) == 20);
+    CHECK(defaultLeft.getColor() == TrafficLight::yellow);
+
+    /// Flashing yellow never leaves yellow, whatever color it starts from
+    flashing.setTransitions(&flashingYellow);
+    flashing.start();
+    CHECK(ticksUntilColorChange(flashing, 1000) == 30);
+    CHECK(flashing.getColor() == TrafficLight::yellow);
+    CHECK(ticksUntilColorChange(flashing, 1000) == 1000);
+    CHECK(flashing.getColor() == TrafficLight::yellow);
+
+    /// Back to the default table
+    flashing.setTransitions(NULL);
+    CHECK(flashing.hasDefaultTransitions());
+    CHECK(&flashing.getTransitions() == &TrafficLight::defaultTransitions[TrafficLight::green]);
+    CHECK(&TrafficLightLeft().getTransitions() == &TrafficLight::defaultTransitions[TrafficLight::greenLeft]);
+    flashing.setTicksRemaining(0);
+    CHECK(flashing.nextState() == TrafficLight::red);
+
+    CHECK_THROWS_AS(TrafficLight::makeSequenceTransitions<2>(repeated), std::invalid_argument);
+
+    /// In an Intersection the permissive green lets left turners keep crossing, the next LightConfig waits for red
+    inter.addRoad(Road::north, {1, 1, 1});
+    inter.addRoad(Road::south, {1, 1, 1});
+    inter.schedule(LightConfig::doubleGreenLeft, Road::north, 2.0, 1.0);
+    inter.schedule(LightConfig::doubleGreen, Road::north, 3.0, 1.0);
+    northLeft = inter.getRoad(Road::north)->getLight(TurnOption::left);
+    northLeft->setDuration(TrafficLight::green, 1.5);
+    northLeft->setTransitions(&protectedPermissiveLeft);
+    inter.setAutoSequence(true);
+    inter.start();
+    CHECK(northLeft->getColor() == TrafficLight::greenLeft);
+    for(int t=0; t < 20; t++){
+        inter.tick();
+    }
+    CHECK(northLeft->getColor() == TrafficLight::green);
+    CHECK(inter.getConfigScheduleIdx() == 0);
+    for(int t=0; t < 25; t++){
+        inter.tick();
+    }
+    CHECK(northLeft->getColor() == TrafficLight::red);
+    CHECK(inter.getConfigScheduleIdx() == 1);
+
+    /// The lockstep kernel only models the default tables
+    CHECK_THROWS_AS(LockstepVariants({&inter}), std::invalid_argument);
+
+    /// Forks follow the table too, so an offset start lands on the permissive green
+    clone = inter.fork();
+    CHECK(&clone->getRoad(Road::north)->getLight(TurnOption::left)->getTransitions() == &protectedPermissiveLeft);
+    inter.releaseFork(clone);
+    inter.startAt(25);
+    CHECK(northLeft->getColor() == TrafficLight::green);
+    CHECK(northLeft->getTicksRemaining() == 10);
+
+    /// Neither snapshots nor corridors can model it
+    std::filesystem::remove(path);
+    CHECK_THROWS_AS(Snapshot::save(path, {&inter}), std::logic_error);
+    CHECK( ! std::filesystem::exists(path));
+
+    other.addRoad(Road::north, {1, 1, 1});
+    other.addRoad(Road::south, {1, 1, 1});
+    other.schedule(LightConfig::doubleGreenLeft, Road::north, 2.0, 1.0);
+    other.schedule(LightConfig::doubleGreen, Road::north, 3.0, 1.0);
+    CorridorCoordinator coord = CorridorCoordinator({&other, &inter}, Road::north, 1);
+    CHECK_THROWS_AS(coord.optimize(), std::invalid_argument);
+
+    refreshRateHzGlobal = DEFAULT_REFRESH_RATE;
+}
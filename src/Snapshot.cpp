@@ -0,0 +1,242 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Snapshot.h"
+
+void Snapshot::save(const std::string& path, const std::vector<Intersection*>& inters){
+    std::ofstream out;
+    Header header = {};
+    uint64_t numLightConfigs = 0;
+
+    for(Intersection* inter : inters){
+        numLightConfigs += inter->configSchedule.size();
+
+        /// A TransitionTable is a pointer into the program, a restored TrafficLight could only get the default one
+        for(TrafficLight* light : inter->getLights()){
+            if( ! light->hasDefaultTransitions()){
+                throw std::logic_error("Snapshot::save() every TrafficLight must follow its default TransitionTable");
+            }
+        }
+    }
+
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if( ! out){
+        throw std::runtime_error("Snapshot::save() could not open " + path);
+    }
+
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.endianMarker = SNAPSHOT_ENDIAN_MARKER;
+    header.recordBytes = sizeof(Record);
+    header.lightConfigBytes = sizeof(LightConfigEntry);
+    header.numRecords = inters.size();
+    header.recordsOffset = sizeof(Header);
+    header.numLightConfigs = numLightConfigs;
+    header.lightConfigsOffset = header.recordsOffset + header.numRecords * sizeof(Record);
+    header.refreshRateHz = refreshRateHzGlobal;
+    header.tickRounding = tickRoundingGlobal;
+
+    out.write((const char*)&header, sizeof(header));
+
+    numLightConfigs = 0;
+    for(Intersection* inter : inters){
+        Record record = {};
+
+        record.state.pack(*inter);
+
+        for(int dir=0; dir < Road::numRoadDirections; dir++){
+            Road* rd = inter->roads[dir];
+
+            record.expectedRoadMask |= (inter->expectedRoads[dir] << dir);
+
+            if(rd == NULL){
+                continue;
+            }
+
+            for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+                TurnOption* turnOpt = rd->getTurnOption((TurnOption::Type)opt);
+                LaneGroupConfig& config = record.laneGroups[Road::laneGroupIdx((Road::RoadDirection)dir, (TurnOption::Type)opt)];
+
+                if( ! turnOpt->isValid()){
+                    continue;
+                }
+
+                config.colorDuration = turnOpt->getLight()->colorDuration;
+                config.timeToCross = turnOpt->timeToCross;
+            }
+        }
+
+        record.firstLightConfig = numLightConfigs;
+        record.numLightConfigs = inter->configSchedule.size();
+        record.autoSequence = inter->autoSequence;
+        record.allRedDuration = inter->allRedDuration;
+        numLightConfigs += inter->configSchedule.size();
+
+        out.write((const char*)&record, sizeof(record));
+    }
+
+    for(Intersection* inter : inters){
+        for(LightConfig* config : inter->configSchedule){
+            LightConfigEntry entry = {};
+
+            entry.configOpt = config->getConfigOption();
+            entry.direction = config->getDirection();
+            entry.duration = config->getDuration();
+            entry.yellowDuration = config->getYellowDuration();
+
+            out.write((const char*)&entry, sizeof(entry));
+        }
+    }
+
+    if( ! out.good()){
+        throw std::runtime_error("Snapshot::save() error writing " + path);
+    }
+}
+
+Snapshot::Snapshot(const std::string& path){
+    struct stat fileStat;
+    void* fileMapping;
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if(fd < 0){
+        throw std::runtime_error("Snapshot() could not open " + path);
+    }
+
+    if(fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(Header)){
+        close(fd);
+        throw std::runtime_error("Snapshot() " + path + " is too short to be a snapshot");
+    }
+
+    fileMapping = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(fileMapping == MAP_FAILED){
+        throw std::runtime_error("Snapshot() could not map " + path);
+    }
+
+    mapping = (const unsigned char*)fileMapping;
+    mappingBytes = fileStat.st_size;
+    header = (const Header*)mapping;
+
+    /// Check everything the records are read through before handing out pointers into the file
+    const char* reason = NULL;
+
+    if(std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0){
+        reason = "is not a snapshot";
+    }
+    else if(header->endianMarker != SNAPSHOT_ENDIAN_MARKER){
+        reason = "was saved on a machine of the other endianness";
+    }
+    else if(header->version != SNAPSHOT_VERSION){
+        reason = "has an unsupported version";
+    }
+    else if(header->recordBytes != sizeof(Record) || header->lightConfigBytes != sizeof(LightConfigEntry)){
+        reason = "was saved with a different record layout";
+    }
+    else if(header->recordsOffset % alignof(Record) != 0 || header->lightConfigsOffset % alignof(LightConfigEntry) != 0 ||
+            header->recordsOffset > mappingBytes || header->numRecords > (mappingBytes - header->recordsOffset) / sizeof(Record) ||
+            header->lightConfigsOffset > mappingBytes || header->numLightConfigs > (mappingBytes - header->lightConfigsOffset) / sizeof(LightConfigEntry))
+    {
+        reason = "is truncated";
+    }
+
+    if(reason != NULL){
+        munmap(fileMapping, mappingBytes);
+        throw std::runtime_error("Snapshot() " + path + " " + reason);
+    }
+
+    records = (const Record*)(mapping + header->recordsOffset);
+    lightConfigs = (const LightConfigEntry*)(mapping + header->lightConfigsOffset);
+}
+
+Snapshot::~Snapshot(){
+    munmap((void*)mapping, mappingBytes);
+}
+
+const Snapshot::Record& Snapshot::getRecord(size_t idx){
+    if(idx >= header->numRecords){
+        throw std::out_of_range("Snapshot::getRecord() index out of range");
+    }
+
+    return records[idx];
+}
+
+void Snapshot::restore(size_t idx, Intersection& inter, SignalController* controller){
+    const Record& record = getRecord(idx);
+    CompactIntersection state = record.state;
+
+    if(inter.numRoads != 0 || ! inter.configSchedule.empty()){
+        throw std::logic_error("Snapshot::restore() Intersection must be newly constructed");
+    }
+
+    if(refreshRateHzGlobal != header->refreshRateHz || tickRoundingGlobal != header->tickRounding){
+        throw std::logic_error("Snapshot::restore() refresh rate or tick rounding differ from the snapshot's, tick counts would be wrong");
+    }
+
+    if(state.isControlled() != (controller != NULL)){
+        throw std::logic_error("Snapshot::restore() a SignalController must be given exactly when the saved Intersection had one");
+    }
+
+    if(record.numLightConfigs > header->numLightConfigs || record.firstLightConfig > header->numLightConfigs - record.numLightConfigs){
+        throw std::runtime_error("Snapshot::restore() record schedule is outside the schedule table");
+    }
+
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        std::array<int, TurnOption::numTurnOptions> numLanesArr;
+        Road* rd;
+
+        inter.expectedRoads[dir] = (record.expectedRoadMask >> dir) & 1;
+
+        if( ! state.roadExists((Road::RoadDirection)dir)){
+            continue;
+        }
+
+        for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+            const CompactIntersection::LaneGroup& group = state.getLaneGroup((Road::RoadDirection)dir, (TurnOption::Type)opt);
+            numLanesArr[opt] = group.valid ? group.numLanes : 0;
+        }
+
+        rd = new Road((Road::RoadDirection)dir, numLanesArr, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION);
+        inter.roads[dir] = rd;
+        inter.numRoads++;
+
+        for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+            int lane = Road::laneGroupIdx((Road::RoadDirection)dir, (TurnOption::Type)opt);
+            TurnOption* turnOpt = rd->getTurnOption((TurnOption::Type)opt);
+
+            if( ! turnOpt->isValid()){
+                continue;
+            }
+
+            turnOpt->maxVehiclesPerLane = state.getLaneGroup((Road::RoadDirection)dir, (TurnOption::Type)opt).maxVehiclesPerLane;
+            turnOpt->timeToCross = record.laneGroups[lane].timeToCross;
+            turnOpt->ticksRefreshRate = 0;
+
+            /// Ticks are converted again from the saved durations on first use
+            turnOpt->getLight()->colorDuration = record.laneGroups[lane].colorDuration;
+            turnOpt->getLight()->ticksRefreshRate = 0;
+        }
+    }
+
+    for(uint64_t i=record.firstLightConfig; i < record.firstLightConfig + record.numLightConfigs; i++){
+        const LightConfigEntry& entry = lightConfigs[i];
+
+        if(entry.configOpt >= LightConfig::numConfigOptions || entry.direction >= Road::numRoadDirections){
+            throw std::runtime_error("Snapshot::restore() invalid LightConfig in the schedule table");
+        }
+
+        inter.schedule((LightConfig::Option)entry.configOpt, (Road::RoadDirection)entry.direction, entry.duration, entry.yellowDuration);
+    }
+
+    inter.autoSequence = record.autoSequence;
+    inter.allRedDuration = record.allRedDuration;
+    inter.planIsStale = true;
+    inter.controller = controller;
+
+    state.unpack(inter);
+}
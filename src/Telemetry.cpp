@@ -0,0 +1,371 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "Telemetry.h"
+#include "Varint.h"
+
+/**
+ * @brief Appends the first "numRows" values of "column" to "out" as zigzag varint deltas from the previous value.
+ */
+template<typename T>
+static void encodeColumn(const std::vector<T>& column, size_t numRows, std::vector<uint8_t>& out){
+    uint64_t previous = 0;
+
+    for(size_t i=0; i < numRows; i++){
+        putVarint(out, zigzagEncode((int64_t)((uint64_t)column[i] - previous)));
+        previous = column[i];
+    }
+}
+
+/**
+ * @brief Decodes "numRows" values written by encodeColumn() from the "numBytes" bytes at "pos" into "column".
+ *
+ * @return false if the bytes do not hold exactly "numRows" values
+ */
+template<typename T>
+static bool decodeColumn(const uint8_t* pos, uint64_t numBytes, size_t numRows, std::vector<T>& column){
+    const uint8_t* end = pos + numBytes;
+    uint64_t previous = 0;
+
+    for(size_t i=0; i < numRows; i++){
+        if(pos == end){
+            return false;
+        }
+
+        previous += (uint64_t)zigzagDecode(getVarint(pos, end));
+        column[i] = (T)previous;
+    }
+
+    return pos == end;
+}
+
+void TelemetryBlock::resize(size_t rows){
+    ticks.resize(rows);
+    laneGroups.resize(rows);
+    colors.resize(rows);
+    queuedVehicles.resize(rows);
+    numVehiclesCrossing.resize(rows);
+    numVehiclesDirected.resize(rows);
+}
+
+TelemetryWriter::TelemetryWriter(const std::string& filePath, size_t rowsPerBlock, size_t maxPending){
+    FileHeader header = {};
+
+    if(rowsPerBlock == 0 || maxPending == 0){
+        throw std::domain_error("TelemetryWriter() rows per block and pending blocks must be > 0");
+    }
+
+    file = std::fopen(filePath.c_str(), "wb");
+    if(file == NULL){
+        throw std::runtime_error("TelemetryWriter() could not open " + filePath);
+    }
+
+    /// Every block goes out in one write, the stdio buffer would only split it up
+    std::setvbuf(file, NULL, _IONBF, 0);
+
+    std::memcpy(header.magic, TELEMETRY_MAGIC, sizeof(header.magic));
+    header.version = TELEMETRY_VERSION;
+    header.numColumns = TelemetryBlock::numColumns;
+
+    if(std::fwrite(&header, sizeof(header), 1, file) != 1){
+        std::fclose(file);
+        throw std::runtime_error("TelemetryWriter() error writing " + filePath);
+    }
+
+    path = filePath;
+    blockRows = rowsPerBlock;
+    numWriting = 0;
+    stopping = false;
+    numRows = 0;
+    numStalls = 0;
+    bytesWritten = sizeof(header);
+
+    /// One block being filled, up to maxPending waiting and one being written
+    blockPool.resize(maxPending + 2);
+    for(TelemetryBlock& block : blockPool){
+        block.resize(blockRows);
+        freeBlocks.push_back(&block);
+    }
+
+    current = freeBlocks.back();
+    freeBlocks.pop_back();
+
+    writerThread = std::thread(&TelemetryWriter::writeBlocks, this);
+}
+
+TelemetryWriter::~TelemetryWriter(){
+    try{
+        close();
+    }
+    catch(const std::exception&){
+        /// Destructors must not throw, call close() to see write errors
+    }
+}
+
+void TelemetryWriter::checkWriteError(){
+    if( ! writeError.empty()){
+        throw std::runtime_error(writeError);
+    }
+}
+
+void TelemetryWriter::sample(Intersection& inter, uint32_t intersectionId){
+    uint64_t tick = inter.time();
+
+    for(int dir=0; dir < Road::numRoadDirections; dir++){
+        Road* rd = inter.getRoad((Road::RoadDirection)dir);
+
+        if(rd == NULL){
+            continue;
+        }
+
+        for(int opt=0; opt < TurnOption::numTurnOptions; opt++){
+            TurnOption* turnOpt = rd->getTurnOption((TurnOption::Type)opt);
+            TelemetryBlock& block = *current;
+            size_t row = block.numRows;
+
+            if( ! turnOpt->isValid()){
+                continue;
+            }
+
+            TrafficLight* light = turnOpt->getLight();
+
+            block.ticks[row] = tick;
+            block.laneGroups[row] = laneGroupId(intersectionId, Road::laneGroupIdx((Road::RoadDirection)dir, (TurnOption::Type)opt));
+            block.colors[row] = light->getColor();
+            block.queuedVehicles[row] = turnOpt->getQueuedVehicles();
+            block.numVehiclesCrossing[row] = turnOpt->getNumVehiclesCurrentlyCrossing();
+            block.numVehiclesDirected[row] = light->getNumVehiclesDirected();
+            block.numRows = row + 1;
+            numRows++;
+
+            if(block.numRows == blockRows){
+                submitBlock();
+            }
+        }
+    }
+}
+
+void TelemetryWriter::submitBlock(){
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if(stopping){
+        throw std::logic_error("TelemetryWriter " + path + " was sampled after close()");
+    }
+
+    checkWriteError();
+
+    if(freeBlocks.empty()){
+        /// The writer thread is behind by maxPending blocks
+        numStalls++;
+        blockIsFree.wait(lock, [this]{ return ! freeBlocks.empty() || ! writeError.empty(); });
+        checkWriteError();
+    }
+
+    fullBlocks.push_back(current);
+    current = freeBlocks.back();
+    freeBlocks.pop_back();
+
+    blockIsFull.notify_one();
+}
+
+void TelemetryWriter::writeBlocks(){
+    std::vector<uint8_t> encoded;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while(true){
+        TelemetryBlock* block;
+
+        blockIsFull.wait(lock, [this]{ return ! fullBlocks.empty() || stopping; });
+        if(fullBlocks.empty()){
+            /// Stopping and nothing left to write
+            return;
+        }
+
+        block = fullBlocks.front();
+        fullBlocks.erase(fullBlocks.begin());
+        numWriting++;
+
+        /// Encoding and writing do not touch the block lists, let sample() carry on
+        lock.unlock();
+
+        encodeBlock(*block, encoded);
+        bool written = writeError.empty() && std::fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+
+        lock.lock();
+
+        if(written){
+            bytesWritten += encoded.size();
+        }
+        else if(writeError.empty()){
+            writeError = "TelemetryWriter error writing " + path;
+        }
+
+        block->numRows = 0;
+        freeBlocks.push_back(block);
+        numWriting--;
+
+        blockIsFree.notify_all();
+    }
+}
+
+void TelemetryWriter::encodeBlock(const TelemetryBlock& block, std::vector<uint8_t>& encoded){
+    BlockHeader header = {};
+    size_t columnStart;
+
+    encoded.assign(sizeof(header), 0);
+    header.numRows = block.numRows;
+
+    columnStart = encoded.size();
+    encodeColumn(block.ticks, block.numRows, encoded);
+    header.columnBytes[TelemetryBlock::tickColumn] = encoded.size() - columnStart;
+
+    columnStart = encoded.size();
+    encodeColumn(block.laneGroups, block.numRows, encoded);
+    header.columnBytes[TelemetryBlock::laneGroupColumn] = encoded.size() - columnStart;
+
+    columnStart = encoded.size();
+    encodeColumn(block.colors, block.numRows, encoded);
+    header.columnBytes[TelemetryBlock::colorColumn] = encoded.size() - columnStart;
+
+    columnStart = encoded.size();
+    encodeColumn(block.queuedVehicles, block.numRows, encoded);
+    header.columnBytes[TelemetryBlock::queuedColumn] = encoded.size() - columnStart;
+
+    columnStart = encoded.size();
+    encodeColumn(block.numVehiclesCrossing, block.numRows, encoded);
+    header.columnBytes[TelemetryBlock::crossingColumn] = encoded.size() - columnStart;
+
+    columnStart = encoded.size();
+    encodeColumn(block.numVehiclesDirected, block.numRows, encoded);
+    header.columnBytes[TelemetryBlock::directedColumn] = encoded.size() - columnStart;
+
+    std::memcpy(encoded.data(), &header, sizeof(header));
+}
+
+void TelemetryWriter::flush(){
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if(stopping){
+        return;
+    }
+
+    if(current->numRows > 0){
+        lock.unlock();
+        submitBlock();
+        lock.lock();
+    }
+
+    blockIsFree.wait(lock, [this]{ return (fullBlocks.empty() && numWriting == 0) || ! writeError.empty(); });
+    checkWriteError();
+}
+
+void TelemetryWriter::close(){
+    if( ! writerThread.joinable()){
+        return;
+    }
+
+    try{
+        flush();
+    }
+    catch(...){
+        /// Still stop the thread and close the file before reporting the error
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    blockIsFull.notify_one();
+    writerThread.join();
+
+    if(std::fclose(file) != 0 && writeError.empty()){
+        writeError = "TelemetryWriter error closing " + path;
+    }
+
+    checkWriteError();
+}
+
+unsigned long TelemetryWriter::getBytesWritten(){
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return bytesWritten;
+}
+
+TelemetryReader::TelemetryReader(const std::string& filePath){
+    TelemetryWriter::FileHeader header;
+
+    file = std::fopen(filePath.c_str(), "rb");
+    if(file == NULL){
+        throw std::runtime_error("TelemetryReader() could not open " + filePath);
+    }
+
+    path = filePath;
+    numRows = 0;
+
+    if(std::fread(&header, sizeof(header), 1, file) != 1 || std::memcmp(header.magic, TELEMETRY_MAGIC, sizeof(header.magic)) != 0){
+        std::fclose(file);
+        throw std::runtime_error("TelemetryReader() " + filePath + " is not telemetry");
+    }
+
+    if(header.version != TELEMETRY_VERSION || header.numColumns != TelemetryBlock::numColumns){
+        std::fclose(file);
+        throw std::runtime_error("TelemetryReader() " + filePath + " has an unsupported version");
+    }
+}
+
+TelemetryReader::~TelemetryReader(){
+    std::fclose(file);
+}
+
+bool TelemetryReader::nextBlock(TelemetryBlock& block){
+    TelemetryWriter::BlockHeader header;
+    size_t numRead = std::fread(&header, 1, sizeof(header), file);
+    uint64_t totalBytes = 0;
+    const uint8_t* column;
+    bool valid;
+
+    if(numRead == 0 && std::feof(file)){
+        return false;
+    }
+
+    if(numRead != sizeof(header)){
+        throw std::runtime_error("TelemetryReader " + path + " block header is truncated");
+    }
+
+    for(uint64_t columnBytes : header.columnBytes){
+        /// Every value takes 1 to VARINT_MAX_BYTES bytes
+        if(columnBytes < header.numRows || columnBytes > (uint64_t)header.numRows * VARINT_MAX_BYTES){
+            throw std::runtime_error("TelemetryReader " + path + " block has an invalid column size");
+        }
+        totalBytes += columnBytes;
+    }
+
+    encoded.resize(totalBytes);
+    if(std::fread(encoded.data(), 1, totalBytes, file) != totalBytes){
+        throw std::runtime_error("TelemetryReader " + path + " block is truncated");
+    }
+
+    block.resize(header.numRows);
+    block.numRows = header.numRows;
+
+    column = encoded.data();
+    valid = decodeColumn(column, header.columnBytes[TelemetryBlock::tickColumn], block.numRows, block.ticks);
+    column += header.columnBytes[TelemetryBlock::tickColumn];
+    valid = valid && decodeColumn(column, header.columnBytes[TelemetryBlock::laneGroupColumn], block.numRows, block.laneGroups);
+    column += header.columnBytes[TelemetryBlock::laneGroupColumn];
+    valid = valid && decodeColumn(column, header.columnBytes[TelemetryBlock::colorColumn], block.numRows, block.colors);
+    column += header.columnBytes[TelemetryBlock::colorColumn];
+    valid = valid && decodeColumn(column, header.columnBytes[TelemetryBlock::queuedColumn], block.numRows, block.queuedVehicles);
+    column += header.columnBytes[TelemetryBlock::queuedColumn];
+    valid = valid && decodeColumn(column, header.columnBytes[TelemetryBlock::crossingColumn], block.numRows, block.numVehiclesCrossing);
+    column += header.columnBytes[TelemetryBlock::crossingColumn];
+    valid = valid && decodeColumn(column, header.columnBytes[TelemetryBlock::directedColumn], block.numRows, block.numVehiclesDirected);
+
+    if( ! valid){
+        throw std::runtime_error("TelemetryReader " + path + " block does not decode to its row count");
+    }
+
+    numRows += block.numRows;
+
+    return true;
+}
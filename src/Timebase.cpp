@@ -0,0 +1,61 @@
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "Timebase.h"
+
+TickRounding tickRoundingGlobal = roundDown;
+
+long long secondsToMicros(double seconds){
+    return llround(seconds * MICROS_PER_SECOND);
+}
+
+int secondsToTicks(double seconds, int refreshRateHz, TickRounding rounding){
+    long long scaledMicros, ticks, remainder;
+
+    if(std::isnan(seconds) || refreshRateHz <= 0){
+        throw std::domain_error("secondsToTicks() called with a NaN duration or a refresh rate <= 0");
+    }
+
+    if(seconds < 0){
+        /// Infinite
+        return -1;
+    }
+
+    if(seconds * MICROS_PER_SECOND >= (double)LLONG_MAX / refreshRateHz){
+        throw std::overflow_error("secondsToTicks() duration of " + std::to_string(seconds) + "s does not fit in ticks");
+    }
+
+    /// ticks = micros * Hz / 1e6, kept as an exact quotient and remainder
+    scaledMicros = secondsToMicros(seconds) * refreshRateHz;
+    ticks = scaledMicros / MICROS_PER_SECOND;
+    remainder = scaledMicros % MICROS_PER_SECOND;
+
+    switch(rounding){
+        case roundDown:
+            break;
+
+        case roundNearest:
+            /// Halves round up
+            if(remainder * 2 >= MICROS_PER_SECOND){
+                ticks++;
+            }
+            break;
+
+        case roundUp:
+            if(remainder > 0){
+                ticks++;
+            }
+            break;
+
+        default:
+            throw std::out_of_range("secondsToTicks() called with an unhandled TickRounding");
+    }
+
+    if(ticks > INT_MAX){
+        throw std::overflow_error("secondsToTicks() duration of " + std::to_string(seconds) + "s does not fit in int ticks");
+    }
+
+    return (int)ticks;
+}
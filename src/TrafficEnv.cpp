@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "TrafficEnv.h"
+
+TrafficEnv::TrafficEnv(size_t batchSize, const Builder& build, int stepTicks, unsigned long episodeLength, unsigned int threads){
+    if(batchSize == 0 || stepTicks <= 0){
+        throw std::domain_error("TrafficEnv() requires a positive batch size and ticks per step");
+    }
+
+    ticksPerStep = stepTicks;
+    episodeTicks = episodeLength;
+    numThreads = (threads == 0) ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+    buffers = {NULL, NULL, NULL, NULL, NULL};
+    numSteps = 0;
+
+    /// Intersections keep a pointer to their ArrivalGenerator, neither vector may reallocate
+    inters = std::vector<Intersection>(batchSize);
+    arrivals.reserve(batchSize);
+    initial.resize(batchSize);
+    policies.assign(batchSize, {ENV_KEEP_SCHEDULE});
+    seeds.assign(batchSize, 0);
+    numPhases.assign(batchSize, 0);
+
+    for(size_t env=0; env < batchSize; env++){
+        Intersection& inter = inters[env];
+
+        /// The same id everywhere, an episode only depends on its seed
+        arrivals.emplace_back(0, 0);
+        build(inter, arrivals[env]);
+
+        for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+            Road* rd = inter.getRoad(dir);
+
+            if(inter.getExitRoad(dir) == NULL && rd != NULL){
+                std::array<int, TurnOption::numTurnOptions> numLanes;
+
+                for(int turn=0; turn < TurnOption::numTurnOptions; turn++){
+                    numLanes[turn] = rd->getTurnOption((TurnOption::Type)turn)->getNumLanes();
+                }
+
+                ownedExitRoads.push_back(new Road(dir, numLanes, DEFAULT_ON_DURATION, DEFAULT_YELLOW_DURATION));
+                inter.setExitRoad(dir, ownedExitRoads.back());
+            }
+        }
+
+        numPhases[env] = inter.getSignalPlan().getNumPhases();
+        if(numPhases[env] == 0){
+            throw std::invalid_argument("TrafficEnv() an environment was built without LightConfigs");
+        }
+
+        inter.setArrivals(&arrivals[env]);
+        inter.setAutoSequence(true);
+        inter.start();
+        initial[env].pack(inter);
+    }
+}
+
+TrafficEnv::~TrafficEnv(){
+    for(Intersection& inter : inters){
+        inter.setArrivals(NULL);
+    }
+
+    for(Road* exitRoad : ownedExitRoads){
+        delete exitRoad;
+    }
+}
+
+void TrafficEnv::forEachEnv(const std::function<void(size_t first, size_t last)>& fn){
+    size_t batchSize = inters.size();
+    unsigned int threads = std::min(numThreads, std::max(1u, (unsigned int)(batchSize / ENV_MIN_ENVS_PER_THREAD)));
+    std::vector<std::thread> workers;
+
+    if(threads == 1){
+        fn(0, batchSize);
+        return;
+    }
+
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    /// Contiguous blocks keep every thread on its own cache lines of the buffers
+    for(unsigned int t=0; t < threads; t++){
+        workers.emplace_back([&fn, &error, &errorMutex, batchSize, t, threads](){
+            try{
+                fn(batchSize * t / threads, batchSize * (t + 1) / threads);
+            }
+            catch(...){
+                std::lock_guard<std::mutex> lock(errorMutex);
+
+                if( ! error){
+                    error = std::current_exception();
+                }
+            }
+        });
+    }
+
+    for(std::thread& worker : workers){
+        worker.join();
+    }
+
+    if(error){
+        std::rethrow_exception(error);
+    }
+}
+
+void TrafficEnv::drainExits(size_t env){
+    for(Road::RoadDirection dir : {Road::north, Road::east, Road::south, Road::west}){
+        Road* exitRoad = inters[env].getExitRoad(dir);
+
+        for(int turn=0; exitRoad != NULL && turn < TurnOption::numTurnOptions; turn++){
+            exitRoad->getTurnOption((TurnOption::Type)turn)->queuedVehicles = 0;
+        }
+    }
+}
+
+unsigned long TrafficEnv::observe(size_t env){
+    Intersection& inter = inters[env];
+    unsigned long numQueued = 0;
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        Road* rd = inter.getRoad(Road::laneGroupDirection(lane));
+        TurnOption* turnOpt = (rd != NULL) ? rd->getTurnOption(Road::laneGroupTurn(lane)) : NULL;
+        size_t idx = env * NUM_LANE_GROUPS + lane;
+        unsigned int queued = 0;
+        int32_t color = TrafficLight::red;
+        int32_t ticksRemaining = 0;
+
+        if(turnOpt != NULL && turnOpt->isValid()){
+            queued = turnOpt->getQueuedVehicles();
+            color = turnOpt->getLight()->getColor();
+            ticksRemaining = turnOpt->getLight()->getTicksRemaining();
+        }
+
+        numQueued += queued;
+
+        if(buffers.queues != NULL){
+            buffers.queues[idx] = (float)queued;
+        }
+        if(buffers.colors != NULL){
+            buffers.colors[idx] = color;
+        }
+        if(buffers.ticksRemaining != NULL){
+            buffers.ticksRemaining[idx] = ticksRemaining;
+        }
+    }
+
+    return numQueued;
+}
+
+void TrafficEnv::resetEnv(size_t env, uint64_t seed){
+    seeds[env] = seed;
+    arrivals[env].reseed(seed);
+    initial[env].unpack(inters[env]);
+    policies[env].action = ENV_KEEP_SCHEDULE;
+    drainExits(env);
+}
+
+void TrafficEnv::reset(const uint64_t* episodeSeeds){
+    forEachEnv([this, episodeSeeds](size_t first, size_t last){
+        for(size_t env=first; env < last; env++){
+            resetEnv(env, episodeSeeds[env]);
+            observe(env);
+        }
+    });
+}
+
+void TrafficEnv::step(const int32_t* actions){
+    /// Checked up front so a bad action leaves every environment untouched
+    for(size_t env=0; env < inters.size(); env++){
+        if(actions[env] != ENV_KEEP_SCHEDULE && (actions[env] < 0 || actions[env] >= numPhases[env] || ! inters[env].getSignalPlan().getPhase(actions[env]).valid)){
+            throw std::out_of_range("TrafficEnv::step() an action is not a valid LightConfig of its environment");
+        }
+    }
+
+    forEachEnv([this, actions](size_t first, size_t last){
+        for(size_t env=first; env < last; env++){
+            Intersection& inter = inters[env];
+            bool done = false;
+
+            policies[env].action = actions[env];
+
+            for(int t=0; t < ticksPerStep; t++){
+                inter.tick(policies[env]);
+                drainExits(env);
+            }
+
+            /// The reward is for the step just made, the observation for the next one
+            if(buffers.rewards != NULL){
+                buffers.rewards[env] = -(float)observe(env);
+            }
+
+            if(episodeTicks > 0 && inter.time() - initial[env].time() >= episodeTicks){
+                resetEnv(env, seeds[env] + 1);
+                done = true;
+            }
+
+            if(done || buffers.rewards == NULL){
+                observe(env);
+            }
+            if(buffers.dones != NULL){
+                buffers.dones[env] = done;
+            }
+        }
+    });
+
+    numSteps++;
+}
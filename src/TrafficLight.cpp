@@ -3,9 +3,18 @@
 #include <sstream>
 
 #include "TrafficLight.h"
+#include "LightHistory.h"
+
+/// The default tables are the green -> yellow -> red -> onColor cycle
+static_assert(TrafficLight::defaultTransitions[TrafficLight::green][TrafficLight::green].next == TrafficLight::yellow);
+static_assert(TrafficLight::defaultTransitions[TrafficLight::greenLeft][TrafficLight::greenRight].next == TrafficLight::yellow);
+static_assert(TrafficLight::defaultTransitions[TrafficLight::green][TrafficLight::yellow].next == TrafficLight::red);
+static_assert(TrafficLight::defaultTransitions[TrafficLight::greenLeft][TrafficLight::red].next == TrafficLight::greenLeft);
+static_assert(TrafficLight::defaultTransitions[TrafficLight::greenRight][TrafficLight::red].durationOf == TrafficLight::greenRight);
 
 TrafficLight::TrafficLight(AvailableColors aOnColor, double onColorDur, double redDur) : TrafficLight(){
     onColor = aOnColor;
+    transitions = &defaultTransitions[onColor];
     setDuration(aOnColor, onColorDur);
     setDuration(yellow, yellowDuration);
     setDuration(red, redDur);
@@ -13,6 +22,7 @@ TrafficLight::TrafficLight(AvailableColors aOnColor, double onColorDur, double r
 
 TrafficLightLeft::TrafficLightLeft(){
     onColor = greenLeft;
+    transitions = &defaultTransitions[onColor];
 }
 
 TrafficLightLeft::TrafficLightLeft(int leftDur, int redDur) : TrafficLight(greenLeft, leftDur, redDur){}
@@ -31,45 +41,62 @@ int TrafficLight::tick(){
     return ticksRemaining;
 }
 
-int TrafficLight::addVehiclesDirected(int numVehicles){
+unsigned long TrafficLight::addVehiclesDirected(long numVehicles){
     numVehiclesDirected += numVehicles;
 
     return numVehiclesDirected;
 }
 
+void TrafficLight::setDuration(AvailableColors durColor, double duration){
+    if(durationTicksAreCurrent()){
+        colorDurationTicks[durColor] = secondsToTicks(duration, ticksRefreshRate, ticksRounding);
+    }
+
+    colorDuration[durColor] = duration;
+}
+
+void TrafficLight::refreshDurationTicks(){
+    std::array<int, numColors> newTicks;
+
+    for(int durColor=0; durColor < numColors; durColor++){
+        newTicks[durColor] = secondsToTicks(colorDuration[durColor], refreshRateHzGlobal, tickRoundingGlobal);
+    }
+
+    colorDurationTicks = newTicks;
+    ticksRefreshRate = refreshRateHzGlobal;
+    ticksRounding = tickRoundingGlobal;
+}
+
 void TrafficLight::resetTicksRemaining(){
     setTicksRemainingColor(color);
 }
 
 TrafficLight::AvailableColors TrafficLight::nextState(){
     if(ticksRemaining == 0){
-        switch(color){
-            case green:
-            case greenLeft:
-            case greenRight:
-                color = yellow;
-                setTicksRemainingColor(yellow);
-                break;
-
-            case yellow:
-                color = red;
-                setTicksRemainingColor(red);
-                break;
-
-            case red:
-                color = onColor;
-                setTicksRemainingColor(onColor);
-                break;
-
-            default:
-                throw std::out_of_range("TrafficLight reached unexpected color in nextState()");
-                break;
+        const Transition& transition = getTransitions()[color];
+
+        color = transition.next;
+        setTicksRemainingColor(transition.durationOf);
+
+        if(history != NULL){
+            history->record(color);
         }
     }
 
     return color;
 }
 
+void TrafficLight::setColor(AvailableColors newColor){
+    isValidColor(newColor);
+
+    color = newColor;
+    setTicksRemainingColor(newColor);
+
+    if(history != NULL){
+        history->record(newColor);
+    }
+}
+
 std::ostream& operator<<(std::ostream &out, TrafficLight::AvailableColors const& data){
     switch(data){
         case TrafficLight::green:
@@ -1,4 +1,6 @@
 #include "TurnOption.h"
+#include "VehiclePool.h"
+#include "RoadNetwork.h"
     
 TurnOption::TurnOption(TurnOption::Type aType, unsigned int lanes, unsigned int maxNumVehiclesPerLane, unsigned int crossTime, double lightDuration, double lightRedDuration): TurnOption(){
     TrafficLight::AvailableColors lightAvailColor;
@@ -50,14 +52,29 @@ bool TurnOption::vehiclesAreCrossing(){
     return getCurrentVehicleProgress() > 0;
 }
     
-void TurnOption::nextVehiclesBeginCrossing(TurnOption *exitTurnOpt){
+void TurnOption::nextVehiclesBeginCrossing(TurnOption *exitTurnOpt, RoadNetwork* network, long routeState){
+    unsigned int numFinished = getNumVehiclesCurrentlyCrossing();
+    unsigned int numAdmitted;
+
     /// These operations need to be called for both green+yellow bc crossing vehicles might finish during a yellow light.
     /// If this is the first call to handleVehicles() for this green/yellow light, numVehiclesCurrentlyCrossing should be 0.
-    queuedVehicles -= getNumVehiclesCurrentlyCrossing();
-    getLight()->addVehiclesDirected(getNumVehiclesCurrentlyCrossing());
+    queuedVehicles -= numFinished;
+    cumulativeDepartures += numFinished;
+    getLight()->addVehiclesDirected(numFinished);
     
     /// Vehicles have finished crossing so they should be added to the exit TurnOption queue.
-    if( ! exitTurnOpt->addVehicles(getNumVehiclesCurrentlyCrossing())){
+    if(network != NULL && routeState >= 0 && vehicles != NULL){
+        numAdmitted = network->routeVehicles(vehicles, numFinished, routeState, exitTurnOpt);
+    }
+    else{
+        numAdmitted = exitTurnOpt->admitVehicles(numFinished);
+
+        if(vehicles != NULL || exitTurnOpt->vehicles != NULL){
+            VehicleRing::transfer(vehicles, exitTurnOpt->vehicles, numFinished, numAdmitted);
+        }
+    }
+
+    if(numAdmitted < numFinished){
         std::cout << "Traffic Jam! Exit TurnOption queue is full : TurnOption::nextVehiclesBeginCrossing()" << std::endl;
     }
 
@@ -92,20 +109,41 @@ bool TurnOption::vehiclesLeftInIntersection(){
     return true;
 }
 
-bool TurnOption::addVehicles(int numVehiclesToAdd){
+unsigned int TurnOption::admitVehicles(int numVehiclesToAdd){
     unsigned int newQueuedVehiclesTotal = queuedVehicles + numVehiclesToAdd;
+    unsigned int numAdmitted;
 
-    if(numVehiclesToAdd < 0){
-        return false;
+    if(numVehiclesToAdd <= 0){
+        return 0;
     }
 
     if(newQueuedVehiclesTotal <= getMaxNumVehicles()){
+        numAdmitted = numVehiclesToAdd;
         queuedVehicles = newQueuedVehiclesTotal;
-        return true;
     }
     else{
-        std::cout << "veCross:" << getNumVehiclesCurrentlyCrossing() << " newTotal:" << newQueuedVehiclesTotal << " max:" << getMaxNumVehicles() << std::endl;
+        /// Only the vehicles that fit arrive
+        numAdmitted = (queuedVehicles < getMaxNumVehicles()) ? getMaxNumVehicles() - queuedVehicles : 0;
         queuedVehicles = getMaxNumVehicles();
+    }
+
+    cumulativeArrivals += numAdmitted;
+
+    return numAdmitted;
+}
+
+bool TurnOption::addVehicles(int numVehiclesToAdd){
+    unsigned int numAdmitted;
+
+    if(numVehiclesToAdd < 0){
         return false;
     }
+
+    numAdmitted = admitVehicles(numVehiclesToAdd);
+
+    if(vehicles != NULL){
+        vehicles->spawn(numAdmitted);
+    }
+
+    return numAdmitted == (unsigned int)numVehiclesToAdd;
 }
\ No newline at end of file
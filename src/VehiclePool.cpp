@@ -0,0 +1,145 @@
+#include <stdexcept>
+
+#include "VehiclePool.h"
+
+TripStream::TripStream(std::ostream& output) : out(output){
+    refreshRate = refreshRateHzGlobal;
+    out << "id,route,arrivalTick,departureTick,tripSeconds,completed\n";
+}
+
+void TripStream::trip(const VehicleRecord& vehicle, unsigned long departureTick, bool completed){
+    out << vehicle.id << ',' << vehicle.routeIndex << ',' << vehicle.arrivalTick << ',' << departureTick << ','
+        << (departureTick - vehicle.arrivalTick) / (double)refreshRate << ',' << completed << '\n';
+}
+
+void VehicleRing::push(const VehicleRecord& vehicle){
+    if(size == capacity){
+        throw std::length_error("VehicleRing::push() ring is full");
+    }
+
+    slots[(head + size) % capacity] = vehicle;
+    size++;
+}
+
+VehicleRecord VehicleRing::pop(){
+    VehicleRecord vehicle;
+
+    if(size == 0){
+        throw std::logic_error("VehicleRing::pop() ring is empty");
+    }
+
+    vehicle = slots[head];
+    head = (head + 1) % capacity;
+    size--;
+
+    return vehicle;
+}
+
+void VehicleRing::spawn(unsigned int numVehicles, uint32_t routeIndex){
+    for(unsigned int i=0; i < numVehicles && size < capacity; i++){
+        push({pool->nextId++, (uint32_t)pool->now, routeIndex});
+        pool->numLive++;
+    }
+}
+
+const VehicleRecord& VehicleRing::at(uint32_t i) const{
+    if(i >= size){
+        throw std::out_of_range("VehicleRing::at() index " + std::to_string(i) + " is past the queue");
+    }
+
+    return slots[(head + i) % capacity];
+}
+
+void VehicleRing::transfer(VehicleRing* from, VehicleRing* to, unsigned int numFinished, unsigned int numAdmitted){
+    if(from == NULL){
+        /// Vehicles crossing from the count-based mode enter the network here
+        if(to != NULL){
+            to->spawn(numAdmitted);
+        }
+        return;
+    }
+
+    for(unsigned int i=0; i < numFinished && from->size > 0; i++){
+        VehicleRecord vehicle = from->pop();
+
+        if(to != NULL && i < numAdmitted){
+            to->push(vehicle);
+        }
+        else{
+            from->pool->finishTrip(vehicle, i < numAdmitted);
+        }
+    }
+}
+
+VehiclePool::VehiclePool(size_t capacity, TripSink* tripSink) : records(capacity){
+    numAllocated = 0;
+    sink = tripSink;
+    nextId = 0;
+    now = 0;
+    numLive = 0;
+    numTrips = 0;
+    numLost = 0;
+}
+
+void VehiclePool::finishTrip(const VehicleRecord& vehicle, bool completed){
+    numLive--;
+    numTrips++;
+
+    if( ! completed){
+        numLost++;
+    }
+
+    if(sink != NULL){
+        sink->trip(vehicle, now, completed);
+    }
+}
+
+void VehiclePool::attach(Intersection& inter){
+    std::vector<TurnOption*> turnOpts;
+    size_t numNeeded = 0;
+
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        Road* rd = inter.getRoad(Road::laneGroupDirection(lane));
+        TurnOption* turnOpt = (rd == NULL) ? NULL : rd->getTurnOption(Road::laneGroupTurn(lane));
+
+        if(turnOpt == NULL || ! turnOpt->isValid()){
+            continue;
+        }
+
+        if(turnOpt->getVehicles() != NULL){
+            throw std::logic_error("VehiclePool::attach() a TurnOption of the Intersection is already in agent mode");
+        }
+
+        turnOpts.push_back(turnOpt);
+        numNeeded += turnOpt->getMaxNumVehicles();
+    }
+
+    if(numNeeded > records.size() - numAllocated){
+        throw std::length_error("VehiclePool::attach() the pool has no room for " + std::to_string(numNeeded) + " more vehicles");
+    }
+
+    now = inter.time();
+
+    for(TurnOption* turnOpt : turnOpts){
+        rings.emplace_back(this, records.data() + numAllocated, turnOpt->getMaxNumVehicles(), rings.size());
+        numAllocated += turnOpt->getMaxNumVehicles();
+
+        rings.back().spawn(turnOpt->getQueuedVehicles());
+        turnOpt->setVehicles(&rings.back());
+    }
+}
+
+void VehiclePool::detach(Intersection& inter){
+    for(int lane=0; lane < NUM_LANE_GROUPS; lane++){
+        Road* rd = inter.getRoad(Road::laneGroupDirection(lane));
+        TurnOption* turnOpt = (rd == NULL) ? NULL : rd->getTurnOption(Road::laneGroupTurn(lane));
+
+        if(turnOpt == NULL || turnOpt->getVehicles() == NULL || turnOpt->getVehicles()->pool != this){
+            continue;
+        }
+
+        numLive -= turnOpt->getVehicles()->size;
+        turnOpt->getVehicles()->size = 0;
+        turnOpt->setVehicles(NULL);
+    }
+}